@@ -0,0 +1,15 @@
+#version 410 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 iPos;
+layout (location = 2) in vec2 iSize;
+layout (location = 3) in vec4 iColor;
+
+uniform mat4 u_Projection;
+
+out vec4 vColor;
+
+void main() {
+    gl_Position = u_Projection * vec4(iPos + iSize * aPos.xy, 0.0f, 1.0f);
+    vColor = iColor;
+}
\ No newline at end of file
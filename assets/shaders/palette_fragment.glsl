@@ -0,0 +1,11 @@
+#version 410 core
+
+uniform usampler2D u_Labels;
+uniform sampler2D u_Palette;
+
+out vec4 FragColor;
+
+void main() {
+    uint label = texelFetch(u_Labels, ivec2(gl_FragCoord.xy), 0).r;
+    FragColor = label == 0u ? vec4(0.0f, 0.0f, 0.0f, 1.0f) : texelFetch(u_Palette, ivec2(int((label - 1u) % 256u), 0), 0);
+}
@@ -0,0 +1,7 @@
+#version 410 core
+
+// One triangle covering the viewport, no vertex buffer needed.
+void main() {
+    const vec2 corners[3] = vec2[3](vec2(-1.0f, -1.0f), vec2(3.0f, -1.0f), vec2(-1.0f, 3.0f));
+    gl_Position = vec4(corners[gl_VertexID], 0.0f, 1.0f);
+}
@@ -0,0 +1,293 @@
+/* danielsinkin97@gmail.com */
+
+// Headless batch processor: no SDL, OpenGL or ImGui, only the CV kernels.
+//
+//   cv_batch [options] <file|directory>...
+//     -p, --pipeline <spec>   stages to run, e.g. "resize:0.5,gray,canny:40:90"
+//     -o, --output <dir>      write results as <dir>/<stem>.<format>; inputs
+//                             sharing a stem are rejected
+//     -f, --format <fmt>      output format: png (default) or cvti, which with an
+//                             empty pipeline converts the inputs to tiled .cvti
+//                             keeping their channel count and bit depth
+//     -l, --list <file>       read further inputs from a file, one path per line
+//     -t, --threads <n>       worker threads (default: all cores)
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+// Standard library
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Project headers
+#include "image.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
+#include "pipeline.hpp"
+#include "tiled.hpp"
+
+namespace fs = std::filesystem;
+using std::chrono::steady_clock;
+
+namespace {
+struct BatchOptions {
+    std::string pipeline;
+    fs::path output_dir;
+    bool output_tiled = false;
+    std::vector<fs::path> inputs;
+};
+
+struct BatchResult {
+    bool ok = false;
+    int width = 0;
+    int height = 0;
+    double milliseconds = 0.0;
+    std::vector<std::pair<std::string_view, double>> measurements;
+};
+
+auto print_usage() -> void {
+    std::cerr << "usage: cv_batch [-p pipeline] [-o output_dir] [-f png|cvti] [-l list_file] [-t threads] <file|directory>...\n"
+              << "stages:";
+    for (const CV::StageInfo &info : CV::stage_table) std::cerr << " " << info.name;
+    std::cerr << "\n";
+}
+
+// Lowercased extension, so FOO.CVTI and foo.cvti are treated alike.
+[[nodiscard]] auto extension_of(const fs::path &path) -> std::string {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return ext;
+}
+
+[[nodiscard]] auto is_image(const fs::path &path) -> bool {
+    const std::string ext = extension_of(path);
+    return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga" || ext == ".pgm" || ext == ".ppm" ||
+           ext == ".cvti";
+}
+
+// Expands directories (non-recursively, sorted) and keeps plain files as given.
+auto add_input(const fs::path &path, std::vector<fs::path> &out) -> bool {
+    std::error_code ec;
+    if (fs::is_directory(path, ec)) {
+        std::vector<fs::path> files;
+        for (const auto &entry : fs::directory_iterator(path, ec)) {
+            if (entry.is_regular_file() && is_image(entry.path())) files.push_back(entry.path());
+        }
+        std::sort(files.begin(), files.end());
+        out.insert(out.end(), files.begin(), files.end());
+        return !ec;
+    }
+    if (!fs::exists(path, ec)) {
+        LOG_ERR("Input {} does not exist", path.string());
+        return false;
+    }
+    out.push_back(path);
+    return true;
+}
+
+[[nodiscard]] auto parse_args(int argc, char **argv, BatchOptions &options) -> bool {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        auto value = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "-p" || arg == "--pipeline") {
+            const char *v = value();
+            if (!v) return false;
+            options.pipeline = v;
+        } else if (arg == "-o" || arg == "--output") {
+            const char *v = value();
+            if (!v) return false;
+            options.output_dir = v;
+        } else if (arg == "-f" || arg == "--format") {
+            const char *v = value();
+            if (!v) return false;
+            const std::string_view format = v;
+            if (format != "png" && format != "cvti") {
+                LOG_ERR("Unknown output format {}", format);
+                return false;
+            }
+            options.output_tiled = format == "cvti";
+        } else if (arg == "-t" || arg == "--threads") {
+            const char *v = value();
+            if (!v) return false;
+            // Must happen before the first parallel call creates the pool.
+            setenv("CV_NUM_THREADS", v, 1);
+        } else if (arg == "-l" || arg == "--list") {
+            const char *v = value();
+            if (!v) return false;
+            std::ifstream list(v);
+            if (!list) {
+                LOG_ERR("Cannot open list file {}", v);
+                return false;
+            }
+            for (std::string line; std::getline(list, line);) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (!line.empty() && !add_input(line, options.inputs)) return false;
+            }
+        } else if (!arg.empty() && arg[0] == '-') {
+            LOG_ERR("Unknown option {}", arg);
+            return false;
+        } else if (!add_input(arg, options.inputs)) {
+            return false;
+        }
+    }
+    return !options.inputs.empty();
+}
+
+[[nodiscard]] auto save_frame(const CV::Frame &frame, const fs::path &path, bool tiled) -> bool {
+    const std::string file = path.string();
+    if (tiled) {
+        return frame.is_gray ? CV::write_tiled<uint8_t, 1>(frame.gray.view(), file) : CV::write_tiled<uint8_t, 4>(frame.rgba.view(), file);
+    }
+    if (frame.is_gray) {
+        return stbi_write_png(file.c_str(), frame.gray.width(), frame.gray.height(), 1, frame.gray.data(),
+                   static_cast<int>(frame.gray.stride())) != 0;
+    }
+    return stbi_write_png(file.c_str(), frame.rgba.width(), frame.rgba.height(), 4, frame.rgba.data(),
+               static_cast<int>(frame.rgba.stride())) != 0;
+}
+
+// Single-tile .cvti files are mapped without copying; tiled ones are assembled
+// once. Gray files start the pipeline already gray.
+template <int C>
+[[nodiscard]] auto load_tiled(const std::string &path) -> CV::Image<uint8_t, C> {
+    const auto header = CV::read_tiled_header(path);
+    if (header && header->tiles_x() == 1 && header->tiles_y() == 1) return CV::map_image<uint8_t, C>(path);
+    const auto tiled = CV::TiledImage<uint8_t, C>::open(path);
+    return tiled.empty() ? CV::Image<uint8_t, C>{} : tiled.read(CV::PixelRect{0, 0, tiled.width(), tiled.height()});
+}
+
+[[nodiscard]] auto load_frame(const fs::path &input) -> CV::Frame {
+    CV::Frame frame;
+    const std::string path = input.string();
+    if (extension_of(input) != ".cvti") {
+        frame.rgba = CV::load_image<uint8_t, 4>(path.c_str());
+        return frame;
+    }
+    const auto header = CV::read_tiled_header(path);
+    if (header && header->channels == 1) {
+        frame.gray = load_tiled<1>(path);
+        frame.is_gray = true;
+    } else if (header && header->channels == 4) {
+        frame.rgba = load_tiled<4>(path);
+    } else {
+        LOG_ERR("{}: cv_batch reads 8-bit gray or RGBA .cvti files only", path);
+    }
+    return frame;
+}
+
+[[nodiscard]] auto output_path(const fs::path &input, const BatchOptions &options) -> fs::path {
+    return options.output_dir / (input.stem().string() + (options.output_tiled ? ".cvti" : ".png"));
+}
+
+// Outputs are flat in the output directory, so inputs from different
+// directories (or a.png next to a.jpg) would overwrite each other.
+[[nodiscard]] auto check_unique_outputs(const BatchOptions &options) -> bool {
+    std::unordered_map<std::string, size_t> seen;
+    bool unique = true;
+    for (size_t i = 0; i < options.inputs.size(); ++i) {
+        const auto [it, inserted] = seen.try_emplace(output_path(options.inputs[i], options).string(), i);
+        if (!inserted) {
+            LOG_ERR("{} and {} would both be written to {}", options.inputs[it->second].string(), options.inputs[i].string(), it->first);
+            unique = false;
+        }
+    }
+    return unique;
+}
+
+auto process(const fs::path &input, const std::vector<CV::PipelineStage> &stages, const BatchOptions &options) -> BatchResult {
+    BatchResult result;
+    const auto start = steady_clock::now();
+    if (stages.empty() && options.output_tiled && !options.output_dir.empty() && extension_of(input) != ".cvti") {
+        // Plain conversion: no Frame, which would widen everything to RGBA8.
+        const fs::path target = output_path(input, options);
+        if (!CV::convert_to_tiled(input.string(), target.string())) {
+            LOG_ERR("Failed to write {}", target.string());
+            return result;
+        }
+        const auto header = CV::read_tiled_header(target.string());
+        if (!header) return result;
+        result.ok = true;
+        result.width = static_cast<int>(header->width);
+        result.height = static_cast<int>(header->height);
+        result.milliseconds = std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+        return result;
+    }
+    CV::Frame frame = load_frame(input);
+    if (frame.empty()) return result;
+    CV::run_pipeline(frame, stages);
+    if (!options.output_dir.empty()) {
+        const fs::path target = output_path(input, options);
+        if (!save_frame(frame, target, options.output_tiled)) {
+            LOG_ERR("Failed to write {}", target.string());
+            return result;
+        }
+    }
+    result.ok = true;
+    result.width = frame.width();
+    result.height = frame.height();
+    result.milliseconds = std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+    result.measurements = std::move(frame.measurements);
+    return result;
+}
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+    const auto start = steady_clock::now();
+    BatchOptions options;
+    if (!parse_args(argc, argv, options)) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    const auto stages = CV::parse_pipeline(options.pipeline);
+    if (!stages) return EXIT_FAILURE;
+    if (!options.output_dir.empty()) {
+        if (!check_unique_outputs(options)) return EXIT_FAILURE;
+        std::error_code ec;
+        fs::create_directories(options.output_dir, ec);
+        if (ec) {
+            LOG_ERR("Cannot create output directory {}: {}", options.output_dir.string(), ec.message());
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Images run concurrently and every kernel inside them shares the same
+    // pool, so small and large inputs both keep all cores busy.
+    std::vector<BatchResult> results(options.inputs.size());
+    CV::parallel_for(0, static_cast<int>(options.inputs.size()), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            results[static_cast<size_t>(i)] = process(options.inputs[static_cast<size_t>(i)], *stages, options);
+        }
+    });
+
+    Log::flush(); // errors of the run precede the report
+    size_t failed = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BatchResult &r = results[i];
+        if (!r.ok) {
+            ++failed;
+            continue;
+        }
+        std::string line = std::format("{}\t{}x{}\t{:.2f} ms", options.inputs[i].string(), r.width, r.height, r.milliseconds);
+        for (const auto &[name, value] : r.measurements) line += std::format("\t{}={}", name, value);
+        std::cout << line << "\n";
+    }
+    const double total = std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+    std::cout << std::format("processed {} of {} images in {:.1f} ms on {} threads\n",
+        results.size() - failed, results.size(), total, CV::worker_count());
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
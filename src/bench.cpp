@@ -0,0 +1,508 @@
+/* danielsinkin97@gmail.com */
+
+// Kernel benchmark suite.
+//
+//   cv_bench [options]
+//     -k, --kernels <list>     comma separated kernel names (default: all)
+//     -s, --sizes <list>       vga,720p,1080p,4k,8k (default: all)
+//     -l, --levels <list>      scalar,sse4.1,avx2,avx512 (default: all supported)
+//     -t, --threads <list>     thread counts, 0 = all cores (default: 1,0)
+//     -r, --repetitions <n>    timed runs per case (default: 15)
+//     -w, --warmup <n>         untimed runs per case (default: 2)
+//     -o, --output <file>      write the JSON report here (default: stdout)
+//     -c, --compare <file>     compare against a baseline report; exit code 1 on regressions
+//     -i, --input <file>       with --compare: compare this report instead of running
+//         --tolerance <pct>    allowed median slowdown before flagging (default: 5)
+//
+// The thread pool size is fixed per process, so each thread count other than
+// the first runs in a child process of this executable and the reports are
+// merged.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+// Standard library
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Project headers
+#include "canny.hpp"
+#include "components.hpp"
+#include "convert.hpp"
+#include "convolve.hpp"
+#include "features.hpp"
+#include "flow.hpp"
+#include "geometry.hpp"
+#include "histogram.hpp"
+#include "image.hpp"
+#include "integral.hpp"
+#include "log.hpp"
+#include "morphology.hpp"
+#include "parallel.hpp"
+#include "pyramid.hpp"
+#include "simd.hpp"
+#include "types.hpp"
+
+namespace fs = std::filesystem;
+using std::chrono::steady_clock;
+
+namespace {
+struct SizeInfo {
+    std::string_view name;
+    int width;
+    int height;
+};
+
+constexpr std::array<SizeInfo, 5> size_table = {{
+    {"vga", 640, 480},
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"4k", 3840, 2160},
+    {"8k", 7680, 4320},
+}};
+
+struct BenchOptions {
+    std::vector<std::string> kernels;
+    std::vector<SizeInfo> sizes;
+    std::vector<CV::Simd::Level> levels;
+    std::vector<int> threads{1, 0};
+    int repetitions = 15;
+    int warmup = 2;
+    std::string output;
+    std::string compare;
+    std::string input;
+    double tolerance = 5.0;
+    std::vector<std::string> forwarded; // options handed to child processes
+};
+
+// Inputs shared by every case of one size, plus their output buffers.
+struct Workspace {
+    CV::ImageRGBA8 rgba;
+    CV::ImageGray8 gray;
+    CV::ImageGray8 binary;
+    CV::BitImage binary_bits;
+    CV::ImageGrayF grayf;
+    CV::ImageRGBA8 rgba_out;
+    CV::ImageRGBA8 rgba_half;
+    CV::ImageGray8 gray_out;
+    CV::ImageGrayF grayf_out;
+    CV::ImageGrayF grayf_half;
+    CV::ImageLabel labels;
+    CV::ImageGray8 gray_moved;
+    CV::FlowPyramid flow_from;
+    CV::FlowPyramid flow_to;
+    std::vector<Position> flow_points;
+
+    Workspace(int w, int h)
+        : rgba(w, h), gray(w, h), binary(w, h), grayf(w, h), rgba_out(w, h), rgba_half(w / 2, h / 2),
+          gray_out(w, h), grayf_out(w, h), grayf_half(CV::pyr_down_size(w), CV::pyr_down_size(h)), labels(w, h), gray_moved(w, h) {
+        // Smooth gradients, hard-edged blocks and hashed noise, so edge, corner
+        // and component kernels do a realistic amount of work.
+        for (int y = 0; y < h; ++y) {
+            uint8_t *p = rgba.row(y);
+            for (int x = 0; x < w; ++x) {
+                const uint32_t hash = (static_cast<uint32_t>(x) * 73856093u) ^ (static_cast<uint32_t>(y) * 19349663u);
+                const int block = ((x / 48) + (y / 48)) % 2 == 0 ? 60 : 0;
+                const int noise_r = static_cast<int>(hash & 15);
+                const int noise_g = static_cast<int>((hash >> 4) & 15);
+                const int noise_b = static_cast<int>((hash >> 8) & 31);
+                p[4 * x + 0] = static_cast<uint8_t>((x * 255 / w + block + noise_r) & 255);
+                p[4 * x + 1] = static_cast<uint8_t>((y * 255 / h + block + noise_g) & 255);
+                p[4 * x + 2] = static_cast<uint8_t>((block * 3 + noise_b) & 255);
+                p[4 * x + 3] = 255;
+            }
+        }
+        CV::rgba_to_gray(std::as_const(rgba).view(), gray.view());
+        CV::normalize<1>(std::as_const(gray).view(), grayf.view());
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) binary.row(y)[x] = gray.row(y)[x] > 110 ? 255 : 0;
+        }
+        binary_bits = CV::pack(std::as_const(binary).view());
+        // Second frame moved by (3, 2) pixels; 2000 points spread over the frame.
+        for (int y = 0; y < h; ++y) {
+            const uint8_t *src = gray.row(std::max(y - 2, 0));
+            for (int x = 0; x < w; ++x) gray_moved.row(y)[x] = src[std::max(x - 3, 0)];
+        }
+        const CV::FlowParams flow;
+        flow_from.build(std::as_const(gray).view(), flow.levels, flow.window);
+        flow_to.build(std::as_const(gray_moved).view(), flow.levels, flow.window);
+        for (int i = 0; i < 2000; ++i) {
+            flow_points.push_back({static_cast<float>((i * 37) % 1000) * 0.001f * static_cast<float>(w - 40) + 20.0f,
+                static_cast<float>(i) * 0.0005f * static_cast<float>(h - 40) + 20.0f});
+        }
+    }
+};
+
+struct BenchCase {
+    std::string_view name;
+    std::string_view type;       // pixel type of the main input
+    size_t bytes;                // bytes read + written per run, for GB/s
+    std::function<void()> run;
+};
+
+[[nodiscard]] auto make_cases(Workspace &ws) -> std::vector<BenchCase> {
+    const int w = ws.gray.width();
+    const int h = ws.gray.height();
+    const size_t px = static_cast<size_t>(w) * static_cast<size_t>(h);
+    const CV::AffineMatrix rotation = CV::rotation_matrix(Position{static_cast<float>(w) * 0.5f, static_cast<float>(h) * 0.5f}, 10.0);
+    const CV::StructuringElement se15 = CV::StructuringElement::rect(15, 15);
+    return {
+        {"rgba_to_gray", "rgba8", px * 5, [&] { CV::rgba_to_gray(std::as_const(ws.rgba).view(), ws.gray_out.view()); }},
+        {"normalize", "u8", px * 5, [&] { CV::normalize<1>(std::as_const(ws.gray).view(), ws.grayf_out.view()); }},
+        {"gaussian_blur", "u8", px * 2, [&] { CV::gaussian_blur(std::as_const(ws.gray).view(), ws.gray_out.view(), 2.0f); }},
+        {"gaussian_blur", "f32", px * 8, [&] { CV::gaussian_blur(std::as_const(ws.grayf).view(), ws.grayf_out.view(), 2.0f); }},
+        {"box_blur", "u8", px * 2, [&] { CV::box_blur(std::as_const(ws.gray).view(), ws.gray_out.view(), 3); }},
+        {"pyr_down", "f32", px * 5, [&] { CV::pyr_down(std::as_const(ws.grayf).view(), ws.grayf_half.view()); }},
+        {"resize_bilinear", "rgba8", px * 5, [&] {
+             CV::resize<4>(std::as_const(ws.rgba).view(), ws.rgba_half.view(), CV::Interpolation::Bilinear);
+         }},
+        {"resize_area", "rgba8", px * 5, [&] {
+             CV::resize<4>(std::as_const(ws.rgba).view(), ws.rgba_half.view(), CV::Interpolation::Area);
+         }},
+        {"warp_affine", "rgba8", px * 8, [&, rotation] {
+             CV::warp_affine<4>(std::as_const(ws.rgba).view(), ws.rgba_out.view(), rotation);
+         }},
+        {"canny", "u8", px * 2, [&] { CV::canny(std::as_const(ws.gray).view(), ws.gray_out.view()); }},
+        {"erode_15x15", "u8", px * 2, [&, se15] { CV::erode(std::as_const(ws.gray).view(), ws.gray_out.view(), se15); }},
+        {"erode_15x15", "bit", px / 4, [&, se15] { (void)CV::erode(ws.binary_bits, se15); }},
+        {"histogram", "rgba8", px * 4, [&] { (void)CV::histogram<4>(std::as_const(ws.rgba).view()); }},
+        {"equalize", "u8", px * 2, [&] { CV::equalize(std::as_const(ws.gray).view(), ws.gray_out.view()); }},
+        {"clahe", "u8", px * 2, [&] { CV::clahe(std::as_const(ws.gray).view(), ws.gray_out.view()); }},
+        {"integral", "u8", px * 13, [&] { (void)CV::integral_image(std::as_const(ws.gray).view()); }},
+        {"detect_corners", "u8", px, [&] { (void)CV::detect_corners(std::as_const(ws.gray).view()); }},
+        {"label_components", "u8", px * 5, [&] {
+             CV::label_components(std::as_const(ws.binary).view(), ws.labels.view());
+         }},
+        // u8 in, u8 level plus two int16 gradient planes out.
+        {"flow_pyramid", "u8", px * 6, [&] {
+             const CV::FlowParams flow;
+             ws.flow_to.build(std::as_const(ws.gray_moved).view(), flow.levels, flow.window);
+         }},
+        // Forward and backward over 4 levels at roughly 10 passes of 21x21
+        // samples and 7 bytes each, so GB/s is only a rough figure.
+        {"lk_track_2k", "u8", ws.flow_points.size() * 2 * 4 * 10 * 21 * 21 * 7, [&] {
+             (void)CV::track_points(ws.flow_from, ws.flow_to, ws.flow_points);
+         }},
+    };
+}
+
+struct Timing {
+    double median_ms = 0.0;
+    double p99_ms = 0.0;
+    double min_ms = 0.0;
+    double mean_ms = 0.0;
+};
+
+[[nodiscard]] auto measure(const std::function<void()> &fn, int warmup, int repetitions) -> Timing {
+    for (int i = 0; i < warmup; ++i) fn();
+    std::vector<double> samples(static_cast<size_t>(std::max(1, repetitions)));
+    for (double &s : samples) {
+        const auto start = steady_clock::now();
+        fn();
+        s = std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+    }
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    Timing t;
+    t.median_ms = n % 2 == 1 ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+    t.p99_ms = samples[std::min(n - 1, static_cast<size_t>(std::ceil(0.99 * static_cast<double>(n))) - 1)];
+    t.min_ms = samples.front();
+    for (double s : samples) t.mean_ms += s;
+    t.mean_ms /= static_cast<double>(n);
+    return t;
+}
+
+[[nodiscard]] auto split(std::string_view list) -> std::vector<std::string> {
+    std::vector<std::string> out;
+    while (!list.empty()) {
+        const size_t comma = list.find(',');
+        if (comma != 0) out.emplace_back(list.substr(0, comma));
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
+    return out;
+}
+
+[[nodiscard]] auto wanted(const std::vector<std::string> &filter, std::string_view name) -> bool {
+    return filter.empty() || std::find(filter.begin(), filter.end(), name) != filter.end();
+}
+
+[[nodiscard]] auto run_suite(const BenchOptions &options) -> json {
+    json results = json::array();
+    const int threads = CV::worker_count();
+    for (const SizeInfo &size : options.sizes) {
+        Workspace ws(size.width, size.height);
+        const std::vector<BenchCase> cases = make_cases(ws);
+        const double mpix = static_cast<double>(size.width) * size.height / 1.0e6;
+        if (&size == &options.sizes.front()) {
+            for (const std::string &name : options.kernels) {
+                if (std::none_of(cases.begin(), cases.end(), [&](const BenchCase &c) { return c.name == name; })) {
+                    LOG_ERR("Unknown kernel {}", name);
+                }
+            }
+        }
+        for (const BenchCase &c : cases) {
+            if (!wanted(options.kernels, c.name)) continue;
+            for (const CV::Simd::Level requested : options.levels) {
+                const CV::Simd::Level level = CV::Simd::set_level(requested);
+                const Timing t = measure(c.run, options.warmup, options.repetitions);
+                const double seconds = t.median_ms / 1000.0;
+                results.push_back({
+                    {"kernel", c.name},
+                    {"type", c.type},
+                    {"size", size.name},
+                    {"width", size.width},
+                    {"height", size.height},
+                    {"threads", threads},
+                    {"simd", CV::Simd::to_string(level)},
+                    {"median_ms", t.median_ms},
+                    {"p99_ms", t.p99_ms},
+                    {"min_ms", t.min_ms},
+                    {"mean_ms", t.mean_ms},
+                    {"mpix_per_s", mpix / seconds},
+                    {"gb_per_s", static_cast<double>(c.bytes) / 1.0e9 / seconds},
+                });
+                std::cerr << std::format("{:<18} {:<6} {:<6} {:>2}T {:<7} {:9.3f} ms  {:8.1f} MP/s\n",
+                    c.name, c.type, size.name, threads, CV::Simd::to_string(level), t.median_ms, mpix / seconds);
+            }
+        }
+    }
+    CV::Simd::set_level(CV::Simd::detected_level());
+    return results;
+}
+
+[[nodiscard]] auto read_report(const std::string &path) -> json {
+    std::ifstream file(path);
+    if (!file) {
+        LOG_ERR("Cannot open report {}", path);
+        return {};
+    }
+    json report = json::parse(file, nullptr, false);
+    if (report.is_discarded() || !report.contains("results")) {
+        LOG_ERR("{} is not a cv_bench report", path);
+        return {};
+    }
+    return report;
+}
+
+[[nodiscard]] auto shell_quote(const std::string &s) -> std::string {
+    std::string out = "'";
+    for (char c : s) out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    return out + "'";
+}
+
+// Runs this executable once per extra thread count and appends its results.
+[[nodiscard]] auto run_children(const char *self, const BenchOptions &options, json &results) -> bool {
+    for (size_t i = 1; i < options.threads.size(); ++i) {
+        const fs::path report = fs::temp_directory_path() / std::format("cv_bench_{}_{}.json", std::chrono::steady_clock::now().time_since_epoch().count(), i);
+        std::string command = shell_quote(self);
+        for (const std::string &arg : options.forwarded) command += " " + shell_quote(arg);
+        command += std::format(" -t {} -o {}", options.threads[i], shell_quote(report.string()));
+        if (std::system(command.c_str()) != 0) {
+            LOG_ERR("Benchmark child for {} threads failed", options.threads[i]);
+            return false;
+        }
+        const json child = read_report(report.string());
+        std::error_code ec;
+        fs::remove(report, ec);
+        if (child.is_null()) return false;
+        for (const json &r : child["results"]) results.push_back(r);
+    }
+    return true;
+}
+
+[[nodiscard]] auto result_key(const json &r) -> std::string {
+    return std::format("{}|{}|{}|{}|{}", r["kernel"].get<std::string>(), r["type"].get<std::string>(),
+        r["size"].get<std::string>(), r["threads"].get<int>(), r["simd"].get<std::string>());
+}
+
+// Prints one line per case present in both reports; returns the number of
+// cases whose median slowed down by more than the tolerance.
+[[nodiscard]] auto compare_reports(const json &baseline, const json &current, double tolerance) -> int {
+    std::map<std::string, double> base;
+    for (const json &r : baseline["results"]) base[result_key(r)] = r["median_ms"].get<double>();
+    int regressions = 0;
+    int improvements = 0;
+    int matched = 0;
+    for (const json &r : current["results"]) {
+        const auto it = base.find(result_key(r));
+        if (it == base.end()) continue;
+        ++matched;
+        const double now = r["median_ms"].get<double>();
+        const double change = (now / it->second - 1.0) * 100.0;
+        const char *verdict = "";
+        if (change > tolerance) {
+            verdict = "REGRESSION";
+            ++regressions;
+        } else if (change < -tolerance) {
+            verdict = "faster";
+            ++improvements;
+        }
+        std::cout << std::format("{:<44} {:9.3f} -> {:9.3f} ms {:+7.1f}% {}\n", it->first, it->second, now, change, verdict);
+    }
+    std::cout << std::format("{} cases compared: {} regressions, {} improvements (tolerance {}%)\n",
+        matched, regressions, improvements, tolerance);
+    return regressions;
+}
+
+auto print_usage() -> void {
+    std::cerr << "usage: cv_bench [-k kernels] [-s sizes] [-l levels] [-t threads] [-r repetitions] [-w warmup]\n"
+              << "                [-o output.json] [-c baseline.json [-i current.json] [--tolerance pct]]\n"
+              << "sizes:";
+    for (const SizeInfo &s : size_table) std::cerr << " " << s.name;
+    std::cerr << "\n";
+}
+
+[[nodiscard]] auto parse_int(const char *text, int &out) -> bool {
+    char *end = nullptr;
+    const long v = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || v < 0) return false;
+    out = static_cast<int>(v);
+    return true;
+}
+
+[[nodiscard]] auto parse_args(int argc, char **argv, BenchOptions &options) -> bool {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        auto value = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+        if (arg == "-h" || arg == "--help") return false;
+        const char *v = value();
+        if (!v) return false;
+        if (arg == "-k" || arg == "--kernels") {
+            options.kernels = split(v);
+        } else if (arg == "-s" || arg == "--sizes") {
+            options.sizes.clear();
+            for (const std::string &name : split(v)) {
+                const auto it = std::find_if(size_table.begin(), size_table.end(), [&](const SizeInfo &s) { return s.name == name; });
+                if (it == size_table.end()) {
+                    LOG_ERR("Unknown size {}", name);
+                    return false;
+                }
+                options.sizes.push_back(*it);
+            }
+        } else if (arg == "-l" || arg == "--levels") {
+            options.levels.clear();
+            for (const std::string &name : split(v)) {
+                bool found = false;
+                for (int l = 0; l < CV::Simd::level_count; ++l) {
+                    const auto level = static_cast<CV::Simd::Level>(l);
+                    if (CV::Simd::to_string(level) == name) {
+                        found = true;
+                        if (l <= static_cast<int>(CV::Simd::detected_level())) options.levels.push_back(level);
+                    }
+                }
+                if (!found) {
+                    LOG_ERR("Unknown SIMD level {}", name);
+                    return false;
+                }
+            }
+        } else if (arg == "-t" || arg == "--threads") {
+            options.threads.clear();
+            for (const std::string &t : split(v)) {
+                int n = 0;
+                if (!parse_int(t.c_str(), n)) return false;
+                options.threads.push_back(n);
+            }
+            if (options.threads.empty()) return false;
+            continue; // not forwarded, each child gets its own count
+        } else if (arg == "-r" || arg == "--repetitions") {
+            if (!parse_int(v, options.repetitions) || options.repetitions == 0) return false;
+        } else if (arg == "-w" || arg == "--warmup") {
+            if (!parse_int(v, options.warmup)) return false;
+        } else if (arg == "-o" || arg == "--output") {
+            options.output = v;
+            continue;
+        } else if (arg == "-c" || arg == "--compare") {
+            options.compare = v;
+            continue;
+        } else if (arg == "-i" || arg == "--input") {
+            options.input = v;
+            continue;
+        } else if (arg == "--tolerance") {
+            char *end = nullptr;
+            options.tolerance = std::strtod(v, &end);
+            if (end == v) return false;
+            continue;
+        } else {
+            LOG_ERR("Unknown option {}", arg);
+            return false;
+        }
+        options.forwarded.emplace_back(arg);
+        options.forwarded.emplace_back(v);
+    }
+    if (options.sizes.empty()) options.sizes.assign(size_table.begin(), size_table.end());
+    if (options.levels.empty()) {
+        for (int l = 0; l <= static_cast<int>(CV::Simd::detected_level()); ++l) options.levels.push_back(static_cast<CV::Simd::Level>(l));
+    }
+    return true;
+}
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+    BenchOptions options;
+    if (!parse_args(argc, argv, options)) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    json report;
+    if (!options.input.empty()) {
+        report = read_report(options.input);
+        if (report.is_null()) return EXIT_FAILURE;
+    } else {
+        // Must happen before the first parallel call creates the pool.
+        const std::string threads = std::to_string(options.threads.front());
+        if (options.threads.front() > 0) {
+            setenv("CV_NUM_THREADS", threads.c_str(), 1);
+        } else {
+            unsetenv("CV_NUM_THREADS");
+        }
+        json results = run_suite(options);
+        if (!run_children(argv[0], options, results)) return EXIT_FAILURE;
+        report = {
+            {"meta", {
+                         {"compiler", __VERSION__},
+#ifdef NDEBUG
+                         {"assertions", false},
+#else
+                         {"assertions", true},
+#endif
+                         {"detected_simd", CV::Simd::to_string(CV::Simd::detected_level())},
+                         {"hardware_threads", std::thread::hardware_concurrency()},
+                         {"repetitions", options.repetitions},
+                         {"warmup", options.warmup},
+                     }},
+            {"results", std::move(results)},
+        };
+        if (options.output.empty()) {
+            std::cout << report.dump(2) << "\n";
+        } else {
+            std::ofstream file(options.output);
+            file << report.dump(2) << "\n";
+            if (!file) {
+                LOG_ERR("Failed to write {}", options.output);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    if (options.compare.empty()) return EXIT_SUCCESS;
+    const json baseline = read_report(options.compare);
+    if (baseline.is_null()) return EXIT_FAILURE;
+    return compare_reports(baseline, report, options.tolerance) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,276 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+
+#include "convert.hpp"
+#include "image.hpp"
+#include "integral.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
+#include "pyramid.hpp"
+
+// Byte-budgeted cache for decoded images and products derived from them.
+//
+// Entries are keyed by file identity (path and modification time) plus an
+// operation signature such as "rgba8" or "gray8/pyramid:2", so an edited file
+// misses instead of returning stale pixels. Values are shared immutably; an
+// evicted value stays alive for as long as someone still holds it, the budget
+// only bounds what the cache itself keeps. The first request for a key builds
+// the value outside the lock, concurrent requests for the same key wait for
+// that result instead of decoding a second time (unless they are inside a build
+// themselves, see get()). Failed builds (empty values) are not cached.
+namespace CV {
+struct CacheKey {
+    std::string path;
+    int64_t mtime = 0; // file clock ticks; part of the key, so edits invalidate
+    std::string op;
+
+    [[nodiscard]] auto str() const -> std::string { return std::format("{}|{}|{}", path, mtime, op); }
+};
+
+// Returns nullopt when the file cannot be stat'ed.
+[[nodiscard]] inline auto file_key(const std::string &path, std::string op) -> std::optional<CacheKey> {
+    std::error_code ec;
+    const auto time = std::filesystem::last_write_time(path, ec);
+    if (ec) return std::nullopt;
+    return CacheKey{path, time.time_since_epoch().count(), std::move(op)};
+}
+
+namespace detail {
+// Cache builds on the calling thread's stack, across all caches.
+inline thread_local int t_cache_builds = 0;
+
+// Counts one build on t_cache_builds for its lifetime, also when it throws.
+struct CacheBuildScope {
+    CacheBuildScope() { ++t_cache_builds; }
+    ~CacheBuildScope() { --t_cache_builds; }
+    CacheBuildScope(const CacheBuildScope &) = delete;
+    auto operator=(const CacheBuildScope &) -> CacheBuildScope & = delete;
+};
+} // namespace detail
+
+template <typename V>
+concept Cacheable = requires(const V &v) {
+    { v.empty() } -> std::convertible_to<bool>;
+    { v.size_bytes() } -> std::convertible_to<size_t>;
+};
+
+struct CacheStats {
+    size_t bytes = 0;
+    size_t budget = 0;
+    size_t entries = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t shared_waits = 0; // requests that waited on another thread's build
+    uint64_t evictions = 0;
+};
+
+class ImageCache {
+public:
+    explicit ImageCache(size_t byte_budget)
+        : m_budget(byte_budget) {}
+
+    ImageCache(const ImageCache &) = delete;
+    auto operator=(const ImageCache &) -> ImageCache & = delete;
+
+    // Returns the cached value for key or builds it with make() -> V. Returns
+    // nullptr when make() produced an empty value.
+    template <Cacheable V, typename F>
+    [[nodiscard]] auto get(const CacheKey &key, F &&make) -> std::shared_ptr<const V> {
+        const std::string id = key.str();
+        std::unique_lock lock(m_mutex);
+        if (auto it = m_entries.find(id); it != m_entries.end()) {
+            Entry &entry = it->second;
+            if (entry.type != std::type_index(typeid(V))) {
+                PANIC(std::format("ImageCache: '{}' requested as {} but holds {}", id, typeid(V).name(), entry.type.name()));
+            }
+            if (entry.ready) {
+                ++m_stats.hits;
+                m_lru.splice(m_lru.begin(), m_lru, entry.lru);
+                return std::static_pointer_cast<const V>(entry.value.get());
+            }
+            if (detail::t_cache_builds == 0) {
+                ++m_stats.shared_waits;
+                const Shared pending = entry.value;
+                lock.unlock();
+                return std::static_pointer_cast<const V>(wait(pending));
+            }
+            // This thread is inside a build itself (possibly of this very key,
+            // further down the stack while it helps the pool), so waiting could
+            // close a cycle. Build a private, uncached copy instead.
+            ++m_stats.misses;
+            lock.unlock();
+            return build<V>(make);
+        }
+
+        ++m_stats.misses;
+        std::promise<std::shared_ptr<const void>> promise;
+        m_entries.emplace(id, Entry{promise.get_future().share(), std::type_index(typeid(V))});
+        lock.unlock();
+
+        std::shared_ptr<const V> result;
+        try {
+            result = build<V>(make);
+        } catch (...) {
+            // Drop the pending entry so the next request retries, and hand the
+            // error to everyone already waiting on it.
+            lock.lock();
+            m_entries.erase(id);
+            lock.unlock();
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+        promise.set_value(result);
+
+        lock.lock();
+        const auto it = m_entries.find(id);
+        if (!result) {
+            m_entries.erase(it);
+            return result;
+        }
+        it->second.bytes = result->size_bytes();
+        it->second.ready = true;
+        m_lru.push_front(id);
+        it->second.lru = m_lru.begin();
+        m_bytes += it->second.bytes;
+        evict_locked();
+        return result;
+    }
+
+    // Decoded RGBA8 pixels of an image file.
+    [[nodiscard]] auto image(const std::string &path) -> std::shared_ptr<const ImageRGBA8> {
+        const auto key = file_key(path, "rgba8");
+        if (!key) {
+            LOG_ERR("ImageCache: cannot stat {}", path);
+            return nullptr;
+        }
+        return get<ImageRGBA8>(*key, [&] { return load_image<uint8_t, 4>(path.c_str()); });
+    }
+
+    [[nodiscard]] auto gray(const std::string &path) -> std::shared_ptr<const ImageGray8> {
+        const auto key = file_key(path, "gray8");
+        if (!key) return nullptr;
+        return get<ImageGray8>(*key, [&]() -> ImageGray8 {
+            const auto rgba = image(path);
+            return rgba ? rgba_to_gray(rgba->view()) : ImageGray8{};
+        });
+    }
+
+    // Level i of the Gaussian pyramid of the normalised gray image; each level
+    // is built from (and caches) the one above it.
+    [[nodiscard]] auto pyramid_level(const std::string &path, int level) -> std::shared_ptr<const ImageGrayF> {
+        const auto key = file_key(path, std::format("gray8/pyramid:{}", level));
+        if (!key) return nullptr;
+        return get<ImageGrayF>(*key, [&]() -> ImageGrayF {
+            if (level <= 0) {
+                const auto g = gray(path);
+                if (!g) return {};
+                ImageGrayF out(g->width(), g->height());
+                normalize<1>(g->view(), out.view());
+                return out;
+            }
+            const auto finer = pyramid_level(path, level - 1);
+            if (!finer || finer->width() < 2 || finer->height() < 2) return {};
+            ImageGrayF out(pyr_down_size(finer->width()), pyr_down_size(finer->height()));
+            pyr_down(finer->view(), out.view());
+            return out;
+        });
+    }
+
+    [[nodiscard]] auto integral(const std::string &path) -> std::shared_ptr<const IntegralImage<uint8_t>> {
+        const auto key = file_key(path, "gray8/integral");
+        if (!key) return nullptr;
+        return get<IntegralImage<uint8_t>>(*key, [&]() -> IntegralImage<uint8_t> {
+            const auto g = gray(path);
+            return g ? IntegralImage<uint8_t>(g->view()) : IntegralImage<uint8_t>{};
+        });
+    }
+
+    auto set_budget(size_t bytes) -> void {
+        std::lock_guard lock(m_mutex);
+        m_budget = bytes;
+        evict_locked();
+    }
+
+    // Drops every finished entry; builds in flight complete normally.
+    auto clear() -> void {
+        std::lock_guard lock(m_mutex);
+        for (const std::string &id : m_lru) m_entries.erase(id);
+        m_stats.evictions += m_lru.size();
+        m_lru.clear();
+        m_bytes = 0;
+    }
+
+    [[nodiscard]] auto stats() const -> CacheStats {
+        std::lock_guard lock(m_mutex);
+        CacheStats s = m_stats;
+        s.bytes = m_bytes;
+        s.budget = m_budget;
+        s.entries = m_lru.size();
+        return s;
+    }
+
+private:
+    using Shared = std::shared_future<std::shared_ptr<const void>>;
+
+    struct Entry {
+        Shared value;
+        std::type_index type;
+        size_t bytes = 0;
+        bool ready = false;
+        std::list<std::string>::iterator lru{};
+    };
+
+    template <typename V, typename F>
+    [[nodiscard]] static auto build(F &&make) -> std::shared_ptr<const V> {
+        CV_PROFILE_SCOPE("cache_build");
+        V value = [&] {
+            const detail::CacheBuildScope scope;
+            return make();
+        }();
+        if (value.empty()) return nullptr;
+        return std::make_shared<const V>(std::move(value));
+    }
+
+    // Pool threads keep executing tasks while they wait, the build they wait
+    // for may itself be queued behind them. Only threads without a build of
+    // their own on the stack wait, so no thread ever waits on itself.
+    [[nodiscard]] static auto wait(const Shared &pending) -> std::shared_ptr<const void> {
+        if (detail::t_slot >= 0) {
+            ThreadPool::instance().help_until([&] { return pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+        }
+        return pending.get();
+    }
+
+    auto evict_locked() -> void {
+        while (m_bytes > m_budget && !m_lru.empty()) {
+            const auto it = m_entries.find(m_lru.back());
+            m_bytes -= it->second.bytes;
+            m_entries.erase(it);
+            m_lru.pop_back();
+            ++m_stats.evictions;
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // finished entries, most recently used first
+    size_t m_bytes = 0;
+    size_t m_budget;
+    CacheStats m_stats;
+};
+} // namespace CV
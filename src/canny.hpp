@@ -0,0 +1,236 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "convert.hpp"
+#include "image.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
+
+// Canny edge detector.
+//
+// Gradient, magnitude, direction quantization and non-maximum suppression run
+// as one fused pass over horizontal strips: each strip keeps three rows of
+// Sobel output in a ring and classifies the middle row directly into the edge
+// map, so no full-size gradient or magnitude image is ever written. Hysteresis
+// then grows strong edges through weak ones with an explicit stack.
+namespace CV {
+struct CannyParams {
+    float low_threshold = 50.0f;
+    float high_threshold = 100.0f;
+    bool l2_gradient = true; // sqrt(gx^2 + gy^2) instead of |gx| + |gy|
+    GrayWeights weights = GrayWeights::BT601;
+};
+
+namespace detail {
+inline constexpr uint8_t canny_none = 0;
+inline constexpr uint8_t canny_weak = 1;
+inline constexpr uint8_t canny_strong = 2;
+
+// tan(22.5 deg) in Q15, used to bin gradient directions without atan2.
+inline constexpr int32_t canny_tg22 = 13573;
+
+// Sobel response and magnitude of one image row; mag is padded by one zero on
+// each side so NMS can read x - 1 and x + 1 unconditionally.
+struct SobelRow {
+    std::vector<int16_t> gx;
+    std::vector<int16_t> gy;
+    std::vector<int32_t> mag;
+
+    explicit SobelRow(int width)
+        : gx(static_cast<size_t>(width)), gy(static_cast<size_t>(width)), mag(static_cast<size_t>(width + 2), 0) {}
+};
+
+inline auto sobel_row(const uint8_t *above, const uint8_t *center, const uint8_t *below, int w, bool l2,
+    std::vector<int16_t> &vsum, std::vector<int16_t> &vdiff, SobelRow &out) -> void {
+    // Vertical [1 2 1] smoothing and [-1 0 1] difference, with replicated ends.
+    for (int x = 0; x < w; ++x) {
+        const auto i = static_cast<size_t>(x + 1);
+        vsum[i] = static_cast<int16_t>(above[x] + 2 * center[x] + below[x]);
+        vdiff[i] = static_cast<int16_t>(below[x] - above[x]);
+    }
+    vsum[0] = vsum[1];
+    vdiff[0] = vdiff[1];
+    vsum[static_cast<size_t>(w + 1)] = vsum[static_cast<size_t>(w)];
+    vdiff[static_cast<size_t>(w + 1)] = vdiff[static_cast<size_t>(w)];
+
+    for (int x = 0; x < w; ++x) {
+        const auto i = static_cast<size_t>(x + 1);
+        const int gx = vsum[i + 1] - vsum[i - 1];
+        const int gy = vdiff[i - 1] + 2 * vdiff[i] + vdiff[i + 1];
+        out.gx[i - 1] = static_cast<int16_t>(gx);
+        out.gy[i - 1] = static_cast<int16_t>(gy);
+        out.mag[i] = l2 ? gx * gx + gy * gy : std::abs(gx) + std::abs(gy);
+    }
+}
+
+// Classifies row y from the magnitudes of rows y - 1, y, y + 1.
+inline auto canny_nms_row(const int32_t *up, const int32_t *mid, const int32_t *down, const SobelRow &center,
+    int w, int32_t low, int32_t high, uint8_t *out, std::vector<PixelCoord> &seeds, int y) -> void {
+    for (int x = 0; x < w; ++x) {
+        const auto i = static_cast<size_t>(x + 1);
+        const int32_t m = mid[i];
+        uint8_t label = canny_none;
+        if (m > low) {
+            const int32_t gx = center.gx[i - 1];
+            const int32_t gy = center.gy[i - 1];
+            const int64_t ax = std::abs(gx);
+            const int64_t ay = static_cast<int64_t>(std::abs(gy)) << 15;
+            const int64_t tg22x = ax * canny_tg22;
+            const int64_t tg67x = tg22x + (ax << 16);
+            bool is_max = false;
+            if (ay < tg22x) {
+                is_max = m > mid[i - 1] && m >= mid[i + 1];
+            } else if (ay > tg67x) {
+                is_max = m > up[i] && m >= down[i];
+            } else {
+                const int s = (gx ^ gy) < 0 ? -1 : 1;
+                is_max = m > up[static_cast<size_t>(static_cast<int>(i) - s)] &&
+                         m >= down[static_cast<size_t>(static_cast<int>(i) + s)];
+            }
+            if (is_max) {
+                if (m > high) {
+                    label = canny_strong;
+                    seeds.push_back(PixelCoord{x, y});
+                } else {
+                    label = canny_weak;
+                }
+            }
+        }
+        out[x] = label;
+    }
+}
+
+template <typename RowSource>
+inline auto canny_impl(int w, int h, ImageView<uint8_t, 1> edges, const CannyParams &params,
+    std::vector<PixelCoord> *edge_pixels, RowSource &&make_source) -> void {
+    float lo = std::max(0.0f, params.low_threshold);
+    float hi = std::max(0.0f, params.high_threshold);
+    if (lo > hi) std::swap(lo, hi);
+    if (params.l2_gradient) {
+        lo *= lo;
+        hi *= hi;
+    }
+    const auto low = static_cast<int32_t>(std::min(std::floor(lo), 2.0e9f));
+    const auto high = static_cast<int32_t>(std::min(std::floor(hi), 2.0e9f));
+
+    const int strips = std::clamp(h / 32, 1, 4 * worker_count());
+    auto strip_begin = [&](int s) { return static_cast<int>(static_cast<long long>(h) * s / strips); };
+    std::vector<std::vector<PixelCoord>> strip_seeds(static_cast<size_t>(strips));
+
+    parallel_for(0, strips, 1, [&](int s_begin, int s_end) {
+        auto gray_row = make_source();
+        std::vector<SobelRow> ring(3, SobelRow(w));
+        std::vector<int16_t> vsum(static_cast<size_t>(w + 2));
+        std::vector<int16_t> vdiff(static_cast<size_t>(w + 2));
+        const std::vector<int32_t> zeros(static_cast<size_t>(w + 2), 0);
+
+        auto compute = [&](int r) {
+            SobelRow &slot = ring[static_cast<size_t>(r % 3)];
+            sobel_row(gray_row(std::max(r - 1, 0)), gray_row(r), gray_row(std::min(r + 1, h - 1)),
+                w, params.l2_gradient, vsum, vdiff, slot);
+        };
+        auto mag = [&](int r) -> const int32_t * {
+            return r < 0 || r >= h ? zeros.data() : ring[static_cast<size_t>(r % 3)].mag.data();
+        };
+
+        for (int s = s_begin; s < s_end; ++s) {
+            const int y0 = strip_begin(s);
+            const int y1 = strip_begin(s + 1);
+            if (y0 > 0) compute(y0 - 1);
+            compute(y0);
+            for (int y = y0; y < y1; ++y) {
+                if (y + 1 < h) compute(y + 1);
+                canny_nms_row(mag(y - 1), mag(y), mag(y + 1), ring[static_cast<size_t>(y % 3)],
+                    w, low, high, edges.row(y), strip_seeds[static_cast<size_t>(s)], y);
+            }
+        }
+    });
+
+    // Hysteresis: promote weak pixels 8-connected to a strong one.
+    std::vector<PixelCoord> stack;
+    for (auto &seeds : strip_seeds) {
+        stack.insert(stack.end(), seeds.begin(), seeds.end());
+        seeds.clear();
+    }
+    while (!stack.empty()) {
+        const PixelCoord p = stack.back();
+        stack.pop_back();
+        for (int dy = -1; dy <= 1; ++dy) {
+            const int ny = p.y + dy;
+            if (ny < 0 || ny >= h) continue;
+            uint8_t *row = edges.row(ny);
+            for (int dx = -1; dx <= 1; ++dx) {
+                const int nx = p.x + dx;
+                if (nx < 0 || nx >= w || row[nx] != canny_weak) continue;
+                row[nx] = canny_strong;
+                stack.push_back(PixelCoord{nx, ny});
+            }
+        }
+    }
+
+    parallel_for(0, strips, 1, [&](int s_begin, int s_end) {
+        for (int s = s_begin; s < s_end; ++s) {
+            auto &pixels = strip_seeds[static_cast<size_t>(s)];
+            for (int y = strip_begin(s); y < strip_begin(s + 1); ++y) {
+                uint8_t *row = edges.row(y);
+                for (int x = 0; x < w; ++x) {
+                    const bool edge = row[x] == canny_strong;
+                    row[x] = edge ? 255 : 0;
+                    if (edge && edge_pixels) pixels.push_back(PixelCoord{x, y});
+                }
+            }
+        }
+    });
+    if (edge_pixels) {
+        edge_pixels->clear();
+        for (const auto &pixels : strip_seeds) edge_pixels->insert(edge_pixels->end(), pixels.begin(), pixels.end());
+    }
+}
+} // namespace detail
+
+// Edge map (255 = edge) from an 8-bit gray image; optionally also returns the
+// edge pixels in row-major order.
+inline auto canny(ImageView<const uint8_t, 1> gray, ImageView<uint8_t, 1> edges, const CannyParams &params = {},
+    std::vector<PixelCoord> *edge_pixels = nullptr) -> void {
+    check_same_size(gray.width, gray.height, edges.width, edges.height, "canny");
+    if (gray.empty()) return;
+    detail::canny_impl(gray.width, gray.height, edges, params, edge_pixels, [&] {
+        return [&](int r) { return gray.row(r); };
+    });
+}
+
+// RGBA8 input (as decoded by stb_image) is converted to gray row by row inside
+// the fused pass, through a 3-row ring per worker.
+inline auto canny(ImageView<const uint8_t, 4> rgba, ImageView<uint8_t, 1> edges, const CannyParams &params = {},
+    std::vector<PixelCoord> *edge_pixels = nullptr) -> void {
+    check_same_size(rgba.width, rgba.height, edges.width, edges.height, "canny");
+    if (rgba.empty()) return;
+    const Convert::Kernels &k = Convert::kernels();
+    const Convert::LumaQ15 weights = Convert::luma_weights(params.weights);
+    const auto w = static_cast<size_t>(rgba.width);
+    detail::canny_impl(rgba.width, rgba.height, edges, params, edge_pixels, [&] {
+        return [&k, &rgba, weights, w, rows = std::vector<uint8_t>(3 * w), tags = std::vector<int>(3, -1)](int r) mutable {
+            const auto slot = static_cast<size_t>(r % 3);
+            uint8_t *buf = rows.data() + slot * w;
+            if (tags[slot] != r) {
+                k.rgba8_to_gray8(rgba.row(r), buf, w, weights);
+                tags[slot] = r;
+            }
+            return static_cast<const uint8_t *>(buf);
+        };
+    });
+}
+
+[[nodiscard]] inline auto canny(ImageView<const uint8_t, 4> rgba, const CannyParams &params = {},
+    std::vector<PixelCoord> *edge_pixels = nullptr) -> ImageGray8 {
+    ImageGray8 edges(rgba.width, rgba.height);
+    canny(rgba, edges.view(), params, edge_pixels);
+    return edges;
+}
+} // namespace CV
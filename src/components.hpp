@@ -0,0 +1,248 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "image.hpp"
+#include "parallel.hpp"
+#include "types.hpp"
+
+// Connected-component labeling of binary images.
+//
+// The image is split into horizontal strips that are labeled in parallel with
+// a strip-local union-find, which also accumulates area, bounds and coordinate
+// sums per provisional label. Strip-local labels are then concatenated into one
+// forest, unions are added along the strip seams, and a single flattening pass
+// assigns final labels and folds the statistics into their roots. A last
+// parallel pass rewrites the label image.
+namespace CV {
+enum class Connectivity {
+    Four,
+    Eight
+};
+
+struct ComponentStats {
+    uint32_t area = 0;
+    Rect bbox{};        // image space: top-left corner, extends downwards
+    Position centroid{}; // mean pixel coordinate
+};
+
+// labels: 0 for background, 1..count for components in raster order of their
+// first pixel. stats[i] describes label i + 1.
+struct Components {
+    ImageLabel labels;
+    std::vector<ComponentStats> stats;
+
+    [[nodiscard]] auto count() const -> size_t { return stats.size(); }
+};
+
+namespace detail {
+// Running statistics of one provisional label.
+struct LabelAccum {
+    uint32_t area = 0;
+    int32_t x0 = 0, y0 = 0, x1 = 0, y1 = 0; // inclusive bounds
+    uint64_t sum_x = 0;
+    uint64_t sum_y = 0;
+
+    auto add(int x, int y) -> void {
+        if (area == 0) {
+            x0 = x1 = x;
+            y0 = y1 = y;
+        } else {
+            x0 = std::min(x0, x);
+            x1 = std::max(x1, x);
+            y0 = std::min(y0, y);
+            y1 = std::max(y1, y);
+        }
+        ++area;
+        sum_x += static_cast<uint64_t>(x);
+        sum_y += static_cast<uint64_t>(y);
+    }
+
+    auto merge(const LabelAccum &o) -> void {
+        if (o.area == 0) return;
+        if (area == 0) {
+            *this = o;
+            return;
+        }
+        area += o.area;
+        x0 = std::min(x0, o.x0);
+        y0 = std::min(y0, o.y0);
+        x1 = std::max(x1, o.x1);
+        y1 = std::max(y1, o.y1);
+        sum_x += o.sum_x;
+        sum_y += o.sum_y;
+    }
+};
+
+[[nodiscard]] inline auto uf_find(std::vector<uint32_t> &parent, uint32_t a) -> uint32_t {
+    uint32_t root = a;
+    while (parent[root] != root) root = parent[root];
+    while (parent[a] != root) {
+        const uint32_t next = parent[a];
+        parent[a] = root;
+        a = next;
+    }
+    return root;
+}
+
+// Links the larger root under the smaller one so that every root is the
+// earliest provisional label of its set. Returns the surviving root.
+inline auto uf_union(std::vector<uint32_t> &parent, uint32_t a, uint32_t b) -> uint32_t {
+    a = uf_find(parent, a);
+    b = uf_find(parent, b);
+    if (a == b) return a;
+    if (a < b) {
+        parent[b] = a;
+        return a;
+    }
+    parent[a] = b;
+    return b;
+}
+
+struct StripLabels {
+    std::vector<uint32_t> parent; // local labels, 0-based; pixel label = index + 1
+    std::vector<LabelAccum> accum;
+};
+
+inline auto label_strip(ImageView<const uint8_t, 1> src, ImageView<uint32_t, 1> labels, int y0, int y1,
+    Connectivity conn, StripLabels &out) -> void {
+    const int w = src.width;
+    const bool eight = conn == Connectivity::Eight;
+    for (int y = y0; y < y1; ++y) {
+        const uint8_t *s = src.row(y);
+        uint32_t *l = labels.row(y);
+        const uint32_t *up = y > y0 ? labels.row(y - 1) : nullptr;
+        for (int x = 0; x < w; ++x) {
+            if (!s[x]) {
+                l[x] = 0;
+                continue;
+            }
+            // Neighbours already visited in raster order.
+            uint32_t n[4] = {0, 0, 0, 0};
+            n[0] = x > 0 ? l[x - 1] : 0;
+            if (up) {
+                n[1] = up[x];
+                if (eight) {
+                    n[2] = x > 0 ? up[x - 1] : 0;
+                    n[3] = x + 1 < w ? up[x + 1] : 0;
+                }
+            }
+            uint32_t label = 0;
+            for (const uint32_t v : n) {
+                if (v == 0) continue;
+                label = label == 0 ? uf_find(out.parent, v - 1) + 1 : uf_union(out.parent, label - 1, v - 1) + 1;
+            }
+            if (label == 0) {
+                label = static_cast<uint32_t>(out.parent.size()) + 1;
+                out.parent.push_back(label - 1);
+                out.accum.emplace_back();
+            }
+            l[x] = label;
+            out.accum[label - 1].add(x, y);
+        }
+    }
+}
+} // namespace detail
+
+// Labels the non-zero pixels of `binary` into `labels` and returns one
+// ComponentStats per component (stats[i] belongs to label i + 1).
+inline auto label_components(ImageView<const uint8_t, 1> binary, ImageView<uint32_t, 1> labels,
+    Connectivity conn = Connectivity::Eight) -> std::vector<ComponentStats> {
+    if (binary.width != labels.width || binary.height != labels.height) PANIC("label_components: size mismatch");
+    if (binary.empty()) return {};
+    const int w = binary.width;
+    const int h = binary.height;
+
+    const int strips = std::clamp(h / 16, 1, 4 * worker_count());
+    auto strip_begin = [&](int s) { return static_cast<int>(static_cast<long long>(h) * s / strips); };
+    std::vector<detail::StripLabels> local(static_cast<size_t>(strips));
+    parallel_for(0, strips, 1, [&](int begin, int end) {
+        for (int s = begin; s < end; ++s) {
+            detail::label_strip(binary, labels, strip_begin(s), strip_begin(s + 1), conn, local[static_cast<size_t>(s)]);
+        }
+    });
+
+    // One forest over all provisional labels; strip s occupies [offset[s], offset[s + 1]).
+    std::vector<uint32_t> offset(static_cast<size_t>(strips) + 1, 0);
+    for (int s = 0; s < strips; ++s) {
+        offset[static_cast<size_t>(s) + 1] = offset[static_cast<size_t>(s)] + static_cast<uint32_t>(local[static_cast<size_t>(s)].parent.size());
+    }
+    std::vector<uint32_t> parent(offset.back());
+    std::vector<detail::LabelAccum> accum(offset.back());
+    for (int s = 0; s < strips; ++s) {
+        const auto &ls = local[static_cast<size_t>(s)];
+        const uint32_t base = offset[static_cast<size_t>(s)];
+        for (size_t i = 0; i < ls.parent.size(); ++i) {
+            parent[base + i] = base + ls.parent[i];
+            accum[base + i] = ls.accum[i];
+        }
+    }
+    local.clear();
+
+    // Stitch each seam: row y0 - 1 of strip s - 1 against row y0 of strip s.
+    for (int s = 1; s < strips; ++s) {
+        const int y = strip_begin(s);
+        const uint32_t *up = labels.row(y - 1);
+        const uint32_t *cur = labels.row(y);
+        const uint32_t up_base = offset[static_cast<size_t>(s) - 1];
+        const uint32_t cur_base = offset[static_cast<size_t>(s)];
+        for (int x = 0; x < w; ++x) {
+            if (cur[x] == 0) continue;
+            const uint32_t a = cur_base + cur[x] - 1;
+            const int xa = conn == Connectivity::Eight ? std::max(x - 1, 0) : x;
+            const int xb = conn == Connectivity::Eight ? std::min(x + 1, w - 1) : x;
+            for (int xx = xa; xx <= xb; ++xx) {
+                if (up[xx] != 0) detail::uf_union(parent, a, up_base + up[xx] - 1);
+            }
+        }
+    }
+
+    // Roots are the smallest label of their set, so a forward pass sees every
+    // root before its children and final labels follow raster order.
+    std::vector<uint32_t> final_label(parent.size(), 0);
+    std::vector<detail::LabelAccum> merged;
+    for (uint32_t i = 0; i < parent.size(); ++i) {
+        const uint32_t root = detail::uf_find(parent, i);
+        if (root == i) {
+            merged.push_back(accum[i]);
+            final_label[i] = static_cast<uint32_t>(merged.size());
+        } else {
+            final_label[i] = final_label[root];
+            merged[final_label[i] - 1].merge(accum[i]);
+        }
+    }
+
+    parallel_for(0, strips, 1, [&](int begin, int end) {
+        for (int s = begin; s < end; ++s) {
+            const uint32_t base = offset[static_cast<size_t>(s)];
+            for (int y = strip_begin(s); y < strip_begin(s + 1); ++y) {
+                uint32_t *l = labels.row(y);
+                for (int x = 0; x < w; ++x) {
+                    if (l[x] != 0) l[x] = final_label[base + l[x] - 1];
+                }
+            }
+        }
+    });
+
+    std::vector<ComponentStats> stats(merged.size());
+    for (size_t i = 0; i < merged.size(); ++i) {
+        const detail::LabelAccum &a = merged[i];
+        const auto inv = 1.0 / static_cast<double>(a.area);
+        stats[i].area = a.area;
+        stats[i].bbox = to_rect(PixelRect{a.x0, a.y0, a.x1 - a.x0 + 1, a.y1 - a.y0 + 1});
+        stats[i].centroid = Position{static_cast<float>(static_cast<double>(a.sum_x) * inv),
+            static_cast<float>(static_cast<double>(a.sum_y) * inv)};
+    }
+    return stats;
+}
+
+[[nodiscard]] inline auto label_components(ImageView<const uint8_t, 1> binary, Connectivity conn = Connectivity::Eight) -> Components {
+    Components out;
+    out.labels = ImageLabel(binary.width, binary.height);
+    out.stats = label_components(binary, out.labels.view(), conn);
+    return out;
+}
+} // namespace CV
@@ -13,6 +13,7 @@ inline constexpr std::string_view window_title = "Chip-8 Emulator";
 inline constexpr int window_width = 1280;
 inline constexpr int window_height = 720;
 inline constexpr float aspect_ratio = static_cast<float>(window_width) / window_height;
+inline constexpr int max_display_size = 512; // longest side the image view is drawn at in the GUI
 
 inline constexpr float path_marker_width = 0.025f;
 inline constexpr float path_marker_height = 0.025f;
@@ -80,9 +81,16 @@ inline constexpr int max_tower_level = 5;
 inline constexpr char const *fp_shader_dir = "assets/shaders/";
 inline constexpr char const *fp_vertex_shader = "assets/shaders/vertex.glsl";
 inline constexpr char const *fp_fragment_shader = "assets/shaders/fragment.glsl";
+inline constexpr char const *fp_overlay_vertex_shader = "assets/shaders/overlay_vertex.glsl";
+inline constexpr char const *fp_overlay_fragment_shader = "assets/shaders/overlay_fragment.glsl";
+inline constexpr char const *fp_palette_vertex_shader = "assets/shaders/palette_vertex.glsl";
+inline constexpr char const *fp_palette_fragment_shader = "assets/shaders/palette_fragment.glsl";
 
 inline constexpr char const *fp_image_hummingbird = "assets/images/hummingbird.png";
 inline constexpr char const *fp_image_fennec = "assets/images/fennec.png";
+inline constexpr std::array<char const *, 2> fp_images = {fp_image_hummingbird, fp_image_fennec};
+inline constexpr size_t image_cache_budget = size_t{256} << 20; // bytes of decoded and derived images kept around
+inline constexpr char const *fp_profile_trace = "profile_trace.json";
 
 inline constexpr char const *fp_sound_beep = "assets/sound/beep.mp3";
 
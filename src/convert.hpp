@@ -0,0 +1,494 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "image.hpp"
+#include "log.hpp"
+#include "simd.hpp"
+
+// Pixel format conversion. Every conversion is a row kernel with a scalar
+// reference implementation and SSE4.1 / AVX2 / AVX-512 variants that produce
+// bit-identical output; the variant is picked through Simd::active_level().
+namespace CV {
+enum class GrayWeights {
+    BT601,
+    BT709
+};
+
+namespace Convert {
+// Luma weights in Q15, each set sums to exactly 1 << 15 so white stays 255.
+struct LumaQ15 {
+    int16_t r, g, b;
+};
+inline constexpr LumaQ15 luma_bt601 = {9798, 19235, 3735};
+inline constexpr LumaQ15 luma_bt709 = {6967, 23436, 2365};
+
+[[nodiscard]] inline auto luma_weights(GrayWeights w) -> LumaQ15 {
+    return w == GrayWeights::BT709 ? luma_bt709 : luma_bt601;
+}
+
+inline constexpr float inv_255 = 1.0f / 255.0f;
+
+// ---------------------------------------------------------------------------
+// Scalar reference kernels
+// ---------------------------------------------------------------------------
+inline auto rgba8_to_gray8_scalar(const uint8_t *src, uint8_t *dst, size_t n, LumaQ15 w) -> void {
+    for (size_t i = 0; i < n; ++i) {
+        const int32_t sum = src[4 * i + 0] * w.r + src[4 * i + 1] * w.g + src[4 * i + 2] * w.b;
+        dst[i] = static_cast<uint8_t>((sum + (1 << 14)) >> 15);
+    }
+}
+
+inline auto rgba8_to_planar_f32_scalar(const uint8_t *src, float *const planes[4], size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t c = 0; c < 4; ++c) {
+            planes[c][i] = static_cast<float>(src[4 * i + c]) * inv_255;
+        }
+    }
+}
+
+inline auto deinterleave4_u8_scalar(const uint8_t *src, uint8_t *const planes[4], size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t c = 0; c < 4; ++c) planes[c][i] = src[4 * i + c];
+    }
+}
+
+inline auto interleave4_u8_scalar(const uint8_t *const planes[4], uint8_t *dst, size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t c = 0; c < 4; ++c) dst[4 * i + c] = planes[c][i];
+    }
+}
+
+inline auto u8_to_f32_scalar(const uint8_t *src, float *dst, size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) dst[i] = static_cast<float>(src[i]) * inv_255;
+}
+
+// Saturating, round-half-to-even; NaN maps to 0 exactly like maxps/minps do.
+inline auto f32_to_u8_scalar(const float *src, uint8_t *dst, size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) {
+        float v = src[i] * 255.0f;
+        v = v > 0.0f ? v : 0.0f;
+        v = v < 255.0f ? v : 255.0f;
+        dst[i] = static_cast<uint8_t>(std::lrintf(v));
+    }
+}
+
+#if CV_SIMD_X86
+// ---------------------------------------------------------------------------
+// SSE4.1
+// ---------------------------------------------------------------------------
+// Luma of 4 RGBA pixels as 4 dwords.
+CV_TARGET_SSE41 inline auto gray4_sse41(const uint8_t *p, __m128i weights) -> __m128i {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), weights);
+    const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), weights);
+    return _mm_srli_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), _mm_set1_epi32(1 << 14)), 15);
+}
+
+CV_TARGET_SSE41 inline auto rgba8_to_gray8_sse41(const uint8_t *src, uint8_t *dst, size_t n, LumaQ15 w) -> void {
+    const __m128i weights = _mm_setr_epi16(w.r, w.g, w.b, 0, w.r, w.g, w.b, 0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i a = _mm_packus_epi32(gray4_sse41(src + 4 * i, weights), gray4_sse41(src + 4 * i + 16, weights));
+        const __m128i b = _mm_packus_epi32(gray4_sse41(src + 4 * i + 32, weights), gray4_sse41(src + 4 * i + 48, weights));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(a, b));
+    }
+    rgba8_to_gray8_scalar(src + 4 * i, dst + i, n - i, w);
+}
+
+CV_TARGET_SSE41 inline auto rgba8_to_planar_f32_sse41(const uint8_t *src, float *const planes[4], size_t n) -> void {
+    const __m128i gather = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    const __m128 scale = _mm_set1_ps(inv_255);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i px = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4 * i)), gather);
+        _mm_storeu_ps(planes[0] + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(px)), scale));
+        _mm_storeu_ps(planes[1] + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(px, 4))), scale));
+        _mm_storeu_ps(planes[2] + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(px, 8))), scale));
+        _mm_storeu_ps(planes[3] + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(px, 12))), scale));
+    }
+    const std::array<float *, 4> rest = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    rgba8_to_planar_f32_scalar(src + 4 * i, rest.data(), n - i);
+}
+
+CV_TARGET_SSE41 inline auto deinterleave4_u8_sse41(const uint8_t *src, uint8_t *const planes[4], size_t n) -> void {
+    const __m128i gather = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(src + 4 * i);
+        const __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(p + 0), gather);
+        const __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(p + 1), gather);
+        const __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(p + 2), gather);
+        const __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(p + 3), gather);
+        const __m128i t0 = _mm_unpacklo_epi32(a, b);
+        const __m128i t1 = _mm_unpackhi_epi32(a, b);
+        const __m128i t2 = _mm_unpacklo_epi32(c, d);
+        const __m128i t3 = _mm_unpackhi_epi32(c, d);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(planes[0] + i), _mm_unpacklo_epi64(t0, t2));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(planes[1] + i), _mm_unpackhi_epi64(t0, t2));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(planes[2] + i), _mm_unpacklo_epi64(t1, t3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(planes[3] + i), _mm_unpackhi_epi64(t1, t3));
+    }
+    const std::array<uint8_t *, 4> rest = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    deinterleave4_u8_scalar(src + 4 * i, rest.data(), n - i);
+}
+
+CV_TARGET_SSE41 inline auto interleave4_u8_sse41(const uint8_t *const planes[4], uint8_t *dst, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes[0] + i));
+        const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes[1] + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes[2] + i));
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes[3] + i));
+        const __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+        const __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+        const __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+        const __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+        __m128i *out = reinterpret_cast<__m128i *>(dst + 4 * i);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+    }
+    const std::array<const uint8_t *, 4> rest = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    interleave4_u8_scalar(rest.data(), dst + 4 * i, n - i);
+}
+
+CV_TARGET_SSE41 inline auto u8_to_f32_sse41(const uint8_t *src, float *dst, size_t n) -> void {
+    const __m128 scale = _mm_set1_ps(inv_255);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_ps(dst + i + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(v)), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4))), scale));
+        _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 8))), scale));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 12))), scale));
+    }
+    u8_to_f32_scalar(src + i, dst + i, n - i);
+}
+
+// Scales 4 floats to [0, 255] and rounds them to dwords.
+CV_TARGET_SSE41 inline auto quantize4_sse41(const float *p) -> __m128i {
+    const __m128 v = _mm_mul_ps(_mm_loadu_ps(p), _mm_set1_ps(255.0f));
+    return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f)));
+}
+
+CV_TARGET_SSE41 inline auto f32_to_u8_sse41(const float *src, uint8_t *dst, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i a = _mm_packus_epi32(quantize4_sse41(src + i), quantize4_sse41(src + i + 4));
+        const __m128i b = _mm_packus_epi32(quantize4_sse41(src + i + 8), quantize4_sse41(src + i + 12));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(a, b));
+    }
+    f32_to_u8_scalar(src + i, dst + i, n - i);
+}
+
+// ---------------------------------------------------------------------------
+// AVX2 (in-lane shuffles followed by a cross-lane dword permute)
+// ---------------------------------------------------------------------------
+// Luma of 8 RGBA pixels as 8 dwords; hadd keeps pixel order within each lane.
+CV_TARGET_AVX2 inline auto gray8_avx2(const uint8_t *p, __m256i weights) -> __m256i {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero), weights);
+    const __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero), weights);
+    return _mm256_srli_epi32(_mm256_add_epi32(_mm256_hadd_epi32(lo, hi), _mm256_set1_epi32(1 << 14)), 15);
+}
+
+CV_TARGET_AVX2 inline auto rgba8_to_gray8_avx2(const uint8_t *src, uint8_t *dst, size_t n, LumaQ15 w) -> void {
+    const __m256i weights = _mm256_setr_epi16(
+        w.r, w.g, w.b, 0, w.r, w.g, w.b, 0, w.r, w.g, w.b, 0, w.r, w.g, w.b, 0);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i a = _mm256_packus_epi32(gray8_avx2(src + 4 * i, weights), gray8_avx2(src + 4 * i + 32, weights));
+        const __m256i b = _mm256_packus_epi32(gray8_avx2(src + 4 * i + 64, weights), gray8_avx2(src + 4 * i + 96, weights));
+        const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+    }
+    rgba8_to_gray8_sse41(src + 4 * i, dst + i, n - i, w);
+}
+
+CV_TARGET_AVX2 inline auto rgba8_to_planar_f32_avx2(const uint8_t *src, float *const planes[4], size_t n) -> void {
+    const __m256i gather = _mm256_setr_epi8(
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256 scale = _mm256_set1_ps(inv_255);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 4 * i));
+        const __m256i grouped = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(px, gather), order);
+        const __m128i rg = _mm256_castsi256_si128(grouped);
+        const __m128i ba = _mm256_extracti128_si256(grouped, 1);
+        _mm256_storeu_ps(planes[0] + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(rg)), scale));
+        _mm256_storeu_ps(planes[1] + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(rg, 8))), scale));
+        _mm256_storeu_ps(planes[2] + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(ba)), scale));
+        _mm256_storeu_ps(planes[3] + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(ba, 8))), scale));
+    }
+    const std::array<float *, 4> rest = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    rgba8_to_planar_f32_scalar(src + 4 * i, rest.data(), n - i);
+}
+
+CV_TARGET_AVX2 inline auto deinterleave4_u8_avx2(const uint8_t *src, uint8_t *const planes[4], size_t n) -> void {
+    const __m256i gather = _mm256_setr_epi8(
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i *p = reinterpret_cast<const __m256i *>(src + 4 * i);
+        const __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256(p + 0), gather);
+        const __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256(p + 1), gather);
+        const __m256i c = _mm256_shuffle_epi8(_mm256_loadu_si256(p + 2), gather);
+        const __m256i d = _mm256_shuffle_epi8(_mm256_loadu_si256(p + 3), gather);
+        const __m256i t0 = _mm256_unpacklo_epi32(a, b);
+        const __m256i t1 = _mm256_unpackhi_epi32(a, b);
+        const __m256i t2 = _mm256_unpacklo_epi32(c, d);
+        const __m256i t3 = _mm256_unpackhi_epi32(c, d);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(planes[0] + i), _mm256_permutevar8x32_epi32(_mm256_unpacklo_epi64(t0, t2), order));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(planes[1] + i), _mm256_permutevar8x32_epi32(_mm256_unpackhi_epi64(t0, t2), order));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(planes[2] + i), _mm256_permutevar8x32_epi32(_mm256_unpacklo_epi64(t1, t3), order));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(planes[3] + i), _mm256_permutevar8x32_epi32(_mm256_unpackhi_epi64(t1, t3), order));
+    }
+    const std::array<uint8_t *, 4> rest = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    deinterleave4_u8_sse41(src + 4 * i, rest.data(), n - i);
+}
+
+CV_TARGET_AVX2 inline auto interleave4_u8_avx2(const uint8_t *const planes[4], uint8_t *dst, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(planes[0] + i));
+        const __m256i g = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(planes[1] + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(planes[2] + i));
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(planes[3] + i));
+        const __m256i rg_lo = _mm256_unpacklo_epi8(r, g);
+        const __m256i rg_hi = _mm256_unpackhi_epi8(r, g);
+        const __m256i ba_lo = _mm256_unpacklo_epi8(b, a);
+        const __m256i ba_hi = _mm256_unpackhi_epi8(b, a);
+        const __m256i p0 = _mm256_unpacklo_epi16(rg_lo, ba_lo);
+        const __m256i p1 = _mm256_unpackhi_epi16(rg_lo, ba_lo);
+        const __m256i p2 = _mm256_unpacklo_epi16(rg_hi, ba_hi);
+        const __m256i p3 = _mm256_unpackhi_epi16(rg_hi, ba_hi);
+        __m256i *out = reinterpret_cast<__m256i *>(dst + 4 * i);
+        _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    const std::array<const uint8_t *, 4> rest = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    interleave4_u8_sse41(rest.data(), dst + 4 * i, n - i);
+}
+
+CV_TARGET_AVX2 inline auto u8_to_f32_avx2(const uint8_t *src, float *dst, size_t n) -> void {
+    const __m256 scale = _mm256_set1_ps(inv_255);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)), scale));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8))), scale));
+    }
+    u8_to_f32_scalar(src + i, dst + i, n - i);
+}
+
+CV_TARGET_AVX2 inline auto quantize8_avx2(const float *p) -> __m256i {
+    const __m256 v = _mm256_mul_ps(_mm256_loadu_ps(p), _mm256_set1_ps(255.0f));
+    return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(255.0f)));
+}
+
+CV_TARGET_AVX2 inline auto f32_to_u8_avx2(const float *src, uint8_t *dst, size_t n) -> void {
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i a = _mm256_packus_epi32(quantize8_avx2(src + i), quantize8_avx2(src + i + 8));
+        const __m256i b = _mm256_packus_epi32(quantize8_avx2(src + i + 16), quantize8_avx2(src + i + 24));
+        const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+    }
+    f32_to_u8_sse41(src + i, dst + i, n - i);
+}
+
+// ---------------------------------------------------------------------------
+// AVX-512 (F + BW + VL). Interleave/deinterleave are pure shuffles that are
+// already store-bound at AVX2 width, so that level reuses the AVX2 kernels.
+// ---------------------------------------------------------------------------
+// madd leaves (r*wr + g*wg, b*wb) per pixel, folding each qword gives the
+// unrounded luma of 8 pixels in order.
+CV_TARGET_AVX512 inline auto luma_sum8_avx512(const uint8_t *p, __m512i weights) -> __m256i {
+    const __m512i px = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+    const __m512i pairs = _mm512_madd_epi16(px, weights);
+    return _mm512_cvtepi64_epi32(_mm512_add_epi64(pairs, _mm512_srli_epi64(pairs, 32)));
+}
+
+CV_TARGET_AVX512 inline auto rgba8_to_gray8_avx512(const uint8_t *src, uint8_t *dst, size_t n, LumaQ15 w) -> void {
+    const __m512i weights = _mm512_set1_epi64(
+        static_cast<int64_t>(static_cast<uint16_t>(w.r)) |
+        static_cast<int64_t>(static_cast<uint16_t>(w.g)) << 16 |
+        static_cast<int64_t>(static_cast<uint16_t>(w.b)) << 32);
+    const __m512i round = _mm512_set1_epi32(1 << 14);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512i sums = _mm512_inserti64x4(
+            _mm512_castsi256_si512(luma_sum8_avx512(src + 4 * i, weights)), luma_sum8_avx512(src + 4 * i + 32, weights), 1);
+        const __m512i y = _mm512_srli_epi32(_mm512_add_epi32(sums, round), 15);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm512_cvtepi32_epi8(y));
+    }
+    rgba8_to_gray8_avx2(src + 4 * i, dst + i, n - i, w);
+}
+
+CV_TARGET_AVX512 inline auto rgba8_to_planar_f32_avx512(const uint8_t *src, float *const planes[4], size_t n) -> void {
+    const __m512i gather = _mm512_broadcast_i32x4(
+        _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15));
+    const __m512i order = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    const __m512 scale = _mm512_set1_ps(inv_255);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512i px = _mm512_loadu_si512(src + 4 * i);
+        const __m512i grouped = _mm512_permutexvar_epi32(order, _mm512_shuffle_epi8(px, gather));
+        _mm512_storeu_ps(planes[0] + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(grouped, 0))), scale));
+        _mm512_storeu_ps(planes[1] + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(grouped, 1))), scale));
+        _mm512_storeu_ps(planes[2] + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(grouped, 2))), scale));
+        _mm512_storeu_ps(planes[3] + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(grouped, 3))), scale));
+    }
+    const std::array<float *, 4> rest = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    rgba8_to_planar_f32_avx2(src + 4 * i, rest.data(), n - i);
+}
+
+CV_TARGET_AVX512 inline auto u8_to_f32_avx512(const uint8_t *src, float *dst, size_t n) -> void {
+    const __m512 scale = _mm512_set1_ps(inv_255);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(v)), scale));
+    }
+    u8_to_f32_avx2(src + i, dst + i, n - i);
+}
+
+CV_TARGET_AVX512 inline auto f32_to_u8_avx512(const float *src, uint8_t *dst, size_t n) -> void {
+    const __m512 scale = _mm512_set1_ps(255.0f);
+    const __m512 lo = _mm512_setzero_ps();
+    const __m512 hi = _mm512_set1_ps(255.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(src + i), scale), lo), hi);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm512_cvtepi32_epi8(_mm512_cvtps_epi32(v)));
+    }
+    f32_to_u8_avx2(src + i, dst + i, n - i);
+}
+#endif
+
+struct Kernels {
+    void (*rgba8_to_gray8)(const uint8_t *, uint8_t *, size_t, LumaQ15);
+    void (*rgba8_to_planar_f32)(const uint8_t *, float *const[4], size_t);
+    void (*deinterleave4_u8)(const uint8_t *, uint8_t *const[4], size_t);
+    void (*interleave4_u8)(const uint8_t *const[4], uint8_t *, size_t);
+    void (*u8_to_f32)(const uint8_t *, float *, size_t);
+    void (*f32_to_u8)(const float *, uint8_t *, size_t);
+};
+
+inline constexpr Kernels scalar_kernels = {
+    rgba8_to_gray8_scalar, rgba8_to_planar_f32_scalar, deinterleave4_u8_scalar,
+    interleave4_u8_scalar, u8_to_f32_scalar, f32_to_u8_scalar};
+
+// Kernel table per Simd::Level, indexed by the level's integer value.
+[[nodiscard]] inline auto kernels() -> const Kernels & {
+#if CV_SIMD_X86
+    static constexpr std::array<Kernels, Simd::level_count> table = {{
+        scalar_kernels,
+        {rgba8_to_gray8_sse41, rgba8_to_planar_f32_sse41, deinterleave4_u8_sse41,
+            interleave4_u8_sse41, u8_to_f32_sse41, f32_to_u8_sse41},
+        {rgba8_to_gray8_avx2, rgba8_to_planar_f32_avx2, deinterleave4_u8_avx2,
+            interleave4_u8_avx2, u8_to_f32_avx2, f32_to_u8_avx2},
+        {rgba8_to_gray8_avx512, rgba8_to_planar_f32_avx512, deinterleave4_u8_avx2,
+            interleave4_u8_avx2, u8_to_f32_avx512, f32_to_u8_avx512},
+    }};
+    return table[static_cast<size_t>(Simd::active_level())];
+#else
+    return scalar_kernels;
+#endif
+}
+} // namespace Convert
+
+// ---------------------------------------------------------------------------
+// Image-level entry points
+// ---------------------------------------------------------------------------
+inline auto check_same_size(int w0, int h0, int w1, int h1, const char *what) -> void {
+    if (w0 != w1 || h0 != h1) {
+        PANIC(std::format("{}: size mismatch ({}x{} vs {}x{})", what, w0, h0, w1, h1));
+    }
+}
+
+inline auto rgba_to_gray(ImageView<const uint8_t, 4> src, ImageView<uint8_t, 1> dst,
+    GrayWeights weights = GrayWeights::BT601) -> void {
+    check_same_size(src.width, src.height, dst.width, dst.height, "rgba_to_gray");
+    const Convert::Kernels &k = Convert::kernels();
+    const Convert::LumaQ15 w = Convert::luma_weights(weights);
+    for (int y = 0; y < src.height; ++y) {
+        k.rgba8_to_gray8(src.row(y), dst.row(y), static_cast<size_t>(src.width), w);
+    }
+}
+
+[[nodiscard]] inline auto rgba_to_gray(ImageView<const uint8_t, 4> src,
+    GrayWeights weights = GrayWeights::BT601) -> ImageGray8 {
+    ImageGray8 out(src.width, src.height);
+    rgba_to_gray(src, out.view(), weights);
+    return out;
+}
+
+inline auto rgba_to_planar(ImageView<const uint8_t, 4> src, PlanarImage<float, 4> &dst) -> void {
+    check_same_size(src.width, src.height, dst.width(), dst.height(), "rgba_to_planar");
+    const Convert::Kernels &k = Convert::kernels();
+    for (int y = 0; y < src.height; ++y) {
+        const std::array<float *, 4> rows = {
+            dst.plane(0).row(y), dst.plane(1).row(y), dst.plane(2).row(y), dst.plane(3).row(y)};
+        k.rgba8_to_planar_f32(src.row(y), rows.data(), static_cast<size_t>(src.width));
+    }
+}
+
+[[nodiscard]] inline auto rgba_to_planar(ImageView<const uint8_t, 4> src) -> PlanarImage<float, 4> {
+    PlanarImage<float, 4> out(src.width, src.height);
+    rgba_to_planar(src, out);
+    return out;
+}
+
+inline auto deinterleave(ImageView<const uint8_t, 4> src, PlanarImage<uint8_t, 4> &dst) -> void {
+    check_same_size(src.width, src.height, dst.width(), dst.height(), "deinterleave");
+    const Convert::Kernels &k = Convert::kernels();
+    for (int y = 0; y < src.height; ++y) {
+        const std::array<uint8_t *, 4> rows = {
+            dst.plane(0).row(y), dst.plane(1).row(y), dst.plane(2).row(y), dst.plane(3).row(y)};
+        k.deinterleave4_u8(src.row(y), rows.data(), static_cast<size_t>(src.width));
+    }
+}
+
+inline auto interleave(const PlanarImage<uint8_t, 4> &src, ImageView<uint8_t, 4> dst) -> void {
+    check_same_size(src.width(), src.height(), dst.width, dst.height, "interleave");
+    const Convert::Kernels &k = Convert::kernels();
+    for (int y = 0; y < dst.height; ++y) {
+        const std::array<const uint8_t *, 4> rows = {
+            src.plane(0).row(y), src.plane(1).row(y), src.plane(2).row(y), src.plane(3).row(y)};
+        k.interleave4_u8(rows.data(), dst.row(y), static_cast<size_t>(dst.width));
+    }
+}
+
+// u8 [0, 255] -> f32 [0, 1], any channel count.
+template <int C>
+inline auto normalize(ImageView<const uint8_t, C> src, ImageView<float, C> dst) -> void {
+    check_same_size(src.width, src.height, dst.width, dst.height, "normalize");
+    const Convert::Kernels &k = Convert::kernels();
+    for (int y = 0; y < src.height; ++y) k.u8_to_f32(src.row(y), dst.row(y), src.row_elements());
+}
+
+// f32 [0, 1] -> u8 [0, 255], saturating and rounding to nearest even.
+template <int C>
+inline auto denormalize(ImageView<const float, C> src, ImageView<uint8_t, C> dst) -> void {
+    check_same_size(src.width, src.height, dst.width, dst.height, "denormalize");
+    const Convert::Kernels &k = Convert::kernels();
+    for (int y = 0; y < src.height; ++y) k.f32_to_u8(src.row(y), dst.row(y), src.row_elements());
+}
+} // namespace CV
@@ -0,0 +1,464 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "image.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+
+// Convolution engine for single-channel u8 / f32 images.
+//
+// Work is split into horizontal strips, one per task. Inside a strip the source
+// rows are prepared (converted to float, border padded and, for separable
+// kernels, horizontally filtered) into a small ring of row buffers, and each
+// output row is produced from that ring. The intermediate image therefore never
+// exists in full; only kernel-height rows per worker are live at a time.
+namespace CV {
+enum class BorderMode {
+    Clamp,   // aaa|abcd|ddd
+    Reflect, // cb|abcd|cb (edge pixel not repeated)
+    Constant // vv|abcd|vv
+};
+
+struct Border {
+    BorderMode mode = BorderMode::Reflect;
+    float value = 0.0f;
+};
+
+// Maps an out-of-range coordinate into [0, n) or returns -1 for Constant.
+[[nodiscard]] inline auto border_index(int i, int n, BorderMode mode) -> int {
+    if (i >= 0 && i < n) return i;
+    switch (mode) {
+    case BorderMode::Clamp:
+        return i < 0 ? 0 : n - 1;
+    case BorderMode::Reflect: {
+        if (n == 1) return 0;
+        const int period = 2 * n - 2;
+        i %= period;
+        if (i < 0) i += period;
+        return i < n ? i : period - i;
+    }
+    case BorderMode::Constant:
+        return -1;
+    }
+    return -1;
+}
+
+// Odd-length 1-D kernel, centered on its middle tap.
+struct Kernel1D {
+    std::vector<float> taps;
+
+    [[nodiscard]] auto size() const -> int { return static_cast<int>(taps.size()); }
+    [[nodiscard]] auto radius() const -> int { return size() / 2; }
+    [[nodiscard]] auto sum() const -> float {
+        float s = 0.0f;
+        for (float t : taps) s += t;
+        return s;
+    }
+};
+
+// Odd-sized dense 2-D kernel, row-major, centered.
+struct Kernel2D {
+    int width = 0;
+    int height = 0;
+    std::vector<float> taps;
+};
+
+struct SeparableKernel {
+    Kernel1D x;
+    Kernel1D y;
+};
+
+// Radius 0 picks ceil(3 * sigma), which keeps > 99.7% of the mass.
+[[nodiscard]] inline auto gaussian_kernel(float sigma, int radius = 0) -> Kernel1D {
+    if (sigma <= 0.0f) PANIC(std::format("gaussian_kernel: sigma must be positive, got {}", sigma));
+    if (radius <= 0) radius = std::max(1, static_cast<int>(std::ceil(3.0f * sigma)));
+    Kernel1D k;
+    k.taps.resize(static_cast<size_t>(2 * radius + 1));
+    const float inv_two_sigma_sq = 1.0f / (2.0f * sigma * sigma);
+    float total = 0.0f;
+    for (int i = -radius; i <= radius; ++i) {
+        const float v = std::exp(-static_cast<float>(i * i) * inv_two_sigma_sq);
+        k.taps[static_cast<size_t>(i + radius)] = v;
+        total += v;
+    }
+    for (float &t : k.taps) t /= total;
+    return k;
+}
+
+[[nodiscard]] inline auto box_kernel(int radius) -> Kernel1D {
+    const int size = 2 * std::max(0, radius) + 1;
+    return Kernel1D{std::vector<float>(static_cast<size_t>(size), 1.0f / static_cast<float>(size))};
+}
+
+[[nodiscard]] inline auto sobel_x() -> SeparableKernel {
+    return {Kernel1D{{-1.0f, 0.0f, 1.0f}}, Kernel1D{{1.0f, 2.0f, 1.0f}}};
+}
+
+[[nodiscard]] inline auto sobel_y() -> SeparableKernel {
+    return {Kernel1D{{1.0f, 2.0f, 1.0f}}, Kernel1D{{-1.0f, 0.0f, 1.0f}}};
+}
+
+namespace Filter {
+// dst[x] = sum_k taps[k] * rows[k][x]. Both passes of a separable filter and
+// the dense 2-D filter reduce to this with suitably offset row pointers.
+inline auto weighted_sum_scalar(const float *const *rows, const float *taps, int ntaps, float *dst, size_t n) -> void {
+    for (size_t x = 0; x < n; ++x) dst[x] = taps[0] * rows[0][x];
+    for (int k = 1; k < ntaps; ++k) {
+        const float t = taps[k];
+        const float *row = rows[k];
+        for (size_t x = 0; x < n; ++x) dst[x] += t * row[x];
+    }
+}
+
+#if CV_SIMD_X86
+CV_TARGET_SSE41 inline auto weighted_sum_sse41(const float *const *rows, const float *taps, int ntaps, float *dst, size_t n) -> void {
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+        for (int k = 0; k < ntaps; ++k) {
+            const __m128 t = _mm_set1_ps(taps[k]);
+            const float *r = rows[k] + x;
+            a0 = _mm_add_ps(a0, _mm_mul_ps(t, _mm_loadu_ps(r)));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(t, _mm_loadu_ps(r + 4)));
+            a2 = _mm_add_ps(a2, _mm_mul_ps(t, _mm_loadu_ps(r + 8)));
+            a3 = _mm_add_ps(a3, _mm_mul_ps(t, _mm_loadu_ps(r + 12)));
+        }
+        _mm_storeu_ps(dst + x, a0);
+        _mm_storeu_ps(dst + x + 4, a1);
+        _mm_storeu_ps(dst + x + 8, a2);
+        _mm_storeu_ps(dst + x + 12, a3);
+    }
+    for (; x < n; ++x) {
+        float acc = 0.0f;
+        for (int k = 0; k < ntaps; ++k) acc += taps[k] * rows[k][x];
+        dst[x] = acc;
+    }
+}
+
+CV_TARGET_AVX2 inline auto weighted_sum_avx2(const float *const *rows, const float *taps, int ntaps, float *dst, size_t n) -> void {
+    size_t x = 0;
+    for (; x + 32 <= n; x += 32) {
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        for (int k = 0; k < ntaps; ++k) {
+            const __m256 t = _mm256_set1_ps(taps[k]);
+            const float *r = rows[k] + x;
+            a0 = _mm256_fmadd_ps(t, _mm256_loadu_ps(r), a0);
+            a1 = _mm256_fmadd_ps(t, _mm256_loadu_ps(r + 8), a1);
+            a2 = _mm256_fmadd_ps(t, _mm256_loadu_ps(r + 16), a2);
+            a3 = _mm256_fmadd_ps(t, _mm256_loadu_ps(r + 24), a3);
+        }
+        _mm256_storeu_ps(dst + x, a0);
+        _mm256_storeu_ps(dst + x + 8, a1);
+        _mm256_storeu_ps(dst + x + 16, a2);
+        _mm256_storeu_ps(dst + x + 24, a3);
+    }
+    for (; x + 8 <= n; x += 8) {
+        __m256 a = _mm256_setzero_ps();
+        for (int k = 0; k < ntaps; ++k) a = _mm256_fmadd_ps(_mm256_set1_ps(taps[k]), _mm256_loadu_ps(rows[k] + x), a);
+        _mm256_storeu_ps(dst + x, a);
+    }
+    for (; x < n; ++x) {
+        float acc = 0.0f;
+        for (int k = 0; k < ntaps; ++k) acc += taps[k] * rows[k][x];
+        dst[x] = acc;
+    }
+}
+
+CV_TARGET_AVX512 inline auto weighted_sum_avx512(const float *const *rows, const float *taps, int ntaps, float *dst, size_t n) -> void {
+    size_t x = 0;
+    for (; x + 64 <= n; x += 64) {
+        __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps(), a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+        for (int k = 0; k < ntaps; ++k) {
+            const __m512 t = _mm512_set1_ps(taps[k]);
+            const float *r = rows[k] + x;
+            a0 = _mm512_fmadd_ps(t, _mm512_loadu_ps(r), a0);
+            a1 = _mm512_fmadd_ps(t, _mm512_loadu_ps(r + 16), a1);
+            a2 = _mm512_fmadd_ps(t, _mm512_loadu_ps(r + 32), a2);
+            a3 = _mm512_fmadd_ps(t, _mm512_loadu_ps(r + 48), a3);
+        }
+        _mm512_storeu_ps(dst + x, a0);
+        _mm512_storeu_ps(dst + x + 16, a1);
+        _mm512_storeu_ps(dst + x + 32, a2);
+        _mm512_storeu_ps(dst + x + 48, a3);
+    }
+    for (; x + 16 <= n; x += 16) {
+        __m512 a = _mm512_setzero_ps();
+        for (int k = 0; k < ntaps; ++k) a = _mm512_fmadd_ps(_mm512_set1_ps(taps[k]), _mm512_loadu_ps(rows[k] + x), a);
+        _mm512_storeu_ps(dst + x, a);
+    }
+    for (; x < n; ++x) {
+        float acc = 0.0f;
+        for (int k = 0; k < ntaps; ++k) acc += taps[k] * rows[k][x];
+        dst[x] = acc;
+    }
+}
+#endif
+
+// Raw (unscaled) u8 <-> f32 row conversion for u8 sources and destinations.
+inline auto widen_u8_scalar(const uint8_t *src, float *dst, size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) dst[i] = static_cast<float>(src[i]);
+}
+
+inline auto narrow_u8_scalar(const float *src, uint8_t *dst, size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) {
+        float v = src[i] > 0.0f ? src[i] : 0.0f;
+        v = v < 255.0f ? v : 255.0f;
+        dst[i] = static_cast<uint8_t>(std::lrintf(v));
+    }
+}
+
+#if CV_SIMD_X86
+CV_TARGET_AVX2 inline auto widen_u8_avx2(const uint8_t *src, float *dst, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)));
+        _mm256_storeu_ps(dst + i + 8, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8))));
+    }
+    widen_u8_scalar(src + i, dst + i, n - i);
+}
+
+CV_TARGET_AVX2 inline auto narrow_u8_avx2(const float *src, uint8_t *dst, size_t n) -> void {
+    const __m256 lo = _mm256_setzero_ps();
+    const __m256 hi = _mm256_set1_ps(255.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i a = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo), hi));
+        const __m256i b = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8), lo), hi));
+        // packs interleave lanes: words are [a0-3 b0-3 | a4-7 b4-7]
+        const __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+        const __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), bytes);
+    }
+    narrow_u8_scalar(src + i, dst + i, n - i);
+}
+#endif
+
+inline auto widen_u8(const uint8_t *src, float *dst, size_t n) -> void {
+#if CV_SIMD_X86
+    if (Simd::active_level() >= Simd::Level::AVX2) return widen_u8_avx2(src, dst, n);
+#endif
+    widen_u8_scalar(src, dst, n);
+}
+
+inline auto narrow_u8(const float *src, uint8_t *dst, size_t n) -> void {
+#if CV_SIMD_X86
+    if (Simd::active_level() >= Simd::Level::AVX2) return narrow_u8_avx2(src, dst, n);
+#endif
+    narrow_u8_scalar(src, dst, n);
+}
+
+using WeightedSumFn = void (*)(const float *const *, const float *, int, float *, size_t);
+
+[[nodiscard]] inline auto weighted_sum_kernel() -> WeightedSumFn {
+#if CV_SIMD_X86
+    switch (Simd::active_level()) {
+    case Simd::Level::AVX512: return weighted_sum_avx512;
+    case Simd::Level::AVX2: return weighted_sum_avx2;
+    case Simd::Level::SSE41: return weighted_sum_sse41;
+    case Simd::Level::Scalar: break;
+    }
+#endif
+    return weighted_sum_scalar;
+}
+} // namespace Filter
+
+namespace detail {
+template <typename T>
+inline auto load_row_f32(const T *src, float *dst, int n) -> void {
+    if constexpr (std::is_same_v<T, float>) {
+        std::copy(src, src + n, dst);
+    } else {
+        Filter::widen_u8(src, dst, static_cast<size_t>(n));
+    }
+}
+
+template <typename T>
+inline auto store_row(const float *src, T *dst, int n) -> void {
+    if constexpr (std::is_same_v<T, float>) {
+        std::copy(src, src + n, dst);
+    } else {
+        Filter::narrow_u8(src, dst, static_cast<size_t>(n));
+    }
+}
+
+// Copies row `y` of src into `pad` as floats with `rx` border pixels on each side.
+template <typename T>
+inline auto load_padded_row(ImageView<const T, 1> src, int y, int rx, Border border, float *pad) -> void {
+    const int w = src.width;
+    if (y < 0) {
+        std::fill(pad, pad + w + 2 * rx, border.value);
+        return;
+    }
+    const T *row = src.row(y);
+    load_row_f32(row, pad + rx, w);
+    for (int i = 1; i <= rx; ++i) {
+        const int l = border_index(-i, w, border.mode);
+        const int r = border_index(w - 1 + i, w, border.mode);
+        pad[rx - i] = l < 0 ? border.value : static_cast<float>(row[l]);
+        pad[rx + w - 1 + i] = r < 0 ? border.value : static_cast<float>(row[r]);
+    }
+}
+
+// Ring of prepared rows tagged with the source row they hold. For centered,
+// odd-height kernels all source rows needed by one output row (after border
+// mapping) lie within `rows` consecutive rows, so their slots never collide.
+// One extra slot holds the constant border row. Storage comes from the
+// caller's arena scope.
+struct RowRing {
+    std::span<float> storage;
+    std::span<int> tags;
+    size_t row_len = 0;
+
+    RowRing(ArenaScope &scope, int rows, size_t len)
+        : storage(scope.array<float>(static_cast<size_t>(rows + 1) * len)),
+          tags(scope.array<int>(static_cast<size_t>(rows + 1), -2)),
+          row_len(len) {}
+
+    // Returns the buffer for source row `src_row` (-1 means "constant border
+    // row"), calling prepare(src_row, buffer) if it is not cached yet.
+    template <typename Prepare>
+    auto get(int src_row, Prepare &&prepare) -> const float * {
+        const size_t n = tags.size() - 1;
+        const size_t slot = src_row < 0 ? n : static_cast<size_t>(src_row) % n;
+        float *buf = storage.data() + slot * row_len;
+        if (tags[slot] != src_row) {
+            prepare(src_row, buf);
+            tags[slot] = src_row;
+        }
+        return buf;
+    }
+};
+
+// Rows per parallel strip: enough to amortize the ring warm-up of `kh` rows.
+[[nodiscard]] inline auto strip_grain(int kh) -> int {
+    return std::max(16, 4 * kh);
+}
+} // namespace detail
+
+// Separable convolution, src and dst must have the same size. S may be const.
+template <typename S, typename D>
+inline auto convolve_separable(ImageView<S, 1> src_view, ImageView<D, 1> dst,
+    const Kernel1D &kx, const Kernel1D &ky, Border border = {}) -> void {
+    using T = std::remove_const_t<S>;
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, float>, "convolve: u8 or f32 source");
+    static_assert(std::is_same_v<D, uint8_t> || std::is_same_v<D, float>, "convolve: u8 or f32 destination");
+    const ImageView<const T, 1> src = src_view;
+    if (src.width != dst.width || src.height != dst.height) PANIC("convolve_separable: size mismatch");
+    if (kx.size() % 2 == 0 || ky.size() % 2 == 0) PANIC("convolve_separable: kernel sizes must be odd");
+    if (src.empty()) return;
+
+    const int w = src.width;
+    const int h = src.height;
+    const int rx = kx.radius();
+    const int ry = ky.radius();
+    const Filter::WeightedSumFn weighted_sum = Filter::weighted_sum_kernel();
+    parallel_for(0, h, detail::strip_grain(ky.size()), [&](int y_begin, int y_end) {
+        ArenaScope scope;
+        detail::RowRing ring(scope, ky.size(), static_cast<size_t>(w));
+        const std::span<float> pad = scope.array<float>(static_cast<size_t>(w + 2 * rx));
+        const std::span<float> out = scope.array<float>(std::is_same_v<D, float> ? 0 : static_cast<size_t>(w));
+        const std::span<const float *> hrows = scope.array<const float *>(static_cast<size_t>(kx.size()));
+        const std::span<const float *> vrows = scope.array<const float *>(static_cast<size_t>(ky.size()));
+        for (int k = 0; k < kx.size(); ++k) hrows[static_cast<size_t>(k)] = pad.data() + k;
+
+        auto prepare = [&](int row, float *buf) {
+            detail::load_padded_row(src, row, rx, border, pad.data());
+            weighted_sum(hrows.data(), kx.taps.data(), kx.size(), buf, static_cast<size_t>(w));
+        };
+
+        for (int y = y_begin; y < y_end; ++y) {
+            for (int k = 0; k < ky.size(); ++k) {
+                const int row = border_index(y - ry + k, h, border.mode);
+                vrows[static_cast<size_t>(k)] = ring.get(row, prepare);
+            }
+            float *target = nullptr;
+            if constexpr (std::is_same_v<D, float>) {
+                target = dst.row(y);
+            } else {
+                target = out.data();
+            }
+            weighted_sum(vrows.data(), ky.taps.data(), ky.size(), target, static_cast<size_t>(w));
+            if constexpr (!std::is_same_v<D, float>) detail::store_row(target, dst.row(y), w);
+        }
+    });
+}
+
+template <typename S, typename D>
+inline auto convolve_separable(ImageView<S, 1> src, ImageView<D, 1> dst,
+    const SeparableKernel &kernel, Border border = {}) -> void {
+    convolve_separable(src, dst, kernel.x, kernel.y, border);
+}
+
+// Dense 2-D convolution for small non-separable kernels.
+template <typename S, typename D>
+inline auto convolve_2d(ImageView<S, 1> src_view, ImageView<D, 1> dst,
+    const Kernel2D &kernel, Border border = {}) -> void {
+    using T = std::remove_const_t<S>;
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, float>, "convolve: u8 or f32 source");
+    static_assert(std::is_same_v<D, uint8_t> || std::is_same_v<D, float>, "convolve: u8 or f32 destination");
+    const ImageView<const T, 1> src = src_view;
+    if (src.width != dst.width || src.height != dst.height) PANIC("convolve_2d: size mismatch");
+    if (kernel.width % 2 == 0 || kernel.height % 2 == 0 ||
+        kernel.taps.size() != static_cast<size_t>(kernel.width * kernel.height)) {
+        PANIC("convolve_2d: kernel must be odd-sized with width * height taps");
+    }
+    if (src.empty()) return;
+
+    const int w = src.width;
+    const int h = src.height;
+    const int rx = kernel.width / 2;
+    const int ry = kernel.height / 2;
+    const Filter::WeightedSumFn weighted_sum = Filter::weighted_sum_kernel();
+    const size_t pad_len = static_cast<size_t>(w + 2 * rx);
+
+    parallel_for(0, h, detail::strip_grain(kernel.height), [&](int y_begin, int y_end) {
+        ArenaScope scope;
+        detail::RowRing ring(scope, kernel.height, pad_len);
+        const std::span<float> out = scope.array<float>(std::is_same_v<D, float> ? 0 : static_cast<size_t>(w));
+        const std::span<const float *> rows = scope.array<const float *>(kernel.taps.size());
+
+        auto prepare = [&](int row, float *buf) {
+            detail::load_padded_row(src, row, rx, border, buf);
+        };
+
+        for (int y = y_begin; y < y_end; ++y) {
+            for (int ky = 0; ky < kernel.height; ++ky) {
+                const float *padded = ring.get(border_index(y - ry + ky, h, border.mode), prepare);
+                for (int kx = 0; kx < kernel.width; ++kx) {
+                    rows[static_cast<size_t>(ky * kernel.width + kx)] = padded + kx;
+                }
+            }
+            float *target = nullptr;
+            if constexpr (std::is_same_v<D, float>) {
+                target = dst.row(y);
+            } else {
+                target = out.data();
+            }
+            weighted_sum(rows.data(), kernel.taps.data(), static_cast<int>(rows.size()), target, static_cast<size_t>(w));
+            if constexpr (!std::is_same_v<D, float>) detail::store_row(target, dst.row(y), w);
+        }
+    });
+}
+
+template <typename S, typename D>
+inline auto gaussian_blur(ImageView<S, 1> src, ImageView<D, 1> dst, float sigma, Border border = {}) -> void {
+    const Kernel1D k = gaussian_kernel(sigma);
+    convolve_separable(src, dst, k, k, border);
+}
+
+template <typename S, typename D>
+inline auto box_blur(ImageView<S, 1> src, ImageView<D, 1> dst, int radius, Border border = {}) -> void {
+    const Kernel1D k = box_kernel(radius);
+    convolve_separable(src, dst, k, k, border);
+}
+} // namespace CV
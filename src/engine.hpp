@@ -12,7 +12,7 @@
 
 [[nodiscard]] inline auto engine_setup() -> bool {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0) {
-        LOG_ERR(std::string("SDL_Init failed: ") + SDL_GetError());
+        LOG_ERR("SDL_Init failed: {}", SDL_GetError());
         return false;
     }
 
@@ -27,14 +27,14 @@
         Constants::window_width, Constants::window_height,
         SDL_WINDOW_OPENGL);
     if (!global.renderer.window) {
-        LOG_ERR(std::string("SDL_CreateWindow failed: ") + SDL_GetError());
+        LOG_ERR("SDL_CreateWindow failed: {}", SDL_GetError());
         SDL_Quit();
         return false;
     }
 
     global.renderer.gl_context = SDL_GL_CreateContext(global.renderer.window);
     if (!global.renderer.gl_context) {
-        LOG_ERR(std::string("SDL_GL_CreateContext failed: ") + SDL_GetError());
+        LOG_ERR("SDL_GL_CreateContext failed: {}", SDL_GetError());
         SDL_DestroyWindow(global.renderer.window);
         SDL_Quit();
         return false;
@@ -88,6 +88,8 @@
 
 inline auto engine_cleanup() -> void {
     LOG_INFO("Cleaning up engine resources");
+    global.renderer.overlay.destroy();
+    global.renderer.image_view.destroy();
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
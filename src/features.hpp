@@ -0,0 +1,429 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "convert.hpp"
+#include "image.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "types.hpp"
+
+// Corner detection: FAST-9 / FAST-12 segment tests with optional Harris or
+// Shi-Tomasi scoring.
+//
+// The image is cut into tiles that are processed independently by the worker
+// threads. Each tile runs the vectorized ring test over its rows, scores the
+// candidates, applies 3x3 non-maximum suppression and writes survivors into its
+// own buffer; buffers are merged in tile order so the output is deterministic.
+namespace CV {
+// Struct-of-arrays keypoint storage. Coordinates are in pixels of the octave-0
+// image; angle is in degrees, or -1 while no orientation has been assigned.
+struct Keypoints {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> score;
+    std::vector<int32_t> octave;
+    std::vector<float> angle;
+
+    [[nodiscard]] auto size() const -> size_t { return x.size(); }
+    [[nodiscard]] auto empty() const -> bool { return x.empty(); }
+
+    auto clear() -> void {
+        x.clear();
+        y.clear();
+        score.clear();
+        octave.clear();
+        angle.clear();
+    }
+
+    auto reserve(size_t n) -> void {
+        x.reserve(n);
+        y.reserve(n);
+        score.reserve(n);
+        octave.reserve(n);
+        angle.reserve(n);
+    }
+
+    auto push_back(float px, float py, float s, int32_t oct = 0, float a = -1.0f) -> void {
+        x.push_back(px);
+        y.push_back(py);
+        score.push_back(s);
+        octave.push_back(oct);
+        angle.push_back(a);
+    }
+
+    auto append(const Keypoints &other) -> void {
+        x.insert(x.end(), other.x.begin(), other.x.end());
+        y.insert(y.end(), other.y.begin(), other.y.end());
+        score.insert(score.end(), other.score.begin(), other.score.end());
+        octave.insert(octave.end(), other.octave.begin(), other.octave.end());
+        angle.insert(angle.end(), other.angle.begin(), other.angle.end());
+    }
+
+    [[nodiscard]] auto position(size_t i) const -> Position { return Position{x[i], y[i]}; }
+};
+
+[[nodiscard]] inline auto to_positions(const Keypoints &kp) -> std::vector<Position> {
+    std::vector<Position> out(kp.size());
+    for (size_t i = 0; i < kp.size(); ++i) out[i] = kp.position(i);
+    return out;
+}
+
+// Gathers the keypoints at `indices` (in that order) into a new set.
+[[nodiscard]] inline auto select(const Keypoints &kp, std::span<const uint32_t> indices) -> Keypoints {
+    Keypoints out;
+    out.reserve(indices.size());
+    for (const uint32_t i : indices) out.push_back(kp.x[i], kp.y[i], kp.score[i], kp.octave[i], kp.angle[i]);
+    return out;
+}
+
+enum class FastType {
+    Fast9,
+    Fast12
+};
+
+enum class CornerScore {
+    Fast,      // largest contiguous-arc contrast
+    Harris,    // det(M) - k * trace(M)^2
+    ShiTomasi, // smaller eigenvalue of M
+};
+
+struct CornerParams {
+    int threshold = 20; // intensity difference, clamped to [0, 127]
+    FastType type = FastType::Fast9;
+    CornerScore score = CornerScore::Fast;
+    bool nonmax = true;
+    int block_size = 7; // structure tensor window for Harris / Shi-Tomasi
+    float harris_k = 0.04f;
+    int cell_size = 32;     // grid NMS cell in pixels of the input image, 0 disables
+    int max_per_cell = 8;   // strongest keypoints kept per cell
+    int octave = 0;         // stored with each keypoint; coordinates are scaled by 2^octave
+    int tile_size = 64;
+};
+
+namespace Features {
+// Bresenham circle of radius 3, clockwise from 12 o'clock.
+inline constexpr std::array<std::array<int, 2>, 16> fast_ring = {{
+    {0, -3}, {1, -3}, {2, -2}, {3, -1}, {3, 0}, {3, 1}, {2, 2}, {1, 3},
+    {0, 3}, {-1, 3}, {-2, 2}, {-3, 1}, {-3, 0}, {-3, -1}, {-2, -2}, {-1, -3},
+}};
+
+[[nodiscard]] inline auto ring_offsets(ptrdiff_t stride) -> std::array<ptrdiff_t, 16> {
+    std::array<ptrdiff_t, 16> off{};
+    for (size_t k = 0; k < 16; ++k) off[k] = fast_ring[k][1] * stride + fast_ring[k][0];
+    return off;
+}
+
+// Marks out[i] = 1 where p[i] passes the segment test, i.e. at least `arc`
+// contiguous ring pixels are all brighter than p + t or all darker than p - t.
+inline auto fast_mask_scalar(const uint8_t *p, const ptrdiff_t *off, int n, int t, int arc, uint8_t *out) -> void {
+    for (int i = 0; i < n; ++i) {
+        const int v = p[i];
+        int run_b = 0, run_d = 0, best = 0;
+        for (int k = 0; k < 16 + arc - 1; ++k) {
+            const int r = p[i + off[k & 15]];
+            run_b = r > v + t ? run_b + 1 : 0;
+            run_d = r < v - t ? run_d + 1 : 0;
+            best = std::max(best, std::max(run_b, run_d));
+        }
+        out[i] = best >= arc ? 1 : 0;
+    }
+}
+
+#if CV_SIMD_X86
+// Comparisons run in the signed domain (x ^ 0x80); the saturating add / sub of
+// the threshold then correctly yields "nothing can be brighter / darker" near
+// the ends of the range. Runs are counted per byte lane: c = (c + 1) & mask.
+CV_TARGET_SSE41 inline auto fast_mask_sse41(const uint8_t *p, const ptrdiff_t *off, int n, int t, int arc, uint8_t *out) -> void {
+    const __m128i sign = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128i tv = _mm_set1_epi8(static_cast<char>(t));
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(arc - 1));
+    const __m128i one = _mm_set1_epi8(1);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i)), sign);
+        const __m128i hi = _mm_adds_epi8(v, tv);
+        const __m128i lo = _mm_subs_epi8(v, tv);
+        __m128i bright[16], dark[16];
+        __m128i any = _mm_setzero_si128();
+        for (size_t k = 0; k < 16; k += 4) {
+            const __m128i r = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + off[k])), sign);
+            bright[k] = _mm_cmpgt_epi8(r, hi);
+            dark[k] = _mm_cmpgt_epi8(lo, r);
+            any = _mm_or_si128(any, _mm_or_si128(bright[k], dark[k]));
+        }
+        // Any arc of 9 or more contains at least two of the compass pixels.
+        if (_mm_movemask_epi8(any) == 0) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_setzero_si128());
+            continue;
+        }
+        for (size_t k = 0; k < 16; ++k) {
+            if (k % 4 == 0) continue;
+            const __m128i r = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + off[k])), sign);
+            bright[k] = _mm_cmpgt_epi8(r, hi);
+            dark[k] = _mm_cmpgt_epi8(lo, r);
+        }
+        __m128i cb = _mm_setzero_si128(), cd = _mm_setzero_si128();
+        __m128i mb = _mm_setzero_si128(), md = _mm_setzero_si128();
+        for (int k = 0; k < 16 + arc - 1; ++k) {
+            cb = _mm_and_si128(_mm_sub_epi8(cb, bright[k & 15]), bright[k & 15]);
+            cd = _mm_and_si128(_mm_sub_epi8(cd, dark[k & 15]), dark[k & 15]);
+            mb = _mm_max_epu8(mb, cb);
+            md = _mm_max_epu8(md, cd);
+        }
+        const __m128i hit = _mm_or_si128(_mm_cmpgt_epi8(mb, limit), _mm_cmpgt_epi8(md, limit));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_and_si128(hit, one));
+    }
+    fast_mask_scalar(p + i, off, n - i, t, arc, out + i);
+}
+
+CV_TARGET_AVX2 inline auto fast_mask_avx2(const uint8_t *p, const ptrdiff_t *off, int n, int t, int arc, uint8_t *out) -> void {
+    const __m256i sign = _mm256_set1_epi8(static_cast<char>(0x80));
+    const __m256i tv = _mm256_set1_epi8(static_cast<char>(t));
+    const __m256i limit = _mm256_set1_epi8(static_cast<char>(arc - 1));
+    const __m256i one = _mm256_set1_epi8(1);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i)), sign);
+        const __m256i hi = _mm256_adds_epi8(v, tv);
+        const __m256i lo = _mm256_subs_epi8(v, tv);
+        __m256i bright[16], dark[16];
+        __m256i any = _mm256_setzero_si256();
+        for (size_t k = 0; k < 16; k += 4) {
+            const __m256i r = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + off[k])), sign);
+            bright[k] = _mm256_cmpgt_epi8(r, hi);
+            dark[k] = _mm256_cmpgt_epi8(lo, r);
+            any = _mm256_or_si256(any, _mm256_or_si256(bright[k], dark[k]));
+        }
+        if (_mm256_movemask_epi8(any) == 0) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_setzero_si256());
+            continue;
+        }
+        for (size_t k = 0; k < 16; ++k) {
+            if (k % 4 == 0) continue;
+            const __m256i r = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + off[k])), sign);
+            bright[k] = _mm256_cmpgt_epi8(r, hi);
+            dark[k] = _mm256_cmpgt_epi8(lo, r);
+        }
+        __m256i cb = _mm256_setzero_si256(), cd = _mm256_setzero_si256();
+        __m256i mb = _mm256_setzero_si256(), md = _mm256_setzero_si256();
+        for (int k = 0; k < 16 + arc - 1; ++k) {
+            cb = _mm256_and_si256(_mm256_sub_epi8(cb, bright[k & 15]), bright[k & 15]);
+            cd = _mm256_and_si256(_mm256_sub_epi8(cd, dark[k & 15]), dark[k & 15]);
+            mb = _mm256_max_epu8(mb, cb);
+            md = _mm256_max_epu8(md, cd);
+        }
+        const __m256i hit = _mm256_or_si256(_mm256_cmpgt_epi8(mb, limit), _mm256_cmpgt_epi8(md, limit));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_and_si256(hit, one));
+    }
+    fast_mask_sse41(p + i, off, n - i, t, arc, out + i);
+}
+#endif
+
+using FastMaskFn = void (*)(const uint8_t *, const ptrdiff_t *, int, int, int, uint8_t *);
+
+// AVX-512 shares the AVX2 kernel: the test is bound by the 16 unaligned ring
+// loads per block, not by lane count.
+[[nodiscard]] inline auto fast_mask_kernel() -> FastMaskFn {
+#if CV_SIMD_X86
+    switch (Simd::active_level()) {
+    case Simd::Level::AVX512:
+    case Simd::Level::AVX2: return fast_mask_avx2;
+    case Simd::Level::SSE41: return fast_mask_sse41;
+    case Simd::Level::Scalar: break;
+    }
+#endif
+    return fast_mask_scalar;
+}
+
+// Largest contrast c such that some arc of `arc` ring pixels is entirely
+// brighter than p + c or darker than p - c, minus one. Detection requires
+// differences strictly above the threshold, so detected corners score >= it.
+[[nodiscard]] inline auto fast_score(const uint8_t *p, const ptrdiff_t *off, int arc) -> float {
+    const int v = *p;
+    std::array<int, 16> d{};
+    for (size_t k = 0; k < 16; ++k) d[k] = p[off[k]] - v;
+    int best = 0;
+    for (int s = 0; s < 16; ++s) {
+        int lo = 255, hi = -255;
+        for (int j = 0; j < arc; ++j) {
+            const int e = d[static_cast<size_t>((s + j) & 15)];
+            lo = std::min(lo, e);
+            hi = std::max(hi, e);
+        }
+        best = std::max(best, std::max(lo, -hi));
+    }
+    return static_cast<float>(best - 1);
+}
+
+// Harris / Shi-Tomasi response from the Sobel structure tensor over a
+// block x block window centred on (x, y). Needs block / 2 + 1 pixels of margin.
+[[nodiscard]] inline auto structure_response(ImageView<const uint8_t, 1> img, int x, int y, int block, CornerScore kind, float k) -> float {
+    const int r = block / 2;
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    for (int yy = y - r; yy <= y + r; ++yy) {
+        const uint8_t *up = img.row(yy - 1);
+        const uint8_t *mid = img.row(yy);
+        const uint8_t *dn = img.row(yy + 1);
+        for (int xx = x - r; xx <= x + r; ++xx) {
+            const int ix = (up[xx + 1] + 2 * mid[xx + 1] + dn[xx + 1]) - (up[xx - 1] + 2 * mid[xx - 1] + dn[xx - 1]);
+            const int iy = (dn[xx - 1] + 2 * dn[xx] + dn[xx + 1]) - (up[xx - 1] + 2 * up[xx] + up[xx + 1]);
+            a += static_cast<float>(ix * ix);
+            b += static_cast<float>(iy * iy);
+            c += static_cast<float>(ix * iy);
+        }
+    }
+    // Normalize so responses do not depend on the window size or bit depth.
+    const float scale = 1.0f / (4.0f * static_cast<float>(block) * 255.0f);
+    const float s2 = scale * scale;
+    a *= s2;
+    b *= s2;
+    c *= s2;
+    if (kind == CornerScore::Harris) return a * b - c * c - k * (a + b) * (a + b);
+    return 0.5f * ((a + b) - std::sqrt((a - b) * (a - b) + 4.0f * c * c));
+}
+} // namespace Features
+
+// Keeps at most `max_per_cell` of the highest-scoring keypoints in every
+// cell_size x cell_size cell, preserving the original order of the survivors.
+inline auto retain_best_per_cell(Keypoints &kp, int cell_size, int max_per_cell) -> void {
+    if (cell_size <= 0 || kp.empty()) return;
+    const auto n = static_cast<uint32_t>(kp.size());
+    std::vector<uint64_t> cell(n);
+    int64_t cols = 1;
+    for (uint32_t i = 0; i < n; ++i) cols = std::max<int64_t>(cols, static_cast<int64_t>(kp.x[i]) / cell_size + 1);
+    for (uint32_t i = 0; i < n; ++i) {
+        const auto cx = static_cast<int64_t>(kp.x[i]) / cell_size;
+        const auto cy = static_cast<int64_t>(kp.y[i]) / cell_size;
+        cell[i] = static_cast<uint64_t>(cy * cols + cx);
+    }
+    std::vector<uint32_t> order(n);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (cell[a] != cell[b]) return cell[a] < cell[b];
+        return kp.score[a] > kp.score[b];
+    });
+    std::vector<uint32_t> keep;
+    keep.reserve(n);
+    for (uint32_t i = 0; i < n;) {
+        uint32_t j = i;
+        while (j < n && cell[order[j]] == cell[order[i]]) ++j;
+        for (uint32_t k = i; k < std::min(j, i + static_cast<uint32_t>(std::max(0, max_per_cell))); ++k) keep.push_back(order[k]);
+        i = j;
+    }
+    std::sort(keep.begin(), keep.end());
+    kp = select(kp, keep);
+}
+
+// Keeps the `count` highest-scoring keypoints, in their original order.
+inline auto retain_best(Keypoints &kp, size_t count) -> void {
+    if (kp.size() <= count) return;
+    std::vector<uint32_t> order(kp.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::nth_element(order.begin(), order.begin() + static_cast<ptrdiff_t>(count), order.end(),
+        [&](uint32_t a, uint32_t b) { return kp.score[a] > kp.score[b]; });
+    order.resize(count);
+    std::sort(order.begin(), order.end());
+    kp = select(kp, order);
+}
+
+[[nodiscard]] inline auto detect_corners(ImageView<const uint8_t, 1> img, const CornerParams &params = {}) -> Keypoints {
+    const int block = std::max(3, params.block_size | 1);
+    const int border = params.score == CornerScore::Fast ? 3 : std::max(3, block / 2 + 1);
+    const int w = img.width;
+    const int h = img.height;
+    if (w <= 2 * border || h <= 2 * border) return {};
+
+    const int t = std::clamp(params.threshold, 0, 127);
+    const int arc = params.type == FastType::Fast9 ? 9 : 12;
+    const int tile = std::max(16, params.tile_size);
+    const int tiles_x = (w - 2 * border + tile - 1) / tile;
+    const int tiles_y = (h - 2 * border + tile - 1) / tile;
+    const auto off = Features::ring_offsets(static_cast<ptrdiff_t>(img.stride));
+    const Features::FastMaskFn fast_mask = Features::fast_mask_kernel();
+    std::vector<Keypoints> tile_points(static_cast<size_t>(tiles_x * tiles_y));
+
+    parallel_for_tiles(w - 2 * border, h - 2 * border, tile, tile, [&](Tile tl) {
+        const int x0 = border + tl.x0;
+        const int y0 = border + tl.y0;
+        const int x1 = border + tl.x1;
+        const int y1 = border + tl.y1;
+        const int ti = (tl.y0 / tile) * tiles_x + tl.x0 / tile;
+        // Scores of the tile plus a one pixel halo; 0 marks "not a corner".
+        std::vector<float> scores;
+        std::vector<uint8_t> mask;
+        const int hx0 = std::max(x0 - 1, border), hx1 = std::min(x1 + 1, w - border);
+        const int hy0 = std::max(y0 - 1, border), hy1 = std::min(y1 + 1, h - border);
+        const int sw = x1 - x0 + 2;
+        scores.assign(static_cast<size_t>(sw * (y1 - y0 + 2)), 0.0f);
+        mask.resize(static_cast<size_t>(hx1 - hx0));
+        auto score_at = [&](int x, int y) -> float & {
+            return scores[static_cast<size_t>((y - y0 + 1) * sw + (x - x0 + 1))];
+        };
+
+        for (int y = hy0; y < hy1; ++y) {
+            const uint8_t *row = img.row(y);
+            fast_mask(row + hx0, off.data(), hx1 - hx0, t, arc, mask.data());
+            for (int x = hx0; x < hx1; ++x) {
+                if (mask[static_cast<size_t>(x - hx0)]) score_at(x, y) = std::max(1.0f, Features::fast_score(row + x, off.data(), arc));
+            }
+        }
+
+        Keypoints &out = tile_points[static_cast<size_t>(ti)];
+        for (int y = y0; y < y1; ++y) {
+            for (int x = x0; x < x1; ++x) {
+                const float s = score_at(x, y);
+                if (s <= 0.0f) continue;
+                if (params.nonmax) {
+                    bool is_max = true;
+                    for (int dy = -1; dy <= 1 && is_max; ++dy) {
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            if ((dx != 0 || dy != 0) && score_at(x + dx, y + dy) >= s) {
+                                // Ties go to the first pixel in raster order.
+                                if (score_at(x + dx, y + dy) > s || dy < 0 || (dy == 0 && dx < 0)) {
+                                    is_max = false;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                    if (!is_max) continue;
+                }
+                const float score = params.score == CornerScore::Fast
+                                        ? s
+                                        : Features::structure_response(img, x, y, block, params.score, params.harris_k);
+                out.push_back(static_cast<float>(x), static_cast<float>(y), score, params.octave);
+            }
+        }
+    });
+
+    Keypoints result;
+    size_t total = 0;
+    for (const auto &tp : tile_points) total += tp.size();
+    result.reserve(total);
+    for (const auto &tp : tile_points) result.append(tp);
+
+    retain_best_per_cell(result, params.cell_size, params.max_per_cell);
+    if (params.octave > 0) {
+        const auto scale = static_cast<float>(1 << params.octave);
+        for (size_t i = 0; i < result.size(); ++i) {
+            result.x[i] *= scale;
+            result.y[i] *= scale;
+        }
+    }
+    return result;
+}
+
+[[nodiscard]] inline auto detect_corners(ImageView<const uint8_t, 4> rgba, const CornerParams &params = {}) -> Keypoints {
+    const ImageGray8 gray = rgba_to_gray(rgba);
+    return detect_corners(gray.view(), params);
+}
+} // namespace CV
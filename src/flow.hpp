@@ -0,0 +1,802 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "convolve.hpp"
+#include "image.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "pyramid.hpp"
+#include "simd.hpp"
+#include "types.hpp"
+
+// Sparse optical flow: pyramidal Lucas-Kanade in Bouguet's fixed-point form.
+//
+// Each frame is turned into a FlowPyramid once: a u8 pyramid downsampled in
+// integers, every level inside a reflected border wide enough for any patch
+// the tracker may read, with its Scharr gradients stored beside it as int16
+// planes, so tracking never differentiates. Per point and level the template patch and its
+// gradients are interpolated with Q14 bilinear weights (intensities keep 5
+// fractional bits) while the 2x2 gradient matrix is accumulated; a Gauss-Newton
+// iteration then only interpolates the target patch and accumulates the
+// mismatch vector. Both loops are int16 madd kernels whose sums are exact in
+// int64, so every SIMD level builds the same pyramids and tracks to
+// bit-identical positions.
+//
+// Points are independent and are spread over the worker threads. With a
+// forward-backward threshold every tracked point is also tracked back from its
+// new position and rejected if it does not return close to where it started.
+namespace CV {
+struct FlowParams {
+    int window = 21;            // odd patch side, at most Flow::max_window
+    int levels = 4;             // pyramid levels including full resolution
+    int max_iterations = 30;    // Gauss-Newton steps per level
+    float epsilon = 0.03f;      // stop once an update moves the point less than this (px)
+    float min_eigen = 1e-4f;    // per-pixel minimum eigenvalue of the gradient matrix
+    float max_fb_error = 1.0f;  // forward-backward distance (px) to reject at; <= 0 disables
+};
+
+enum class FlowStatus : uint8_t {
+    Tracked,
+    OutOfBounds,   // the patch left the image and its border
+    Untextured,    // gradient matrix too weak to solve for the motion
+    Inconsistent,  // tracking back did not return to the start
+};
+
+struct FlowResult {
+    std::vector<Position> points;   // positions in the target frame, the last estimate for lost points
+    std::vector<FlowStatus> status;
+    std::vector<float> fb_error;    // forward-backward distance in pixels, 0 when unchecked
+
+    [[nodiscard]] auto size() const -> size_t { return points.size(); }
+    [[nodiscard]] auto tracked() const -> size_t {
+        return static_cast<size_t>(std::count(status.begin(), status.end(), FlowStatus::Tracked));
+    }
+};
+
+namespace Flow {
+inline constexpr int max_window = 63;
+inline constexpr int weight_bits = 14;
+inline constexpr int intensity_bits = 5;
+// Scales the integer sums back down; keeps min_eigen in the customary units.
+inline constexpr float sum_scale = 1.0f / static_cast<float>(1 << 20);
+
+// Patch rows are padded to whole 16-lane chunks. The padding lanes carry zero
+// gradients, so they drop out of every sum.
+[[nodiscard]] constexpr auto patch_stride(int window) -> int { return (window + 15) & ~15; }
+
+// Q14 bilinear weights of the fractional offset (ax, ay); they sum to exactly 1 << 14.
+struct PatchWeights {
+    int32_t w00;
+    int32_t w01;
+    int32_t w10;
+    int32_t w11;
+};
+
+[[nodiscard]] inline auto patch_weights(float ax, float ay) -> PatchWeights {
+    constexpr float one = static_cast<float>(1 << weight_bits);
+    PatchWeights w{};
+    w.w00 = static_cast<int32_t>(std::lround((1.0f - ax) * (1.0f - ay) * one));
+    w.w01 = static_cast<int32_t>(std::lround(ax * (1.0f - ay) * one));
+    w.w10 = static_cast<int32_t>(std::lround((1.0f - ax) * ay * one));
+    w.w11 = (1 << weight_bits) - w.w00 - w.w01 - w.w10;
+    return w;
+}
+
+// Top-left sample of a patch in a level's intensity and gradient planes.
+struct PatchSource {
+    const uint8_t *image;
+    const int16_t *dx;
+    const int16_t *dy;
+    ptrdiff_t image_stride;
+    ptrdiff_t grad_stride;
+};
+
+// Template of one point: Q5 intensities and gradients, `window` rows of `stride` values each.
+struct Patch {
+    int16_t *intensity;
+    int16_t *dx;
+    int16_t *dy;
+    int window;
+    int stride;
+};
+
+// prepare fills the template and writes the gradient matrix {Ixx, Ixy, Iyy};
+// residual compares a target patch with it and writes {sum d Ix, sum d Iy}
+// for d = J - I.
+using PatchPrepareFn = void (*)(const PatchSource &, PatchWeights, const Patch &, int64_t *);
+using PatchResidualFn = void (*)(const uint8_t *, ptrdiff_t, PatchWeights, const Patch &, int64_t *);
+using ScharrRowFn = void (*)(const uint8_t *, const uint8_t *, const uint8_t *, int16_t *, int16_t *, int);
+
+struct Kernels {
+    PatchPrepareFn prepare;
+    PatchResidualFn residual;
+    ScharrRowFn scharr_row;
+};
+
+template <int Shift, typename T>
+[[nodiscard]] inline auto lerp_scalar(const T *s0, const T *s1, int x, PatchWeights w) -> int32_t {
+    const int32_t v = s0[x] * w.w00 + s0[x + 1] * w.w01 + s1[x] * w.w10 + s1[x + 1] * w.w11;
+    return (v + (1 << (Shift - 1))) >> Shift;
+}
+
+inline auto patch_prepare_scalar(const PatchSource &src, PatchWeights w, const Patch &patch, int64_t *sums) -> void {
+    int64_t xx = 0, xy = 0, yy = 0;
+    for (int y = 0; y < patch.window; ++y) {
+        const uint8_t *i0 = src.image + y * src.image_stride;
+        const int16_t *x0 = src.dx + y * src.grad_stride;
+        const int16_t *y0 = src.dy + y * src.grad_stride;
+        int16_t *pi = patch.intensity + y * patch.stride;
+        int16_t *px = patch.dx + y * patch.stride;
+        int16_t *py = patch.dy + y * patch.stride;
+        for (int x = 0; x < patch.window; ++x) {
+            const int32_t gx = lerp_scalar<weight_bits>(x0, x0 + src.grad_stride, x, w);
+            const int32_t gy = lerp_scalar<weight_bits>(y0, y0 + src.grad_stride, x, w);
+            pi[x] = static_cast<int16_t>(lerp_scalar<weight_bits - intensity_bits>(i0, i0 + src.image_stride, x, w));
+            px[x] = static_cast<int16_t>(gx);
+            py[x] = static_cast<int16_t>(gy);
+            xx += gx * gx;
+            xy += gx * gy;
+            yy += gy * gy;
+        }
+    }
+    sums[0] = xx;
+    sums[1] = xy;
+    sums[2] = yy;
+}
+
+inline auto patch_residual_scalar(const uint8_t *image, ptrdiff_t stride, PatchWeights w, const Patch &patch, int64_t *sums) -> void {
+    int64_t bx = 0, by = 0;
+    for (int y = 0; y < patch.window; ++y) {
+        const uint8_t *j0 = image + y * stride;
+        const int16_t *pi = patch.intensity + y * patch.stride;
+        const int16_t *px = patch.dx + y * patch.stride;
+        const int16_t *py = patch.dy + y * patch.stride;
+        for (int x = 0; x < patch.window; ++x) {
+            const int32_t d = lerp_scalar<weight_bits - intensity_bits>(j0, j0 + stride, x, w) - pi[x];
+            bx += d * px[x];
+            by += d * py[x];
+        }
+    }
+    sums[0] = bx;
+    sums[1] = by;
+}
+
+// 3x3 Scharr of row b between rows a and c for n pixels starting at column
+// 1; 32x the unit gradient, at most 4080 in magnitude.
+inline auto scharr_row_scalar(const uint8_t *a, const uint8_t *b, const uint8_t *c, int16_t *gx, int16_t *gy, int n) -> void {
+    for (int x = 1; x <= n; ++x) {
+        gx[x] = static_cast<int16_t>(3 * (a[x + 1] - a[x - 1] + c[x + 1] - c[x - 1]) + 10 * (b[x + 1] - b[x - 1]));
+        gy[x] = static_cast<int16_t>(3 * (c[x - 1] - a[x - 1] + c[x + 1] - a[x + 1]) + 10 * (c[x] - a[x]));
+    }
+}
+
+#if CV_SIMD_X86
+// -1 for the first 16 entries, 0 after: loading at 16 - n keeps n lanes.
+alignas(64) inline constexpr std::array<int16_t, 32> lane_mask = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+
+// Int32 lane sums are widened into int64 every this many rows, well before
+// they could overflow.
+inline constexpr int widen_rows = 16;
+
+// The kernels walk the patch one chunk column at a time, top to bottom, so the
+// lower sample row of one output row is reused as the upper row of the next.
+// A row is kept as (sample, right neighbour) int16 pairs, which madd weights
+// with both horizontal taps at once.
+struct PairsSse {
+    __m128i lo;
+    __m128i hi;
+};
+
+CV_TARGET_SSE41 inline auto pairs_sse41(__m128i a, __m128i b) -> PairsSse {
+    return {_mm_unpacklo_epi16(a, b), _mm_unpackhi_epi16(a, b)};
+}
+
+CV_TARGET_SSE41 inline auto widen_u8_sse41(const uint8_t *s) -> __m128i {
+    return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(s)));
+}
+
+CV_TARGET_SSE41 inline auto pairs_u8_sse41(const uint8_t *s) -> PairsSse {
+    return pairs_sse41(widen_u8_sse41(s), widen_u8_sse41(s + 1));
+}
+
+CV_TARGET_SSE41 inline auto pairs_i16_sse41(const int16_t *s) -> PairsSse {
+    return pairs_sse41(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 1)));
+}
+
+// Bilinear interpolation of 8 samples between two rows of pairs, rounded and
+// shifted down by Shift bits.
+template <int Shift>
+CV_TARGET_SSE41 inline auto lerp_sse41(PairsSse top, PairsSse bottom, __m128i w01, __m128i w23) -> __m128i {
+    const __m128i round = _mm_set1_epi32(1 << (Shift - 1));
+    const __m128i lo = _mm_add_epi32(_mm_madd_epi16(top.lo, w01), _mm_madd_epi16(bottom.lo, w23));
+    const __m128i hi = _mm_add_epi32(_mm_madd_epi16(top.hi, w01), _mm_madd_epi16(bottom.hi, w23));
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(lo, round), Shift), _mm_srai_epi32(_mm_add_epi32(hi, round), Shift));
+}
+
+CV_TARGET_SSE41 inline auto weight_pair_sse41(int32_t left, int32_t right) -> __m128i {
+    return _mm_set1_epi32(static_cast<int32_t>((static_cast<uint32_t>(right) << 16) | (static_cast<uint32_t>(left) & 0xFFFFu)));
+}
+
+CV_TARGET_SSE41 inline auto widen_add_sse41(__m128i acc, __m128i v) -> __m128i {
+    return _mm_add_epi64(acc, _mm_add_epi64(_mm_cvtepi32_epi64(v), _mm_cvtepi32_epi64(_mm_srli_si128(v, 8))));
+}
+
+CV_TARGET_SSE41 inline auto hsum_sse41(__m128i v) -> int64_t {
+    return _mm_extract_epi64(v, 0) + _mm_extract_epi64(v, 1);
+}
+
+CV_TARGET_SSE41 inline auto patch_prepare_sse41(const PatchSource &src, PatchWeights w, const Patch &patch, int64_t *sums) -> void {
+    const __m128i w01 = weight_pair_sse41(w.w00, w.w01);
+    const __m128i w23 = weight_pair_sse41(w.w10, w.w11);
+    __m128i xx = _mm_setzero_si128(), xy = _mm_setzero_si128(), yy = _mm_setzero_si128();
+    for (int x = 0; x < patch.window; x += 8) {
+        const __m128i keep = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lane_mask.data() + 16 - std::min(patch.window - x, 8)));
+        const uint8_t *ip = src.image + x;
+        const int16_t *xp = src.dx + x;
+        const int16_t *yp = src.dy + x;
+        PairsSse it = pairs_u8_sse41(ip), xt = pairs_i16_sse41(xp), yt = pairs_i16_sse41(yp);
+        for (int y0 = 0; y0 < patch.window; y0 += widen_rows) {
+            const int y1 = std::min(y0 + widen_rows, patch.window);
+            __m128i rxx = _mm_setzero_si128(), rxy = _mm_setzero_si128(), ryy = _mm_setzero_si128();
+            for (int y = y0; y < y1; ++y) {
+                ip += src.image_stride;
+                xp += src.grad_stride;
+                yp += src.grad_stride;
+                const PairsSse ib = pairs_u8_sse41(ip), xb = pairs_i16_sse41(xp), yb = pairs_i16_sse41(yp);
+                const __m128i gx = _mm_and_si128(lerp_sse41<weight_bits>(xt, xb, w01, w23), keep);
+                const __m128i gy = _mm_and_si128(lerp_sse41<weight_bits>(yt, yb, w01, w23), keep);
+                const ptrdiff_t at = static_cast<ptrdiff_t>(y) * patch.stride + x;
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(patch.intensity + at), lerp_sse41<weight_bits - intensity_bits>(it, ib, w01, w23));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(patch.dx + at), gx);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(patch.dy + at), gy);
+                rxx = _mm_add_epi32(rxx, _mm_madd_epi16(gx, gx));
+                rxy = _mm_add_epi32(rxy, _mm_madd_epi16(gx, gy));
+                ryy = _mm_add_epi32(ryy, _mm_madd_epi16(gy, gy));
+                it = ib;
+                xt = xb;
+                yt = yb;
+            }
+            xx = widen_add_sse41(xx, rxx);
+            xy = widen_add_sse41(xy, rxy);
+            yy = widen_add_sse41(yy, ryy);
+        }
+    }
+    sums[0] = hsum_sse41(xx);
+    sums[1] = hsum_sse41(xy);
+    sums[2] = hsum_sse41(yy);
+}
+
+CV_TARGET_SSE41 inline auto patch_residual_sse41(const uint8_t *image, ptrdiff_t stride, PatchWeights w, const Patch &patch, int64_t *sums) -> void {
+    const __m128i w01 = weight_pair_sse41(w.w00, w.w01);
+    const __m128i w23 = weight_pair_sse41(w.w10, w.w11);
+    __m128i bx = _mm_setzero_si128(), by = _mm_setzero_si128();
+    for (int x = 0; x < patch.window; x += 8) {
+        const uint8_t *jp = image + x;
+        PairsSse top = pairs_u8_sse41(jp);
+        for (int y0 = 0; y0 < patch.window; y0 += widen_rows) {
+            const int y1 = std::min(y0 + widen_rows, patch.window);
+            __m128i rx = _mm_setzero_si128(), ry = _mm_setzero_si128();
+            for (int y = y0; y < y1; ++y) {
+                jp += stride;
+                const PairsSse bottom = pairs_u8_sse41(jp);
+                const ptrdiff_t at = static_cast<ptrdiff_t>(y) * patch.stride + x;
+                const __m128i d = _mm_sub_epi16(lerp_sse41<weight_bits - intensity_bits>(top, bottom, w01, w23),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(patch.intensity + at)));
+                rx = _mm_add_epi32(rx, _mm_madd_epi16(d, _mm_loadu_si128(reinterpret_cast<const __m128i *>(patch.dx + at))));
+                ry = _mm_add_epi32(ry, _mm_madd_epi16(d, _mm_loadu_si128(reinterpret_cast<const __m128i *>(patch.dy + at))));
+                top = bottom;
+            }
+            bx = widen_add_sse41(bx, rx);
+            by = widen_add_sse41(by, ry);
+        }
+    }
+    sums[0] = hsum_sse41(bx);
+    sums[1] = hsum_sse41(by);
+}
+
+CV_TARGET_SSE41 inline auto scharr_row_sse41(const uint8_t *a, const uint8_t *b, const uint8_t *c, int16_t *gx, int16_t *gy, int n) -> void {
+    const __m128i three = _mm_set1_epi16(3);
+    const __m128i ten = _mm_set1_epi16(10);
+    int x = 1;
+    for (; x + 8 <= n + 1; x += 8) {
+        const __m128i al = widen_u8_sse41(a + x - 1), ac = widen_u8_sse41(a + x), ar = widen_u8_sse41(a + x + 1);
+        const __m128i bl = widen_u8_sse41(b + x - 1), br = widen_u8_sse41(b + x + 1);
+        const __m128i cl = widen_u8_sse41(c + x - 1), cc = widen_u8_sse41(c + x), cr = widen_u8_sse41(c + x + 1);
+        const __m128i sx = _mm_add_epi16(_mm_sub_epi16(ar, al), _mm_sub_epi16(cr, cl));
+        const __m128i sy = _mm_add_epi16(_mm_sub_epi16(cl, al), _mm_sub_epi16(cr, ar));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(gx + x), _mm_add_epi16(_mm_mullo_epi16(sx, three), _mm_mullo_epi16(_mm_sub_epi16(br, bl), ten)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(gy + x), _mm_add_epi16(_mm_mullo_epi16(sy, three), _mm_mullo_epi16(_mm_sub_epi16(cc, ac), ten)));
+    }
+    scharr_row_scalar(a + x - 1, b + x - 1, c + x - 1, gx + x - 1, gy + x - 1, n + 1 - x);
+}
+
+// The 256-bit unpacks work per 128-bit lane, which pairs samples 0-3 and 8-11
+// in lo and 4-7 and 12-15 in hi; packs puts them back in order.
+struct PairsAvx {
+    __m256i lo;
+    __m256i hi;
+};
+
+CV_TARGET_AVX2 inline auto pairs_avx2(__m256i a, __m256i b) -> PairsAvx {
+    return {_mm256_unpacklo_epi16(a, b), _mm256_unpackhi_epi16(a, b)};
+}
+
+CV_TARGET_AVX2 inline auto widen_u8_avx2(const uint8_t *s) -> __m256i {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s)));
+}
+
+CV_TARGET_AVX2 inline auto pairs_u8_avx2(const uint8_t *s) -> PairsAvx {
+    return pairs_avx2(widen_u8_avx2(s), widen_u8_avx2(s + 1));
+}
+
+CV_TARGET_AVX2 inline auto pairs_i16_avx2(const int16_t *s) -> PairsAvx {
+    return pairs_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 1)));
+}
+
+template <int Shift>
+CV_TARGET_AVX2 inline auto lerp_avx2(PairsAvx top, PairsAvx bottom, __m256i w01, __m256i w23) -> __m256i {
+    const __m256i round = _mm256_set1_epi32(1 << (Shift - 1));
+    const __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(top.lo, w01), _mm256_madd_epi16(bottom.lo, w23));
+    const __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(top.hi, w01), _mm256_madd_epi16(bottom.hi, w23));
+    return _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(lo, round), Shift), _mm256_srai_epi32(_mm256_add_epi32(hi, round), Shift));
+}
+
+CV_TARGET_AVX2 inline auto weight_pair_avx2(int32_t left, int32_t right) -> __m256i {
+    return _mm256_set1_epi32(static_cast<int32_t>((static_cast<uint32_t>(right) << 16) | (static_cast<uint32_t>(left) & 0xFFFFu)));
+}
+
+CV_TARGET_AVX2 inline auto widen_add_avx2(__m256i acc, __m256i v) -> __m256i {
+    return _mm256_add_epi64(acc, _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)),
+                                     _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1))));
+}
+
+CV_TARGET_AVX2 inline auto hsum_avx2(__m256i v) -> int64_t {
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return _mm_extract_epi64(s, 0) + _mm_extract_epi64(s, 1);
+}
+
+CV_TARGET_AVX2 inline auto scharr_row_avx2(const uint8_t *a, const uint8_t *b, const uint8_t *c, int16_t *gx, int16_t *gy, int n) -> void {
+    const __m256i three = _mm256_set1_epi16(3);
+    const __m256i ten = _mm256_set1_epi16(10);
+    int x = 1;
+    for (; x + 16 <= n + 1; x += 16) {
+        const __m256i al = widen_u8_avx2(a + x - 1), ac = widen_u8_avx2(a + x), ar = widen_u8_avx2(a + x + 1);
+        const __m256i bl = widen_u8_avx2(b + x - 1), br = widen_u8_avx2(b + x + 1);
+        const __m256i cl = widen_u8_avx2(c + x - 1), cc = widen_u8_avx2(c + x), cr = widen_u8_avx2(c + x + 1);
+        const __m256i sx = _mm256_add_epi16(_mm256_sub_epi16(ar, al), _mm256_sub_epi16(cr, cl));
+        const __m256i sy = _mm256_add_epi16(_mm256_sub_epi16(cl, al), _mm256_sub_epi16(cr, ar));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(gx + x), _mm256_add_epi16(_mm256_mullo_epi16(sx, three), _mm256_mullo_epi16(_mm256_sub_epi16(br, bl), ten)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(gy + x), _mm256_add_epi16(_mm256_mullo_epi16(sy, three), _mm256_mullo_epi16(_mm256_sub_epi16(cc, ac), ten)));
+    }
+    scharr_row_sse41(a + x - 1, b + x - 1, c + x - 1, gx + x - 1, gy + x - 1, n + 1 - x);
+}
+
+CV_TARGET_AVX2 inline auto patch_prepare_avx2(const PatchSource &src, PatchWeights w, const Patch &patch, int64_t *sums) -> void {
+    const __m256i w01 = weight_pair_avx2(w.w00, w.w01);
+    const __m256i w23 = weight_pair_avx2(w.w10, w.w11);
+    __m256i xx = _mm256_setzero_si256(), xy = _mm256_setzero_si256(), yy = _mm256_setzero_si256();
+    for (int x = 0; x < patch.window; x += 16) {
+        const __m256i keep = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lane_mask.data() + 16 - std::min(patch.window - x, 16)));
+        const uint8_t *ip = src.image + x;
+        const int16_t *xp = src.dx + x;
+        const int16_t *yp = src.dy + x;
+        PairsAvx it = pairs_u8_avx2(ip), xt = pairs_i16_avx2(xp), yt = pairs_i16_avx2(yp);
+        for (int y0 = 0; y0 < patch.window; y0 += widen_rows) {
+            const int y1 = std::min(y0 + widen_rows, patch.window);
+            __m256i rxx = _mm256_setzero_si256(), rxy = _mm256_setzero_si256(), ryy = _mm256_setzero_si256();
+            for (int y = y0; y < y1; ++y) {
+                ip += src.image_stride;
+                xp += src.grad_stride;
+                yp += src.grad_stride;
+                const PairsAvx ib = pairs_u8_avx2(ip), xb = pairs_i16_avx2(xp), yb = pairs_i16_avx2(yp);
+                const __m256i gx = _mm256_and_si256(lerp_avx2<weight_bits>(xt, xb, w01, w23), keep);
+                const __m256i gy = _mm256_and_si256(lerp_avx2<weight_bits>(yt, yb, w01, w23), keep);
+                const ptrdiff_t at = static_cast<ptrdiff_t>(y) * patch.stride + x;
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(patch.intensity + at), lerp_avx2<weight_bits - intensity_bits>(it, ib, w01, w23));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(patch.dx + at), gx);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(patch.dy + at), gy);
+                rxx = _mm256_add_epi32(rxx, _mm256_madd_epi16(gx, gx));
+                rxy = _mm256_add_epi32(rxy, _mm256_madd_epi16(gx, gy));
+                ryy = _mm256_add_epi32(ryy, _mm256_madd_epi16(gy, gy));
+                it = ib;
+                xt = xb;
+                yt = yb;
+            }
+            xx = widen_add_avx2(xx, rxx);
+            xy = widen_add_avx2(xy, rxy);
+            yy = widen_add_avx2(yy, ryy);
+        }
+    }
+    sums[0] = hsum_avx2(xx);
+    sums[1] = hsum_avx2(xy);
+    sums[2] = hsum_avx2(yy);
+}
+
+CV_TARGET_AVX2 inline auto patch_residual_avx2(const uint8_t *image, ptrdiff_t stride, PatchWeights w, const Patch &patch, int64_t *sums) -> void {
+    const __m256i w01 = weight_pair_avx2(w.w00, w.w01);
+    const __m256i w23 = weight_pair_avx2(w.w10, w.w11);
+    __m256i bx = _mm256_setzero_si256(), by = _mm256_setzero_si256();
+    for (int x = 0; x < patch.window; x += 16) {
+        const uint8_t *jp = image + x;
+        PairsAvx top = pairs_u8_avx2(jp);
+        for (int y0 = 0; y0 < patch.window; y0 += widen_rows) {
+            const int y1 = std::min(y0 + widen_rows, patch.window);
+            __m256i rx = _mm256_setzero_si256(), ry = _mm256_setzero_si256();
+            for (int y = y0; y < y1; ++y) {
+                jp += stride;
+                const PairsAvx bottom = pairs_u8_avx2(jp);
+                const ptrdiff_t at = static_cast<ptrdiff_t>(y) * patch.stride + x;
+                const __m256i d = _mm256_sub_epi16(lerp_avx2<weight_bits - intensity_bits>(top, bottom, w01, w23),
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(patch.intensity + at)));
+                rx = _mm256_add_epi32(rx, _mm256_madd_epi16(d, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(patch.dx + at))));
+                ry = _mm256_add_epi32(ry, _mm256_madd_epi16(d, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(patch.dy + at))));
+                top = bottom;
+            }
+            bx = widen_add_avx2(bx, rx);
+            by = widen_add_avx2(by, ry);
+        }
+    }
+    sums[0] = hsum_avx2(bx);
+    sums[1] = hsum_avx2(by);
+}
+#endif
+
+// AVX-512 shares the AVX2 kernels: a 21 pixel patch row is two 16-lane chunks
+// already, wider vectors would mostly compute padding.
+[[nodiscard]] inline auto kernels() -> Kernels {
+#if CV_SIMD_X86
+    switch (Simd::active_level()) {
+    case Simd::Level::AVX512:
+    case Simd::Level::AVX2: return {patch_prepare_avx2, patch_residual_avx2, scharr_row_avx2};
+    case Simd::Level::SSE41: return {patch_prepare_sse41, patch_residual_sse41, scharr_row_sse41};
+    case Simd::Level::Scalar: break;
+    }
+#endif
+    return {patch_prepare_scalar, patch_residual_scalar, scharr_row_scalar};
+}
+} // namespace Flow
+
+// One pyramid level inside a reflect-101 border of `pad` pixels. image, dx and
+// dy share that padded geometry; the level itself starts at (pad, pad).
+struct FlowLevel {
+    ImageGray8 image;
+    Image<int16_t, 1> dx;
+    Image<int16_t, 1> dy;
+    int width = 0;
+    int height = 0;
+    int pad = 0;
+
+    // Patch reads at top-left (x, y) stay inside the border, see Flow::patch_stride.
+    [[nodiscard]] auto contains_patch(int x, int y, int window) const -> bool {
+        return x >= -window && x < width && y >= -window && y < height;
+    }
+    [[nodiscard]] auto source(int x, int y) const -> Flow::PatchSource {
+        const size_t gx = static_cast<size_t>(x + pad);
+        return {image.row(y + pad) + gx, dx.row(y + pad) + gx, dy.row(y + pad) + gx,
+            static_cast<ptrdiff_t>(image.stride()), static_cast<ptrdiff_t>(dx.stride())};
+    }
+};
+
+namespace detail {
+inline auto fill_flow_border(FlowLevel &level) -> void {
+    const int w = level.width, h = level.height, pad = level.pad;
+    for (int y = 0; y < h; ++y) {
+        uint8_t *row = level.image.row(y + pad) + pad;
+        for (int i = 1; i <= pad; ++i) {
+            row[-i] = row[border_index(-i, w, BorderMode::Reflect)];
+            row[w - 1 + i] = row[border_index(w - 1 + i, w, BorderMode::Reflect)];
+        }
+    }
+    const size_t bytes = static_cast<size_t>(w + 2 * pad);
+    for (int i = 1; i <= pad; ++i) {
+        std::memcpy(level.image.row(pad - i), level.image.row(pad + border_index(-i, h, BorderMode::Reflect)), bytes);
+        std::memcpy(level.image.row(pad + h - 1 + i), level.image.row(pad + border_index(h - 1 + i, h, BorderMode::Reflect)), bytes);
+    }
+}
+
+// Binomial 5-tap blur and 2x decimation from the inner area of `fine`, whose
+// reflected border supplies the edge taps, into the inner area of `coarse`.
+// Plain integer code with no dispatch, so the pyramid, unlike the float
+// Pyramid (AVX2 fuses its multiply-adds), is the same at every SIMD level.
+inline auto flow_pyr_down(const FlowLevel &fine, FlowLevel &coarse) -> void {
+    const int cw = coarse.width;
+    const auto span = static_cast<size_t>(2 * cw + 3); // fine columns -2 .. 2 * cw
+    parallel_for(0, coarse.height, 16, [&](int y_begin, int y_end) {
+        ArenaScope scope;
+        const std::span<uint16_t> column = scope.array<uint16_t>(span);
+        for (int y = y_begin; y < y_end; ++y) {
+            std::array<const uint8_t *, 5> rows{};
+            for (int k = 0; k < 5; ++k) rows[static_cast<size_t>(k)] = fine.image.row(fine.pad + 2 * y - 2 + k) + fine.pad - 2;
+            for (size_t i = 0; i < span; ++i) {
+                column[i] = static_cast<uint16_t>(rows[0][i] + 4 * rows[1][i] + 6 * rows[2][i] + 4 * rows[3][i] + rows[4][i]);
+            }
+            uint8_t *out = coarse.image.row(coarse.pad + y) + coarse.pad;
+            for (int x = 0; x < cw; ++x) {
+                const uint16_t *c = column.data() + 2 * x;
+                const int sum = c[0] + 4 * c[1] + 6 * c[2] + 4 * c[3] + c[4];
+                out[x] = static_cast<uint8_t>((sum + 128) >> 8);
+            }
+        }
+    });
+}
+
+// Scharr gradients over the whole padded level; the outermost ring, which no
+// patch reads, is zero.
+inline auto flow_gradients(FlowLevel &level) -> void {
+    const int pw = level.image.width();
+    const int ph = level.image.height();
+    const Flow::ScharrRowFn scharr_row = Flow::kernels().scharr_row;
+    parallel_for(0, ph, 32, [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            int16_t *gx = level.dx.row(y);
+            int16_t *gy = level.dy.row(y);
+            if (y == 0 || y == ph - 1) {
+                std::fill_n(gx, pw, int16_t{0});
+                std::fill_n(gy, pw, int16_t{0});
+                continue;
+            }
+            gx[0] = gy[0] = gx[pw - 1] = gy[pw - 1] = 0;
+            scharr_row(level.image.row(y - 1), level.image.row(y), level.image.row(y + 1), gx, gy, pw - 2);
+        }
+    });
+}
+} // namespace detail
+
+// Per-frame tracking input: the u8 pyramid with borders and gradients.
+class FlowPyramid {
+public:
+    FlowPyramid() = default;
+
+    // Levels whose shorter side would not exceed the window are skipped, like
+    // any level beyond `levels`. Buffers are reused while the frame size stays.
+    auto build(ImageView<const uint8_t, 1> gray, int levels, int window) -> void {
+        if (window < 3 || window > Flow::max_window || window % 2 == 0) {
+            PANIC(std::format("FlowPyramid: window must be odd and in [3, {}], got {}", Flow::max_window, window));
+        }
+        m_window = window;
+        if (gray.empty()) {
+            m_levels.clear();
+            return;
+        }
+        const int pad = Flow::patch_stride(window);
+        // As many levels as Pyramid(levels, window + 1) would have.
+        int count = 1;
+        for (int w = gray.width, h = gray.height; count < levels && std::min(pyr_down_size(w), pyr_down_size(h)) > window; ++count) {
+            w = pyr_down_size(w);
+            h = pyr_down_size(h);
+        }
+        m_levels.resize(static_cast<size_t>(count));
+        for (int i = 0; i < count; ++i) {
+            const FlowLevel *finer = i > 0 ? &m_levels[static_cast<size_t>(i - 1)] : nullptr;
+            const int w = finer ? pyr_down_size(finer->width) : gray.width;
+            const int h = finer ? pyr_down_size(finer->height) : gray.height;
+            FlowLevel &level = m_levels[static_cast<size_t>(i)];
+            if (level.width != w || level.height != h || level.pad != pad) {
+                level.image = ImageGray8(w + 2 * pad, h + 2 * pad);
+                level.dx = Image<int16_t, 1>(w + 2 * pad, h + 2 * pad);
+                level.dy = Image<int16_t, 1>(w + 2 * pad, h + 2 * pad);
+                level.width = w;
+                level.height = h;
+                level.pad = pad;
+            }
+            if (finer) {
+                detail::flow_pyr_down(*finer, level);
+            } else {
+                copy<uint8_t, 1>(gray, level.image.roi(pad, pad, w, h));
+            }
+            detail::fill_flow_border(level);
+            detail::flow_gradients(level);
+        }
+    }
+
+    [[nodiscard]] auto level_count() const -> int { return static_cast<int>(m_levels.size()); }
+    [[nodiscard]] auto level(int i) const -> const FlowLevel & { return m_levels[static_cast<size_t>(i)]; }
+    [[nodiscard]] auto width() const -> int { return m_levels.empty() ? 0 : m_levels[0].width; }
+    [[nodiscard]] auto height() const -> int { return m_levels.empty() ? 0 : m_levels[0].height; }
+    [[nodiscard]] auto window() const -> int { return m_window; }
+    [[nodiscard]] auto empty() const -> bool { return m_levels.empty(); }
+
+private:
+    std::vector<FlowLevel> m_levels;
+    int m_window = 0;
+};
+
+namespace detail {
+// Coarse-to-fine tracking of `start` from one pyramid into the other. `guess`
+// holds the initial estimate and receives the result.
+[[nodiscard]] inline auto lk_track(const FlowPyramid &from, const FlowPyramid &to, Position start, Position &guess,
+    const FlowParams &params, const Flow::Kernels &kernels, const Flow::Patch &patch) -> FlowStatus {
+    const int win = params.window;
+    const float half = static_cast<float>(win / 2);
+    const float eps2 = params.epsilon * params.epsilon;
+    const float area2 = 2.0f * static_cast<float>(win * win);
+    const int top = from.level_count() - 1;
+    std::array<int64_t, 3> sums{};
+    float nx = 0.0f, ny = 0.0f;
+    for (int level = top; level >= 0; --level) {
+        const float scale = 1.0f / static_cast<float>(1 << level);
+        if (level == top) {
+            nx = guess.x * scale;
+            ny = guess.y * scale;
+        } else {
+            nx *= 2.0f;
+            ny *= 2.0f;
+        }
+        const FlowLevel &a = from.level(level);
+        const FlowLevel &b = to.level(level);
+        const float px = start.x * scale - half;
+        const float py = start.y * scale - half;
+        const int ix = static_cast<int>(std::floor(px));
+        const int iy = static_cast<int>(std::floor(py));
+        if (!a.contains_patch(ix, iy, win)) {
+            if (level == 0) return FlowStatus::OutOfBounds;
+            continue;
+        }
+        kernels.prepare(a.source(ix, iy), Flow::patch_weights(px - static_cast<float>(ix), py - static_cast<float>(iy)), patch, sums.data());
+        const float gxx = static_cast<float>(sums[0]) * Flow::sum_scale;
+        const float gxy = static_cast<float>(sums[1]) * Flow::sum_scale;
+        const float gyy = static_cast<float>(sums[2]) * Flow::sum_scale;
+        const float det = gxx * gyy - gxy * gxy;
+        const float min_eigen = (gxx + gyy - std::sqrt((gxx - gyy) * (gxx - gyy) + 4.0f * gxy * gxy)) / area2;
+        if (min_eigen < params.min_eigen || det < FLT_EPSILON) {
+            if (level == 0) return FlowStatus::Untextured;
+            continue;
+        }
+        const float inv_det = 1.0f / det;
+
+        float qx = nx - half, qy = ny - half;
+        float last_dx = 0.0f, last_dy = 0.0f;
+        for (int it = 0; it < params.max_iterations; ++it) {
+            const int jx = static_cast<int>(std::floor(qx));
+            const int jy = static_cast<int>(std::floor(qy));
+            if (!b.contains_patch(jx, jy, win)) {
+                if (level == 0) return FlowStatus::OutOfBounds;
+                break;
+            }
+            const Flow::PatchSource target = b.source(jx, jy);
+            kernels.residual(target.image, target.image_stride,
+                Flow::patch_weights(qx - static_cast<float>(jx), qy - static_cast<float>(jy)), patch, sums.data());
+            const float bx = static_cast<float>(sums[0]) * Flow::sum_scale;
+            const float by = static_cast<float>(sums[1]) * Flow::sum_scale;
+            const float dx = (gxy * by - gyy * bx) * inv_det;
+            const float dy = (gxy * bx - gxx * by) * inv_det;
+            qx += dx;
+            qy += dy;
+            if (dx * dx + dy * dy <= eps2) break;
+            // Oscillating between two positions: settle in the middle.
+            if (it > 0 && std::abs(dx + last_dx) < 0.01f && std::abs(dy + last_dy) < 0.01f) {
+                qx -= 0.5f * dx;
+                qy -= 0.5f * dy;
+                break;
+            }
+            last_dx = dx;
+            last_dy = dy;
+        }
+        nx = qx + half;
+        ny = qy + half;
+    }
+    guess = {nx, ny};
+    return FlowStatus::Tracked;
+}
+} // namespace detail
+
+// Tracks points from the frame of `from` into the frame of `to`. `guesses`,
+// if not empty, holds one initial estimate per point (e.g. from a motion
+// model); otherwise every point starts where it is.
+[[nodiscard]] inline auto track_points(const FlowPyramid &from, const FlowPyramid &to, std::span<const Position> points,
+    const FlowParams &params = {}, std::span<const Position> guesses = {}) -> FlowResult {
+    if (from.level_count() != to.level_count() || from.width() != to.width() || from.height() != to.height()) {
+        PANIC(std::format("track_points: pyramids differ ({}x{}, {} levels vs {}x{}, {} levels)",
+            from.width(), from.height(), from.level_count(), to.width(), to.height(), to.level_count()));
+    }
+    if (params.window < 3 || params.window > std::min(from.window(), to.window()) || params.window % 2 == 0) {
+        PANIC(std::format("track_points: window {} must be odd and at most the pyramid window {}", params.window, std::min(from.window(), to.window())));
+    }
+    if (!guesses.empty() && guesses.size() != points.size()) {
+        PANIC(std::format("track_points: {} guesses for {} points", guesses.size(), points.size()));
+    }
+
+    const size_t n = points.size();
+    FlowResult result;
+    result.points.assign(points.begin(), points.end());
+    result.status.assign(n, FlowStatus::OutOfBounds);
+    result.fb_error.assign(n, 0.0f);
+    if (n == 0 || from.empty()) return result;
+
+    const Flow::Kernels kernels = Flow::kernels();
+    const int stride = Flow::patch_stride(params.window);
+    const size_t patch_size = static_cast<size_t>(params.window) * static_cast<size_t>(stride);
+    const bool check_back = params.max_fb_error > 0.0f;
+    parallel_for(0, static_cast<int>(n), 16, [&](int begin, int end) {
+        ArenaScope scope;
+        const Flow::Patch patch = {scope.array<int16_t>(patch_size).data(), scope.array<int16_t>(patch_size).data(),
+            scope.array<int16_t>(patch_size).data(), params.window, stride};
+        for (int i = begin; i < end; ++i) {
+            const auto k = static_cast<size_t>(i);
+            const Position start = points[k];
+            Position forward = guesses.empty() ? start : guesses[k];
+            FlowStatus status = detail::lk_track(from, to, start, forward, params, kernels, patch);
+            if (status == FlowStatus::Tracked && check_back) {
+                Position back = start;
+                const FlowStatus back_status = detail::lk_track(to, from, forward, back, params, kernels, patch);
+                const float error = std::hypot(back.x - start.x, back.y - start.y);
+                result.fb_error[k] = error;
+                if (back_status != FlowStatus::Tracked || error > params.max_fb_error) status = FlowStatus::Inconsistent;
+            }
+            result.points[k] = forward;
+            result.status[k] = status;
+        }
+    });
+    return result;
+}
+
+// Convenience for two standalone frames; video should use FlowTracker.
+[[nodiscard]] inline auto track_points(ImageView<const uint8_t, 1> from, ImageView<const uint8_t, 1> to,
+    std::span<const Position> points, const FlowParams &params = {}) -> FlowResult {
+    FlowPyramid a, b;
+    a.build(from, params.levels, params.window);
+    b.build(to, params.levels, params.window);
+    return track_points(a, b, points, params);
+}
+
+// Frame-to-frame tracker. Keeps the pyramid of the previous frame, so a video
+// costs one pyramid build per frame no matter how often points are tracked.
+class FlowTracker {
+public:
+    explicit FlowTracker(FlowParams params = {})
+        : m_params(params) {}
+
+    // Makes `gray` the current frame; the old current frame becomes the one
+    // points are tracked from.
+    auto push(ImageView<const uint8_t, 1> gray) -> void {
+        std::swap(m_previous, m_current);
+        m_current.build(gray, m_params.levels, m_params.window);
+        m_frames = std::min<uint64_t>(m_frames + 1, 2);
+    }
+
+    // Two frames of the same size have been pushed since the last reset().
+    [[nodiscard]] auto ready() const -> bool {
+        return m_frames >= 2 && m_previous.width() == m_current.width() && m_previous.height() == m_current.height();
+    }
+
+    // Previous frame to current frame; every point is OutOfBounds until ready().
+    [[nodiscard]] auto track(std::span<const Position> points, std::span<const Position> guesses = {}) const -> FlowResult {
+        if (!ready()) {
+            FlowResult result;
+            result.points.assign(points.begin(), points.end());
+            result.status.assign(points.size(), FlowStatus::OutOfBounds);
+            result.fb_error.assign(points.size(), 0.0f);
+            return result;
+        }
+        return track_points(m_previous, m_current, points, m_params, guesses);
+    }
+
+    auto reset() -> void { m_frames = 0; }
+
+    [[nodiscard]] auto params() const -> const FlowParams & { return m_params; }
+    [[nodiscard]] auto previous() const -> const FlowPyramid & { return m_previous; }
+    [[nodiscard]] auto current() const -> const FlowPyramid & { return m_current; }
+
+private:
+    FlowParams m_params;
+    FlowPyramid m_previous;
+    FlowPyramid m_current;
+    uint64_t m_frames = 0;
+};
+} // namespace CV
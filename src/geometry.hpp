@@ -0,0 +1,470 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <numbers>
+#include <span>
+#include <vector>
+
+#include "convolve.hpp"
+#include "image.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "types.hpp"
+
+// Resampling and geometric warps for 8-bit images.
+//
+// Resize is separable. Every output column and row gets a precomputed list of
+// (clamped) source indices and 16-bit fixed-point weights that sum exactly to
+// one. Source rows are filtered horizontally into Q5 int16 rows which are
+// cached in a small per-worker ring keyed by source row, so every source row
+// is filtered once per worker. The vertical pass combines ring rows with 16-bit
+// multiply-adds (Q11 weights) and rounds straight back to bytes.
+//
+// Warps walk the output in tiles. Inside a tile row the source coordinate is
+// advanced incrementally (Q16 for affine maps, one divide per pixel for
+// homographies) and re-anchored from the exact matrix at every tile row, so
+// drift stays far below the 1/32 pixel bilinear resolution.
+namespace CV {
+enum class Interpolation {
+    Nearest,
+    Bilinear,
+    Bicubic,
+    Area // box-filter average when downscaling, bilinear when upscaling
+};
+
+// x' = m[0] x + m[1] y + m[2], y' = m[3] x + m[4] y + m[5]
+using AffineMatrix = std::array<double, 6>;
+// Row-major 3x3 homography acting on (x, y, 1).
+using Homography = std::array<double, 9>;
+
+struct WarpParams {
+    Interpolation interpolation = Interpolation::Bilinear; // Nearest or Bilinear, others fall back to Bilinear
+    Border border = {BorderMode::Constant, 0.0f};
+    bool inverse_map = false; // the matrix already maps destination to source pixels
+};
+
+[[nodiscard]] inline auto invert(const AffineMatrix &m) -> AffineMatrix {
+    const double det = m[0] * m[4] - m[1] * m[3];
+    if (std::abs(det) < 1e-12) PANIC(std::format("invert: singular affine matrix (det = {})", det));
+    const double a = m[4] / det;
+    const double b = -m[1] / det;
+    const double d = -m[3] / det;
+    const double e = m[0] / det;
+    return {a, b, -(a * m[2] + b * m[5]), d, e, -(d * m[2] + e * m[5])};
+}
+
+[[nodiscard]] inline auto invert(const Homography &h) -> Homography {
+    const double c0 = h[4] * h[8] - h[5] * h[7];
+    const double c1 = h[5] * h[6] - h[3] * h[8];
+    const double c2 = h[3] * h[7] - h[4] * h[6];
+    const double det = h[0] * c0 + h[1] * c1 + h[2] * c2;
+    if (std::abs(det) < 1e-12) PANIC(std::format("invert: singular homography (det = {})", det));
+    const double s = 1.0 / det;
+    return {c0 * s, (h[2] * h[7] - h[1] * h[8]) * s, (h[1] * h[5] - h[2] * h[4]) * s,
+        c1 * s, (h[0] * h[8] - h[2] * h[6]) * s, (h[2] * h[3] - h[0] * h[5]) * s,
+        c2 * s, (h[1] * h[6] - h[0] * h[7]) * s, (h[0] * h[4] - h[1] * h[3]) * s};
+}
+
+// Rotation by `degrees` (counter-clockwise on screen) and uniform scaling about `center`.
+[[nodiscard]] inline auto rotation_matrix(Position center, double degrees, double scale = 1.0) -> AffineMatrix {
+    const double rad = degrees * std::numbers::pi / 180.0;
+    const double a = scale * std::cos(rad);
+    const double b = scale * std::sin(rad);
+    const double cx = center.x;
+    const double cy = center.y;
+    return {a, b, (1.0 - a) * cx - b * cy, -b, a, b * cx + (1.0 - a) * cy};
+}
+
+namespace Resample {
+inline constexpr int horizontal_bits = 14;                   // horizontal weights
+inline constexpr int intermediate_shift = 9;                 // Q14 -> Q5 intermediate rows
+inline constexpr int vertical_bits = 11;                     // vertical weights
+inline constexpr int output_shift = horizontal_bits - intermediate_shift + vertical_bits; // 16
+
+// Taps of every output sample along one axis; index is clamped to [0, n).
+struct Coefficients {
+    int taps = 0;
+    std::vector<int32_t> index;  // size() * taps
+    std::vector<int16_t> weight; // size() * taps, each group sums to 1 << bits
+
+    [[nodiscard]] auto size() const -> int { return taps > 0 ? static_cast<int>(index.size()) / taps : 0; }
+};
+
+[[nodiscard]] inline auto cubic(double x) -> double {
+    constexpr double a = -0.75;
+    x = std::abs(x);
+    if (x < 1.0) return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+    if (x < 2.0) return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+    return 0.0;
+}
+
+// Output sample i covers source [i * scale, (i + 1) * scale); its centre maps to
+// (i + 0.5) * scale - 0.5 in source pixel coordinates.
+[[nodiscard]] inline auto coefficients(int n_src, int n_dst, Interpolation interp, int bits) -> Coefficients {
+    const double scale = static_cast<double>(n_src) / static_cast<double>(n_dst);
+    if (interp == Interpolation::Area && scale <= 1.0) interp = Interpolation::Bilinear;
+    Coefficients out;
+    switch (interp) {
+    case Interpolation::Nearest: out.taps = 1; break;
+    case Interpolation::Bilinear: out.taps = 2; break;
+    case Interpolation::Bicubic: out.taps = 4; break;
+    case Interpolation::Area: out.taps = static_cast<int>(std::ceil(scale)) + 1; break;
+    }
+    const auto taps = static_cast<size_t>(out.taps);
+    out.index.resize(static_cast<size_t>(n_dst) * taps);
+    out.weight.resize(static_cast<size_t>(n_dst) * taps);
+    std::vector<double> w(taps);
+    const double one = static_cast<double>(1 << bits);
+
+    for (int i = 0; i < n_dst; ++i) {
+        int start = 0;
+        std::fill(w.begin(), w.end(), 0.0);
+        const double centre = (i + 0.5) * scale - 0.5;
+        switch (interp) {
+        case Interpolation::Nearest:
+            start = std::min(static_cast<int>((i + 0.5) * scale), n_src - 1);
+            w[0] = 1.0;
+            break;
+        case Interpolation::Bilinear: {
+            start = static_cast<int>(std::floor(centre));
+            const double t = centre - start;
+            w[0] = 1.0 - t;
+            w[1] = t;
+            break;
+        }
+        case Interpolation::Bicubic: {
+            const int base = static_cast<int>(std::floor(centre));
+            const double t = centre - base;
+            start = base - 1;
+            for (size_t k = 0; k < 4; ++k) w[k] = cubic(t + 1.0 - static_cast<double>(k));
+            break;
+        }
+        case Interpolation::Area: {
+            const double s0 = i * scale;
+            const double s1 = std::min((i + 1) * scale, static_cast<double>(n_src));
+            start = static_cast<int>(std::floor(s0));
+            for (size_t k = 0; k < taps; ++k) {
+                const double lo = std::max(s0, static_cast<double>(start) + static_cast<double>(k));
+                const double hi = std::min(s1, static_cast<double>(start) + static_cast<double>(k) + 1.0);
+                w[k] = std::max(0.0, hi - lo) / (s1 - s0);
+            }
+            break;
+        }
+        }
+
+        // Round, then push the rounding residue onto the largest tap so the
+        // weights sum to exactly one and flat regions stay flat.
+        const size_t base = static_cast<size_t>(i) * taps;
+        int sum = 0;
+        size_t largest = 0;
+        for (size_t k = 0; k < taps; ++k) {
+            const auto q = static_cast<int>(std::lround(w[k] * one));
+            out.weight[base + k] = static_cast<int16_t>(q);
+            out.index[base + k] = std::clamp(start + static_cast<int>(k), 0, n_src - 1);
+            sum += q;
+            if (std::abs(w[k]) > std::abs(w[largest])) largest = k;
+        }
+        out.weight[base + largest] = static_cast<int16_t>(out.weight[base + largest] + (1 << bits) - sum);
+    }
+    return out;
+}
+
+// Filters one source row into a Q5 intermediate row of n_dst * C values.
+template <int C>
+inline auto horizontal(const uint8_t *src, const Coefficients &cx, int16_t *dst) -> void {
+    const int taps = cx.taps;
+    const int n = cx.size();
+    const int32_t *index = cx.index.data();
+    const int16_t *weight = cx.weight.data();
+    constexpr int32_t round = 1 << (intermediate_shift - 1);
+    constexpr auto channels = static_cast<size_t>(C);
+    for (int x = 0; x < n; ++x, index += taps, weight += taps, dst += channels) {
+        std::array<int32_t, channels> acc;
+        acc.fill(round);
+        for (int k = 0; k < taps; ++k) {
+            const uint8_t *p = src + static_cast<size_t>(index[k]) * channels;
+            const int32_t wk = weight[k];
+            for (size_t c = 0; c < channels; ++c) acc[c] += wk * p[c];
+        }
+        for (size_t c = 0; c < channels; ++c) dst[c] = static_cast<int16_t>(acc[c] >> intermediate_shift);
+    }
+}
+
+using VerticalFn = void (*)(const int16_t *const *rows, const int16_t *weight, int taps, uint8_t *dst, size_t i, size_t n);
+
+// Combines `taps` intermediate rows into bytes [i, n) of dst.
+inline auto vertical_scalar(const int16_t *const *rows, const int16_t *weight, int taps, uint8_t *dst, size_t i, size_t n) -> void {
+    for (; i < n; ++i) {
+        int32_t acc = 1 << (output_shift - 1);
+        for (int k = 0; k < taps; ++k) acc += weight[k] * rows[k][i];
+        dst[i] = static_cast<uint8_t>(std::clamp(acc >> output_shift, 0, 255));
+    }
+}
+
+// Two taps' weights interleaved for pmaddwd against interleaved rows.
+[[nodiscard]] inline auto weight_pair(const int16_t *weight, int k, int taps) -> int32_t {
+    const auto lo = static_cast<uint16_t>(weight[k]);
+    const auto hi = static_cast<uint16_t>(k + 1 < taps ? weight[k + 1] : 0);
+    return static_cast<int32_t>(static_cast<uint32_t>(lo) | (static_cast<uint32_t>(hi) << 16));
+}
+
+#if CV_SIMD_X86
+CV_TARGET_SSE41 inline auto vertical_sse41(const int16_t *const *rows, const int16_t *weight, int taps, uint8_t *dst, size_t i, size_t n) -> void {
+    const __m128i bias = _mm_set1_epi32(1 << (output_shift - 1));
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = bias;
+        __m128i hi = bias;
+        for (int k = 0; k < taps; k += 2) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k] + i));
+            const __m128i b = k + 1 < taps ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k + 1] + i)) : _mm_setzero_si128();
+            const __m128i w = _mm_set1_epi32(weight_pair(weight, k, taps));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+        const __m128i words = _mm_packs_epi32(_mm_srai_epi32(lo, output_shift), _mm_srai_epi32(hi, output_shift));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(words, words));
+    }
+    vertical_scalar(rows, weight, taps, dst, i, n);
+}
+
+CV_TARGET_AVX2 inline auto vertical_avx2(const int16_t *const *rows, const int16_t *weight, int taps, uint8_t *dst, size_t i, size_t n) -> void {
+    const __m256i bias = _mm256_set1_epi32(1 << (output_shift - 1));
+    for (; i + 16 <= n; i += 16) {
+        __m256i lo = bias;
+        __m256i hi = bias;
+        for (int k = 0; k < taps; k += 2) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows[k] + i));
+            const __m256i b = k + 1 < taps ? _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows[k + 1] + i)) : _mm256_setzero_si256();
+            const __m256i w = _mm256_set1_epi32(weight_pair(weight, k, taps));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+        // Unpack and pack are both per 128-bit lane, so the order is restored;
+        // only the two lanes' byte halves need gathering.
+        const __m256i words = _mm256_packs_epi32(_mm256_srai_epi32(lo, output_shift), _mm256_srai_epi32(hi, output_shift));
+        const __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm256_castsi256_si128(bytes));
+    }
+    vertical_sse41(rows, weight, taps, dst, i, n);
+}
+#endif
+
+[[nodiscard]] inline auto vertical_kernel() -> VerticalFn {
+#if CV_SIMD_X86
+    switch (Simd::active_level()) {
+    case Simd::Level::AVX512:
+    case Simd::Level::AVX2: return vertical_avx2;
+    case Simd::Level::SSE41: return vertical_sse41;
+    case Simd::Level::Scalar: break;
+    }
+#endif
+    return vertical_scalar;
+}
+
+template <int C>
+inline auto resize_nearest(ImageView<const uint8_t, C> src, ImageView<uint8_t, C> dst) -> void {
+    const Coefficients cx = coefficients(src.width, dst.width, Interpolation::Nearest, 0);
+    const Coefficients cy = coefficients(src.height, dst.height, Interpolation::Nearest, 0);
+    parallel_for(0, dst.height, 32, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t *s = src.row(cy.index[static_cast<size_t>(y)]);
+            uint8_t *d = dst.row(y);
+            for (int x = 0; x < dst.width; ++x) {
+                std::memcpy(d + static_cast<size_t>(x) * C, s + static_cast<size_t>(cx.index[static_cast<size_t>(x)]) * C, C);
+            }
+        }
+    });
+}
+} // namespace Resample
+
+// Resamples src to the size of dst. Borders replicate the edge pixels.
+// Bilinear and bicubic do not prefilter, so use Area for strong downscaling.
+template <int C>
+inline auto resize(ImageView<const uint8_t, C> src, ImageView<uint8_t, C> dst, Interpolation interp = Interpolation::Bilinear) -> void {
+    if (src.empty() || dst.empty()) return;
+    if (interp == Interpolation::Nearest) {
+        Resample::resize_nearest<C>(src, dst);
+        return;
+    }
+    const Resample::Coefficients cx = Resample::coefficients(src.width, dst.width, interp, Resample::horizontal_bits);
+    const Resample::Coefficients cy = Resample::coefficients(src.height, dst.height, interp, Resample::vertical_bits);
+    const Resample::VerticalFn vertical = Resample::vertical_kernel();
+    const size_t row_len = dst.row_elements();
+    const int taps = cy.taps;
+
+    parallel_for(0, dst.height, 16, [&](int y0, int y1) {
+        // The source rows of one output row are a contiguous clamped range of at
+        // most `taps` distinct indices, so index % taps never collides.
+        ArenaScope scope;
+        const std::span<int16_t> ring = scope.array<int16_t>(row_len * static_cast<size_t>(taps));
+        const std::span<int> tag = scope.array<int>(static_cast<size_t>(taps), -1);
+        const std::span<const int16_t *> rows = scope.array<const int16_t *>(static_cast<size_t>(taps));
+        for (int y = y0; y < y1; ++y) {
+            const int32_t *index = cy.index.data() + static_cast<size_t>(y) * static_cast<size_t>(taps);
+            for (int k = 0; k < taps; ++k) {
+                const int sy = index[k];
+                const auto slot = static_cast<size_t>(sy % taps);
+                int16_t *buffer = ring.data() + slot * row_len;
+                if (tag[slot] != sy) {
+                    Resample::horizontal<C>(src.row(sy), cx, buffer);
+                    tag[slot] = sy;
+                }
+                rows[static_cast<size_t>(k)] = buffer;
+            }
+            vertical(rows.data(), cy.weight.data() + static_cast<size_t>(y) * static_cast<size_t>(taps), taps, dst.row(y), 0, row_len);
+        }
+    });
+}
+
+template <int C>
+[[nodiscard]] inline auto resize(ImageView<const uint8_t, C> src, int width, int height,
+    Interpolation interp = Interpolation::Bilinear) -> Image<uint8_t, C> {
+    Image<uint8_t, C> out(width, height);
+    resize<C>(src, out.view(), interp);
+    return out;
+}
+
+// Downscales (never upscales) so the longer side is at most max_side, keeping the aspect ratio.
+template <int C>
+[[nodiscard]] inline auto thumbnail(ImageView<const uint8_t, C> src, int max_side) -> Image<uint8_t, C> {
+    const int longest = std::max(src.width, src.height);
+    if (src.empty() || max_side <= 0) return {};
+    if (longest <= max_side) {
+        Image<uint8_t, C> out(src.width, src.height);
+        for (int y = 0; y < src.height; ++y) std::memcpy(out.view().row(y), src.row(y), src.row_elements());
+        return out;
+    }
+    const double s = static_cast<double>(max_side) / static_cast<double>(longest);
+    const int w = std::max(1, static_cast<int>(std::lround(src.width * s)));
+    const int h = std::max(1, static_cast<int>(std::lround(src.height * s)));
+    return resize<C>(src, w, h, Interpolation::Area);
+}
+
+namespace detail {
+inline constexpr int warp_tile_width = 128;
+inline constexpr int warp_tile_height = 32;
+inline constexpr int warp_bits = 16;     // source coordinate precision
+inline constexpr int warp_frac_bits = 5; // bilinear weight precision per axis
+
+// Source coordinates far outside the image are clamped so the Q16 values and
+// the border index arithmetic stay in range.
+[[nodiscard]] inline auto to_fixed(double v) -> int64_t {
+    return std::llround(std::clamp(v, -1e8, 1e8) * (1 << warp_bits));
+}
+
+template <int C>
+struct WarpSampler {
+    ImageView<const uint8_t, C> src;
+    Border border;
+    bool nearest = false;
+    uint8_t fill = 0;
+
+    // Fetches pixel (x, y) through the border rule; returns nullptr for Constant fill.
+    [[nodiscard]] auto fetch(int x, int y) const -> const uint8_t * {
+        const int bx = border_index(x, src.width, border.mode);
+        const int by = border_index(y, src.height, border.mode);
+        if (bx < 0 || by < 0) return nullptr;
+        return src.row(by) + static_cast<size_t>(bx) * C;
+    }
+
+    auto sample(int64_t fx, int64_t fy, uint8_t *out) const -> void {
+        if (nearest) {
+            const auto x = static_cast<int>((fx + (int64_t{1} << (warp_bits - 1))) >> warp_bits);
+            const auto y = static_cast<int>((fy + (int64_t{1} << (warp_bits - 1))) >> warp_bits);
+            const uint8_t *p = fetch(x, y);
+            for (int c = 0; c < C; ++c) out[c] = p ? p[c] : fill;
+            return;
+        }
+        constexpr int one = 1 << warp_frac_bits;
+        const auto x = static_cast<int>(fx >> warp_bits);
+        const auto y = static_cast<int>(fy >> warp_bits);
+        const auto ax = static_cast<int>((fx >> (warp_bits - warp_frac_bits)) & (one - 1));
+        const auto ay = static_cast<int>((fy >> (warp_bits - warp_frac_bits)) & (one - 1));
+        constexpr int round = 1 << (2 * warp_frac_bits - 1);
+        if (static_cast<unsigned>(x) < static_cast<unsigned>(src.width - 1) && static_cast<unsigned>(y) < static_cast<unsigned>(src.height - 1)) {
+            const uint8_t *p = src.row(y) + static_cast<size_t>(x) * C;
+            const uint8_t *q = src.row(y + 1) + static_cast<size_t>(x) * C;
+            for (int c = 0; c < C; ++c) {
+                const int top = p[c] * (one - ax) + p[c + C] * ax;
+                const int bottom = q[c] * (one - ax) + q[c + C] * ax;
+                out[c] = static_cast<uint8_t>((top * (one - ay) + bottom * ay + round) >> (2 * warp_frac_bits));
+            }
+            return;
+        }
+        if (border.mode == BorderMode::Constant && (x < -1 || y < -1 || x >= src.width || y >= src.height)) {
+            for (int c = 0; c < C; ++c) out[c] = fill;
+            return;
+        }
+        const uint8_t *p00 = fetch(x, y);
+        const uint8_t *p01 = fetch(x + 1, y);
+        const uint8_t *p10 = fetch(x, y + 1);
+        const uint8_t *p11 = fetch(x + 1, y + 1);
+        for (int c = 0; c < C; ++c) {
+            const int top = (p00 ? p00[c] : fill) * (one - ax) + (p01 ? p01[c] : fill) * ax;
+            const int bottom = (p10 ? p10[c] : fill) * (one - ax) + (p11 ? p11[c] : fill) * ax;
+            out[c] = static_cast<uint8_t>((top * (one - ay) + bottom * ay + round) >> (2 * warp_frac_bits));
+        }
+    }
+};
+
+// Runs fn(x0, x1, y) for every row segment of every output tile, in parallel over tiles.
+template <typename F>
+inline auto for_each_warp_tile(int width, int height, F &&fn) -> void {
+    parallel_for_tiles(width, height, warp_tile_width, warp_tile_height, [&](Tile tile) {
+        for (int y = tile.y0; y < tile.y1; ++y) fn(tile.x0, tile.x1, y);
+    });
+}
+
+template <int C>
+[[nodiscard]] inline auto make_sampler(ImageView<const uint8_t, C> src, const WarpParams &params) -> WarpSampler<C> {
+    return {src, params.border, params.interpolation == Interpolation::Nearest,
+        static_cast<uint8_t>(std::clamp(std::lround(params.border.value), 0l, 255l))};
+}
+} // namespace detail
+
+// dst(x, y) = src(M^-1 (x, y)); with params.inverse_map the matrix is used as is.
+template <int C>
+inline auto warp_affine(ImageView<const uint8_t, C> src, ImageView<uint8_t, C> dst, const AffineMatrix &matrix, const WarpParams &params = {}) -> void {
+    if (src.empty() || dst.empty()) return;
+    const AffineMatrix m = params.inverse_map ? matrix : invert(matrix);
+    const detail::WarpSampler<C> sampler = detail::make_sampler<C>(src, params);
+    const int64_t dx = detail::to_fixed(m[0]);
+    const int64_t dy = detail::to_fixed(m[3]);
+    detail::for_each_warp_tile(dst.width, dst.height, [&](int x0, int x1, int y) {
+        int64_t fx = detail::to_fixed(m[0] * x0 + m[1] * y + m[2]);
+        int64_t fy = detail::to_fixed(m[3] * x0 + m[4] * y + m[5]);
+        uint8_t *d = dst.row(y) + static_cast<size_t>(x0) * C;
+        for (int x = x0; x < x1; ++x, fx += dx, fy += dy, d += C) sampler.sample(fx, fy, d);
+    });
+}
+
+template <int C>
+inline auto warp_perspective(ImageView<const uint8_t, C> src, ImageView<uint8_t, C> dst, const Homography &matrix, const WarpParams &params = {}) -> void {
+    if (src.empty() || dst.empty()) return;
+    const Homography h = params.inverse_map ? matrix : invert(matrix);
+    const detail::WarpSampler<C> sampler = detail::make_sampler<C>(src, params);
+    // Points on the horizon map outside any image.
+    constexpr int64_t outside = int64_t{-1000000} << detail::warp_bits;
+    detail::for_each_warp_tile(dst.width, dst.height, [&](int x0, int x1, int y) {
+        double X = h[0] * x0 + h[1] * y + h[2];
+        double Y = h[3] * x0 + h[4] * y + h[5];
+        double W = h[6] * x0 + h[7] * y + h[8];
+        uint8_t *d = dst.row(y) + static_cast<size_t>(x0) * C;
+        for (int x = x0; x < x1; ++x, X += h[0], Y += h[3], W += h[6], d += C) {
+            if (std::abs(W) > 1e-12) {
+                const double inv = 1.0 / W;
+                sampler.sample(detail::to_fixed(X * inv), detail::to_fixed(Y * inv), d);
+            } else {
+                sampler.sample(outside, outside, d);
+            }
+        }
+    });
+}
+} // namespace CV
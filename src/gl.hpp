@@ -1,6 +1,7 @@
 /* danielsinkin97@gmail.com */
 #pragma once
 
+#include <format>
 #include <fstream>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
@@ -32,20 +33,34 @@ public:
     }
     static auto unbind() -> void { glUseProgram(GL_ZERO); }
 
+    // Hot paths look a location up once with get_uniform and set it directly.
+    static auto set_uniform(UniformLocation location, int value) -> void { glUniform1i(location, value); } // also samplers
+    static auto set_uniform(UniformLocation location, float value) -> void { glUniform1f(location, value); }
+    static auto set_uniform(UniformLocation location, const glm::vec2 &v) -> void { glUniform2f(location, v.x, v.y); }
+    static auto set_uniform(UniformLocation location, const glm::vec3 &v) -> void { glUniform3f(location, v.x, v.y, v.z); }
+    static auto set_uniform(UniformLocation location, const glm::vec4 &v) -> void { glUniform4f(location, v.x, v.y, v.z, v.w); }
+    static auto set_uniform(UniformLocation location, const glm::mat4 &m) -> void {
+        glUniformMatrix4fv(location, 1, GL_FALSE, &m[0][0]);
+    }
+
     auto set_uniform(const std::string &name, float value) const -> void {
-        glUniform1f(get_uniform(name), value);
+        set_uniform(get_uniform(name), value);
     }
 
     auto set_uniform(const std::string &name, const glm::vec2 &v) const -> void {
-        glUniform2f(get_uniform(name), v.x, v.y);
+        set_uniform(get_uniform(name), v);
     }
 
     auto set_uniform(const std::string &name, const glm::vec3 &v) const -> void {
-        glUniform3f(get_uniform(name), v.x, v.y, v.z);
+        set_uniform(get_uniform(name), v);
     }
 
     auto set_uniform(const std::string &name, const glm::vec4 &v) const -> void {
-        glUniform4f(get_uniform(name), v.x, v.y, v.z, v.w);
+        set_uniform(get_uniform(name), v);
+    }
+
+    auto set_uniform(const std::string &name, const glm::mat4 &m) const -> void {
+        set_uniform(get_uniform(name), m);
     }
 
     auto load(const char *vertex_path, const char *fragment_path) -> void {
@@ -62,26 +77,43 @@ public:
         if (!success) {
             char info_log[512];
             glGetProgramInfoLog(m_id, 512, nullptr, info_log);
-            LOG_ERR("Shader Program Linking Failed:\n" + std::string(info_log));
+            LOG_ERR("Shader Program Linking Failed:\n{}", info_log);
             PANIC("Shader Program linking failed");
         }
 
         glDeleteShader(vert);
         glDeleteShader(frag);
+        resolve_uniforms();
 
-        LOG_INFO(std::string("Shader program loaded: ") + vertex_path + " / " + fragment_path);
+        LOG_INFO("Shader program loaded: {} / {}", vertex_path, fragment_path);
+    }
+
+    // Caches the location of every active uniform right after linking, so no
+    // lookup ever reaches the driver afterwards.
+    auto resolve_uniforms() -> void {
+        m_uniforms.clear();
+        GLint count = 0;
+        glGetProgramiv(m_id, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; ++i) {
+            char name[256];
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(m_id, static_cast<GLuint>(i), sizeof(name), &length, &size, &type, name);
+            m_uniforms.emplace(std::string(name, static_cast<size_t>(length)), glGetUniformLocation(m_id, name));
+        }
     }
 
     [[nodiscard]] auto get_uniform(const std::string &name) const -> UniformLocation {
         auto it = m_uniforms.find(name);
         if (it != m_uniforms.end()) return it->second;
-        PANIC("Uniform not found: " + name);
+        PANIC(std::format("Uniform not found: {}", name));
     }
 
     [[nodiscard]] auto compile_shader_from_file(const char *filepath, GLenum type) -> ShaderID {
         std::ifstream in(filepath);
         if (!in) {
-            LOG_ERR("Couldn't open shader file: " + std::string(filepath));
+            LOG_ERR("Couldn't open shader file: {}", filepath);
             PANIC("Shader file open failed");
         }
 
@@ -99,7 +131,7 @@ public:
         if (!success) {
             char error_log[512];
             glGetShaderInfoLog(shader, 512, nullptr, error_log);
-            LOG_ERR(std::string("Shader Compilation Failed (") + filepath + "):\n" + error_log);
+            LOG_ERR("Shader Compilation Failed ({}):\n{}", filepath, error_log);
             PANIC("Shader compile error");
         }
 
@@ -111,6 +143,7 @@ struct GeometryBuffers {
     VAO vao = GL_ZERO;
     VBO vbo = GL_ZERO;
     EBO ebo = GL_ZERO;
+    GLsizei index_count = 0;
 };
 
 template <size_t VertexCount, size_t IndexCount>
@@ -118,6 +151,7 @@ template <size_t VertexCount, size_t IndexCount>
     const std::array<float, VertexCount> &vertices,
     const std::array<unsigned int, IndexCount> &indices) -> GeometryBuffers {
     GeometryBuffers gb;
+    gb.index_count = static_cast<GLsizei>(IndexCount);
 
     glGenVertexArrays(1, &gb.vao);
     glBindVertexArray(gb.vao);
@@ -135,9 +169,7 @@ template <size_t VertexCount, size_t IndexCount>
 
     glBindVertexArray(0);
 
-    LOG_INFO("Created geometry: VAO = " + std::to_string(gb.vao) +
-             ", VBO = " + std::to_string(gb.vbo) +
-             ", EBO = " + std::to_string(gb.ebo));
+    LOG_INFO("Created geometry: VAO = {}, VBO = {}, EBO = {}", gb.vao, gb.vbo, gb.ebo);
 
     return gb;
 }
@@ -161,11 +193,4 @@ inline auto draw_simple_vao(const GeometryBuffers &geom, GLsizei index_count) ->
     glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, nullptr);
     glBindVertexArray(0);
 }
-
-struct ImageTexture {
-    TextureID id;
-    int width;
-    int height;
-    int channels;
-};
 } // namespace GL
\ No newline at end of file
@@ -3,9 +3,20 @@
 #include <SDL.h>
 #include <chrono>
 #include <imgui.h>
+#include <memory>
+#include <optional>
 
+#include "cache.hpp"
+#include "canny.hpp"
+#include "components.hpp"
 #include "constants.hpp"
+#include "features.hpp"
 #include "gl.hpp"
+#include "histogram.hpp"
+#include "image.hpp"
+#include "overlay.hpp"
+#include "stream.hpp"
+#include "texture.hpp"
 #include "types.hpp"
 
 struct RendererState {
@@ -20,7 +31,8 @@ struct RendererState {
     GL::GeometryBuffers blit_quad;
     GL::ShaderProgram blit_shader;
 
-    GL::ImageTexture image_texture;
+    GL::StreamingTexture image_view; // what the Computer Vision window shows
+    GL::OverlayRenderer overlay;
 
     int gl_success;
     char gl_error_buffer[512];
@@ -44,6 +56,35 @@ struct InputState {
     Position mouse_pos;
 };
 
+// Pipeline buffer shown in the image view.
+enum class DisplayBuffer {
+    Source,
+    Gray,
+    Edges,
+    Labels // connected components of the edge map
+};
+
+struct VisionState {
+    CV::ImageCache cache{Constants::image_cache_budget};
+    int image_index = 0; // into Constants::fp_images
+    std::shared_ptr<const CV::ImageRGBA8> source_image;
+    std::array<CV::Histogram256, 4> channel_histogram{};
+    CV::Histogram256 luma_histogram{};
+    CV::Keypoints keypoints; // FAST corners of the source image
+    bool show_keypoints = false;
+    DisplayBuffer display = DisplayBuffer::Source;
+    CV::CannyParams canny;
+    CV::ImageGray8 edges;
+    CV::Components components;
+    std::unique_ptr<CV::VideoStream> stream; // streaming mode when set, see main --stream
+    std::optional<CV::FrameTimes> stream_shown; // uploaded this frame, reported after the swap
+    std::array<char, 256> stream_pipeline{};
+};
+
+struct ProfilerViewState {
+    int frames_back = 0; // timeline frame, counted back from the newest one
+};
+
 struct ColorPalette {
     Color background = color_from_u8(15, 15, 21);
 };
@@ -53,6 +94,8 @@ struct Global {
     RendererState renderer;
     SimulationState sim;
     InputState input;
+    VisionState vision;
+    ProfilerViewState profiler_view;
     ColorPalette color;
 };
 inline Global global;
\ No newline at end of file
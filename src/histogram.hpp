@@ -0,0 +1,252 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "image.hpp"
+#include "parallel.hpp"
+
+// Histograms, global equalization and CLAHE.
+//
+// Every parallel chunk counts into its own private histogram (itself split in
+// four interleaved sub-histograms so consecutive equal pixels do not serialize
+// on one counter) and the partial results are summed at the end, so no atomics
+// are needed anywhere.
+namespace CV {
+using Histogram256 = std::array<uint32_t, 256>;
+
+// Configurable-bin histogram over [lo, hi) for float images.
+struct HistogramF {
+    std::vector<uint32_t> bins;
+    float lo = 0.0f;
+    float hi = 1.0f;
+
+    [[nodiscard]] auto bin_width() const -> float { return (hi - lo) / static_cast<float>(bins.size()); }
+};
+
+namespace detail {
+// Counts channel c of rows [y0, y1) into `out`, accumulating.
+template <int C>
+inline auto count_rows(ImageView<const uint8_t, C> src, int c, int y0, int y1, Histogram256 &out) -> void {
+    std::array<Histogram256, 4> sub{};
+    const int w = src.width;
+    for (int y = y0; y < y1; ++y) {
+        const uint8_t *p = src.row(y) + c;
+        int x = 0;
+        for (; x + 4 <= w; x += 4) {
+            ++sub[0][p[C * (x + 0)]];
+            ++sub[1][p[C * (x + 1)]];
+            ++sub[2][p[C * (x + 2)]];
+            ++sub[3][p[C * (x + 3)]];
+        }
+        for (; x < w; ++x) ++sub[0][p[C * x]];
+    }
+    for (size_t i = 0; i < 256; ++i) out[i] += sub[0][i] + sub[1][i] + sub[2][i] + sub[3][i];
+}
+
+// Reduces one private histogram per parallel chunk.
+template <typename Hist, typename F>
+inline auto privatized(int rows, F &&count) -> std::vector<Hist> {
+    const int chunks = std::clamp(rows / 64, 1, worker_count());
+    std::vector<Hist> partial(static_cast<size_t>(chunks));
+    parallel_for(0, chunks, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const int y0 = static_cast<int>(static_cast<long long>(rows) * i / chunks);
+            const int y1 = static_cast<int>(static_cast<long long>(rows) * (i + 1) / chunks);
+            if (y1 - y0 > 0) count(y0, y1, partial[static_cast<size_t>(i)]);
+        }
+    });
+    return partial;
+}
+
+// Maps a cumulative histogram onto [0, 255] (the classic equalization LUT).
+[[nodiscard]] inline auto cdf_lut(const Histogram256 &hist, uint64_t total) -> std::array<uint8_t, 256> {
+    std::array<uint8_t, 256> lut{};
+    size_t first = 0;
+    while (first < 256 && hist[first] == 0) ++first;
+    if (first == 256 || hist[first] == total) {
+        for (size_t i = 0; i < 256; ++i) lut[i] = static_cast<uint8_t>(i);
+        return lut;
+    }
+    const double scale = 255.0 / static_cast<double>(total - hist[first]);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < 256; ++i) {
+        sum += hist[i];
+        const double v = i < first ? 0.0 : static_cast<double>(sum - hist[first]) * scale;
+        lut[i] = static_cast<uint8_t>(std::clamp(std::lround(v), 0l, 255l));
+    }
+    return lut;
+}
+} // namespace detail
+
+// Per-channel 256-bin histograms.
+template <int C>
+[[nodiscard]] inline auto histogram(ImageView<const uint8_t, C> src) -> std::array<Histogram256, static_cast<size_t>(C)> {
+    std::array<Histogram256, static_cast<size_t>(C)> out{};
+    if (src.empty()) return out;
+    struct Partial {
+        std::array<Histogram256, static_cast<size_t>(C)> h{};
+    };
+    auto partial = detail::privatized<Partial>(src.height, [&](int y0, int y1, Partial &p) {
+        for (int c = 0; c < C; ++c) detail::count_rows<C>(src, c, y0, y1, p.h[static_cast<size_t>(c)]);
+    });
+    for (const Partial &p : partial) {
+        for (size_t c = 0; c < static_cast<size_t>(C); ++c) {
+            for (size_t i = 0; i < 256; ++i) out[c][i] += p.h[c][i];
+        }
+    }
+    return out;
+}
+
+[[nodiscard]] inline auto histogram(ImageView<const uint8_t, 1> src) -> Histogram256 {
+    return histogram<1>(src)[0];
+}
+
+// Values outside [lo, hi) are clamped into the first / last bin; NaNs are skipped.
+[[nodiscard]] inline auto histogram(ImageView<const float, 1> src, int bins, float lo, float hi) -> HistogramF {
+    HistogramF out;
+    out.bins.assign(static_cast<size_t>(std::max(1, bins)), 0);
+    out.lo = lo;
+    out.hi = hi > lo ? hi : lo + 1.0f;
+    if (src.empty()) return out;
+    const int n = static_cast<int>(out.bins.size());
+    const float scale = static_cast<float>(n) / (out.hi - out.lo);
+    auto partial = detail::privatized<std::vector<uint32_t>>(src.height,
+        [&](int y0, int y1, std::vector<uint32_t> &h) {
+            h.assign(static_cast<size_t>(n), 0);
+            for (int y = y0; y < y1; ++y) {
+                const float *row = src.row(y);
+                for (int x = 0; x < src.width; ++x) {
+                    const float v = row[x];
+                    if (std::isnan(v)) continue;
+                    const float f = std::clamp((v - out.lo) * scale, 0.0f, static_cast<float>(n - 1));
+                    ++h[static_cast<size_t>(f)];
+                }
+            }
+        });
+    for (const auto &h : partial) {
+        for (size_t i = 0; i < h.size(); ++i) out.bins[i] += h[i];
+    }
+    return out;
+}
+
+inline auto apply_lut(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, const std::array<uint8_t, 256> &lut) -> void {
+    if (src.width != dst.width || src.height != dst.height) PANIC("apply_lut: size mismatch");
+    parallel_for(0, src.height, 64, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t *s = src.row(y);
+            uint8_t *d = dst.row(y);
+            for (int x = 0; x < src.width; ++x) d[x] = lut[s[x]];
+        }
+    });
+}
+
+// Global histogram equalization; src and dst may alias.
+inline auto equalize(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst) -> void {
+    const Histogram256 hist = histogram(src);
+    const auto total = static_cast<uint64_t>(src.width) * static_cast<uint64_t>(src.height);
+    apply_lut(src, dst, detail::cdf_lut(hist, total));
+}
+
+struct ClaheParams {
+    float clip_limit = 2.0f; // multiple of the mean bin height; <= 0 disables clipping
+    int tiles_x = 8;
+    int tiles_y = 8;
+};
+
+// Contrast-limited adaptive histogram equalization. Each tile gets a clipped
+// equalization LUT; pixels blend the LUTs of the four nearest tile centres
+// bilinearly so tile seams do not show. src and dst may alias.
+inline auto clahe(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, const ClaheParams &params = {}) -> void {
+    if (src.width != dst.width || src.height != dst.height) PANIC("clahe: size mismatch");
+    if (src.empty()) return;
+    const int w = src.width;
+    const int h = src.height;
+    const int tx = std::clamp(params.tiles_x, 1, w);
+    const int ty = std::clamp(params.tiles_y, 1, h);
+    const int tile_w = (w + tx - 1) / tx;
+    const int tile_h = (h + ty - 1) / ty;
+    std::vector<std::array<uint8_t, 256>> luts(static_cast<size_t>(tx * ty));
+
+    parallel_for(0, tx * ty, 1, [&](int begin, int end) {
+        for (int t = begin; t < end; ++t) {
+            const int x0 = (t % tx) * tile_w;
+            const int y0 = (t / tx) * tile_h;
+            const int x1 = std::min(x0 + tile_w, w);
+            const int y1 = std::min(y0 + tile_h, h);
+            auto &lut = luts[static_cast<size_t>(t)];
+            if (x1 <= x0 || y1 <= y0) {
+                for (size_t i = 0; i < 256; ++i) lut[i] = static_cast<uint8_t>(i);
+                continue;
+            }
+            Histogram256 hist{};
+            detail::count_rows<1>(src.roi(x0, y0, x1 - x0, y1 - y0), 0, 0, y1 - y0, hist);
+            const auto area = static_cast<uint64_t>(x1 - x0) * static_cast<uint64_t>(y1 - y0);
+
+            if (params.clip_limit > 0.0f) {
+                const auto limit = std::max<uint32_t>(1, static_cast<uint32_t>(params.clip_limit * static_cast<float>(area) / 256.0f));
+                uint64_t excess = 0;
+                for (uint32_t &b : hist) {
+                    if (b > limit) {
+                        excess += b - limit;
+                        b = limit;
+                    }
+                }
+                const auto share = static_cast<uint32_t>(excess / 256);
+                const size_t rest = excess % 256;
+                for (uint32_t &b : hist) b += share;
+                // Spread the remainder evenly over the range.
+                if (rest > 0) {
+                    const size_t step = 256 / rest;
+                    for (size_t i = 0, k = 0; k < rest; i += step, ++k) ++hist[i];
+                }
+            }
+            // Plain CDF scaling (no min subtraction) keeps flat tiles flat.
+            const double scale = 255.0 / static_cast<double>(area);
+            uint64_t sum = 0;
+            for (size_t i = 0; i < 256; ++i) {
+                sum += hist[i];
+                lut[i] = static_cast<uint8_t>(std::min<long>(255, std::lround(static_cast<double>(sum) * scale)));
+            }
+        }
+    });
+
+    parallel_for(0, h, 16, [&](int y_begin, int y_end) {
+        std::vector<int> x_tile(static_cast<size_t>(w));
+        std::vector<float> x_frac(static_cast<size_t>(w));
+        for (int x = 0; x < w; ++x) {
+            const float fx = (static_cast<float>(x) + 0.5f) / static_cast<float>(tile_w) - 0.5f;
+            const int ix = static_cast<int>(std::floor(fx));
+            x_tile[static_cast<size_t>(x)] = ix;
+            x_frac[static_cast<size_t>(x)] = fx - static_cast<float>(ix);
+        }
+        for (int y = y_begin; y < y_end; ++y) {
+            const float fy = (static_cast<float>(y) + 0.5f) / static_cast<float>(tile_h) - 0.5f;
+            const int iy = static_cast<int>(std::floor(fy));
+            const float wy = fy - static_cast<float>(iy);
+            const int r0 = std::clamp(iy, 0, ty - 1);
+            const int r1 = std::clamp(iy + 1, 0, ty - 1);
+            const uint8_t *s = src.row(y);
+            uint8_t *d = dst.row(y);
+            for (int x = 0; x < w; ++x) {
+                const int ix = x_tile[static_cast<size_t>(x)];
+                const float wx = x_frac[static_cast<size_t>(x)];
+                const int c0 = std::clamp(ix, 0, tx - 1);
+                const int c1 = std::clamp(ix + 1, 0, tx - 1);
+                const uint8_t v = s[x];
+                const float a = luts[static_cast<size_t>(r0 * tx + c0)][v];
+                const float b = luts[static_cast<size_t>(r0 * tx + c1)][v];
+                const float c = luts[static_cast<size_t>(r1 * tx + c0)][v];
+                const float e = luts[static_cast<size_t>(r1 * tx + c1)][v];
+                const float top = a + (b - a) * wx;
+                const float bottom = c + (e - c) * wx;
+                d[x] = static_cast<uint8_t>(std::lround(top + (bottom - top) * wy));
+            }
+        }
+    });
+}
+} // namespace CV
@@ -0,0 +1,268 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stb_image.h>
+#include <type_traits>
+
+#include "log.hpp"
+#include "types.hpp"
+
+namespace CV {
+// Row starts of owned images are aligned to a cache line so that every row can
+// be processed with aligned vector loads up to AVX-512 width.
+inline constexpr size_t row_alignment = 64;
+
+// Releases the storage behind an Image. Owned images, adopted stb_image buffers,
+// mapped .cvti files and BufferPool buffers (pooled_image(), released through
+// pool_release_bytes) all go through the same deleter so that kernels never
+// need to know where their pixels came from.
+struct BufferDeleter {
+    void (*release)(void *ptr, size_t bytes, void *ctx) = nullptr;
+    size_t bytes = 0;
+    void *ctx = nullptr;
+
+    auto operator()(void *ptr) const -> void {
+        if (ptr && release) release(ptr, bytes, ctx);
+    }
+};
+
+[[nodiscard]] inline auto aligned_alloc_bytes(size_t bytes) -> void * {
+    return ::operator new(bytes, std::align_val_t{row_alignment});
+}
+
+inline auto aligned_free_bytes(void *ptr, size_t, void *) -> void {
+    ::operator delete(ptr, std::align_val_t{row_alignment});
+}
+
+inline auto stbi_free_bytes(void *ptr, size_t, void *) -> void {
+    stbi_image_free(ptr);
+}
+
+// Number of elements between two row starts so that every row begins on a
+// row_alignment boundary.
+[[nodiscard]] inline auto aligned_stride(int width, int channels, size_t elem_size) -> size_t {
+    const size_t row_bytes = static_cast<size_t>(width) * static_cast<size_t>(channels) * elem_size;
+    const size_t padded = (row_bytes + row_alignment - 1) / row_alignment * row_alignment;
+    return padded / elem_size;
+}
+
+// Integer pixel rectangle covering columns [x, x + width) and rows [y, y + height).
+struct PixelRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// Integer pixel location; see to_position() for the display type.
+struct PixelCoord {
+    int32_t x = 0;
+    int32_t y = 0;
+};
+
+[[nodiscard]] inline auto to_position(const PixelCoord &p) -> Position {
+    return Position{static_cast<float>(p.x), static_cast<float>(p.y)};
+}
+
+// In image space a Rect's position is its top-left corner in pixels and the
+// rectangle extends towards increasing row index, i.e. downwards. Fractional
+// edges are expanded to cover every touched pixel.
+[[nodiscard]] inline auto to_pixel_rect(const Rect &rect) -> PixelRect {
+    const int x0 = static_cast<int>(std::floor(rect.position.x));
+    const int y0 = static_cast<int>(std::floor(rect.position.y));
+    const int x1 = static_cast<int>(std::ceil(rect.position.x + rect.width));
+    const int y1 = static_cast<int>(std::ceil(rect.position.y + rect.height));
+    return PixelRect{x0, y0, x1 - x0, y1 - y0};
+}
+
+[[nodiscard]] inline auto to_rect(const PixelRect &r) -> Rect {
+    return Rect{Position{static_cast<float>(r.x), static_cast<float>(r.y)},
+        static_cast<float>(r.width), static_cast<float>(r.height)};
+}
+
+// Intersection of `r` with a width x height image; may become empty.
+[[nodiscard]] inline auto clip(const PixelRect &r, int width, int height) -> PixelRect {
+    const int x0 = r.x < 0 ? 0 : r.x;
+    const int y0 = r.y < 0 ? 0 : r.y;
+    const int x1 = r.x + r.width > width ? width : r.x + r.width;
+    const int y1 = r.y + r.height > height ? height : r.y + r.height;
+    return PixelRect{x0, y0, x1 > x0 ? x1 - x0 : 0, y1 > y0 ? y1 - y0 : 0};
+}
+
+// Non-owning, strided window into interleaved pixel data. `stride` is measured
+// in elements of T, not in pixels, so a view can describe any sub-rectangle.
+template <typename T, int C>
+struct ImageView {
+    static_assert(C >= 1 && C <= 4, "ImageView supports 1 to 4 channels");
+    using value_type = T;
+    static constexpr int channels = C;
+
+    T *data = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t stride = 0;
+
+    operator ImageView<const T, C>() const
+        requires(!std::is_const_v<T>)
+    {
+        return ImageView<const T, C>{data, width, height, stride};
+    }
+
+    [[nodiscard]] auto empty() const -> bool { return data == nullptr || width <= 0 || height <= 0; }
+    [[nodiscard]] auto row(int y) const -> T * { return data + static_cast<size_t>(y) * stride; }
+    [[nodiscard]] auto at(int x, int y, int c = 0) const -> T & {
+        return row(y)[static_cast<size_t>(x) * C + static_cast<size_t>(c)];
+    }
+    [[nodiscard]] auto row_elements() const -> size_t { return static_cast<size_t>(width) * C; }
+    [[nodiscard]] auto is_contiguous() const -> bool { return stride == row_elements(); }
+
+    [[nodiscard]] auto roi(int x, int y, int w, int h) const -> ImageView {
+        if (x < 0 || y < 0 || w < 0 || h < 0 || x + w > width || y + h > height) {
+            PANIC(std::format("ROI ({}, {}, {}x{}) outside of {}x{} image", x, y, w, h, width, height));
+        }
+        return ImageView{row(y) + static_cast<size_t>(x) * C, w, h, stride};
+    }
+};
+
+// Owning interleaved image with aligned rows, or an adopted external buffer.
+template <typename T, int C>
+class Image {
+public:
+    static_assert(!std::is_const_v<T>, "Image owns mutable storage, use ImageView<const T, C> instead");
+    using value_type = T;
+    static constexpr int channels = C;
+
+    Image() = default;
+    Image(int width, int height)
+        : m_width(width), m_height(height), m_stride(aligned_stride(width, C, sizeof(T))) {
+        if (width <= 0 || height <= 0) {
+            m_width = m_height = 0;
+            m_stride = 0;
+            return;
+        }
+        const size_t bytes = m_stride * static_cast<size_t>(height) * sizeof(T);
+        m_data = Storage(static_cast<T *>(aligned_alloc_bytes(bytes)),
+            BufferDeleter{aligned_free_bytes, bytes, nullptr});
+    }
+
+    // Takes ownership of `data` without copying. The deleter decides how the
+    // memory is returned (stbi_image_free, munmap, a buffer pool, ...).
+    [[nodiscard]] static auto adopt(T *data, int width, int height, size_t stride, BufferDeleter deleter) -> Image {
+        Image img;
+        img.m_data = Storage(data, deleter);
+        img.m_width = width;
+        img.m_height = height;
+        img.m_stride = stride;
+        return img;
+    }
+
+    [[nodiscard]] auto view() -> ImageView<T, C> { return {m_data.get(), m_width, m_height, m_stride}; }
+    [[nodiscard]] auto view() const -> ImageView<const T, C> { return {m_data.get(), m_width, m_height, m_stride}; }
+    [[nodiscard]] auto roi(int x, int y, int w, int h) -> ImageView<T, C> { return view().roi(x, y, w, h); }
+    [[nodiscard]] auto roi(int x, int y, int w, int h) const -> ImageView<const T, C> { return view().roi(x, y, w, h); }
+
+    [[nodiscard]] auto data() -> T * { return m_data.get(); }
+    [[nodiscard]] auto data() const -> const T * { return m_data.get(); }
+    [[nodiscard]] auto row(int y) -> T * { return m_data.get() + static_cast<size_t>(y) * m_stride; }
+    [[nodiscard]] auto row(int y) const -> const T * { return m_data.get() + static_cast<size_t>(y) * m_stride; }
+    [[nodiscard]] auto width() const -> int { return m_width; }
+    [[nodiscard]] auto height() const -> int { return m_height; }
+    [[nodiscard]] auto stride() const -> size_t { return m_stride; }
+    [[nodiscard]] auto empty() const -> bool { return !m_data; }
+    [[nodiscard]] auto size_bytes() const -> size_t { return m_stride * static_cast<size_t>(m_height) * sizeof(T); }
+
+private:
+    using Storage = std::unique_ptr<T, BufferDeleter>;
+
+    Storage m_data;
+    int m_width = 0;
+    int m_height = 0;
+    size_t m_stride = 0;
+};
+
+// Planar image: C single-channel planes of identical geometry in one aligned
+// allocation, so per-channel kernels stream through contiguous memory.
+template <typename T, int C>
+class PlanarImage {
+public:
+    static_assert(C >= 1 && C <= 4, "PlanarImage supports 1 to 4 channels");
+    using value_type = T;
+    static constexpr int channels = C;
+
+    PlanarImage() = default;
+    PlanarImage(int width, int height)
+        : m_plane(width, height * C) {
+        m_height = m_plane.empty() ? 0 : height;
+    }
+
+    [[nodiscard]] auto plane(int c) -> ImageView<T, 1> {
+        return m_plane.roi(0, c * m_height, m_plane.width(), m_height);
+    }
+    [[nodiscard]] auto plane(int c) const -> ImageView<const T, 1> {
+        return m_plane.roi(0, c * m_height, m_plane.width(), m_height);
+    }
+
+    [[nodiscard]] auto width() const -> int { return m_plane.width(); }
+    [[nodiscard]] auto height() const -> int { return m_height; }
+    [[nodiscard]] auto stride() const -> size_t { return m_plane.stride(); }
+    [[nodiscard]] auto empty() const -> bool { return m_plane.empty(); }
+    [[nodiscard]] auto size_bytes() const -> size_t { return m_plane.size_bytes(); }
+
+private:
+    Image<T, 1> m_plane;
+    int m_height = 0;
+};
+
+using ImageGray8 = Image<uint8_t, 1>;
+using ImageRGBA8 = Image<uint8_t, 4>;
+using ImageGray16 = Image<uint16_t, 1>;
+using ImageGrayF = Image<float, 1>;
+using ImageLabel = Image<uint32_t, 1>;
+using PlanarRGBAF = PlanarImage<float, 4>;
+
+// Copies pixel data between views of identical size, row by row.
+template <typename T, int C>
+inline auto copy(ImageView<const T, C> src, ImageView<T, C> dst) -> void {
+    if (src.width != dst.width || src.height != dst.height) PANIC("copy: size mismatch");
+    for (int y = 0; y < src.height; ++y) {
+        std::memcpy(dst.row(y), src.row(y), src.row_elements() * sizeof(T));
+    }
+}
+
+template <typename T, int C>
+[[nodiscard]] inline auto clone(ImageView<const T, C> src) -> Image<std::remove_const_t<T>, C> {
+    Image<std::remove_const_t<T>, C> out(src.width, src.height);
+    if (!out.empty()) copy<std::remove_const_t<T>, C>(src, out.view());
+    return out;
+}
+
+// Decodes an image file with stb_image and adopts the decoded buffer without
+// copying. Returns an empty image and logs the reason on failure.
+template <typename T, int C>
+[[nodiscard]] inline auto load_image(const char *path) -> Image<T, C> {
+    int width = 0, height = 0, file_channels = 0;
+    T *pixels = nullptr;
+    if constexpr (std::is_same_v<T, uint8_t>) {
+        pixels = stbi_load(path, &width, &height, &file_channels, C);
+    } else if constexpr (std::is_same_v<T, uint16_t>) {
+        pixels = stbi_load_16(path, &width, &height, &file_channels, C);
+    } else if constexpr (std::is_same_v<T, float>) {
+        pixels = stbi_loadf(path, &width, &height, &file_channels, C);
+    } else {
+        static_assert(sizeof(T) == 0, "load_image supports uint8_t, uint16_t and float");
+    }
+    if (!pixels) {
+        LOG_ERR("Failed to load image {}. (Reason:{})", path, stbi_failure_reason());
+        return {};
+    }
+    const size_t stride = static_cast<size_t>(width) * C;
+    return Image<T, C>::adopt(pixels, width, height, stride,
+        BufferDeleter{stbi_free_bytes, stride * static_cast<size_t>(height) * sizeof(T), nullptr});
+}
+} // namespace CV
@@ -0,0 +1,266 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "image.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "types.hpp"
+
+// Summed-area tables with O(1) box sum, mean and variance queries.
+//
+// Tables are (width + 1) x (height + 1) with a zero first row and column, so
+// sum(x0, y0, x1, y1) = S[y1][x1] - S[y0][x1] - S[y1][x0] + S[y0][x0].
+// The u8 sum table is u32 and relies on modular arithmetic: any box whose true
+// sum fits in 32 bits (area < 16.8 MP) is exact even if the table wraps.
+namespace CV {
+template <typename T>
+struct IntegralTypes;
+template <>
+struct IntegralTypes<uint8_t> {
+    using Sum = uint32_t;
+    using SqSum = uint64_t;
+};
+template <>
+struct IntegralTypes<uint16_t> {
+    using Sum = uint64_t;
+    using SqSum = uint64_t;
+};
+template <>
+struct IntegralTypes<float> {
+    using Sum = double;
+    using SqSum = double;
+};
+
+namespace Integral {
+// One table row: sum[x + 1] = above[x + 1] + src[0] + ... + src[x], same for
+// the squares. sum[0] / sq[0] are left for the caller (always zero).
+template <typename T, typename Sum, typename SqSum>
+inline auto scan_row_scalar(const T *src, int n, const Sum *sum_above, const SqSum *sq_above, Sum *sum, SqSum *sq) -> void {
+    Sum s = 0;
+    SqSum q = 0;
+    for (int x = 0; x < n; ++x) {
+        const auto v = src[x];
+        s += static_cast<Sum>(v);
+        q += static_cast<SqSum>(v) * static_cast<SqSum>(v);
+        sum[x + 1] = static_cast<Sum>(s + sum_above[x + 1]);
+        sq[x + 1] = q + sq_above[x + 1];
+    }
+}
+
+template <typename S>
+inline auto add_row_scalar(S *dst, const S *src, size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) dst[i] = static_cast<S>(dst[i] + src[i]);
+}
+
+#if CV_SIMD_X86
+// Inclusive prefix sum of 8 u32 lanes.
+CV_TARGET_AVX2 inline auto scan8_epi32(__m256i x) -> __m256i {
+    x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+    x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+    const __m256i low_total = _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(3));
+    return _mm256_add_epi32(x, _mm256_blend_epi32(_mm256_setzero_si256(), low_total, 0xF0));
+}
+
+// u8 row scan, 8 pixels per step. Squares are scanned in u32 within a step and
+// carried across steps in u64, so arbitrarily wide rows stay exact.
+CV_TARGET_AVX2 inline auto scan_row_u8_avx2(const uint8_t *src, int n, const uint32_t *sum_above,
+    const uint64_t *sq_above, uint32_t *sum, uint64_t *sq) -> void {
+    __m256i carry = _mm256_setzero_si256();
+    __m256i carry_sq = _mm256_setzero_si256();
+    const __m256i last = _mm256_set1_epi32(7);
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        const __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + x)));
+        const __m256i s = _mm256_add_epi32(scan8_epi32(v), carry);
+        const __m256i q = scan8_epi32(_mm256_mullo_epi32(v, v));
+        carry = _mm256_permutevar8x32_epi32(s, last);
+
+        const __m256i above = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sum_above + x + 1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(sum + x + 1), _mm256_add_epi32(s, above));
+
+        const __m256i q_lo = _mm256_add_epi64(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(q)), carry_sq);
+        const __m256i q_hi = _mm256_add_epi64(_mm256_cvtepu32_epi64(_mm256_extracti128_si256(q, 1)), carry_sq);
+        carry_sq = _mm256_permute4x64_epi64(q_hi, 0xFF);
+        const __m256i *sq_src = reinterpret_cast<const __m256i *>(sq_above + x + 1);
+        __m256i *sq_dst = reinterpret_cast<__m256i *>(sq + x + 1);
+        _mm256_storeu_si256(sq_dst, _mm256_add_epi64(q_lo, _mm256_loadu_si256(sq_src)));
+        _mm256_storeu_si256(sq_dst + 1, _mm256_add_epi64(q_hi, _mm256_loadu_si256(sq_src + 1)));
+    }
+    uint32_t s = static_cast<uint32_t>(_mm256_cvtsi256_si32(carry));
+    uint64_t q = static_cast<uint64_t>(_mm256_extract_epi64(carry_sq, 0));
+    for (; x < n; ++x) {
+        const uint32_t v = src[x];
+        s += v;
+        q += v * v;
+        sum[x + 1] = s + sum_above[x + 1];
+        sq[x + 1] = q + sq_above[x + 1];
+    }
+}
+
+template <typename S>
+CV_TARGET_AVX2 inline auto add_row_avx2(S *dst, const S *src, size_t n) -> void {
+    size_t i = 0;
+    if constexpr (std::is_same_v<S, double>) {
+        for (; i + 4 <= n; i += 4) _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(dst + i), _mm256_loadu_pd(src + i)));
+    } else {
+        constexpr size_t lanes = 32 / sizeof(S);
+        for (; i + lanes <= n; i += lanes) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            const __m256i r = sizeof(S) == 4 ? _mm256_add_epi32(a, b) : _mm256_add_epi64(a, b);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), r);
+        }
+    }
+    add_row_scalar(dst + i, src + i, n - i);
+}
+#endif
+
+template <typename T, typename Sum, typename SqSum>
+inline auto scan_row(const T *src, int n, const Sum *sum_above, const SqSum *sq_above, Sum *sum, SqSum *sq) -> void {
+#if CV_SIMD_X86
+    if constexpr (std::is_same_v<T, uint8_t>) {
+        if (Simd::active_level() >= Simd::Level::AVX2) return scan_row_u8_avx2(src, n, sum_above, sq_above, sum, sq);
+    }
+#endif
+    scan_row_scalar(src, n, sum_above, sq_above, sum, sq);
+}
+
+template <typename S>
+inline auto add_row(S *dst, const S *src, size_t n) -> void {
+#if CV_SIMD_X86
+    if (Simd::active_level() >= Simd::Level::AVX2) return add_row_avx2(dst, src, n);
+#endif
+    add_row_scalar(dst, src, n);
+}
+} // namespace Integral
+
+template <typename T>
+class IntegralImage {
+public:
+    using Sum = typename IntegralTypes<T>::Sum;
+    using SqSum = typename IntegralTypes<T>::SqSum;
+
+    IntegralImage() = default;
+    explicit IntegralImage(ImageView<const T, 1> src) { build(src); }
+
+    // Builds both tables. Horizontal strips are scanned in parallel (row prefix
+    // sums accumulated down the strip), then every strip after the first gets
+    // the running total of the strips above it added in a parallel fixup pass.
+    auto build(ImageView<const T, 1> src) -> void {
+        m_width = src.width;
+        m_height = src.height;
+        m_sum = Image<Sum, 1>(m_width + 1, m_height + 1);
+        m_sqsum = Image<SqSum, 1>(m_width + 1, m_height + 1);
+        if (src.empty()) return;
+
+        const size_t cols = static_cast<size_t>(m_width) + 1;
+        std::fill(m_sum.row(0), m_sum.row(0) + cols, Sum{0});
+        std::fill(m_sqsum.row(0), m_sqsum.row(0) + cols, SqSum{0});
+
+        const int strips = std::clamp(m_height / 32, 1, worker_count());
+        auto strip_begin = [&](int s) {
+            return static_cast<int>(static_cast<long long>(m_height) * s / strips);
+        };
+        const std::vector<Sum> zero_sum(cols, Sum{0});
+        const std::vector<SqSum> zero_sq(cols, SqSum{0});
+
+        parallel_for(0, strips, 1, [&](int s_begin, int s_end) {
+            for (int s = s_begin; s < s_end; ++s) {
+                for (int y = strip_begin(s); y < strip_begin(s + 1); ++y) {
+                    const bool first = y == strip_begin(s);
+                    Sum *sum = m_sum.row(y + 1);
+                    SqSum *sq = m_sqsum.row(y + 1);
+                    sum[0] = Sum{0};
+                    sq[0] = SqSum{0};
+                    Integral::scan_row(src.row(y), m_width,
+                        first ? zero_sum.data() : m_sum.row(y),
+                        first ? zero_sq.data() : m_sqsum.row(y), sum, sq);
+                }
+            }
+        });
+        if (strips == 1) return;
+
+        // carry[s] = table value just above strip s once everything is final.
+        std::vector<std::vector<Sum>> carry_sum(static_cast<size_t>(strips));
+        std::vector<std::vector<SqSum>> carry_sq(static_cast<size_t>(strips));
+        carry_sum[1].assign(m_sum.row(strip_begin(1)), m_sum.row(strip_begin(1)) + cols);
+        carry_sq[1].assign(m_sqsum.row(strip_begin(1)), m_sqsum.row(strip_begin(1)) + cols);
+        for (int s = 2; s < strips; ++s) {
+            const auto si = static_cast<size_t>(s);
+            carry_sum[si] = carry_sum[si - 1];
+            carry_sq[si] = carry_sq[si - 1];
+            Integral::add_row(carry_sum[si].data(), m_sum.row(strip_begin(s)), cols);
+            Integral::add_row(carry_sq[si].data(), m_sqsum.row(strip_begin(s)), cols);
+        }
+
+        parallel_for(1, strips, 1, [&](int s_begin, int s_end) {
+            for (int s = s_begin; s < s_end; ++s) {
+                const auto si = static_cast<size_t>(s);
+                for (int y = strip_begin(s); y < strip_begin(s + 1); ++y) {
+                    Integral::add_row(m_sum.row(y + 1), carry_sum[si].data(), cols);
+                    Integral::add_row(m_sqsum.row(y + 1), carry_sq[si].data(), cols);
+                }
+            }
+        });
+    }
+
+    [[nodiscard]] auto width() const -> int { return m_width; }
+    [[nodiscard]] auto height() const -> int { return m_height; }
+    [[nodiscard]] auto empty() const -> bool { return m_width == 0 || m_height == 0; }
+    [[nodiscard]] auto size_bytes() const -> size_t { return m_sum.size_bytes() + m_sqsum.size_bytes(); }
+    [[nodiscard]] auto sum_table() const -> ImageView<const Sum, 1> { return m_sum.view(); }
+    [[nodiscard]] auto sqsum_table() const -> ImageView<const SqSum, 1> { return m_sqsum.view(); }
+
+    // Rects are clipped to the image; an empty intersection yields zero.
+    [[nodiscard]] auto sum(const PixelRect &rect) const -> Sum {
+        return box(m_sum, clip(rect, m_width, m_height));
+    }
+    [[nodiscard]] auto squared_sum(const PixelRect &rect) const -> SqSum {
+        return box(m_sqsum, clip(rect, m_width, m_height));
+    }
+    [[nodiscard]] auto mean(const PixelRect &rect) const -> double {
+        const PixelRect r = clip(rect, m_width, m_height);
+        const double area = static_cast<double>(r.width) * r.height;
+        return area > 0.0 ? static_cast<double>(box(m_sum, r)) / area : 0.0;
+    }
+    [[nodiscard]] auto variance(const PixelRect &rect) const -> double {
+        const PixelRect r = clip(rect, m_width, m_height);
+        const double area = static_cast<double>(r.width) * r.height;
+        if (area <= 0.0) return 0.0;
+        const double m = static_cast<double>(box(m_sum, r)) / area;
+        const double v = static_cast<double>(box(m_sqsum, r)) / area - m * m;
+        return v > 0.0 ? v : 0.0;
+    }
+
+    [[nodiscard]] auto sum(const Rect &rect) const -> Sum { return sum(to_pixel_rect(rect)); }
+    [[nodiscard]] auto squared_sum(const Rect &rect) const -> SqSum { return squared_sum(to_pixel_rect(rect)); }
+    [[nodiscard]] auto mean(const Rect &rect) const -> double { return mean(to_pixel_rect(rect)); }
+    [[nodiscard]] auto variance(const Rect &rect) const -> double { return variance(to_pixel_rect(rect)); }
+
+private:
+    template <typename S>
+    [[nodiscard]] static auto box(const Image<S, 1> &table, const PixelRect &r) -> S {
+        if (r.width <= 0 || r.height <= 0) return S{0};
+        const S *top = table.row(r.y);
+        const S *bottom = table.row(r.y + r.height);
+        const int x0 = r.x;
+        const int x1 = r.x + r.width;
+        return static_cast<S>(bottom[x1] - top[x1] - bottom[x0] + top[x0]);
+    }
+
+    Image<Sum, 1> m_sum;
+    Image<SqSum, 1> m_sqsum;
+    int m_width = 0;
+    int m_height = 0;
+};
+
+template <typename S>
+[[nodiscard]] inline auto integral_image(ImageView<S, 1> src) -> IntegralImage<std::remove_const_t<S>> {
+    return IntegralImage<std::remove_const_t<S>>(src);
+}
+} // namespace CV
@@ -0,0 +1,170 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stb_image.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
+#include "queue.hpp"
+
+// Asynchronous image decoding.
+//
+// A few dedicated decode threads claim input paths in order, read each file
+// into a per-thread byte buffer that is reused across files, decode it with
+// stb_image and hand the adopted pixels to a bounded queue. Decode threads are
+// kept out of the compute pool because they block on I/O and on the full
+// queue; the queue capacity caps how far decoding may run ahead of the
+// consumers, so memory stays bounded however long the input list is.
+namespace CV {
+struct LoaderParams {
+    int decode_threads = 0;    // 0 = a quarter of worker_count(), at least one
+    size_t queue_capacity = 4; // decoded images waiting for a consumer
+    bool ordered = true;       // deliver in input order instead of completion order
+};
+
+struct DecodedImage {
+    size_t index = 0; // position in the input list
+    std::string path;
+    ImageRGBA8 image; // empty when reading or decoding failed
+    std::chrono::duration<float, std::milli> decode_time{};
+
+    [[nodiscard]] auto ok() const -> bool { return !image.empty(); }
+};
+
+class ImageLoader {
+public:
+    explicit ImageLoader(std::vector<std::string> paths, LoaderParams params = {})
+        : m_paths(std::move(paths)), m_params(params), m_queue(params.queue_capacity) {
+        int threads = params.decode_threads > 0 ? params.decode_threads : std::max(1, worker_count() / 4);
+        threads = std::min(threads, static_cast<int>(m_paths.size()));
+        if (threads == 0) {
+            m_queue.close();
+            return;
+        }
+        m_active.store(threads);
+        m_threads.reserve(static_cast<size_t>(threads));
+        for (int i = 0; i < threads; ++i) m_threads.emplace_back([this] { decode_main(); });
+    }
+
+    ~ImageLoader() {
+        cancel();
+        m_threads.clear();
+    }
+
+    ImageLoader(const ImageLoader &) = delete;
+    auto operator=(const ImageLoader &) -> ImageLoader & = delete;
+
+    // Blocks until the next image is decoded. Safe to call from several
+    // consumer threads; returns nullopt once every input was delivered.
+    [[nodiscard]] auto next() -> std::optional<DecodedImage> { return m_queue.pop(); }
+
+    // Stops decoding; images already queued are still returned by next().
+    auto cancel() -> void {
+        m_queue.close();
+        {
+            std::lock_guard lock(m_order_mutex);
+            m_cancelled = true;
+        }
+        m_order_cv.notify_all();
+    }
+
+    [[nodiscard]] auto size() const -> size_t { return m_paths.size(); }
+    [[nodiscard]] auto decoded() const -> size_t { return m_decoded.load(); }
+    [[nodiscard]] auto mean_decode_ms() const -> float {
+        const size_t n = m_decoded.load();
+        return n == 0 ? 0.0f : static_cast<float>(m_decode_us.load()) / 1000.0f / static_cast<float>(n);
+    }
+
+private:
+    [[nodiscard]] static auto read_file(const std::string &path, std::vector<uint8_t> &bytes) -> bool {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) return false;
+        const std::streamsize size = file.tellg();
+        if (size <= 0) return false;
+        bytes.resize(static_cast<size_t>(size)); // keeps the capacity of earlier, larger files
+        file.seekg(0);
+        return static_cast<bool>(file.read(reinterpret_cast<char *>(bytes.data()), size));
+    }
+
+    [[nodiscard]] static auto decode(const std::vector<uint8_t> &bytes) -> ImageRGBA8 {
+        int width = 0, height = 0, file_channels = 0;
+        stbi_uc *pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &file_channels, 4);
+        if (!pixels) return {};
+        const size_t stride = static_cast<size_t>(width) * 4;
+        return ImageRGBA8::adopt(pixels, width, height, stride,
+            BufferDeleter{stbi_free_bytes, stride * static_cast<size_t>(height), nullptr});
+    }
+
+    auto decode_main() -> void {
+        Profile::set_thread_name("loader");
+        std::vector<uint8_t> bytes;
+        for (;;) {
+            const size_t index = m_next_index.fetch_add(1);
+            if (index >= m_paths.size()) break;
+            DecodedImage item;
+            item.index = index;
+            item.path = m_paths[index];
+            CV_PROFILE_SCOPE("decode");
+            const auto start = std::chrono::steady_clock::now();
+            if (!read_file(item.path, bytes)) {
+                LOG_ERR("Failed to read image {}", item.path);
+            } else {
+                item.image = decode(bytes);
+                if (item.image.empty()) LOG_ERR("Failed to decode image {}. (Reason:{})", item.path, stbi_failure_reason());
+            }
+            item.decode_time = std::chrono::steady_clock::now() - start;
+            if (item.ok()) {
+                m_decode_us.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(item.decode_time).count()));
+                m_decoded.fetch_add(1);
+            }
+            if (!publish(std::move(item))) break;
+        }
+        if (m_active.fetch_sub(1) == 1) m_queue.close();
+    }
+
+    // In ordered mode an image waits for its predecessors; at most one decoder
+    // is pushing at a time, so the order lock is not held across the push.
+    auto publish(DecodedImage &&item) -> bool {
+        if (!m_params.ordered) return m_queue.push(std::move(item));
+        const size_t index = item.index;
+        {
+            std::unique_lock lock(m_order_mutex);
+            m_order_cv.wait(lock, [&] { return m_cancelled || m_next_publish == index; });
+            if (m_cancelled) return false;
+        }
+        const bool pushed = m_queue.push(std::move(item));
+        {
+            std::lock_guard lock(m_order_mutex);
+            ++m_next_publish;
+        }
+        m_order_cv.notify_all();
+        return pushed;
+    }
+
+    std::vector<std::string> m_paths;
+    LoaderParams m_params;
+    BoundedQueue<DecodedImage> m_queue;
+    std::atomic<size_t> m_next_index{0};
+    std::atomic<int> m_active{0};
+    std::atomic<size_t> m_decoded{0};
+    std::atomic<uint64_t> m_decode_us{0};
+    std::mutex m_order_mutex;
+    std::condition_variable m_order_cv;
+    size_t m_next_publish = 0;
+    bool m_cancelled = false;
+    std::vector<std::jthread> m_threads; // last, so threads are joined before the state goes away
+};
+} // namespace CV
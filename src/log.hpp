@@ -1,11 +1,48 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <format>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <source_location>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// Asynchronous logging.
+//
+// LOG_INFO / LOG_WARN / LOG_ERR take a format string literal that is checked at
+// compile time like std::format. A call site only copies its arguments into a
+// fixed-size record in the calling thread's lock-free ring, next to a pointer
+// to the static Site of that statement. Formatting and batched writes to
+// stdout (info, warn) and stderr (error) happen on a background thread, so
+// workers that log neither serialise on a stream lock nor wait on the terminal.
+// Arithmetic values, enums and pointers are stored as they are and strings are
+// copied; a message with any other argument type, or one that does not fit a
+// record, is formatted on the calling thread instead. Levels below
+// CV_LOG_LEVEL (0 info, 1 warn, 2 error) compile to nothing.
+//
+// When a ring is full, info and warn records are dropped under
+// OverflowPolicy::Drop (the writer reports how many) or wait for the writer
+// under OverflowPolicy::Block; errors always wait. PANIC flushes everything
+// logged before it, and whatever is still queued at exit is written by an
+// atexit hook.
+#ifndef CV_LOG_LEVEL
+#define CV_LOG_LEVEL 0
+#endif
 
 enum class LogLevel {
     Info,
@@ -13,35 +50,389 @@ enum class LogLevel {
     Error
 };
 
-template <typename... Args>
-inline auto log(LogLevel level, std::string_view fmt, Args &&...args) -> void {
-    std::string msg = std::vformat(fmt, std::make_format_args(args...));
+namespace Log {
+enum class OverflowPolicy {
+    Drop,
+    Block
+};
+
+// One log statement; every record points at the Site it came from.
+struct Site {
+    LogLevel level;
+    std::string_view format;
+};
+
+namespace detail {
+[[nodiscard]] inline auto prefix(LogLevel level) -> std::string_view {
     switch (level) {
-    case LogLevel::Info:
-        std::cout << "[INFO]  " << msg << "\n";
-        break;
-    case LogLevel::Warn:
-        std::cout << "[WARN]  " << msg << "\n";
-        break;
-    case LogLevel::Error:
-        std::cerr << "[ERROR] " << msg << "\n";
-        break;
+    case LogLevel::Info: return "[INFO]  ";
+    case LogLevel::Warn: return "[WARN]  ";
+    case LogLevel::Error: return "[ERROR] ";
+    }
+    return "";
+}
+
+struct Record {
+    static constexpr size_t payload_bytes = 224;
+
+    const Site *site = nullptr;
+    void (*format)(const Record &, std::string &) = nullptr;
+    int64_t time_ns = 0;
+    std::string *text = nullptr; // owned; messages formatted by the caller that exceed the payload
+    alignas(8) std::array<std::byte, payload_bytes> payload{};
+};
+
+template <typename T>
+concept TextArg = std::is_convertible_v<const T &, std::string_view>;
+
+template <typename T>
+concept ValueArg = !TextArg<T> && (std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_same_v<T, void *> ||
+                                      std::is_same_v<T, const void *> || std::is_same_v<T, std::nullptr_t>);
+
+template <typename T>
+concept Deferrable = TextArg<T> || ValueArg<T>;
+
+template <typename T>
+using Stored = std::conditional_t<TextArg<T>, std::string_view, T>;
+
+template <typename T>
+[[nodiscard]] inline auto as_text(const T &value) -> std::string_view {
+    if constexpr (std::is_pointer_v<T>) {
+        if (value == nullptr) return "(null)";
+    }
+    return std::string_view(value);
+}
+
+[[nodiscard]] constexpr auto align_up(size_t offset, size_t alignment) -> size_t { return (offset + alignment - 1) / alignment * alignment; }
+
+// Payload layout: values at their natural alignment, strings as a uint32_t
+// length followed by the characters.
+template <typename T>
+[[nodiscard]] inline auto footprint(size_t offset, const T &value) -> size_t {
+    if constexpr (TextArg<T>) {
+        return offset + sizeof(uint32_t) + as_text(value).size();
+    } else {
+        return align_up(offset, alignof(T)) + sizeof(T);
+    }
+}
+
+template <typename T>
+inline auto store(std::byte *base, size_t &offset, const T &value) -> void {
+    if constexpr (TextArg<T>) {
+        const std::string_view text = as_text(value);
+        const auto size = static_cast<uint32_t>(text.size());
+        std::memcpy(base + offset, &size, sizeof(size));
+        std::memcpy(base + offset + sizeof(size), text.data(), size);
+        offset += sizeof(size) + size;
+    } else {
+        offset = align_up(offset, alignof(T));
+        std::memcpy(base + offset, &value, sizeof(T));
+        offset += sizeof(T);
+    }
+}
+
+template <typename T>
+[[nodiscard]] inline auto load(const std::byte *base, size_t &offset) -> Stored<T> {
+    if constexpr (TextArg<T>) {
+        uint32_t size = 0;
+        std::memcpy(&size, base + offset, sizeof(size));
+        const std::string_view text(reinterpret_cast<const char *>(base + offset + sizeof(size)), size);
+        offset += sizeof(size) + size;
+        return text;
+    } else {
+        offset = align_up(offset, alignof(T));
+        T value;
+        std::memcpy(&value, base + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+}
+
+template <typename... Ts>
+inline auto format_record(const Record &record, std::string &out) -> void {
+    [[maybe_unused]] size_t offset = 0;
+    // Braced initialisation evaluates the loads left to right.
+    const std::tuple<Stored<Ts>...> args{load<Ts>(record.payload.data(), offset)...};
+    std::apply([&](const auto &...values) { std::vformat_to(std::back_inserter(out), record.site->format, std::make_format_args(values...)); }, args);
+}
+
+inline auto format_text(const Record &record, std::string &out) -> void {
+    if (record.text) {
+        out += *record.text;
+    } else {
+        size_t offset = 0;
+        out += load<std::string_view>(record.payload.data(), offset);
+    }
+}
+
+// Single-producer / single-consumer ring of records; the owning thread fills
+// a claimed slot in place, the writer drains.
+class RecordRing {
+public:
+    static constexpr size_t capacity = 256; // 64 KiB per logging thread
+
+    [[nodiscard]] auto claim() -> Record * {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == capacity) return nullptr;
+        return &m_records[head & (capacity - 1)];
+    }
+
+    auto publish() -> void { m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    [[nodiscard]] auto size() const -> size_t { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+
+    template <typename F>
+    auto drain(F &&consume) -> void {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t head = m_head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) consume(m_records[tail & (capacity - 1)]);
+        m_tail.store(tail, std::memory_order_release);
     }
+
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> retired{false};
+
+private:
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+    std::array<Record, capacity> m_records{};
+};
+
+[[nodiscard]] inline auto now_ns() -> int64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-template <
-    typename T,
-    typename = std::enable_if_t<!std::is_convertible_v<T, std::string_view>>>
-inline auto log(LogLevel level, T &&value) -> void {
-    log(level, "{}", std::forward<T>(value));
+class Logger {
+public:
+    // Leaked: threads may still log during static destruction, the atexit
+    // hook stops the writer and later records are written synchronously.
+    [[nodiscard]] static auto instance() -> Logger & {
+        static Logger *logger = [] {
+            auto *l = new Logger();
+            std::atexit([] { instance().shutdown(); });
+            return l;
+        }();
+        return *logger;
+    }
+
+    template <typename Fill>
+    auto push(const Site &site, Fill &&fill) -> void {
+        RecordRing &ring = thread_ring();
+        Record *slot = nullptr;
+        while (m_running.load(std::memory_order_acquire) && (slot = ring.claim()) == nullptr) {
+            if (site.level != LogLevel::Error && m_policy.load(std::memory_order_relaxed) == OverflowPolicy::Drop) {
+                ring.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            wake();
+            std::this_thread::yield();
+        }
+        if (!slot) {
+            Record record;
+            record.site = &site;
+            fill(record);
+            write_now(record);
+            return;
+        }
+        slot->site = &site;
+        slot->time_ns = now_ns();
+        slot->text = nullptr;
+        fill(*slot);
+        ring.publish();
+        if (site.level == LogLevel::Error || ring.size() > RecordRing::capacity / 2) wake();
+    }
+
+    // Returns once every record pushed before the call has been written.
+    auto flush() -> void {
+        std::unique_lock lock(m_mutex);
+        if (!m_running.load()) return;
+        const uint64_t ticket = ++m_flush_requested;
+        m_wake.store(true);
+        m_cv.notify_all();
+        m_flushed_cv.wait(lock, [&] { return m_flushed >= ticket || !m_running.load(); });
+    }
+
+    auto set_policy(OverflowPolicy policy) -> void { m_policy.store(policy, std::memory_order_relaxed); }
+
+    auto shutdown() -> void {
+        {
+            std::lock_guard lock(m_mutex);
+            if (!m_running.load()) return;
+            m_running.store(false);
+            m_cv.notify_all();
+        }
+        m_writer.join();
+        m_flushed_cv.notify_all();
+    }
+
+private:
+    struct Line {
+        int64_t time_ns;
+        LogLevel level;
+        size_t begin;
+        size_t end;
+    };
+
+    Logger()
+        : m_writer([this] { writer_main(); }) {}
+
+    auto wake() -> void {
+        if (!m_wake.exchange(true, std::memory_order_acq_rel)) m_cv.notify_one();
+    }
+
+    // Registers the calling thread's ring on its first message; the writer
+    // drops it once the thread has exited and the ring is empty.
+    auto thread_ring() -> RecordRing & {
+        struct Handle {
+            std::shared_ptr<RecordRing> ring = std::make_shared<RecordRing>();
+            explicit Handle(Logger &logger) {
+                std::lock_guard lock(logger.m_rings_mutex);
+                logger.m_rings.push_back(ring);
+            }
+            ~Handle() { ring->retired.store(true, std::memory_order_release); }
+        };
+        thread_local Handle handle(*this);
+        return *handle.ring;
+    }
+
+    auto write_now(const Record &record) -> void {
+        std::string line(prefix(record.site->level));
+        record.format(record, line);
+        delete record.text;
+        line += '\n';
+        std::lock_guard lock(m_mutex);
+        std::ostream &stream = record.site->level == LogLevel::Error ? std::cerr : std::cout;
+        stream << line << std::flush;
+    }
+
+    // Formats every queued record into one buffer, then writes the lines in
+    // time order, one write per run of lines that share a stream.
+    auto write_batch(std::string &buffer, std::vector<Line> &lines) -> void {
+        buffer.clear();
+        lines.clear();
+        uint64_t dropped = 0;
+        {
+            std::lock_guard lock(m_rings_mutex);
+            for (const auto &ring : m_rings) {
+                dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+                ring->drain([&](Record &record) {
+                    const size_t begin = buffer.size();
+                    buffer += prefix(record.site->level);
+                    record.format(record, buffer);
+                    buffer += '\n';
+                    delete record.text;
+                    record.text = nullptr;
+                    lines.push_back(Line{record.time_ns, record.site->level, begin, buffer.size()});
+                });
+            }
+            std::erase_if(m_rings, [](const auto &ring) { return ring->retired.load(std::memory_order_acquire) && ring->size() == 0; });
+        }
+        if (dropped > 0) {
+            const size_t begin = buffer.size();
+            std::format_to(std::back_inserter(buffer), "{}{} log messages dropped\n", prefix(LogLevel::Warn), dropped);
+            lines.push_back(Line{now_ns(), LogLevel::Warn, begin, buffer.size()});
+        }
+        if (lines.empty()) return;
+        std::stable_sort(lines.begin(), lines.end(), [](const Line &a, const Line &b) { return a.time_ns < b.time_ns; });
+
+        std::lock_guard lock(m_mutex); // against write_now
+        for (size_t i = 0; i < lines.size();) {
+            const bool error = lines[i].level == LogLevel::Error;
+            std::ostream &stream = error ? std::cerr : std::cout;
+            std::string run;
+            for (; i < lines.size() && (lines[i].level == LogLevel::Error) == error; ++i) {
+                run.append(buffer, lines[i].begin, lines[i].end - lines[i].begin);
+            }
+            stream << run << std::flush;
+        }
+    }
+
+    auto writer_main() -> void {
+        std::string buffer;
+        std::vector<Line> lines;
+        for (;;) {
+            uint64_t ticket = 0;
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait_for(lock, std::chrono::milliseconds(10), [&] {
+                    return m_wake.load() || !m_running.load() || m_flush_requested > m_flushed;
+                });
+                m_wake.store(false);
+                ticket = m_flush_requested;
+            }
+            const bool stopping = !m_running.load();
+            write_batch(buffer, lines);
+            {
+                std::lock_guard lock(m_mutex);
+                m_flushed = ticket;
+            }
+            m_flushed_cv.notify_all();
+            if (stopping) return;
+        }
+    }
+
+    std::mutex m_mutex; // writer state and the output streams
+    std::condition_variable m_cv;
+    std::condition_variable m_flushed_cv;
+    std::atomic<bool> m_wake{false};
+    std::atomic<bool> m_running{true};
+    std::atomic<OverflowPolicy> m_policy{OverflowPolicy::Block};
+    uint64_t m_flush_requested = 0;
+    uint64_t m_flushed = 0;
+    std::mutex m_rings_mutex;
+    std::vector<std::shared_ptr<RecordRing>> m_rings;
+    std::thread m_writer; // last, started once everything else is initialised
+};
+} // namespace detail
+
+// Called by the LOG_* macros; fmt only serves the compile-time check.
+template <typename... Args>
+inline auto enqueue(const Site &site, [[maybe_unused]] std::format_string<Args...> fmt, Args &&...args) -> void {
+    using namespace detail;
+    if constexpr ((Deferrable<std::decay_t<Args>> && ...)) {
+        size_t size = 0;
+        ((size = footprint<std::decay_t<Args>>(size, args)), ...);
+        if (size <= Record::payload_bytes) {
+            Logger::instance().push(site, [&](Record &record) {
+                [[maybe_unused]] size_t offset = 0;
+                (store<std::decay_t<Args>>(record.payload.data(), offset, args), ...);
+                record.format = &format_record<std::decay_t<Args>...>;
+            });
+            return;
+        }
+    }
+    std::string text = std::format(fmt, std::forward<Args>(args)...);
+    Logger::instance().push(site, [&](Record &record) {
+        if (footprint<std::string_view>(0, text) <= Record::payload_bytes) {
+            size_t offset = 0;
+            store<std::string_view>(record.payload.data(), offset, text);
+        } else {
+            record.text = new std::string(std::move(text));
+        }
+        record.format = &format_text;
+    });
 }
 
-#define LOG_INFO(fmt, ...) log(LogLevel::Info, fmt, ##__VA_ARGS__)
-#define LOG_WARN(fmt, ...) log(LogLevel::Warn, fmt, ##__VA_ARGS__)
-#define LOG_ERR(fmt, ...) log(LogLevel::Error, fmt, ##__VA_ARGS__)
+inline auto flush() -> void { detail::Logger::instance().flush(); }
+
+// Applies to info and warn records; errors always wait for space.
+inline auto set_overflow_policy(OverflowPolicy policy) -> void { detail::Logger::instance().set_policy(policy); }
+} // namespace Log
+
+#define CV_LOG(level, fmt, ...)                                                   \
+    do {                                                                          \
+        if constexpr (static_cast<int>(level) >= CV_LOG_LEVEL) {                  \
+            static constexpr Log::Site cv_log_site{level, fmt};                   \
+            Log::enqueue(cv_log_site, fmt, ##__VA_ARGS__);                        \
+        }                                                                         \
+    } while (false)
+
+#define LOG_INFO(fmt, ...) CV_LOG(LogLevel::Info, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...) CV_LOG(LogLevel::Warn, fmt, ##__VA_ARGS__)
+#define LOG_ERR(fmt, ...) CV_LOG(LogLevel::Error, fmt, ##__VA_ARGS__)
 
 /**
- * panic_impl: prints an error and aborts.
+ * panic_impl: flushes the log, prints an error and aborts.
  * - msg defaults to empty if not provided.
  * - loc defaults to the *call-site* source_location.
  */
@@ -58,11 +449,13 @@ panic_impl(
             loc.file_name(), loc.line());
     }
 
-    // Log it and abort
-    LOG_ERR("{}", full);
+    // Everything logged before the panic goes out first, then the panic
+    // itself, written directly
+    Log::flush();
+    std::cerr << Log::detail::prefix(LogLevel::Error) << full << std::endl;
     std::exit(EXIT_FAILURE);
 }
 
 // Now macros *at the use site* to forward into panic_impl():
 #undef PANIC
-#define PANIC(...) panic_impl(__VA_ARGS__)
\ No newline at end of file
+#define PANIC(...) panic_impl(__VA_ARGS__)
@@ -16,28 +16,120 @@
 #include <array>
 #include <assert.h>
 #include <bitset>
+#include <charconv>
 #include <chrono>
 #include <cstdint>
 #include <format>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <thread>
 
 using std::chrono::steady_clock;
 using namespace std::chrono_literals;
 
 // Project headers
+#include "cache.hpp"
 #include "constants.hpp"
+#include "convert.hpp"
 #include "engine.hpp"
+#include "geometry.hpp"
 #include "gl.hpp"
 #include "global.hpp"
+#include "histogram.hpp"
+#include "image.hpp"
 #include "input.hpp"
+#include "loader.hpp"
 #include "log.hpp"
+#include "memory.hpp"
+#include "pipeline.hpp"
+#include "profile.hpp"
 #include "render.hpp"
+#include "stream.hpp"
 #include "types.hpp"
 #include "utils.hpp"
 
+namespace {
+// Without options the app shows the bundled still images.
+//
+//   main [--stream <frame directory|file.y4m|file.nv12>] [options]
+//     -s, --size <w>x<h>       frame size of NV12 input
+//     -f, --fps <n>            source frame rate (default: Y4M header, else 30)
+//     -p, --pipeline <spec>    stages run on every frame (default: none); start
+//                              with gray to read only the luma of raw video
+//     -l, --max-latency <ms>   older frames are skipped for newer ones before processing
+struct AppOptions {
+    std::string stream;
+    std::string pipeline;
+    CV::StreamParams stream_params;
+};
+
+auto print_usage() -> void {
+    std::cerr << "usage: main [--stream <frame_dir|file.y4m|file.nv12>] [-s WxH] [-f fps] [-p pipeline] [-l max_latency_ms]\n";
+}
+
+[[nodiscard]] auto parse_number(std::string_view text, auto &out) -> bool {
+    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+    return ec == std::errc{} && end == text.data() + text.size();
+}
+
+[[nodiscard]] auto parse_args(int argc, char **argv, AppOptions &options) -> bool {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        auto value = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "--stream") {
+            const char *v = value();
+            if (!v) return false;
+            options.stream = v;
+        } else if (arg == "-s" || arg == "--size") {
+            const char *v = value();
+            if (!v) return false;
+            const std::string_view size = v;
+            const size_t x = size.find('x');
+            if (x == std::string_view::npos || !parse_number(size.substr(0, x), options.stream_params.width) ||
+                !parse_number(size.substr(x + 1), options.stream_params.height)) {
+                LOG_ERR("Frame size must be <width>x<height>, got {}", size);
+                return false;
+            }
+        } else if (arg == "-f" || arg == "--fps") {
+            const char *v = value();
+            if (!v || !parse_number(v, options.stream_params.fps)) return false;
+        } else if (arg == "-p" || arg == "--pipeline") {
+            const char *v = value();
+            if (!v) return false;
+            options.pipeline = v;
+        } else if (arg == "-l" || arg == "--max-latency") {
+            const char *v = value();
+            int ms = 0;
+            if (!v || !parse_number(v, ms)) return false;
+            options.stream_params.max_latency = std::chrono::milliseconds(ms);
+        } else {
+            LOG_ERR("Unknown option {}", arg);
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
 auto main(int argc, char **argv) -> int {
     LOG_INFO("Application starting");
+    AppOptions options;
+    if (!parse_args(argc, argv, options)) {
+        Log::flush();
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    const auto stages = CV::parse_pipeline(options.pipeline);
+    if (!stages) return EXIT_FAILURE;
+    CV::Profile::set_thread_name("main");
+    CV::Profile::set_enabled(true);
+    // Decode in the background while SDL and OpenGL start up.
+    CV::ImageLoader loader({Constants::fp_image_hummingbird});
     if (!engine_setup()) PANIC("Setup failed!");
     LOG_INFO("Engine setup complete");
 
@@ -46,38 +138,29 @@ auto main(int argc, char **argv) -> int {
         Constants::fp_vertex_shader,
         Constants::fp_fragment_shader);
     global.renderer.geom_square = GL::create_geometry(Constants::square_vertices, Constants::square_indices);
-
-    stbi_uc *image_data = stbi_load(
-        Constants::fp_image_hummingbird,
-        &global.renderer.image_texture.width,
-        &global.renderer.image_texture.height,
-        &global.renderer.image_texture.channels,
-        STBI_rgb_alpha);
-    if (!image_data) {
-        LOG_ERR("Failed to load image {}. (Reason:{})", Constants::fp_image_hummingbird, stbi_failure_reason());
-        PANIC();
+    global.renderer.geom_circle = GL::create_geometry(Constants::circle_vertices, Constants::circle_indices);
+    global.renderer.geom_triangle = GL::create_geometry(Constants::triangle_vertices, Constants::triangle_indices);
+    global.renderer.overlay.init(
+        global.renderer.geom_square,
+        global.renderer.geom_circle,
+        global.renderer.geom_triangle,
+        Constants::fp_overlay_vertex_shader,
+        Constants::fp_overlay_fragment_shader);
+    global.renderer.image_view.init(Constants::fp_palette_vertex_shader, Constants::fp_palette_fragment_shader);
+
+    std::optional<CV::DecodedImage> decoded = loader.next();
+    if (!decoded || !decoded->ok()) PANIC();
+    LOG_INFO("Decoded {} in {:.2f} ms", decoded->path, decoded->decode_time.count());
+    // Seed the cache with the prefetched pixels so the first lookup hits.
+    if (const auto key = CV::file_key(decoded->path, "rgba8")) {
+        (void)global.vision.cache.get<CV::ImageRGBA8>(*key, [&] { return std::move(decoded->image); });
+    }
+    if (!Render::select_image(0)) PANIC();
+    if (!options.stream.empty()) {
+        global.vision.stream = std::make_unique<CV::VideoStream>(options.stream, *stages, options.stream_params);
+        if (!global.vision.stream->ok()) PANIC(std::format("Cannot stream {}", options.stream));
+        options.pipeline.copy(global.vision.stream_pipeline.data(), global.vision.stream_pipeline.size() - 1);
     }
-
-    glGenTextures(1, &global.renderer.image_texture.id);
-    glBindTexture(GL_TEXTURE_2D, global.renderer.image_texture.id);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RGBA,
-        global.renderer.image_texture.width,
-        global.renderer.image_texture.height,
-        0,
-        GL_RGBA,
-        GL_UNSIGNED_BYTE,
-        image_data);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    stbi_image_free(image_data);
 
     global.is_running = true;
     global.sim.run_start_time = std::chrono::steady_clock::now();
@@ -90,17 +173,45 @@ auto main(int argc, char **argv) -> int {
         global.sim.frame_start_time = now;
         global.sim.total_runtime = now - global.sim.run_start_time;
 
-        handle_input();
-        Render::gui_debug();
-        Render::frame();
-
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        SDL_GL_SwapWindow(global.renderer.window);
+        {
+            CV_PROFILE_SCOPE("input");
+            handle_input();
+        }
+        {
+            CV_PROFILE_SCOPE("stream");
+            Render::update_stream();
+        }
+        {
+            CV_PROFILE_SCOPE("gui");
+            Render::gui_debug();
+        }
+        {
+            CV_PROFILE_SCOPE("render");
+            Render::frame();
+            Render::draw_overlay();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        {
+            CV_PROFILE_SCOPE("present");
+            SDL_GL_SwapWindow(global.renderer.window);
+        }
+        Render::stream_presented();
+        CV_PROFILE_COUNTER("pool_in_use_mib", static_cast<double>(CV::BufferPool::instance().stats().bytes_in_use) / (1 << 20));
 
         global.sim.frame_counter += 1;
+        // The stream threads keep pool workers busy across GUI frames, so only
+        // this thread's arena is ours to reset; the process thread resets its
+        // own and the workers' scopes rewind on exit.
+        if (global.vision.stream) {
+            CV::frame_arena().reset();
+        } else {
+            CV::reset_frame_arenas();
+        }
+        CV::Profile::Profiler::instance().end_frame();
     }
 
     LOG_INFO("Main loop exited");
+    global.vision.stream.reset(); // joins the stream threads
     engine_cleanup();
     LOG_INFO("Engine cleanup complete");
     LOG_INFO("Application exiting successfully");
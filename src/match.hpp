@@ -0,0 +1,295 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "orb.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+
+// Hamming-distance matching of 256-bit binary descriptors.
+//
+// match_brute_force compares every query against every train descriptor with a
+// vectorized popcount inner loop, tiled so a block of train descriptors stays
+// in cache while a group of queries streams over it. HammingIndex is a
+// multi-index hash over 16-bit substrings for databases too large to scan.
+namespace CV {
+struct Match {
+    uint32_t query = 0;
+    uint32_t train = 0;
+    uint32_t distance = 0;
+};
+
+struct MatchParams {
+    float ratio = 0.8f;                             // Lowe ratio test; >= 1 disables it
+    bool cross_check = false;                       // keep only mutual best matches
+    uint32_t max_distance = descriptor_bits;        // reject anything farther
+};
+
+namespace Hamming {
+// Distances from one query to n consecutive train descriptors.
+inline auto distances_scalar(const uint8_t *query, const uint8_t *train, size_t n, uint32_t *out) -> void {
+    std::array<uint64_t, 4> q{};
+    std::memcpy(q.data(), query, descriptor_bytes);
+    for (size_t j = 0; j < n; ++j) {
+        std::array<uint64_t, 4> t{};
+        std::memcpy(t.data(), train + j * descriptor_bytes, descriptor_bytes);
+        uint32_t d = 0;
+        for (size_t k = 0; k < 4; ++k) d += static_cast<uint32_t>(std::popcount(q[k] ^ t[k]));
+        out[j] = d;
+    }
+}
+
+#if CV_SIMD_X86
+CV_TARGET_POPCNT inline auto distance_popcnt(const uint8_t *a, const uint8_t *b) -> uint32_t {
+    uint32_t d = 0;
+    for (size_t k = 0; k < descriptor_bytes; k += 8) {
+        uint64_t x = 0, y = 0;
+        std::memcpy(&x, a + k, 8);
+        std::memcpy(&y, b + k, 8);
+        d += static_cast<uint32_t>(__builtin_popcountll(x ^ y));
+    }
+    return d;
+}
+
+// Byte popcount through a nibble lookup table, summed per 64-bit lane by SAD.
+CV_TARGET_AVX2 inline auto popcount_lanes_avx2(__m256i x) -> __m256i {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, low));
+    const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+CV_TARGET_AVX2 inline auto distances_avx2(const uint8_t *query, const uint8_t *train, size_t n, uint32_t *out) -> void {
+    const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(query));
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        const auto *t = reinterpret_cast<const __m256i *>(train + j * descriptor_bytes);
+        const __m256i s0 = popcount_lanes_avx2(_mm256_xor_si256(q, _mm256_load_si256(t + 0)));
+        const __m256i s1 = popcount_lanes_avx2(_mm256_xor_si256(q, _mm256_load_si256(t + 1)));
+        const __m256i s2 = popcount_lanes_avx2(_mm256_xor_si256(q, _mm256_load_si256(t + 2)));
+        const __m256i s3 = popcount_lanes_avx2(_mm256_xor_si256(q, _mm256_load_si256(t + 3)));
+        // Transpose-and-add the four 4 x u64 partial sums into [d0, d1, d2, d3].
+        const __m256i t01 = _mm256_add_epi64(_mm256_unpacklo_epi64(s0, s1), _mm256_unpackhi_epi64(s0, s1));
+        const __m256i t23 = _mm256_add_epi64(_mm256_unpacklo_epi64(s2, s3), _mm256_unpackhi_epi64(s2, s3));
+        const __m256i d = _mm256_add_epi64(_mm256_permute2x128_si256(t01, t23, 0x20), _mm256_permute2x128_si256(t01, t23, 0x31));
+        const __m256i packed = _mm256_permutevar8x32_epi32(d, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + j), _mm256_castsi256_si128(packed));
+    }
+    for (; j < n; ++j) out[j] = distance_popcnt(query, train + j * descriptor_bytes);
+}
+
+CV_TARGET_AVX512_VPOPCNT inline auto distances_avx512(const uint8_t *query, const uint8_t *train, size_t n, uint32_t *out) -> void {
+    const __m512i q = _mm512_broadcast_i64x4(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(query)));
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        // Two descriptors per register: a = [j, j + 1], b = [j + 2, j + 3].
+        const auto *t = reinterpret_cast<const __m512i *>(train + j * descriptor_bytes);
+        const __m512i a = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_loadu_si512(t)));
+        const __m512i b = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_loadu_si512(t + 1)));
+        const __m512i x = _mm512_add_epi64(_mm512_unpacklo_epi64(a, b), _mm512_unpackhi_epi64(a, b));
+        const __m512i y = _mm512_add_epi64(x, _mm512_shuffle_i64x2(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+        // y = [d_j, d_j+2, ., ., d_j+1, d_j+3, ., .]
+        const __m512i order = _mm512_setr_epi64(0, 4, 1, 5, 0, 0, 0, 0);
+        const __m256i d = _mm512_cvtepi64_epi32(_mm512_permutexvar_epi64(order, y));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + j), _mm256_castsi256_si128(d));
+    }
+    for (; j < n; ++j) out[j] = distance_popcnt(query, train + j * descriptor_bytes);
+}
+#endif
+
+using DistancesFn = void (*)(const uint8_t *, const uint8_t *, size_t, uint32_t *);
+
+[[nodiscard]] inline auto distances_kernel() -> DistancesFn {
+#if CV_SIMD_X86
+    const Simd::Level level = Simd::active_level();
+    if (level == Simd::Level::AVX512 && Simd::features().avx512_vpopcntdq) return distances_avx512;
+    if (level >= Simd::Level::AVX2) return distances_avx2;
+#endif
+    return distances_scalar;
+}
+
+[[nodiscard]] inline auto distance(const uint8_t *a, const uint8_t *b) -> uint32_t {
+#if CV_SIMD_X86
+    if (Simd::active_level() >= Simd::Level::AVX2) return distance_popcnt(a, b);
+#endif
+    uint32_t d = 0;
+    distances_scalar(a, b, 1, &d);
+    return d;
+}
+
+// Best and second-best distance seen so far for one query.
+struct Best2 {
+    uint32_t best = std::numeric_limits<uint32_t>::max();
+    uint32_t second = std::numeric_limits<uint32_t>::max();
+    uint32_t index = 0;
+
+    auto update(uint32_t d, uint32_t i) -> void {
+        if (d < best) {
+            second = best;
+            best = d;
+            index = i;
+        } else if (d < second) {
+            second = d;
+        }
+    }
+};
+
+[[nodiscard]] inline auto accept(const Best2 &b, const MatchParams &params) -> bool {
+    if (b.best > params.max_distance) return false;
+    if (params.ratio >= 1.0f || b.second == std::numeric_limits<uint32_t>::max()) return true;
+    return static_cast<float>(b.best) < params.ratio * static_cast<float>(b.second);
+}
+
+// Drops matches whose train descriptor has a closer query than the matched one
+// (ties resolve to the lowest query index). Only the matched train descriptors
+// are checked, so this stays cheap even when the train set is huge.
+inline auto filter_cross_check(std::vector<Match> &matches, const Descriptors &query, const Descriptors &train) -> void {
+    const DistancesFn kernel = distances_kernel();
+    std::vector<uint8_t> keep(matches.size(), 0);
+    parallel_for(0, static_cast<int>(matches.size()), 16, [&](int begin, int end) {
+        std::vector<uint32_t> dist(query.size());
+        for (int i = begin; i < end; ++i) {
+            const Match &m = matches[static_cast<size_t>(i)];
+            kernel(train.row(m.train), query.data(), query.size(), dist.data());
+            const auto best = static_cast<uint32_t>(std::min_element(dist.begin(), dist.end()) - dist.begin());
+            keep[static_cast<size_t>(i)] = best == m.query ? 1 : 0;
+        }
+    });
+    size_t out = 0;
+    for (size_t i = 0; i < matches.size(); ++i) {
+        if (keep[i]) matches[out++] = matches[i];
+    }
+    matches.resize(out);
+}
+} // namespace Hamming
+
+// Exhaustive matching; returns at most one match per query, ordered by query.
+[[nodiscard]] inline auto match_brute_force(const Descriptors &query, const Descriptors &train,
+    const MatchParams &params = {}) -> std::vector<Match> {
+    if (query.empty() || train.empty()) return {};
+    // 512 descriptors = 16 KiB of train data per block, well inside L1 + L2.
+    constexpr size_t train_block = 512;
+    const Hamming::DistancesFn kernel = Hamming::distances_kernel();
+    std::vector<Hamming::Best2> best(query.size());
+
+    parallel_for(0, static_cast<int>(query.size()), 32, [&](int begin, int end) {
+        std::array<uint32_t, train_block> dist{};
+        for (size_t t0 = 0; t0 < train.size(); t0 += train_block) {
+            const size_t n = std::min(train_block, train.size() - t0);
+            for (int qi = begin; qi < end; ++qi) {
+                Hamming::Best2 &b = best[static_cast<size_t>(qi)];
+                kernel(query.row(static_cast<size_t>(qi)), train.row(t0), n, dist.data());
+                for (size_t j = 0; j < n; ++j) b.update(dist[j], static_cast<uint32_t>(t0 + j));
+            }
+        }
+    });
+
+    std::vector<Match> matches;
+    for (size_t i = 0; i < best.size(); ++i) {
+        if (Hamming::accept(best[i], params)) matches.push_back(Match{static_cast<uint32_t>(i), best[i].index, best[i].best});
+    }
+    if (params.cross_check) Hamming::filter_cross_check(matches, query, train);
+    return matches;
+}
+
+// Multi-index hashing: descriptors are split into 16-bit substrings and each
+// substring indexes its own table (stored CSR-style, one bucket per value). A
+// query only looks at database entries that share a substring with it, exactly
+// or within probe_radius bits, and ranks those by full Hamming distance. Fewer
+// tables or probe_radius 0 trade recall for speed. The indexed Descriptors must
+// outlive the index.
+class HammingIndex {
+public:
+    static constexpr int max_tables = static_cast<int>(descriptor_bytes / 2);
+    static constexpr size_t bucket_count = size_t{1} << 16;
+
+    explicit HammingIndex(int tables = max_tables, int probe_radius = 1)
+        : m_tables(std::clamp(tables, 1, max_tables)), m_probe_radius(std::clamp(probe_radius, 0, 1)) {}
+
+    auto build(const Descriptors &db) -> void {
+        m_db = &db;
+        m_offsets.assign(static_cast<size_t>(m_tables), std::vector<uint32_t>(bucket_count + 1, 0));
+        m_ids.assign(static_cast<size_t>(m_tables), std::vector<uint32_t>(db.size()));
+        parallel_for(0, m_tables, 1, [&](int begin, int end) {
+            for (int t = begin; t < end; ++t) {
+                auto &offsets = m_offsets[static_cast<size_t>(t)];
+                auto &ids = m_ids[static_cast<size_t>(t)];
+                for (size_t i = 0; i < db.size(); ++i) ++offsets[key(db.row(i), t) + 1];
+                for (size_t k = 0; k < bucket_count; ++k) offsets[k + 1] += offsets[k];
+                std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+                for (size_t i = 0; i < db.size(); ++i) ids[fill[key(db.row(i), t)]++] = static_cast<uint32_t>(i);
+            }
+        });
+    }
+
+    [[nodiscard]] auto size() const -> size_t { return m_db ? m_db->size() : 0; }
+
+    // Approximate best / second-best neighbours of one descriptor. Returns
+    // false if no candidate shares a probed substring.
+    [[nodiscard]] auto search(const uint8_t *query, Hamming::Best2 &out) const -> bool {
+        std::vector<uint32_t> candidates;
+        return search(query, out, candidates);
+    }
+
+    [[nodiscard]] auto match(const Descriptors &query, const MatchParams &params = {}) const -> std::vector<Match> {
+        if (!m_db || query.empty() || m_db->empty()) return {};
+        std::vector<Hamming::Best2> best(query.size());
+        std::vector<uint8_t> found(query.size(), 0);
+        parallel_for(0, static_cast<int>(query.size()), 16, [&](int begin, int end) {
+            std::vector<uint32_t> candidates;
+            for (int i = begin; i < end; ++i) {
+                const auto idx = static_cast<size_t>(i);
+                found[idx] = search(query.row(idx), best[idx], candidates) ? 1 : 0;
+            }
+        });
+        std::vector<Match> matches;
+        for (size_t i = 0; i < best.size(); ++i) {
+            if (found[i] && Hamming::accept(best[i], params)) matches.push_back(Match{static_cast<uint32_t>(i), best[i].index, best[i].best});
+        }
+        if (params.cross_check) Hamming::filter_cross_check(matches, query, *m_db);
+        return matches;
+    }
+
+private:
+    [[nodiscard]] static auto key(const uint8_t *desc, int table) -> uint32_t {
+        return static_cast<uint32_t>(desc[2 * table]) | (static_cast<uint32_t>(desc[2 * table + 1]) << 8);
+    }
+
+    auto search(const uint8_t *query, Hamming::Best2 &out, std::vector<uint32_t> &candidates) const -> bool {
+        out = Hamming::Best2{};
+        candidates.clear();
+        for (int t = 0; t < m_tables; ++t) {
+            const auto &offsets = m_offsets[static_cast<size_t>(t)];
+            const auto &ids = m_ids[static_cast<size_t>(t)];
+            const uint32_t k = key(query, t);
+            auto gather = [&](uint32_t bucket) {
+                candidates.insert(candidates.end(), ids.begin() + offsets[bucket], ids.begin() + offsets[bucket + 1]);
+            };
+            gather(k);
+            if (m_probe_radius > 0) {
+                for (int bit = 0; bit < 16; ++bit) gather(k ^ (1u << bit));
+            }
+        }
+        if (candidates.empty()) return false;
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        for (const uint32_t c : candidates) out.update(Hamming::distance(query, m_db->row(c)), c);
+        return true;
+    }
+
+    const Descriptors *m_db = nullptr;
+    int m_tables = max_tables;
+    int m_probe_radius = 1;
+    std::vector<std::vector<uint32_t>> m_offsets;
+    std::vector<std::vector<uint32_t>> m_ids;
+};
+} // namespace CV
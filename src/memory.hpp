@@ -0,0 +1,402 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "image.hpp"
+#include "log.hpp"
+
+// Allocation for per-frame intermediates.
+//
+// FrameArena is a per-thread bump allocator. Kernels take row scratch from it
+// inside an ArenaScope, which rewinds on exit, so the memory is reused by the
+// next chunk instead of going back to malloc. The main loop calls
+// reset_frame_arenas() once per frame to drop frame-lifetime allocations and to
+// merge chunks, so after the first frames every arena is a single block whose
+// pages are already faulted in.
+//
+// BufferPool recycles whole image buffers by size class (four classes per
+// doubling, so at most 25% slack). Released buffers go to a small per-thread
+// cache first and overflow into a shared free list, so workers rarely touch the
+// lock. pooled_image() adopts a pool buffer into an Image whose deleter hands
+// it back.
+namespace CV {
+class FrameArena {
+public:
+    struct Marker {
+        size_t chunk = 0;
+        size_t offset = 0;
+    };
+
+    explicit FrameArena(size_t initial_bytes = size_t{1} << 20)
+        : m_initial(initial_bytes) {}
+
+    FrameArena(const FrameArena &) = delete;
+    auto operator=(const FrameArena &) -> FrameArena & = delete;
+
+    // Uninitialised storage, valid until the enclosing scope rewinds or the
+    // arena is reset. align must be a power of two no larger than row_alignment.
+    [[nodiscard]] auto allocate(size_t bytes, size_t align = alignof(std::max_align_t)) -> void * {
+        for (;;) {
+            if (m_chunk < m_chunks.size()) {
+                Chunk &c = m_chunks[m_chunk];
+                const size_t start = (m_offset + align - 1) & ~(align - 1);
+                if (start + bytes <= c.size) {
+                    m_offset = start + bytes;
+                    m_used = position();
+                    m_peak = std::max(m_peak, m_used);
+                    return c.data.get() + start;
+                }
+                // Skip to the next chunk that fits; later chunks are kept from
+                // earlier frames and reused before growing.
+                ++m_chunk;
+                m_offset = 0;
+                continue;
+            }
+            const size_t last = m_chunks.empty() ? m_initial : m_chunks.back().size;
+            m_chunks.push_back(make_chunk(std::max(bytes + row_alignment, 2 * last)));
+            m_offset = 0;
+        }
+    }
+
+    template <typename T>
+    [[nodiscard]] auto allocate_array(size_t n) -> std::span<T> {
+        static_assert(std::is_trivially_destructible_v<T>, "arena memory is never destroyed");
+        return {static_cast<T *>(allocate(n * sizeof(T), alignof(T) < row_alignment ? row_alignment : alignof(T))), n};
+    }
+
+    [[nodiscard]] auto mark() const -> Marker { return {m_chunk, m_offset}; }
+
+    // Frees everything allocated after m. Scopes must rewind in LIFO order.
+    auto rewind(Marker m) -> void {
+        m_chunk = m.chunk;
+        m_offset = m.offset;
+        m_used = position();
+    }
+
+    // Frees everything. If the last frame needed several chunks they are
+    // replaced by one block of their combined size.
+    auto reset() -> void {
+        if (m_chunks.size() > 1) {
+            size_t total = 0;
+            for (const Chunk &c : m_chunks) total += c.size;
+            m_chunks.clear();
+            m_chunks.push_back(make_chunk(total));
+        }
+        m_chunk = 0;
+        m_offset = 0;
+        m_used = 0;
+    }
+
+    [[nodiscard]] auto used() const -> size_t { return m_used; }
+    [[nodiscard]] auto peak() const -> size_t { return m_peak; }
+    [[nodiscard]] auto capacity() const -> size_t {
+        size_t total = 0;
+        for (const Chunk &c : m_chunks) total += c.size;
+        return total;
+    }
+
+private:
+    struct Chunk {
+        std::unique_ptr<std::byte, BufferDeleter> data;
+        size_t size = 0;
+    };
+
+    [[nodiscard]] static auto make_chunk(size_t bytes) -> Chunk {
+        return Chunk{std::unique_ptr<std::byte, BufferDeleter>(static_cast<std::byte *>(aligned_alloc_bytes(bytes)),
+                         BufferDeleter{aligned_free_bytes, bytes, nullptr}),
+            bytes};
+    }
+
+    [[nodiscard]] auto position() const -> size_t {
+        size_t bytes = m_offset;
+        for (size_t i = 0; i < m_chunk && i < m_chunks.size(); ++i) bytes += m_chunks[i].size;
+        return bytes;
+    }
+
+    std::vector<Chunk> m_chunks;
+    size_t m_chunk = 0;
+    size_t m_offset = 0;
+    size_t m_initial;
+    size_t m_used = 0;
+    size_t m_peak = 0;
+};
+
+namespace detail {
+// Every thread's arena, so the main loop can reset them between frames. Never
+// destroyed: pool threads may unregister during static destruction.
+struct ArenaRegistry {
+    std::mutex mutex;
+    std::vector<FrameArena *> arenas;
+
+    [[nodiscard]] static auto instance() -> ArenaRegistry & {
+        static auto *registry = new ArenaRegistry();
+        return *registry;
+    }
+};
+
+struct ThreadArena {
+    FrameArena arena;
+
+    ThreadArena() {
+        ArenaRegistry &r = ArenaRegistry::instance();
+        std::lock_guard lock(r.mutex);
+        r.arenas.push_back(&arena);
+    }
+    ~ThreadArena() {
+        ArenaRegistry &r = ArenaRegistry::instance();
+        std::lock_guard lock(r.mutex);
+        r.arenas.erase(std::find(r.arenas.begin(), r.arenas.end(), &arena));
+    }
+};
+} // namespace detail
+
+// The calling thread's arena.
+[[nodiscard]] inline auto frame_arena() -> FrameArena & {
+    thread_local detail::ThreadArena local;
+    return local.arena;
+}
+
+// Resets every thread's arena. Only call while no parallel work is running,
+// e.g. at the end of a main loop iteration.
+inline auto reset_frame_arenas() -> void {
+    detail::ArenaRegistry &r = detail::ArenaRegistry::instance();
+    std::lock_guard lock(r.mutex);
+    for (FrameArena *arena : r.arenas) arena->reset();
+}
+
+struct ArenaStats {
+    size_t used = 0;     // bytes currently allocated, all threads
+    size_t peak = 0;     // largest per-thread high-water mark
+    size_t capacity = 0; // bytes reserved, all threads
+};
+
+// Same restriction as reset_frame_arenas().
+[[nodiscard]] inline auto frame_arena_stats() -> ArenaStats {
+    detail::ArenaRegistry &r = detail::ArenaRegistry::instance();
+    std::lock_guard lock(r.mutex);
+    ArenaStats s;
+    for (const FrameArena *arena : r.arenas) {
+        s.used += arena->used();
+        s.peak = std::max(s.peak, arena->peak());
+        s.capacity += arena->capacity();
+    }
+    return s;
+}
+
+// Scratch that lives until the end of the enclosing block.
+class ArenaScope {
+public:
+    ArenaScope()
+        : m_arena(frame_arena()), m_mark(m_arena.mark()) {}
+    ~ArenaScope() { m_arena.rewind(m_mark); }
+
+    ArenaScope(const ArenaScope &) = delete;
+    auto operator=(const ArenaScope &) -> ArenaScope & = delete;
+
+    // n elements, value-initialised like std::vector<T>(n).
+    template <typename T>
+    [[nodiscard]] auto array(size_t n, T value = T{}) -> std::span<T> {
+        const std::span<T> out = m_arena.allocate_array<T>(n);
+        std::fill(out.begin(), out.end(), value);
+        return out;
+    }
+
+private:
+    FrameArena &m_arena;
+    FrameArena::Marker m_mark;
+};
+
+struct PoolStats {
+    uint64_t requests = 0;
+    uint64_t reuses = 0;        // requests served from a free list
+    size_t bytes_allocated = 0; // total ever obtained from the system
+    size_t bytes_in_use = 0;    // handed out and not yet released
+    size_t peak_in_use = 0;
+    size_t bytes_cached = 0; // free buffers kept for reuse
+
+    [[nodiscard]] auto reuse_rate() const -> double {
+        return requests == 0 ? 0.0 : static_cast<double>(reuses) / static_cast<double>(requests);
+    }
+};
+
+class BufferPool {
+public:
+    static constexpr size_t min_class_bytes = 4096;
+    static constexpr size_t class_count = 96; // largest class 32 GiB; bigger requests bypass the pool
+    static constexpr size_t thread_cache_slots = 2;
+    static constexpr size_t thread_cache_bytes = size_t{64} << 20;
+
+    // Never destroyed, for the same reason as the arena registry.
+    [[nodiscard]] static auto instance() -> BufferPool & {
+        static auto *pool = new BufferPool();
+        return *pool;
+    }
+
+    BufferPool(const BufferPool &) = delete;
+    auto operator=(const BufferPool &) -> BufferPool & = delete;
+
+    // Rounds bytes up to its size class.
+    [[nodiscard]] static auto class_bytes(size_t bytes) -> size_t {
+        const size_t index = class_index(bytes);
+        return index < class_count ? bytes_of_class(index) : bytes;
+    }
+
+    // Returns a row_alignment aligned buffer of class_bytes(bytes) bytes.
+    [[nodiscard]] auto acquire(size_t bytes) -> void * {
+        const size_t index = class_index(bytes);
+        const size_t size = index < class_count ? bytes_of_class(index) : bytes;
+        m_requests.fetch_add(1, std::memory_order_relaxed);
+        note_in_use(size);
+        if (index < class_count) {
+            if (void *ptr = local().take(index)) {
+                m_reuses.fetch_add(1, std::memory_order_relaxed);
+                m_cached.fetch_sub(size, std::memory_order_relaxed);
+                return ptr;
+            }
+            std::lock_guard lock(m_mutex);
+            if (std::vector<void *> &list = m_free[index]; !list.empty()) {
+                void *ptr = list.back();
+                list.pop_back();
+                m_reuses.fetch_add(1, std::memory_order_relaxed);
+                m_cached.fetch_sub(size, std::memory_order_relaxed);
+                return ptr;
+            }
+        }
+        m_allocated.fetch_add(size, std::memory_order_relaxed);
+        return aligned_alloc_bytes(size);
+    }
+
+    // bytes must be the class size the buffer was acquired with.
+    auto release(void *ptr, size_t bytes) -> void {
+        m_in_use.fetch_sub(bytes, std::memory_order_relaxed);
+        const size_t index = class_index(bytes);
+        if (index >= class_count) {
+            aligned_free_bytes(ptr, bytes, nullptr);
+            return;
+        }
+        m_cached.fetch_add(bytes, std::memory_order_relaxed);
+        if (local().put(index, ptr, bytes)) return;
+        give_back(index, ptr, bytes);
+    }
+
+    // Frees the shared free lists; thread caches are flushed when their
+    // threads exit.
+    auto trim() -> void {
+        std::lock_guard lock(m_mutex);
+        for (size_t i = 0; i < class_count; ++i) {
+            for (void *ptr : m_free[i]) aligned_free_bytes(ptr, bytes_of_class(i), nullptr);
+            m_cached.fetch_sub(bytes_of_class(i) * m_free[i].size(), std::memory_order_relaxed);
+            m_free[i].clear();
+        }
+    }
+
+    // Free buffers beyond this are returned to the system.
+    auto set_cache_limit(size_t bytes) -> void { m_cache_limit.store(bytes, std::memory_order_relaxed); }
+
+    [[nodiscard]] auto stats() const -> PoolStats {
+        PoolStats s;
+        s.requests = m_requests.load(std::memory_order_relaxed);
+        s.reuses = m_reuses.load(std::memory_order_relaxed);
+        s.bytes_allocated = m_allocated.load(std::memory_order_relaxed);
+        s.bytes_in_use = m_in_use.load(std::memory_order_relaxed);
+        s.peak_in_use = m_peak.load(std::memory_order_relaxed);
+        s.bytes_cached = m_cached.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    BufferPool() = default;
+
+    // Four classes per power of two: q / 4 * 2^(e + 2) for q in 5..8.
+    [[nodiscard]] static auto class_index(size_t bytes) -> size_t {
+        bytes = std::max(bytes, min_class_bytes);
+        const int e = static_cast<int>(std::bit_width(bytes - 1)) - 3;
+        const size_t q = ((bytes - 1) >> e) + 1;
+        return static_cast<size_t>(e - 9) * 4 + (q - 5);
+    }
+    [[nodiscard]] static auto bytes_of_class(size_t index) -> size_t {
+        return (index % 4 + 5) << (index / 4 + 9);
+    }
+
+    struct ThreadCache {
+        std::array<std::array<void *, thread_cache_slots>, class_count> slots{};
+        std::array<uint8_t, class_count> count{};
+        size_t bytes = 0;
+
+        ~ThreadCache() {
+            for (size_t i = 0; i < class_count; ++i) {
+                for (size_t k = 0; k < count[i]; ++k) BufferPool::instance().give_back(i, slots[i][k], bytes_of_class(i));
+            }
+        }
+
+        [[nodiscard]] auto take(size_t index) -> void * {
+            if (count[index] == 0) return nullptr;
+            bytes -= bytes_of_class(index);
+            return slots[index][--count[index]];
+        }
+
+        [[nodiscard]] auto put(size_t index, void *ptr, size_t size) -> bool {
+            if (count[index] == thread_cache_slots || bytes + size > thread_cache_bytes) return false;
+            slots[index][count[index]++] = ptr;
+            bytes += size;
+            return true;
+        }
+    };
+
+    [[nodiscard]] static auto local() -> ThreadCache & {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    auto give_back(size_t index, void *ptr, size_t bytes) -> void {
+        if (m_cached.load(std::memory_order_relaxed) <= m_cache_limit.load(std::memory_order_relaxed)) {
+            std::lock_guard lock(m_mutex);
+            m_free[index].push_back(ptr);
+            return;
+        }
+        m_cached.fetch_sub(bytes, std::memory_order_relaxed);
+        aligned_free_bytes(ptr, bytes, nullptr);
+    }
+
+    auto note_in_use(size_t bytes) -> void {
+        const size_t now = m_in_use.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        size_t peak = m_peak.load(std::memory_order_relaxed);
+        while (now > peak && !m_peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+    }
+
+    std::mutex m_mutex;
+    std::array<std::vector<void *>, class_count> m_free;
+    std::atomic<size_t> m_cache_limit{size_t{1} << 30};
+    std::atomic<uint64_t> m_requests{0};
+    std::atomic<uint64_t> m_reuses{0};
+    std::atomic<size_t> m_allocated{0};
+    std::atomic<size_t> m_in_use{0};
+    std::atomic<size_t> m_peak{0};
+    std::atomic<size_t> m_cached{0};
+};
+
+inline auto pool_release_bytes(void *ptr, size_t bytes, void *) -> void {
+    BufferPool::instance().release(ptr, bytes);
+}
+
+// Image with aligned rows whose storage comes from, and returns to, the pool.
+template <typename T, int C>
+[[nodiscard]] inline auto pooled_image(int width, int height) -> Image<T, C> {
+    if (width <= 0 || height <= 0) return {};
+    const size_t stride = aligned_stride(width, C, sizeof(T));
+    const size_t bytes = BufferPool::class_bytes(stride * static_cast<size_t>(height) * sizeof(T));
+    return Image<T, C>::adopt(static_cast<T *>(BufferPool::instance().acquire(bytes)), width, height, stride,
+        BufferDeleter{pool_release_bytes, bytes, nullptr});
+}
+} // namespace CV
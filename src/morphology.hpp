@@ -0,0 +1,530 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "image.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+
+// Grayscale and binary morphology with rectangular (and line) elements.
+//
+// Grayscale erosion / dilation use the van Herk / Gil-Werman scheme along each
+// axis: per block of k samples a prefix and a suffix min (max) are built, and
+// every output is the min (max) of one suffix and one prefix value, i.e. three
+// comparisons per pixel and axis whatever the element size. The vertical pass
+// works on whole rows with SIMD min / max. Compound operations are evaluated
+// per strip of rows so the intermediate image never leaves the cache.
+//
+// Binary masks are packed 64 pixels per word. Vertical runs use the same block
+// scheme on words; horizontal runs are built by doubling shifts, which costs
+// O(log k) word operations per 64 pixels.
+namespace CV {
+// Rectangular structuring element. The anchor defaults to the centre (for even
+// sizes the extra row / column lies below / right of it).
+struct StructuringElement {
+    int width = 3;
+    int height = 3;
+    int anchor_x = -1; // -1 = centre
+    int anchor_y = -1;
+
+    [[nodiscard]] static auto rect(int w, int h) -> StructuringElement { return {std::max(1, w), std::max(1, h)}; }
+    [[nodiscard]] static auto horizontal_line(int length) -> StructuringElement { return {std::max(1, length), 1}; }
+    [[nodiscard]] static auto vertical_line(int length) -> StructuringElement { return {1, std::max(1, length)}; }
+
+    [[nodiscard]] auto left() const -> int { return anchor_x >= 0 ? std::min(anchor_x, width - 1) : (width - 1) / 2; }
+    [[nodiscard]] auto right() const -> int { return width - 1 - left(); }
+    [[nodiscard]] auto top() const -> int { return anchor_y >= 0 ? std::min(anchor_y, height - 1) : (height - 1) / 2; }
+    [[nodiscard]] auto bottom() const -> int { return height - 1 - top(); }
+    // Point reflection about the anchor, used for the second half of open /
+    // close so that both stay idempotent for even-sized elements.
+    [[nodiscard]] auto reflected() const -> StructuringElement { return {width, height, right(), bottom()}; }
+};
+
+namespace Morph {
+inline auto min_row_scalar(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) dst[i] = std::min(a[i], b[i]);
+}
+inline auto max_row_scalar(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) dst[i] = std::max(a[i], b[i]);
+}
+inline auto subs_row_scalar(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) dst[i] = static_cast<uint8_t>(a[i] > b[i] ? a[i] - b[i] : 0);
+}
+
+#if CV_SIMD_X86
+CV_TARGET_SSE41 inline auto min_row_sse41(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_min_epu8(x, y));
+    }
+    min_row_scalar(a + i, b + i, dst + i, n - i);
+}
+CV_TARGET_SSE41 inline auto max_row_sse41(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_max_epu8(x, y));
+    }
+    max_row_scalar(a + i, b + i, dst + i, n - i);
+}
+CV_TARGET_SSE41 inline auto subs_row_sse41(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_subs_epu8(x, y));
+    }
+    subs_row_scalar(a + i, b + i, dst + i, n - i);
+}
+
+CV_TARGET_AVX2 inline auto min_row_avx2(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_min_epu8(x, y));
+    }
+    min_row_sse41(a + i, b + i, dst + i, n - i);
+}
+CV_TARGET_AVX2 inline auto max_row_avx2(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_max_epu8(x, y));
+    }
+    max_row_sse41(a + i, b + i, dst + i, n - i);
+}
+CV_TARGET_AVX2 inline auto subs_row_avx2(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_subs_epu8(x, y));
+    }
+    subs_row_sse41(a + i, b + i, dst + i, n - i);
+}
+#endif
+
+using RowOpFn = void (*)(const uint8_t *, const uint8_t *, uint8_t *, size_t);
+
+struct RowOps {
+    RowOpFn min;
+    RowOpFn max;
+    RowOpFn subs; // saturating a - b
+};
+
+// These loops are load/store bound, so AVX-512 gains nothing over AVX2.
+[[nodiscard]] inline auto row_ops() -> RowOps {
+#if CV_SIMD_X86
+    switch (Simd::active_level()) {
+    case Simd::Level::AVX512:
+    case Simd::Level::AVX2: return {min_row_avx2, max_row_avx2, subs_row_avx2};
+    case Simd::Level::SSE41: return {min_row_sse41, max_row_sse41, subs_row_sse41};
+    case Simd::Level::Scalar: break;
+    }
+#endif
+    return {min_row_scalar, max_row_scalar, subs_row_scalar};
+}
+} // namespace Morph
+
+namespace detail {
+// Strip-local buffer holding rows [y0, y1) of an intermediate image.
+struct StripBuffer {
+    std::vector<uint8_t> data;
+    int y0 = 0;
+    int y1 = 0;
+    size_t width = 0;
+
+    auto reset(int first, int last, size_t w) -> void {
+        y0 = first;
+        y1 = last;
+        width = w;
+        data.resize(static_cast<size_t>(std::max(0, last - first)) * w);
+    }
+    [[nodiscard]] auto row(int y) -> uint8_t * { return data.data() + static_cast<size_t>(y - y0) * width; }
+    [[nodiscard]] auto get(int y) -> const uint8_t * { return y >= y0 && y < y1 ? row(y) : nullptr; }
+};
+
+// Per-worker buffers for one erosion / dilation stage.
+struct MorphScratch {
+    std::vector<uint8_t> prefix;   // vertical block prefixes, rows x width
+    std::vector<uint8_t> suffix;   // vertical block suffixes, rows x width
+    std::vector<uint8_t> identity; // one row of the neutral element
+    std::vector<uint8_t> vert;     // one vertically filtered row
+    std::vector<uint8_t> pad;      // horizontal pass, padded row
+    std::vector<uint8_t> hpre;
+    std::vector<uint8_t> hsuf;
+    StripBuffer intermediate; // output of the first stage of a compound op
+};
+
+// Block prefix / suffix of one padded row for the horizontal pass.
+template <bool Dilate>
+inline auto block_scan(const uint8_t *p, uint8_t *g, uint8_t *hs, size_t n, size_t k) -> void {
+    auto op = [](uint8_t a, uint8_t b) { return Dilate ? std::max(a, b) : std::min(a, b); };
+    for (size_t b = 0; b < n; b += k) {
+        const size_t e = std::min(b + k, n);
+        g[b] = p[b];
+        for (size_t i = b + 1; i < e; ++i) g[i] = op(g[i - 1], p[i]);
+        hs[e - 1] = p[e - 1];
+        for (size_t i = e - 1; i-- > b;) hs[i] = op(hs[i + 1], p[i]);
+    }
+}
+
+// Computes rows [y0, y1) of the erosion (dilate == false) or dilation of an
+// image whose rows are provided by in_row(y); in_row returns nullptr for rows
+// outside the valid input, which then act as the neutral element. Output rows
+// are written through out_row(y).
+template <typename InRow, typename OutRow>
+inline auto morph_strip(InRow &&in_row, int w, int y0, int y1, StructuringElement se, bool dilate,
+    const Morph::RowOps &ops, MorphScratch &s, OutRow &&out_row) -> void {
+    const Morph::RowOpFn op = dilate ? ops.max : ops.min;
+    const uint8_t neutral = dilate ? 0 : 255;
+    const auto wn = static_cast<size_t>(w);
+    const int kh = se.height;
+    const int kw = se.width;
+    s.identity.assign(wn, neutral);
+    s.vert.resize(wn);
+
+    auto source = [&](int y) -> const uint8_t * {
+        const uint8_t *r = in_row(y);
+        return r ? r : s.identity.data();
+    };
+
+    // Vertical van Herk / Gil-Werman over rows [y0 - top, y1 - 1 + bottom].
+    const int first = y0 - se.top();
+    const int rows = (y1 - y0) + kh - 1;
+    if (kh > 1) {
+        s.prefix.resize(static_cast<size_t>(rows) * wn);
+        s.suffix.resize(static_cast<size_t>(rows) * wn);
+        auto pre = [&](int i) { return s.prefix.data() + static_cast<size_t>(i) * wn; };
+        auto suf = [&](int i) { return s.suffix.data() + static_cast<size_t>(i) * wn; };
+        for (int i = 0; i < rows; ++i) {
+            if (i % kh == 0) {
+                std::memcpy(pre(i), source(first + i), wn);
+            } else {
+                op(pre(i - 1), source(first + i), pre(i), wn);
+            }
+        }
+        for (int i = rows - 1; i >= 0; --i) {
+            if (i == rows - 1 || (i + 1) % kh == 0) {
+                std::memcpy(suf(i), source(first + i), wn);
+            } else {
+                op(suf(i + 1), source(first + i), suf(i), wn);
+            }
+        }
+    }
+
+    const int left = se.left();
+    const size_t plen = wn + static_cast<size_t>(kw) - 1;
+    if (kw > 1) {
+        s.pad.assign(plen, neutral);
+        s.hpre.resize(plen);
+        s.hsuf.resize(plen);
+    }
+
+    for (int y = y0; y < y1; ++y) {
+        const int j = y - y0;
+        const uint8_t *v = kh > 1 ? s.vert.data() : source(y);
+        if (kh > 1) op(s.suffix.data() + static_cast<size_t>(j) * wn, s.prefix.data() + static_cast<size_t>(j + kh - 1) * wn, s.vert.data(), wn);
+        uint8_t *out = out_row(y);
+        if (kw == 1) {
+            std::memcpy(out, v, wn);
+            continue;
+        }
+        // Horizontal pass over the row padded with `left` / `right` neutral pixels.
+        std::memcpy(s.pad.data() + left, v, wn);
+        if (dilate) {
+            block_scan<true>(s.pad.data(), s.hpre.data(), s.hsuf.data(), plen, static_cast<size_t>(kw));
+        } else {
+            block_scan<false>(s.pad.data(), s.hpre.data(), s.hsuf.data(), plen, static_cast<size_t>(kw));
+        }
+        op(s.hsuf.data(), s.hpre.data() + kw - 1, out, wn);
+    }
+}
+
+// Taller elements get taller strips so the halo rows recomputed by compound
+// operations stay a small fraction of the work.
+[[nodiscard]] inline auto morph_strip_rows(const StructuringElement &se) -> int { return std::max(32, 2 * se.height); }
+
+inline auto check_morph_args(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, const char *what) -> void {
+    if (src.width != dst.width || src.height != dst.height) PANIC(std::format("{}: size mismatch", what));
+    if (!src.empty() && src.data == dst.data) PANIC(std::format("{}: source and destination must not alias", what));
+}
+
+// Runs `fn(y0, y1, scratch)` over strips of output rows in parallel.
+template <typename F>
+inline auto for_each_strip(int height, const StructuringElement &se, F &&fn) -> void {
+    const int strip = morph_strip_rows(se);
+    const int strips = (height + strip - 1) / strip;
+    parallel_for(0, strips, 1, [&](int begin, int end) {
+        MorphScratch a, b;
+        for (int i = begin; i < end; ++i) fn(i * strip, std::min(height, (i + 1) * strip), a, b);
+    });
+}
+
+// dst = second(first(src)), evaluated strip by strip.
+inline auto morph_chain(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, StructuringElement se, bool first_dilate) -> void {
+    const Morph::RowOps ops = Morph::row_ops();
+    const int h = src.height;
+    const StructuringElement se2 = se.reflected();
+    auto in_src = [&](int y) -> const uint8_t * { return y >= 0 && y < h ? src.row(y) : nullptr; };
+    for_each_strip(h, se, [&](int y0, int y1, MorphScratch &sa, MorphScratch &sb) {
+        StripBuffer &mid = sa.intermediate;
+        const int m0 = std::max(0, y0 - se2.top());
+        const int m1 = std::min(h, y1 + se2.bottom());
+        mid.reset(m0, m1, static_cast<size_t>(src.width));
+        morph_strip(in_src, src.width, m0, m1, se, first_dilate, ops, sa, [&](int y) { return mid.row(y); });
+        morph_strip([&](int y) { return mid.get(y); }, src.width, y0, y1, se2, !first_dilate, ops, sb,
+            [&](int y) { return dst.row(y); });
+    });
+}
+} // namespace detail
+
+inline auto erode(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, StructuringElement se) -> void {
+    detail::check_morph_args(src, dst, "erode");
+    const Morph::RowOps ops = Morph::row_ops();
+    auto in = [&](int y) -> const uint8_t * { return y >= 0 && y < src.height ? src.row(y) : nullptr; };
+    detail::for_each_strip(src.height, se, [&](int y0, int y1, detail::MorphScratch &s, detail::MorphScratch &) {
+        detail::morph_strip(in, src.width, y0, y1, se, false, ops, s, [&](int y) { return dst.row(y); });
+    });
+}
+
+inline auto dilate(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, StructuringElement se) -> void {
+    detail::check_morph_args(src, dst, "dilate");
+    const Morph::RowOps ops = Morph::row_ops();
+    auto in = [&](int y) -> const uint8_t * { return y >= 0 && y < src.height ? src.row(y) : nullptr; };
+    detail::for_each_strip(src.height, se, [&](int y0, int y1, detail::MorphScratch &s, detail::MorphScratch &) {
+        detail::morph_strip(in, src.width, y0, y1, se, true, ops, s, [&](int y) { return dst.row(y); });
+    });
+}
+
+// Erosion followed by dilation.
+inline auto open(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, StructuringElement se) -> void {
+    detail::check_morph_args(src, dst, "open");
+    detail::morph_chain(src, dst, se, false);
+}
+
+// Dilation followed by erosion.
+inline auto close(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, StructuringElement se) -> void {
+    detail::check_morph_args(src, dst, "close");
+    detail::morph_chain(src, dst, se, true);
+}
+
+// dilate(src) - erode(src), both evaluated per strip.
+inline auto morph_gradient(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, StructuringElement se) -> void {
+    detail::check_morph_args(src, dst, "morph_gradient");
+    const Morph::RowOps ops = Morph::row_ops();
+    const auto w = static_cast<size_t>(src.width);
+    auto in = [&](int y) -> const uint8_t * { return y >= 0 && y < src.height ? src.row(y) : nullptr; };
+    detail::for_each_strip(src.height, se, [&](int y0, int y1, detail::MorphScratch &sa, detail::MorphScratch &sb) {
+        detail::StripBuffer &eroded = sa.intermediate;
+        eroded.reset(y0, y1, w);
+        detail::morph_strip(in, src.width, y0, y1, se, false, ops, sa, [&](int y) { return eroded.row(y); });
+        detail::morph_strip(in, src.width, y0, y1, se, true, ops, sb, [&](int y) { return dst.row(y); });
+        for (int y = y0; y < y1; ++y) ops.subs(dst.row(y), eroded.row(y), dst.row(y), w);
+    });
+}
+
+// White top-hat: src - open(src).
+inline auto top_hat(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, StructuringElement se) -> void {
+    open(src, dst, se);
+    const Morph::RowOps ops = Morph::row_ops();
+    parallel_for(0, src.height, 64, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) ops.subs(src.row(y), dst.row(y), dst.row(y), static_cast<size_t>(src.width));
+    });
+}
+
+// Black top-hat: close(src) - src.
+inline auto black_hat(ImageView<const uint8_t, 1> src, ImageView<uint8_t, 1> dst, StructuringElement se) -> void {
+    close(src, dst, se);
+    const Morph::RowOps ops = Morph::row_ops();
+    parallel_for(0, src.height, 64, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) ops.subs(dst.row(y), src.row(y), dst.row(y), static_cast<size_t>(src.width));
+    });
+}
+
+// Binary mask packed 64 pixels per word; pixel x of a row is bit x % 64 of word
+// x / 64. Bits past the width are kept zero.
+class BitImage {
+public:
+    BitImage() = default;
+    BitImage(int width, int height)
+        : m_width(std::max(0, width)), m_height(std::max(0, height)),
+          m_words((static_cast<size_t>(m_width) + 63) / 64),
+          m_data(m_words * static_cast<size_t>(m_height), 0) {}
+
+    [[nodiscard]] auto width() const -> int { return m_width; }
+    [[nodiscard]] auto height() const -> int { return m_height; }
+    [[nodiscard]] auto words_per_row() const -> size_t { return m_words; }
+    [[nodiscard]] auto empty() const -> bool { return m_data.empty(); }
+    [[nodiscard]] auto row(int y) -> uint64_t * { return m_data.data() + static_cast<size_t>(y) * m_words; }
+    [[nodiscard]] auto row(int y) const -> const uint64_t * { return m_data.data() + static_cast<size_t>(y) * m_words; }
+    [[nodiscard]] auto get(int x, int y) const -> bool { return (row(y)[x / 64] >> (x % 64)) & 1u; }
+
+    // Mask of the valid bits in the last word of each row.
+    [[nodiscard]] auto tail_mask() const -> uint64_t {
+        const int r = m_width % 64;
+        return r == 0 ? ~uint64_t{0} : (uint64_t{1} << r) - 1;
+    }
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    size_t m_words = 0;
+    std::vector<uint64_t> m_data;
+};
+
+// Non-zero pixels become set bits.
+[[nodiscard]] inline auto pack(ImageView<const uint8_t, 1> mask) -> BitImage {
+    BitImage out(mask.width, mask.height);
+    parallel_for(0, mask.height, 64, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t *s = mask.row(y);
+            uint64_t *d = out.row(y);
+            for (size_t wi = 0; wi < out.words_per_row(); ++wi) {
+                const int x0 = static_cast<int>(wi * 64);
+                const int n = std::min(64, mask.width - x0);
+                uint64_t word = 0;
+                for (int b = 0; b < n; ++b) word |= static_cast<uint64_t>(s[x0 + b] != 0) << b;
+                d[wi] = word;
+            }
+        }
+    });
+    return out;
+}
+
+// Set bits become 255, others 0.
+inline auto unpack(const BitImage &bits, ImageView<uint8_t, 1> dst) -> void {
+    if (bits.width() != dst.width || bits.height() != dst.height) PANIC("unpack: size mismatch");
+    parallel_for(0, dst.height, 64, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const uint64_t *s = bits.row(y);
+            uint8_t *d = dst.row(y);
+            for (int x = 0; x < dst.width; ++x) d[x] = ((s[x / 64] >> (x % 64)) & 1u) ? 255 : 0;
+        }
+    });
+}
+
+namespace detail {
+// Word i of the result holds pixels [64 i + s, 64 i + s + 64) of `src`; words
+// outside [0, n) read as `fill`.
+inline auto shift_bits(const uint64_t *src, uint64_t *dst, size_t n, int s, uint64_t fill) -> void {
+    const int q = s >= 0 ? s / 64 : -((-s + 63) / 64);
+    const int r = s - q * 64;
+    auto word = [&](long long i) { return i >= 0 && i < static_cast<long long>(n) ? src[i] : fill; };
+    for (size_t i = 0; i < n; ++i) {
+        const long long j = static_cast<long long>(i) + q;
+        dst[i] = r == 0 ? word(j) : (word(j) >> r) | (word(j + 1) << (64 - r));
+    }
+}
+
+// out[x] = op over in[x - left .. x + right] for one packed row, where
+// pixels outside the row are the neutral element.
+inline auto binary_row_run(const uint64_t *in, uint64_t *out, size_t n, uint64_t tail, int left, int width,
+    bool dilate, std::vector<uint64_t> &cur, std::vector<uint64_t> &acc, std::vector<uint64_t> &tmp) -> void {
+    const uint64_t fill = dilate ? 0 : ~uint64_t{0};
+    auto combine = [dilate](uint64_t a, uint64_t b) { return dilate ? (a | b) : (a & b); };
+    // Pad bits beyond the width with the neutral element, then move the
+    // window start to the pixel itself: cur[x] = in[x - left].
+    // The shift pushes the last `left` pixels past word n - 1, so the working
+    // rows carry enough extra words to keep them.
+    const size_t m = n + static_cast<size_t>(left) / 64 + 1;
+    tmp.assign(m, fill);
+    std::copy(in, in + n, tmp.begin());
+    if (n > 0) tmp[n - 1] = dilate ? (tmp[n - 1] & tail) : (tmp[n - 1] | ~tail);
+    cur.resize(m);
+    shift_bits(tmp.data(), cur.data(), m, -left, fill);
+    acc.assign(m, fill);
+    // Binary decomposition of the run length: acc covers [0, done) and cur
+    // covers [0, len) relative to each (shifted) pixel.
+    int done = 0;
+    int len = 1;
+    for (int k = width; k > 0; k >>= 1) {
+        if (k & 1) {
+            shift_bits(cur.data(), tmp.data(), m, done, fill);
+            for (size_t i = 0; i < m; ++i) acc[i] = combine(acc[i], tmp[i]);
+            done += len;
+        }
+        if (k > 1) {
+            shift_bits(cur.data(), tmp.data(), m, len, fill);
+            for (size_t i = 0; i < m; ++i) cur[i] = combine(cur[i], tmp[i]);
+            len *= 2;
+        }
+    }
+    std::copy(acc.begin(), acc.begin() + static_cast<ptrdiff_t>(n), out);
+    if (n > 0) out[n - 1] &= tail;
+}
+
+inline auto binary_morph(const BitImage &src, StructuringElement se, bool dilate) -> BitImage {
+    BitImage dst(src.width(), src.height());
+    if (src.empty()) return dst;
+    const size_t n = src.words_per_row();
+    const int h = src.height();
+    const int kh = se.height;
+    const uint64_t neutral = dilate ? 0 : ~uint64_t{0};
+    auto combine_rows = [&](const uint64_t *a, const uint64_t *b, uint64_t *d) {
+        for (size_t i = 0; i < n; ++i) d[i] = dilate ? (a[i] | b[i]) : (a[i] & b[i]);
+    };
+
+    const int strip = morph_strip_rows(se);
+    const int strips = (h + strip - 1) / strip;
+    parallel_for(0, strips, 1, [&](int begin, int end) {
+        std::vector<uint64_t> identity(n, neutral), prefix, suffix, vert(n), cur, acc, tmp;
+        for (int si = begin; si < end; ++si) {
+            const int y0 = si * strip;
+            const int y1 = std::min(h, y0 + strip);
+            const int first = y0 - se.top();
+            const int rows = (y1 - y0) + kh - 1;
+            auto source = [&](int y) -> const uint64_t * { return y >= 0 && y < h ? src.row(y) : identity.data(); };
+            prefix.resize(static_cast<size_t>(rows) * n);
+            suffix.resize(static_cast<size_t>(rows) * n);
+            auto pre = [&](int i) { return prefix.data() + static_cast<size_t>(i) * n; };
+            auto suf = [&](int i) { return suffix.data() + static_cast<size_t>(i) * n; };
+            for (int i = 0; i < rows; ++i) {
+                if (i % kh == 0) {
+                    std::copy(source(first + i), source(first + i) + n, pre(i));
+                } else {
+                    combine_rows(pre(i - 1), source(first + i), pre(i));
+                }
+            }
+            for (int i = rows - 1; i >= 0; --i) {
+                if (i == rows - 1 || (i + 1) % kh == 0) {
+                    std::copy(source(first + i), source(first + i) + n, suf(i));
+                } else {
+                    combine_rows(suf(i + 1), source(first + i), suf(i));
+                }
+            }
+            for (int y = y0; y < y1; ++y) {
+                combine_rows(suf(y - y0), pre(y - y0 + kh - 1), vert.data());
+                binary_row_run(vert.data(), dst.row(y), n, src.tail_mask(), se.left(), se.width, dilate, cur, acc, tmp);
+            }
+        }
+    });
+    return dst;
+}
+} // namespace detail
+
+[[nodiscard]] inline auto erode(const BitImage &src, StructuringElement se) -> BitImage {
+    return detail::binary_morph(src, se, false);
+}
+
+[[nodiscard]] inline auto dilate(const BitImage &src, StructuringElement se) -> BitImage {
+    return detail::binary_morph(src, se, true);
+}
+
+[[nodiscard]] inline auto open(const BitImage &src, StructuringElement se) -> BitImage {
+    return dilate(erode(src, se), se.reflected());
+}
+
+[[nodiscard]] inline auto close(const BitImage &src, StructuringElement se) -> BitImage {
+    return erode(dilate(src, se), se.reflected());
+}
+} // namespace CV
@@ -0,0 +1,228 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numbers>
+#include <vector>
+
+#include "convolve.hpp"
+#include "features.hpp"
+#include "image.hpp"
+#include "parallel.hpp"
+
+// Oriented FAST / rotated BRIEF descriptors.
+//
+// Each keypoint gets an orientation from the intensity centroid of a circular
+// patch, then 256 intensity comparisons on a Gaussian-smoothed image produce a
+// 32 byte binary descriptor. The sampling pattern is pre-rotated into 30 angle
+// bins, so steering costs a table lookup instead of 512 rotations per keypoint.
+namespace CV {
+inline constexpr size_t descriptor_bytes = 32;
+inline constexpr int descriptor_bits = 256;
+
+// Contiguous array of 256-bit descriptors; every descriptor starts on a 32 byte
+// boundary so the matchers can use aligned vector loads.
+class Descriptors {
+public:
+    Descriptors() = default;
+    explicit Descriptors(size_t count)
+        : m_count(count) {
+        if (count == 0) return;
+        const size_t bytes = count * descriptor_bytes;
+        m_data = Storage(static_cast<uint8_t *>(aligned_alloc_bytes(bytes)), BufferDeleter{aligned_free_bytes, bytes, nullptr});
+        std::memset(m_data.get(), 0, bytes);
+    }
+
+    [[nodiscard]] auto row(size_t i) -> uint8_t * { return m_data.get() + i * descriptor_bytes; }
+    [[nodiscard]] auto row(size_t i) const -> const uint8_t * { return m_data.get() + i * descriptor_bytes; }
+    [[nodiscard]] auto data() const -> const uint8_t * { return m_data.get(); }
+    [[nodiscard]] auto size() const -> size_t { return m_count; }
+    [[nodiscard]] auto empty() const -> bool { return m_count == 0; }
+    [[nodiscard]] auto size_bytes() const -> size_t { return m_count * descriptor_bytes; }
+
+    // Concatenation, e.g. to grow a reference database frame by frame.
+    [[nodiscard]] static auto concat(const Descriptors &a, const Descriptors &b) -> Descriptors {
+        Descriptors out(a.size() + b.size());
+        if (!a.empty()) std::memcpy(out.row(0), a.data(), a.size_bytes());
+        if (!b.empty()) std::memcpy(out.row(a.size()), b.data(), b.size_bytes());
+        return out;
+    }
+
+private:
+    using Storage = std::unique_ptr<uint8_t, BufferDeleter>;
+
+    Storage m_data;
+    size_t m_count = 0;
+};
+
+struct OrbParams {
+    float blur_sigma = 2.0f;
+    bool compute_orientation = true; // false keeps existing angles (>= 0) or uses 0
+};
+
+namespace Orb {
+inline constexpr int patch_radius = 15;
+inline constexpr int pattern_radius = 13;
+inline constexpr int angle_bins = 30;
+// Keypoints closer than this to the image border are dropped.
+inline constexpr int border = patch_radius + 1;
+
+struct PatternPoint {
+    int8_t x;
+    int8_t y;
+};
+
+// 256 point pairs drawn from an isotropic Gaussian (sigma = patch size / 5, the
+// BRIEF "G II" layout) with a fixed seed, rejected outside pattern_radius so
+// that every rotation stays inside the patch.
+[[nodiscard]] inline auto make_pattern() -> std::array<PatternPoint, 2 * descriptor_bits> {
+    std::array<PatternPoint, 2 * descriptor_bits> pattern{};
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    auto uniform = [&state] {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return (static_cast<double>(state >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+    };
+    const double sigma = (2.0 * patch_radius + 1.0) / 5.0;
+    for (auto &p : pattern) {
+        for (;;) {
+            const double r = sigma * std::sqrt(-2.0 * std::log(uniform()));
+            const double phi = 2.0 * std::numbers::pi * uniform();
+            const auto x = static_cast<int>(std::lround(r * std::cos(phi)));
+            const auto y = static_cast<int>(std::lround(r * std::sin(phi)));
+            if (x * x + y * y <= pattern_radius * pattern_radius) {
+                p = PatternPoint{static_cast<int8_t>(x), static_cast<int8_t>(y)};
+                break;
+            }
+        }
+    }
+    return pattern;
+}
+
+// Pattern rotated by bin * 12 degrees, as (x, y) pairs.
+[[nodiscard]] inline auto rotated_patterns() -> const std::vector<PatternPoint> & {
+    static const std::vector<PatternPoint> table = [] {
+        const auto base = make_pattern();
+        std::vector<PatternPoint> out(static_cast<size_t>(angle_bins) * base.size());
+        for (int b = 0; b < angle_bins; ++b) {
+            const double a = 2.0 * std::numbers::pi * b / angle_bins;
+            const double c = std::cos(a), s = std::sin(a);
+            for (size_t i = 0; i < base.size(); ++i) {
+                const double x = base[i].x, y = base[i].y;
+                out[static_cast<size_t>(b) * base.size() + i] = PatternPoint{
+                    static_cast<int8_t>(std::lround(c * x - s * y)), static_cast<int8_t>(std::lround(s * x + c * y))};
+            }
+        }
+        return out;
+    }();
+    return table;
+}
+
+// Half-widths of the circular orientation patch per row offset.
+[[nodiscard]] inline auto patch_extent() -> const std::array<int, patch_radius + 1> & {
+    static const std::array<int, patch_radius + 1> extent = [] {
+        std::array<int, patch_radius + 1> e{};
+        for (int v = 0; v <= patch_radius; ++v) {
+            e[static_cast<size_t>(v)] = static_cast<int>(std::lround(std::sqrt(static_cast<double>(patch_radius * patch_radius - v * v))));
+        }
+        return e;
+    }();
+    return extent;
+}
+
+// Intensity centroid orientation in degrees, [0, 360).
+[[nodiscard]] inline auto orientation(ImageView<const uint8_t, 1> img, int x, int y) -> float {
+    const auto &extent = patch_extent();
+    int64_t m01 = 0, m10 = 0;
+    for (int v = -patch_radius; v <= patch_radius; ++v) {
+        const int e = extent[static_cast<size_t>(std::abs(v))];
+        const uint8_t *row = img.row(y + v);
+        int64_t sum = 0, wsum = 0;
+        for (int u = -e; u <= e; ++u) {
+            const int p = row[x + u];
+            sum += p;
+            wsum += static_cast<int64_t>(u) * p;
+        }
+        m10 += wsum;
+        m01 += static_cast<int64_t>(v) * sum;
+    }
+    float angle = static_cast<float>(std::atan2(static_cast<double>(m01), static_cast<double>(m10)) * (180.0 / std::numbers::pi));
+    if (angle < 0.0f) angle += 360.0f;
+    return angle >= 360.0f ? 0.0f : angle;
+}
+} // namespace Orb
+
+// Computes descriptors for `kp` on `image`. Keypoint coordinates are mapped
+// into the image by their octave (x / 2^octave), so call once per pyramid level
+// with the keypoints detected on it. Keypoints too close to the border are
+// removed from `kp`; on return kp.size() == result.size() and angles are set.
+[[nodiscard]] inline auto compute_orb(ImageView<const uint8_t, 1> image, Keypoints &kp, const OrbParams &params = {}) -> Descriptors {
+    const int w = image.width;
+    const int h = image.height;
+
+    std::vector<uint32_t> keep;
+    std::vector<std::array<int, 2>> pixel;
+    keep.reserve(kp.size());
+    pixel.reserve(kp.size());
+    for (size_t i = 0; i < kp.size(); ++i) {
+        const float inv = 1.0f / static_cast<float>(1 << std::max(0, kp.octave[i]));
+        const auto x = static_cast<int>(std::lround(kp.x[i] * inv));
+        const auto y = static_cast<int>(std::lround(kp.y[i] * inv));
+        if (x < Orb::border || y < Orb::border || x >= w - Orb::border || y >= h - Orb::border) continue;
+        keep.push_back(static_cast<uint32_t>(i));
+        pixel.push_back({x, y});
+    }
+    if (keep.size() != kp.size()) kp = select(kp, keep);
+    Descriptors out(kp.size());
+    if (kp.empty()) return out;
+
+    ImageGray8 smooth(w, h);
+    gaussian_blur(image, smooth.view(), params.blur_sigma);
+    const ImageView<const uint8_t, 1> sv = smooth.view();
+
+    const auto &patterns = Orb::rotated_patterns();
+    const auto stride = static_cast<ptrdiff_t>(sv.stride);
+    parallel_for(0, static_cast<int>(kp.size()), 128, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const auto idx = static_cast<size_t>(i);
+            const auto [x, y] = pixel[idx];
+            if (params.compute_orientation) {
+                kp.angle[idx] = Orb::orientation(image, x, y);
+            } else if (kp.angle[idx] < 0.0f) {
+                kp.angle[idx] = 0.0f;
+            }
+            const int bin = static_cast<int>(std::lround(kp.angle[idx] * (Orb::angle_bins / 360.0f))) % Orb::angle_bins;
+            const Orb::PatternPoint *pat = patterns.data() + static_cast<size_t>(bin) * 2 * descriptor_bits;
+            const uint8_t *center = sv.row(y) + x;
+            uint8_t *desc = out.row(idx);
+            for (int byte = 0; byte < static_cast<int>(descriptor_bytes); ++byte) {
+                uint8_t bits = 0;
+                for (int b = 0; b < 8; ++b) {
+                    const Orb::PatternPoint &p = pat[2 * (8 * byte + b)];
+                    const Orb::PatternPoint &q = pat[2 * (8 * byte + b) + 1];
+                    const uint8_t a = center[p.y * stride + p.x];
+                    const uint8_t c = center[q.y * stride + q.x];
+                    bits |= static_cast<uint8_t>((a < c ? 1 : 0) << b);
+                }
+                desc[byte] = bits;
+            }
+        }
+    });
+    return out;
+}
+
+// FAST detection followed by ORB description on the same image.
+[[nodiscard]] inline auto detect_and_compute_orb(ImageView<const uint8_t, 1> image, Keypoints &kp,
+    const CornerParams &corners = {}, const OrbParams &params = {}) -> Descriptors {
+    CornerParams cp = corners;
+    cp.octave = 0;
+    kp = detect_corners(image, cp);
+    return compute_orb(image, kp, params);
+}
+} // namespace CV
@@ -0,0 +1,160 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "gl.hpp"
+#include "log.hpp"
+
+// Instanced overlay renderer for rects, circles and markers.
+//
+// Shapes are collected on the CPU into one instance array per shape type and
+// drawn with a single glDrawElementsInstanced call per type, however many
+// there are. Each type gets its own VAO over the existing unit geometry
+// (geom_square, geom_circle, geom_triangle) plus a per-instance attribute
+// stream. Instance buffers are streamed by orphaning: glBufferData with nullptr
+// hands the driver fresh storage while the previous frame's draw may still
+// read the old one, then glBufferSubData fills it. Persistent mapping would
+// need GL 4.4 and the context is 4.1 (macOS); everything used here is GL 3.3
+// core, which Mesa llvmpipe provides, so it also runs without a GPU.
+//
+// Coordinates are in overlay units with y pointing down (e.g. image pixels);
+// the projection passed to draw() maps them to clip space.
+namespace GL {
+struct OverlayInstance {
+    glm::vec2 position;
+    glm::vec2 size;
+    glm::vec4 color;
+};
+
+enum class OverlayShape {
+    Rect,
+    Circle,
+    Marker
+};
+
+class OverlayRenderer {
+public:
+    static constexpr size_t shape_count = 3;
+
+    // The geometry is borrowed: the renderer builds its own VAOs over the
+    // vertex and index buffers but leaves their lifetime to the caller.
+    auto init(const GeometryBuffers &square, const GeometryBuffers &circle, const GeometryBuffers &triangle,
+        const char *vertex_path, const char *fragment_path) -> void {
+        m_shader.load(vertex_path, fragment_path);
+        m_projection = m_shader.get_uniform("u_Projection");
+        const std::array<const GeometryBuffers *, shape_count> geometry = {&square, &circle, &triangle};
+        for (size_t i = 0; i < shape_count; ++i) {
+            if (geometry[i]->vao == GL_ZERO) PANIC("OverlayRenderer needs initialised geometry");
+            Batch &batch = m_batches[i];
+            batch.index_count = geometry[i]->index_count;
+
+            glGenVertexArrays(1, &batch.vao);
+            glBindVertexArray(batch.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, geometry[i]->vbo);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
+            glEnableVertexAttribArray(0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry[i]->ebo);
+
+            glGenBuffers(1, &batch.instances);
+            glBindBuffer(GL_ARRAY_BUFFER, batch.instances);
+            instance_attribute(1, 2, offsetof(OverlayInstance, position));
+            instance_attribute(2, 2, offsetof(OverlayInstance, size));
+            instance_attribute(3, 4, offsetof(OverlayInstance, color));
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        LOG_INFO("Overlay renderer ready: {} shape batches", shape_count);
+    }
+
+    auto destroy() -> void {
+        for (Batch &batch : m_batches) {
+            glDeleteBuffers(1, &batch.instances);
+            glDeleteVertexArrays(1, &batch.vao);
+            batch = Batch{};
+        }
+        glDeleteProgram(m_shader.m_id);
+        m_shader = ShaderProgram();
+    }
+
+    // Drops everything collected since the last clear.
+    auto clear() -> void {
+        for (Batch &batch : m_batches) batch.instances_cpu.clear();
+    }
+
+    auto reserve(OverlayShape shape, size_t count) -> void { batch(shape).instances_cpu.reserve(count); }
+
+    auto rect(glm::vec2 top_left, glm::vec2 size, const glm::vec4 &color) -> void {
+        // The unit square spans [0, 1] x [-1, 0].
+        batch(OverlayShape::Rect).instances_cpu.push_back({top_left, {size.x, -size.y}, color});
+    }
+
+    auto circle(glm::vec2 centre, float radius, const glm::vec4 &color) -> void {
+        batch(OverlayShape::Circle).instances_cpu.push_back({centre, {radius, radius}, color});
+    }
+
+    // Upward-pointing triangle of side `size` centred on centre.
+    auto marker(glm::vec2 centre, float size, const glm::vec4 &color) -> void {
+        batch(OverlayShape::Marker).instances_cpu.push_back({centre - 0.5f * glm::vec2(size), {size, -size}, color});
+    }
+
+    // Uploads and draws everything collected, rects first, then circles and
+    // markers on top. The collected shapes stay until clear().
+    auto draw(const glm::mat4 &projection) -> void {
+        m_shader.bind();
+        ShaderProgram::set_uniform(m_projection, projection);
+        m_draw_calls = 0;
+        for (Batch &batch : m_batches) {
+            const size_t count = batch.instances_cpu.size();
+            if (count == 0) continue;
+            glBindBuffer(GL_ARRAY_BUFFER, batch.instances);
+            batch.capacity = std::max(batch.capacity, count);
+            const auto bytes = static_cast<GLsizeiptr>(batch.capacity * sizeof(OverlayInstance));
+            glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(count * sizeof(OverlayInstance)), batch.instances_cpu.data());
+            glBindVertexArray(batch.vao);
+            glDrawElementsInstanced(GL_TRIANGLES, batch.index_count, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(count));
+            ++m_draw_calls;
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        ShaderProgram::unbind();
+    }
+
+    [[nodiscard]] auto instance_count() const -> size_t {
+        size_t n = 0;
+        for (const Batch &batch : m_batches) n += batch.instances_cpu.size();
+        return n;
+    }
+
+    // Draw calls issued by the last draw().
+    [[nodiscard]] auto draw_calls() const -> int { return m_draw_calls; }
+
+private:
+    struct Batch {
+        VAO vao = GL_ZERO;
+        VBO instances = GL_ZERO;
+        GLsizei index_count = 0;
+        size_t capacity = 0; // instances the buffer storage is sized for
+        std::vector<OverlayInstance> instances_cpu;
+    };
+
+    static auto instance_attribute(GLuint index, GLint components, size_t offset) -> void {
+        glVertexAttribPointer(index, components, GL_FLOAT, GL_FALSE, sizeof(OverlayInstance), reinterpret_cast<const void *>(offset));
+        glVertexAttribDivisor(index, 1);
+        glEnableVertexAttribArray(index);
+    }
+
+    [[nodiscard]] auto batch(OverlayShape shape) -> Batch & { return m_batches[static_cast<size_t>(shape)]; }
+
+    ShaderProgram m_shader;
+    UniformLocation m_projection = -1;
+    std::array<Batch, shape_count> m_batches{};
+    int m_draw_calls = 0;
+};
+} // namespace GL
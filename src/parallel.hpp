@@ -0,0 +1,387 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "profile.hpp"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Process-wide work-stealing thread pool.
+//
+// Every pool thread owns a Chase-Lev deque: it pushes and pops tasks at the
+// bottom, idle threads steal from the top of a random victim. Threads outside
+// the pool (main, pipeline stages) lease one of a few extra deques for the
+// duration of a parallel call and help execute tasks while they wait, so any
+// number of concurrent callers share the same worker_count() threads instead
+// of oversubscribing the machine. Waiting always helps, so parallel_for may be
+// nested freely inside a task, but never call it while holding a lock that a
+// helped task could also take.
+//
+// CV_NUM_THREADS overrides the thread count, CV_PIN_THREADS=1 pins pool
+// thread i to CPU i + 1 so the calling thread keeps CPU 0 (Linux only).
+namespace CV {
+[[nodiscard]] inline auto worker_count() -> int {
+    static const int count = [] {
+        if (const char *env = std::getenv("CV_NUM_THREADS")) {
+            const int n = std::atoi(env);
+            if (n > 0) return n;
+        }
+        return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }();
+    return count;
+}
+
+namespace detail {
+struct Task {
+    void (*run)(Task *) = nullptr;
+};
+
+// Fixed-capacity Chase-Lev deque (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models"). push fails when full and the caller
+// then runs the task inline, which keeps the deque free of reallocation. Slots
+// are published release / acquire so a thief also sees the task's fields.
+class WorkDeque {
+public:
+    static constexpr int64_t capacity = 4096;
+
+    auto push(Task *task) -> bool {
+        const int64_t b = m_bottom.load(std::memory_order_relaxed);
+        const int64_t t = m_top.load(std::memory_order_acquire);
+        if (b - t >= capacity) return false;
+        m_slots[static_cast<size_t>(b & (capacity - 1))].store(task, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Owner only.
+    [[nodiscard]] auto pop() -> Task * {
+        const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        if (t > b) {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Task *task = m_slots[static_cast<size_t>(b & (capacity - 1))].load(std::memory_order_relaxed);
+        if (t == b) {
+            // Last element: race the thieves for it.
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) task = nullptr;
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    [[nodiscard]] auto steal() -> Task * {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        Task *task = m_slots[static_cast<size_t>(t & (capacity - 1))].load(std::memory_order_acquire);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+        return task;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> m_top{0};
+    alignas(64) std::atomic<int64_t> m_bottom{0};
+    alignas(64) std::array<std::atomic<Task *>, capacity> m_slots{};
+};
+
+struct WorkerSlot {
+    WorkDeque deque;
+    std::atomic<bool> leased{false}; // external slots only
+};
+
+// Deque of the calling thread, or -1 outside the pool and any parallel call.
+inline thread_local int t_slot = -1;
+} // namespace detail
+
+class ThreadPool {
+public:
+    explicit ThreadPool(int concurrency)
+        : m_workers(std::max(0, concurrency - 1)) {
+        const int external = std::max(4, concurrency);
+        for (int i = 0; i < m_workers + external; ++i) m_slots.push_back(std::make_unique<detail::WorkerSlot>());
+        m_threads.reserve(static_cast<size_t>(m_workers));
+        const char *pin = std::getenv("CV_PIN_THREADS");
+        const bool pinned = pin != nullptr && pin[0] == '1';
+        for (int i = 0; i < m_workers; ++i) {
+            m_threads.emplace_back([this, i] { worker_main(i); });
+            if (pinned) pin_thread(m_threads.back(), i + 1);
+        }
+    }
+
+    ~ThreadPool() {
+        m_stop.store(true);
+        m_epoch.fetch_add(1);
+        m_epoch.notify_all();
+        m_threads.clear();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    auto operator=(const ThreadPool &) -> ThreadPool & = delete;
+
+    [[nodiscard]] static auto instance() -> ThreadPool & {
+        static ThreadPool pool(worker_count());
+        return pool;
+    }
+
+    // Number of threads that execute tasks, counting one caller.
+    [[nodiscard]] auto concurrency() const -> int { return m_workers + 1; }
+
+    // Pushes onto the calling thread's deque. Returns false when the task has to
+    // be run inline instead (no deque leased, or deque full).
+    auto push(detail::Task *task) -> bool {
+        if (detail::t_slot < 0 || !m_slots[static_cast<size_t>(detail::t_slot)]->deque.push(task)) return false;
+        m_epoch.fetch_add(1);
+        if (m_sleepers.load() > 0) m_epoch.notify_one();
+        return true;
+    }
+
+    // Executes pending tasks (own first, then stolen) until done() holds.
+    template <typename Done>
+    auto help_until(Done &&done) -> void {
+        int idle = 0;
+        while (!done()) {
+            if (detail::Task *task = find_task(detail::t_slot)) {
+                task->run(task);
+                idle = 0;
+            } else if (++idle > 64) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Leases a deque to an external thread for the duration of a parallel call.
+    class Lease {
+    public:
+        explicit Lease(ThreadPool &pool)
+            : m_pool(pool) {
+            if (detail::t_slot >= 0 || pool.m_workers == 0) return;
+            for (size_t i = static_cast<size_t>(pool.m_workers); i < pool.m_slots.size(); ++i) {
+                bool expected = false;
+                if (pool.m_slots[i]->leased.compare_exchange_strong(expected, true)) {
+                    detail::t_slot = static_cast<int>(i);
+                    m_slot = static_cast<int>(i);
+                    return;
+                }
+            }
+        }
+        ~Lease() {
+            if (m_slot < 0) return;
+            detail::t_slot = -1;
+            m_pool.m_slots[static_cast<size_t>(m_slot)]->leased.store(false);
+        }
+        Lease(const Lease &) = delete;
+        auto operator=(const Lease &) -> Lease & = delete;
+
+        // False when every external deque is taken; the caller then runs serially.
+        [[nodiscard]] auto active() const -> bool { return detail::t_slot >= 0; }
+
+    private:
+        ThreadPool &m_pool;
+        int m_slot = -1;
+    };
+
+private:
+    [[nodiscard]] auto find_task(int self) -> detail::Task * {
+        if (self >= 0) {
+            if (detail::Task *task = m_slots[static_cast<size_t>(self)]->deque.pop()) return task;
+        }
+        // xorshift victim selection; every deque is tried once per round.
+        thread_local uint32_t seed = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())) | 1u;
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        const size_t n = m_slots.size();
+        const size_t start = seed % n;
+        for (size_t i = 0; i < n; ++i) {
+            const size_t victim = (start + i) % n;
+            if (static_cast<int>(victim) == self) continue;
+            if (detail::Task *task = m_slots[victim]->deque.steal()) return task;
+        }
+        return nullptr;
+    }
+
+    auto worker_main(int index) -> void {
+        detail::t_slot = index;
+        Profile::set_thread_name(std::format("worker {}", index));
+        while (!m_stop.load(std::memory_order_relaxed)) {
+            detail::Task *task = nullptr;
+            for (int spin = 0; spin < 256 && task == nullptr; ++spin) {
+                task = find_task(index);
+                if (task == nullptr && spin >= 32) std::this_thread::yield();
+            }
+            if (task != nullptr) {
+                task->run(task);
+                continue;
+            }
+            // Sleep until the next push. Reading the epoch before the final
+            // check closes the window in which a push could be missed.
+            const uint32_t epoch = m_epoch.load();
+            m_sleepers.fetch_add(1);
+            task = find_task(index);
+            if (task == nullptr && !m_stop.load()) m_epoch.wait(epoch);
+            m_sleepers.fetch_sub(1);
+            if (task != nullptr) task->run(task);
+        }
+    }
+
+    static auto pin_thread([[maybe_unused]] std::jthread &thread, [[maybe_unused]] int cpu) -> void {
+#if defined(__linux__)
+        const int cpus = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(static_cast<size_t>(cpu % cpus), &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+    }
+
+    int m_workers = 0;
+    std::vector<std::unique_ptr<detail::WorkerSlot>> m_slots; // pool threads first, then external leases
+    std::atomic<uint32_t> m_epoch{0};
+    std::atomic<int> m_sleepers{0};
+    std::atomic<bool> m_stop{false};
+    std::vector<std::jthread> m_threads; // last, so threads are joined before the slots go away
+};
+
+namespace detail {
+// Binary-splitting range job: running a task splits off the upper half of its
+// chunk range as a new stealable task until a single chunk remains.
+template <typename F>
+struct RangeJob {
+    struct Split : Task {
+        RangeJob *job = nullptr;
+        int lo = 0;
+        int hi = 0;
+    };
+
+    F *fn = nullptr;
+    int begin = 0;
+    int total = 0;
+    int chunks = 0;
+    std::vector<Split> splits; // chunks - 1 splits happen in total
+    std::atomic<int> next_split{0};
+    std::atomic<int> pending{0};
+
+    auto execute(ThreadPool &pool, int lo, int hi) -> void {
+        while (hi - lo > 1) {
+            const int mid = lo + (hi - lo) / 2;
+            Split &split = splits[static_cast<size_t>(next_split.fetch_add(1, std::memory_order_relaxed))];
+            split.run = [](Task *task) {
+                auto *self = static_cast<Split *>(task);
+                self->job->execute(ThreadPool::instance(), self->lo, self->hi);
+            };
+            split.job = this;
+            split.lo = mid;
+            split.hi = hi;
+            if (!pool.push(&split)) execute(pool, mid, hi);
+            hi = mid;
+        }
+        CV_PROFILE_SCOPE("parallel_for");
+        (*fn)(begin + static_cast<int>(static_cast<long long>(total) * lo / chunks),
+            begin + static_cast<int>(static_cast<long long>(total) * (lo + 1) / chunks));
+        pending.fetch_sub(1, std::memory_order_release);
+    }
+};
+} // namespace detail
+
+// Splits [begin, end) into contiguous chunks of at least `grain` indices and
+// calls fn(chunk_begin, chunk_end) for each on the shared pool. The calling
+// thread takes part and returns once every chunk has finished.
+template <typename F>
+inline auto parallel_for(int begin, int end, int grain, F &&fn) -> void {
+    const int total = end - begin;
+    if (total <= 0) return;
+    grain = std::max(1, grain);
+    ThreadPool &pool = ThreadPool::instance();
+    // A few chunks per thread leave room for stealing to balance uneven work.
+    const int chunks = std::min((total + grain - 1) / grain, 8 * pool.concurrency());
+    if (chunks <= 1 || pool.concurrency() == 1) {
+        fn(begin, end);
+        return;
+    }
+    ThreadPool::Lease lease(pool);
+    if (!lease.active()) {
+        fn(begin, end);
+        return;
+    }
+
+    using Fn = std::remove_reference_t<F>;
+    detail::RangeJob<Fn> job;
+    job.fn = &fn;
+    job.begin = begin;
+    job.total = total;
+    job.chunks = chunks;
+    job.splits.resize(static_cast<size_t>(chunks - 1));
+    job.pending.store(chunks, std::memory_order_relaxed);
+    job.execute(pool, 0, chunks);
+    pool.help_until([&] { return job.pending.load(std::memory_order_acquire) == 0; });
+}
+
+// Output tile [x0, x1) x [y0, y1) of a 2-D grid.
+struct Tile {
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+};
+
+// Calls fn(Tile) for every tile_width x tile_height tile of a width x height
+// grid (edge tiles are clipped). Tiles are scheduled in row-major order.
+template <typename F>
+inline auto parallel_for_tiles(int width, int height, int tile_width, int tile_height, F &&fn) -> void {
+    tile_width = std::max(1, tile_width);
+    tile_height = std::max(1, tile_height);
+    const int tiles_x = (width + tile_width - 1) / tile_width;
+    const int tiles_y = (height + tile_height - 1) / tile_height;
+    if (tiles_x <= 0 || tiles_y <= 0) return;
+    parallel_for(0, tiles_x * tiles_y, 1, [&](int t_begin, int t_end) {
+        for (int t = t_begin; t < t_end; ++t) {
+            const int x0 = (t % tiles_x) * tile_width;
+            const int y0 = (t / tiles_x) * tile_height;
+            fn(Tile{x0, y0, std::min(x0 + tile_width, width), std::min(y0 + tile_height, height)});
+        }
+    });
+}
+
+// Runs a and b, potentially in parallel, and returns when both are done.
+template <typename A, typename B>
+inline auto parallel_invoke(A &&a, B &&b) -> void {
+    ThreadPool &pool = ThreadPool::instance();
+    ThreadPool::Lease lease(pool);
+    struct Job : detail::Task {
+        std::remove_reference_t<B> *fn = nullptr;
+        std::atomic<bool> done{false};
+    };
+    Job job;
+    job.fn = &b;
+    job.run = [](detail::Task *task) {
+        auto *self = static_cast<Job *>(task);
+        (*self->fn)();
+        self->done.store(true, std::memory_order_release);
+    };
+    if (!pool.push(&job)) {
+        a();
+        b();
+        return;
+    }
+    a();
+    pool.help_until([&] { return job.done.load(std::memory_order_acquire); });
+}
+} // namespace CV
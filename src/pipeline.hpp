@@ -0,0 +1,338 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "canny.hpp"
+#include "components.hpp"
+#include "convert.hpp"
+#include "convolve.hpp"
+#include "features.hpp"
+#include "geometry.hpp"
+#include "histogram.hpp"
+#include "image.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "morphology.hpp"
+#include "profile.hpp"
+
+// Text-described image pipelines for batch and headless runs.
+//
+// A pipeline is a comma separated list of stages, each a name followed by
+// colon separated numeric arguments, e.g. "resize:0.5,gray,blur:1.5,canny:40:90".
+// Stages that need a gray image convert RGBA input on first use; measuring
+// stages (corners, components) record a value and leave the image untouched.
+// Stage outputs are pooled buffers, so a pipeline run repeatedly (per frame or
+// per batch image) recycles the buffers of the previous run.
+namespace CV {
+enum class StageOp {
+    Gray,
+    Resize,    // resize:<scale> | resize:<width>:<height>
+    Thumbnail, // thumbnail:<max side>
+    Rotate,    // rotate:<degrees>
+    Blur,      // blur:<sigma>
+    Equalize,
+    Clahe,     // clahe[:<clip limit>]
+    Threshold, // threshold:<t>, 255 where value > t
+    Canny,     // canny[:<low>:<high>]
+    Erode,     // erode:<size>
+    Dilate,    // dilate:<size>
+    Open,      // open:<size>
+    Close,     // close:<size>
+    Corners,   // corners[:<threshold>]
+    Components
+};
+
+struct StageInfo {
+    std::string_view name;
+    StageOp op;
+    int min_args;
+    int max_args;
+};
+
+inline constexpr std::array<StageInfo, 15> stage_table = {{
+    {"gray", StageOp::Gray, 0, 0},
+    {"resize", StageOp::Resize, 1, 2},
+    {"thumbnail", StageOp::Thumbnail, 1, 1},
+    {"rotate", StageOp::Rotate, 1, 1},
+    {"blur", StageOp::Blur, 1, 1},
+    {"equalize", StageOp::Equalize, 0, 0},
+    {"clahe", StageOp::Clahe, 0, 1},
+    {"threshold", StageOp::Threshold, 1, 1},
+    {"canny", StageOp::Canny, 0, 2},
+    {"erode", StageOp::Erode, 1, 1},
+    {"dilate", StageOp::Dilate, 1, 1},
+    {"open", StageOp::Open, 1, 1},
+    {"close", StageOp::Close, 1, 1},
+    {"corners", StageOp::Corners, 0, 1},
+    {"components", StageOp::Components, 0, 0},
+}};
+
+// Upper bound for sizes taken from a spec: output sides and element sizes.
+inline constexpr int max_stage_size = 65535;
+
+struct PipelineStage {
+    StageOp op = StageOp::Gray;
+    std::vector<float> args;
+
+    [[nodiscard]] auto arg(size_t i, float fallback) const -> float { return i < args.size() ? args[i] : fallback; }
+};
+
+// Image flowing through a pipeline: RGBA until a stage needs gray.
+struct Frame {
+    ImageRGBA8 rgba;
+    ImageGray8 gray;
+    bool is_gray = false;
+    std::vector<std::pair<std::string_view, double>> measurements;
+
+    [[nodiscard]] auto width() const -> int { return is_gray ? gray.width() : rgba.width(); }
+    [[nodiscard]] auto height() const -> int { return is_gray ? gray.height() : rgba.height(); }
+    [[nodiscard]] auto empty() const -> bool { return is_gray ? gray.empty() : rgba.empty(); }
+};
+
+[[nodiscard]] inline auto stage_name(StageOp op) -> std::string_view {
+    for (const StageInfo &info : stage_table) {
+        if (info.op == op) return info.name;
+    }
+    return "?";
+}
+
+namespace detail {
+// Range checks, so that apply_stage never converts an out-of-range float to
+// int. Logs the reason and returns false on error.
+[[nodiscard]] inline auto check_stage_args(std::string_view name, const PipelineStage &stage) -> bool {
+    const auto in_range = [&](size_t i, float lo, float hi) {
+        const float v = stage.args[i];
+        if (std::isfinite(v) && v >= lo && v <= hi) return true;
+        LOG_ERR("Stage '{}': argument {} must be in [{}, {}], got {}", name, i + 1, lo, hi, v);
+        return false;
+    };
+    constexpr auto max_size = static_cast<float>(max_stage_size);
+    switch (stage.op) {
+    case StageOp::Resize:
+        if (stage.args.size() == 2) return in_range(0, 1.0f, max_size) && in_range(1, 1.0f, max_size);
+        if (!std::isfinite(stage.args[0]) || stage.args[0] <= 0.0f || stage.args[0] > max_size) {
+            LOG_ERR("Stage '{}': scale must be positive and at most {}, got {}", name, max_stage_size, stage.args[0]);
+            return false;
+        }
+        return true;
+    case StageOp::Thumbnail: return in_range(0, 1.0f, max_size);
+    case StageOp::Blur:
+        if (stage.args[0] <= 0.0f) {
+            LOG_ERR("Stage '{}': sigma must be positive, got {}", name, stage.args[0]);
+            return false;
+        }
+        return in_range(0, 0.0f, 1000.0f);
+    case StageOp::Erode:
+    case StageOp::Dilate:
+    case StageOp::Open:
+    case StageOp::Close: return in_range(0, 1.0f, max_size);
+    case StageOp::Corners: return stage.args.empty() || in_range(0, 0.0f, 255.0f);
+    default:
+        for (size_t i = 0; i < stage.args.size(); ++i) {
+            if (!std::isfinite(stage.args[i])) {
+                LOG_ERR("Stage '{}': argument {} must be finite, got {}", name, i + 1, stage.args[i]);
+                return false;
+            }
+        }
+        return true;
+    }
+}
+} // namespace detail
+
+// Parses a pipeline description; logs the reason and returns nullopt on error.
+[[nodiscard]] inline auto parse_pipeline(std::string_view spec) -> std::optional<std::vector<PipelineStage>> {
+    std::vector<PipelineStage> stages;
+    while (!spec.empty()) {
+        const size_t comma = spec.find(',');
+        std::string_view token = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view{} : spec.substr(comma + 1);
+        if (token.empty()) continue;
+
+        const size_t colon = token.find(':');
+        const std::string_view name = token.substr(0, colon);
+        const StageInfo *info = nullptr;
+        for (const StageInfo &candidate : stage_table) {
+            if (candidate.name == name) info = &candidate;
+        }
+        if (info == nullptr) {
+            LOG_ERR("Unknown pipeline stage '{}'", name);
+            return std::nullopt;
+        }
+
+        PipelineStage stage{info->op, {}};
+        std::string_view rest = colon == std::string_view::npos ? std::string_view{} : token.substr(colon + 1);
+        while (colon != std::string_view::npos) {
+            const size_t next = rest.find(':');
+            const std::string_view text = rest.substr(0, next);
+            float value = 0.0f;
+            const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+            if (ec != std::errc{} || end != text.data() + text.size()) {
+                LOG_ERR("Stage '{}': '{}' is not a number", name, text);
+                return std::nullopt;
+            }
+            stage.args.push_back(value);
+            if (next == std::string_view::npos) break;
+            rest = rest.substr(next + 1);
+        }
+        const auto count = static_cast<int>(stage.args.size());
+        if (count < info->min_args || count > info->max_args) {
+            LOG_ERR("Stage '{}' takes {} to {} arguments, got {}", name, info->min_args, info->max_args, count);
+            return std::nullopt;
+        }
+        if (!detail::check_stage_args(name, stage)) return std::nullopt;
+        stages.push_back(std::move(stage));
+    }
+    return stages;
+}
+
+namespace detail {
+inline auto ensure_gray(Frame &frame) -> void {
+    if (frame.is_gray) return;
+    frame.gray = pooled_image<uint8_t, 1>(frame.rgba.width(), frame.rgba.height());
+    rgba_to_gray(std::as_const(frame.rgba).view(), frame.gray.view());
+    frame.rgba = {};
+    frame.is_gray = true;
+}
+
+template <int C>
+[[nodiscard]] inline auto resized(const Image<uint8_t, C> &src, int width, int height) -> Image<uint8_t, C> {
+    const bool shrinking = width < src.width() || height < src.height();
+    Image<uint8_t, C> out = pooled_image<uint8_t, C>(std::max(1, width), std::max(1, height));
+    resize<C>(src.view(), out.view(), shrinking ? Interpolation::Area : Interpolation::Bilinear);
+    return out;
+}
+
+// Applies fn(src view, dst view) to the gray image through a fresh buffer.
+template <typename F>
+inline auto gray_op(Frame &frame, F &&fn) -> void {
+    ensure_gray(frame);
+    ImageGray8 out = pooled_image<uint8_t, 1>(frame.gray.width(), frame.gray.height());
+    fn(std::as_const(frame.gray).view(), out.view());
+    frame.gray = std::move(out);
+}
+
+// round(size * scale), kept at least 1 and within int.
+[[nodiscard]] inline auto scaled_size(int size, float scale) -> int {
+    const double scaled = std::round(static_cast<double>(size) * static_cast<double>(scale));
+    return static_cast<int>(std::clamp(scaled, 1.0, static_cast<double>(std::numeric_limits<int>::max())));
+}
+
+[[nodiscard]] inline auto square_element(float size) -> StructuringElement {
+    const int k = std::max(1, static_cast<int>(size));
+    return StructuringElement::rect(k, k);
+}
+} // namespace detail
+
+inline auto apply_stage(Frame &frame, const PipelineStage &stage) -> void {
+    if (frame.empty()) return;
+    CV_PROFILE_SCOPE(stage_name(stage.op).data()); // stage_table names are literals
+    switch (stage.op) {
+    case StageOp::Gray:
+        detail::ensure_gray(frame);
+        break;
+    case StageOp::Resize:
+    case StageOp::Thumbnail: {
+        int w = 0;
+        int h = 0;
+        if (stage.op == StageOp::Thumbnail) {
+            const float s = std::min(1.0f, stage.arg(0, 1.0f) / static_cast<float>(std::max(frame.width(), frame.height())));
+            w = detail::scaled_size(frame.width(), s);
+            h = detail::scaled_size(frame.height(), s);
+        } else if (stage.args.size() == 1) {
+            w = detail::scaled_size(frame.width(), stage.args[0]);
+            h = detail::scaled_size(frame.height(), stage.args[0]);
+        } else {
+            w = static_cast<int>(stage.args[0]);
+            h = static_cast<int>(stage.args[1]);
+        }
+        if (frame.is_gray) {
+            frame.gray = detail::resized<1>(frame.gray, w, h);
+        } else {
+            frame.rgba = detail::resized<4>(frame.rgba, w, h);
+        }
+        break;
+    }
+    case StageOp::Rotate: {
+        const Position centre{static_cast<float>(frame.width() - 1) * 0.5f, static_cast<float>(frame.height() - 1) * 0.5f};
+        const AffineMatrix m = rotation_matrix(centre, stage.arg(0, 0.0f));
+        if (frame.is_gray) {
+            ImageGray8 out = pooled_image<uint8_t, 1>(frame.gray.width(), frame.gray.height());
+            warp_affine<1>(std::as_const(frame.gray).view(), out.view(), m);
+            frame.gray = std::move(out);
+        } else {
+            ImageRGBA8 out = pooled_image<uint8_t, 4>(frame.rgba.width(), frame.rgba.height());
+            warp_affine<4>(std::as_const(frame.rgba).view(), out.view(), m);
+            frame.rgba = std::move(out);
+        }
+        break;
+    }
+    case StageOp::Blur:
+        detail::gray_op(frame, [&](auto src, auto dst) { gaussian_blur(src, dst, stage.arg(0, 1.0f)); });
+        break;
+    case StageOp::Equalize:
+        detail::ensure_gray(frame);
+        equalize(frame.gray.view(), frame.gray.view());
+        break;
+    case StageOp::Clahe:
+        detail::ensure_gray(frame);
+        clahe(frame.gray.view(), frame.gray.view(), ClaheParams{stage.arg(0, 2.0f)});
+        break;
+    case StageOp::Threshold: {
+        std::array<uint8_t, 256> lut{};
+        const float t = stage.arg(0, 127.0f);
+        for (size_t i = 0; i < lut.size(); ++i) lut[i] = static_cast<float>(i) > t ? 255 : 0;
+        detail::ensure_gray(frame);
+        apply_lut(frame.gray.view(), frame.gray.view(), lut);
+        break;
+    }
+    case StageOp::Canny: {
+        CannyParams params;
+        params.low_threshold = stage.arg(0, params.low_threshold);
+        params.high_threshold = stage.arg(1, params.high_threshold);
+        detail::gray_op(frame, [&](auto src, auto dst) { canny(src, dst, params); });
+        break;
+    }
+    case StageOp::Erode:
+        detail::gray_op(frame, [&](auto src, auto dst) { erode(src, dst, detail::square_element(stage.arg(0, 3.0f))); });
+        break;
+    case StageOp::Dilate:
+        detail::gray_op(frame, [&](auto src, auto dst) { dilate(src, dst, detail::square_element(stage.arg(0, 3.0f))); });
+        break;
+    case StageOp::Open:
+        detail::gray_op(frame, [&](auto src, auto dst) { open(src, dst, detail::square_element(stage.arg(0, 3.0f))); });
+        break;
+    case StageOp::Close:
+        detail::gray_op(frame, [&](auto src, auto dst) { close(src, dst, detail::square_element(stage.arg(0, 3.0f))); });
+        break;
+    case StageOp::Corners: {
+        CornerParams params;
+        params.threshold = static_cast<int>(stage.arg(0, static_cast<float>(params.threshold)));
+        detail::ensure_gray(frame);
+        const Keypoints kp = detect_corners(std::as_const(frame.gray).view(), params);
+        frame.measurements.emplace_back("corners", static_cast<double>(kp.size()));
+        break;
+    }
+    case StageOp::Components: {
+        detail::ensure_gray(frame);
+        const Components comps = label_components(std::as_const(frame.gray).view());
+        frame.measurements.emplace_back("components", static_cast<double>(comps.count()));
+        break;
+    }
+    }
+}
+
+inline auto run_pipeline(Frame &frame, const std::vector<PipelineStage> &stages) -> void {
+    for (const PipelineStage &stage : stages) apply_stage(frame, stage);
+}
+} // namespace CV
@@ -0,0 +1,476 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CV_PROFILE_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+#include "log.hpp"
+
+// Scope timers and counters for the hot paths.
+//
+// CV_PROFILE_SCOPE("name") times the enclosing scope, CV_PROFILE_COUNTER
+// samples a value. Names must be string literals (or otherwise outlive the
+// profiler), only the pointer is recorded. Every thread writes into its own
+// single-producer ring, so recording takes no lock: two timestamp reads (the
+// TSC on x86-64, converted to nanoseconds by the collector) and a 40 byte
+// store, well under 50 ns, and a single relaxed load while profiling is
+// disabled. Defining CV_DISABLE_PROFILING compiles the macros out entirely.
+//
+// Once per frame the collecting thread calls Profiler::end_frame(), which
+// drains every ring into a frame record. The most recent records (240 by
+// default, see set_history_length) back the timeline and percentile views and
+// the Chrome trace export (chrome://tracing, ui.perfetto.dev). A full ring
+// drops events and counts them instead of blocking the thread.
+namespace CV::Profile {
+[[nodiscard]] inline auto now_ns() -> int64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+enum class EventKind : uint8_t {
+    Scope,
+    Counter
+};
+
+// Timestamps are raw ticks while in a ring and nanoseconds once collected.
+struct Event {
+    const char *name = nullptr;
+    int64_t start_ns = 0;
+    int64_t end_ns = 0; // == start_ns for counters
+    double value = 0.0; // counters only
+    uint16_t depth = 0; // scopes open on the thread when this one began
+    EventKind kind = EventKind::Scope;
+};
+
+namespace detail {
+inline std::atomic<bool> g_enabled{false};
+
+// Invariant TSC (constant rate, synchronised across cores) on x86-64,
+// steady_clock nanoseconds elsewhere.
+[[nodiscard]] inline auto ticks() -> int64_t {
+#if defined(CV_PROFILE_TSC)
+    return static_cast<int64_t>(__rdtsc());
+#else
+    return now_ns();
+#endif
+}
+
+// Lock-free single-producer / single-consumer ring: the owning thread pushes,
+// the collector drains under the profiler lock.
+class EventRing {
+public:
+    static constexpr size_t capacity = 8192;
+
+    auto push(const Event &event) -> void {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == capacity) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_events[head & (capacity - 1)] = event;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    template <typename F>
+    auto drain(F &&consume) -> void {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t head = m_head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) consume(m_events[tail & (capacity - 1)]);
+        m_tail.store(tail, std::memory_order_release);
+    }
+
+    [[nodiscard]] auto empty() const -> bool { return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire); }
+    [[nodiscard]] auto take_dropped() -> uint64_t { return m_dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::array<Event, capacity> m_events{};
+};
+
+struct ThreadBuffer {
+    EventRing ring;
+    int id = 0;
+    uint16_t depth = 0; // owner only
+    std::string name;   // guarded by Registry::mutex
+    std::atomic<bool> retired{false};
+};
+
+// Every thread that ever recorded. Leaked, so threads exiting during static
+// destruction still find it.
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    int next_id = 0;
+
+    [[nodiscard]] static auto instance() -> Registry & {
+        static Registry *registry = new Registry();
+        return *registry;
+    }
+};
+
+inline thread_local ThreadBuffer *t_buffer = nullptr;
+inline thread_local std::string t_thread_name;
+
+// Registers the thread on its first recorded event, so threads that never
+// record cost nothing. The buffer outlives the thread until the collector has
+// drained it.
+class ThreadHandle {
+public:
+    ThreadHandle() {
+        m_buffer = std::make_shared<ThreadBuffer>();
+        Registry &registry = Registry::instance();
+        std::lock_guard lock(registry.mutex);
+        m_buffer->id = registry.next_id++;
+        m_buffer->name = t_thread_name.empty() ? std::format("thread {}", m_buffer->id) : t_thread_name;
+        registry.buffers.push_back(m_buffer);
+        t_buffer = m_buffer.get();
+    }
+    ~ThreadHandle() {
+        t_buffer = nullptr;
+        m_buffer->retired.store(true, std::memory_order_release);
+    }
+    ThreadHandle(const ThreadHandle &) = delete;
+    auto operator=(const ThreadHandle &) -> ThreadHandle & = delete;
+
+    [[nodiscard]] auto buffer() -> ThreadBuffer & { return *m_buffer; }
+
+private:
+    std::shared_ptr<ThreadBuffer> m_buffer;
+};
+
+[[nodiscard]] inline auto thread_buffer() -> ThreadBuffer & {
+    if (t_buffer) return *t_buffer;
+    thread_local ThreadHandle handle;
+    return handle.buffer();
+}
+} // namespace detail
+
+[[nodiscard]] inline auto enabled() -> bool { return detail::g_enabled.load(std::memory_order_relaxed); }
+inline auto set_enabled(bool on) -> void { detail::g_enabled.store(on, std::memory_order_relaxed); }
+
+// Lane label of the calling thread in the timeline and trace.
+inline auto set_thread_name(std::string name) -> void {
+    detail::t_thread_name = std::move(name);
+    if (!detail::t_buffer) return;
+    std::lock_guard lock(detail::Registry::instance().mutex);
+    detail::t_buffer->name = detail::t_thread_name;
+}
+
+class Scope {
+public:
+    explicit Scope(const char *name) {
+        if (!enabled()) return;
+        m_buffer = &detail::thread_buffer();
+        m_name = name;
+        m_depth = m_buffer->depth++;
+        m_start = detail::ticks();
+    }
+    ~Scope() {
+        if (!m_buffer) return;
+        const int64_t end = detail::ticks();
+        --m_buffer->depth;
+        m_buffer->ring.push(Event{m_name, m_start, end, 0.0, m_depth, EventKind::Scope});
+    }
+    Scope(const Scope &) = delete;
+    auto operator=(const Scope &) -> Scope & = delete;
+
+private:
+    detail::ThreadBuffer *m_buffer = nullptr;
+    const char *m_name = nullptr;
+    int64_t m_start = 0;
+    uint16_t m_depth = 0;
+};
+
+inline auto counter(const char *name, double value) -> void {
+    if (!enabled()) return;
+    detail::ThreadBuffer &buffer = detail::thread_buffer();
+    const int64_t t = detail::ticks();
+    buffer.ring.push(Event{name, t, t, value, buffer.depth, EventKind::Counter});
+}
+
+struct RecordedEvent {
+    Event event;
+    int thread = 0; // ThreadInfo::id
+};
+
+// Per-frame totals of one scope name, summed over all threads.
+struct ScopeTotal {
+    std::string_view name;
+    int64_t total_ns = 0;
+    int calls = 0;
+};
+
+struct FrameRecord {
+    uint64_t index = 0;
+    int64_t begin_ns = 0;
+    int64_t end_ns = 0;
+    std::vector<RecordedEvent> events; // scopes in completion order, then counters
+    std::vector<ScopeTotal> totals;
+
+    [[nodiscard]] auto duration_ms() const -> double { return static_cast<double>(end_ns - begin_ns) / 1.0e6; }
+};
+
+struct ThreadInfo {
+    int id = 0;
+    std::string name;
+};
+
+// Distribution of a scope's per-frame total over the frames it appeared in.
+struct ScopeStats {
+    std::string_view name;
+    size_t frames = 0;
+    double calls_per_frame = 0.0;
+    double mean_ms = 0.0;
+    double p50_ms = 0.0;
+    double p95_ms = 0.0;
+    double p99_ms = 0.0;
+    double max_ms = 0.0;
+};
+
+class Profiler {
+public:
+    static constexpr size_t default_history = 240;
+
+    [[nodiscard]] static auto instance() -> Profiler & {
+        static Profiler *profiler = new Profiler();
+        return *profiler;
+    }
+
+    // Closes the frame that began at the previous call: drains every thread's
+    // ring into a new record, dropping the oldest beyond the history length.
+    // While paused the rings are still drained, but the history is frozen.
+    auto end_frame() -> void {
+        std::lock_guard lock(m_mutex);
+        const int64_t now = calibrate();
+        FrameRecord frame;
+        frame.index = m_frame_index++;
+        frame.begin_ns = m_frame_begin;
+        frame.end_ns = now;
+        m_frame_begin = now;
+        drain(frame);
+        if (m_paused || frame.begin_ns == 0) return;
+
+        std::unordered_map<std::string_view, size_t> slots;
+        for (const RecordedEvent &r : frame.events) {
+            if (r.event.kind != EventKind::Scope) continue;
+            const auto [it, inserted] = slots.try_emplace(r.event.name, frame.totals.size());
+            if (inserted) frame.totals.push_back(ScopeTotal{r.event.name});
+            ScopeTotal &total = frame.totals[it->second];
+            total.total_ns += r.event.end_ns - r.event.start_ns;
+            ++total.calls;
+        }
+        m_history.push_back(std::move(frame));
+        while (m_history.size() > m_history_length) m_history.pop_front();
+    }
+
+    [[nodiscard]] auto frame_count() const -> size_t {
+        std::lock_guard lock(m_mutex);
+        return m_history.size();
+    }
+
+    // Copy of a recorded frame, 0 is the oldest one still in the history.
+    [[nodiscard]] auto frame(size_t i) const -> std::optional<FrameRecord> {
+        std::lock_guard lock(m_mutex);
+        if (i >= m_history.size()) return std::nullopt;
+        return m_history[i];
+    }
+
+    [[nodiscard]] auto frame_times_ms() const -> std::vector<float> {
+        std::lock_guard lock(m_mutex);
+        std::vector<float> times;
+        times.reserve(m_history.size());
+        for (const FrameRecord &frame : m_history) times.push_back(static_cast<float>(frame.duration_ms()));
+        return times;
+    }
+
+    // Slowest first by median.
+    [[nodiscard]] auto scope_stats() const -> std::vector<ScopeStats> {
+        std::lock_guard lock(m_mutex);
+        std::unordered_map<std::string_view, std::pair<std::vector<double>, int64_t>> samples; // per-frame ms, calls
+        for (const FrameRecord &frame : m_history) {
+            for (const ScopeTotal &total : frame.totals) {
+                auto &[ms, calls] = samples[total.name];
+                ms.push_back(static_cast<double>(total.total_ns) / 1.0e6);
+                calls += total.calls;
+            }
+        }
+        std::vector<ScopeStats> out;
+        out.reserve(samples.size());
+        for (auto &[name, entry] : samples) {
+            auto &[ms, calls] = entry;
+            std::sort(ms.begin(), ms.end());
+            const auto at = [&](double q) { return ms[std::min(ms.size() - 1, static_cast<size_t>(q * static_cast<double>(ms.size())))]; };
+            ScopeStats s;
+            s.name = name;
+            s.frames = ms.size();
+            s.calls_per_frame = static_cast<double>(calls) / static_cast<double>(ms.size());
+            for (const double v : ms) s.mean_ms += v;
+            s.mean_ms /= static_cast<double>(ms.size());
+            s.p50_ms = at(0.50);
+            s.p95_ms = at(0.95);
+            s.p99_ms = at(0.99);
+            s.max_ms = ms.back();
+            out.push_back(s);
+        }
+        std::sort(out.begin(), out.end(), [](const ScopeStats &a, const ScopeStats &b) { return a.p50_ms > b.p50_ms; });
+        return out;
+    }
+
+    // Every thread seen so far, in registration order.
+    [[nodiscard]] auto threads() const -> std::vector<ThreadInfo> {
+        std::lock_guard lock(m_mutex);
+        std::vector<ThreadInfo> out;
+        out.reserve(m_threads.size());
+        for (const auto &[id, name] : m_threads) out.push_back(ThreadInfo{id, name});
+        std::sort(out.begin(), out.end(), [](const ThreadInfo &a, const ThreadInfo &b) { return a.id < b.id; });
+        return out;
+    }
+
+    [[nodiscard]] auto dropped() const -> uint64_t {
+        std::lock_guard lock(m_mutex);
+        return m_dropped;
+    }
+
+    [[nodiscard]] auto paused() const -> bool {
+        std::lock_guard lock(m_mutex);
+        return m_paused;
+    }
+
+    auto set_paused(bool paused) -> void {
+        std::lock_guard lock(m_mutex);
+        m_paused = paused;
+    }
+
+    auto set_history_length(size_t frames) -> void {
+        std::lock_guard lock(m_mutex);
+        m_history_length = std::max<size_t>(1, frames);
+        while (m_history.size() > m_history_length) m_history.pop_front();
+    }
+
+    // Writes the recorded frames as Chrome trace-event JSON: complete ("X")
+    // events per scope, "C" events per counter sample, a global instant event
+    // at every frame start and one lane per thread.
+    [[nodiscard]] auto write_chrome_trace(const std::string &path) const -> bool {
+        using json = nlohmann::json;
+        std::lock_guard lock(m_mutex);
+        if (m_history.empty()) {
+            LOG_ERR("Profiler: nothing recorded, not writing {}", path);
+            return false;
+        }
+        const int64_t origin = m_history.front().begin_ns;
+        const auto us = [&](int64_t ns) { return static_cast<double>(ns - origin) / 1000.0; };
+        json events = json::array();
+        for (const auto &[id, name] : m_threads) {
+            events.push_back({{"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", id}, {"args", {{"name", name}}}});
+            events.push_back({{"name", "thread_sort_index"}, {"ph", "M"}, {"pid", 1}, {"tid", id}, {"args", {{"sort_index", id}}}});
+        }
+        for (const FrameRecord &frame : m_history) {
+            events.push_back({{"name", std::format("frame {}", frame.index)}, {"ph", "i"}, {"s", "g"}, {"ts", us(frame.begin_ns)}, {"pid", 1}, {"tid", 0}});
+            for (const RecordedEvent &r : frame.events) {
+                const Event &e = r.event;
+                if (e.kind == EventKind::Scope) {
+                    events.push_back({{"name", e.name}, {"cat", "cv"}, {"ph", "X"}, {"ts", us(e.start_ns)},
+                        {"dur", static_cast<double>(e.end_ns - e.start_ns) / 1000.0}, {"pid", 1}, {"tid", r.thread}});
+                } else {
+                    events.push_back({{"name", e.name}, {"ph", "C"}, {"ts", us(e.start_ns)}, {"pid", 1}, {"args", {{"value", e.value}}}});
+                }
+            }
+        }
+        std::ofstream out(path);
+        if (!out) {
+            LOG_ERR("Profiler: cannot write {}", path);
+            return false;
+        }
+        out << json{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}}.dump();
+        LOG_INFO("Profiler: wrote {} frames to {}", m_history.size(), path);
+        return static_cast<bool>(out);
+    }
+
+private:
+    // The tick rate is measured over a short spin here and refined against the
+    // growing interval on every frame.
+    Profiler()
+        : m_tick_origin(detail::ticks()), m_ns_origin(now_ns()) {
+        while (now_ns() - m_ns_origin < 2'000'000) {}
+        (void)calibrate();
+    }
+
+    // Updates the tick rate, returns the current time in nanoseconds.
+    auto calibrate() -> int64_t {
+        const int64_t tick = detail::ticks();
+        const int64_t ns = now_ns();
+        if (tick > m_tick_origin) m_ns_per_tick = static_cast<double>(ns - m_ns_origin) / static_cast<double>(tick - m_tick_origin);
+        return ns;
+    }
+
+    [[nodiscard]] auto to_ns(int64_t tick) const -> int64_t {
+        return m_ns_origin + static_cast<int64_t>(static_cast<double>(tick - m_tick_origin) * m_ns_per_tick);
+    }
+
+    auto drain(FrameRecord &frame) -> void {
+        detail::Registry &registry = detail::Registry::instance();
+        std::lock_guard lock(registry.mutex);
+        auto &buffers = registry.buffers;
+        for (const auto &buffer : buffers) {
+            m_threads[buffer->id] = buffer->name;
+            m_dropped += buffer->ring.take_dropped();
+            buffer->ring.drain([&](Event e) {
+                e.start_ns = to_ns(e.start_ns);
+                e.end_ns = to_ns(e.end_ns);
+                frame.events.push_back(RecordedEvent{e, buffer->id});
+            });
+        }
+        // Counters go last, scopes stay in completion order per thread.
+        std::stable_partition(frame.events.begin(), frame.events.end(), [](const RecordedEvent &r) { return r.event.kind == EventKind::Scope; });
+        // A retired thread wrote its last event before its handle was destroyed.
+        std::erase_if(buffers, [](const auto &buffer) { return buffer->retired.load(std::memory_order_acquire) && buffer->ring.empty(); });
+    }
+
+    mutable std::mutex m_mutex;
+    std::deque<FrameRecord> m_history;
+    size_t m_history_length = default_history;
+    std::unordered_map<int, std::string> m_threads;
+    uint64_t m_frame_index = 0;
+    int64_t m_frame_begin = 0;
+    uint64_t m_dropped = 0;
+    bool m_paused = false;
+    int64_t m_tick_origin;
+    int64_t m_ns_origin;
+    double m_ns_per_tick = 1.0;
+};
+} // namespace CV::Profile
+
+#define CV_PROFILE_CONCAT_IMPL(a, b) a##b
+#define CV_PROFILE_CONCAT(a, b) CV_PROFILE_CONCAT_IMPL(a, b)
+#if defined(CV_DISABLE_PROFILING)
+#define CV_PROFILE_SCOPE(name) ((void)0)
+#define CV_PROFILE_COUNTER(name, value) ((void)0)
+#else
+#define CV_PROFILE_SCOPE(name) const CV::Profile::Scope CV_PROFILE_CONCAT(cv_profile_scope_, __LINE__)(name)
+#define CV_PROFILE_COUNTER(name, value) CV::Profile::counter(name, value)
+#endif
@@ -0,0 +1,340 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "convert.hpp"
+#include "convolve.hpp"
+#include "image.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+
+// Gaussian / Laplacian image pyramids on f32 gray images.
+//
+// pyr_down fuses the 5-tap binomial blur with 2x decimation: only the even
+// output columns of the horizontal pass are ever computed and only the even
+// output rows are produced, so one level costs a single pass over its source.
+namespace CV {
+namespace detail {
+inline constexpr std::array<float, 5> binomial5 = {1.0f / 16, 4.0f / 16, 6.0f / 16, 4.0f / 16, 1.0f / 16};
+inline constexpr std::array<float, 3> up_even = {1.0f / 8, 6.0f / 8, 1.0f / 8};
+inline constexpr std::array<float, 2> up_odd = {4.0f / 8, 4.0f / 8};
+} // namespace detail
+
+[[nodiscard]] inline auto pyr_down_size(int size) -> int { return (size + 1) / 2; }
+
+// src (w x h) -> dst ((w + 1) / 2 x (h + 1) / 2), reflect-101 borders.
+inline auto pyr_down(ImageView<const float, 1> src, ImageView<float, 1> dst) -> void {
+    if (dst.width != pyr_down_size(src.width) || dst.height != pyr_down_size(src.height)) {
+        PANIC(std::format("pyr_down: expected {}x{} destination, got {}x{}",
+            pyr_down_size(src.width), pyr_down_size(src.height), dst.width, dst.height));
+    }
+    if (src.empty()) return;
+
+    const int w = src.width;
+    const int h = src.height;
+    const int dw = dst.width;
+    const Filter::WeightedSumFn weighted_sum = Filter::weighted_sum_kernel();
+    const Border border{BorderMode::Reflect, 0.0f};
+
+    parallel_for(0, dst.height, 16, [&](int y_begin, int y_end) {
+        ArenaScope scope;
+        detail::RowRing ring(scope, 5, static_cast<size_t>(dw));
+        const std::span<float> pad = scope.array<float>(static_cast<size_t>(w + 4));
+        const std::span<float> even = scope.array<float>(static_cast<size_t>(dw + 2));
+        const std::span<float> odd = scope.array<float>(static_cast<size_t>(dw + 1));
+        const std::array<const float *, 5> hrows = {even.data(), odd.data(), even.data() + 1, odd.data() + 1, even.data() + 2};
+        std::array<const float *, 5> vrows{};
+
+        // Horizontal blur evaluated at even columns only: split the padded row
+        // into even/odd phases and take a 5-tap weighted sum across them.
+        auto prepare = [&](int row, float *buf) {
+            detail::load_padded_row(src, row, 2, border, pad.data());
+            for (size_t j = 0; j < even.size(); ++j) even[j] = pad[2 * j];
+            for (size_t j = 0; j < odd.size(); ++j) odd[j] = pad[2 * j + 1];
+            weighted_sum(hrows.data(), detail::binomial5.data(), 5, buf, static_cast<size_t>(dw));
+        };
+
+        for (int y = y_begin; y < y_end; ++y) {
+            for (int k = 0; k < 5; ++k) {
+                vrows[static_cast<size_t>(k)] = ring.get(border_index(2 * y - 2 + k, h, border.mode), prepare);
+            }
+            weighted_sum(vrows.data(), detail::binomial5.data(), 5, dst.row(y), static_cast<size_t>(dw));
+        }
+    });
+}
+
+// 2x upsampling with the same binomial kernel (gain 4). dst may be one pixel
+// smaller than 2 * src in either direction to match an odd-sized finer level.
+inline auto pyr_up(ImageView<const float, 1> src, ImageView<float, 1> dst) -> void {
+    if (pyr_down_size(dst.width) != src.width || pyr_down_size(dst.height) != src.height) {
+        PANIC(std::format("pyr_up: {}x{} cannot be upsampled to {}x{}", src.width, src.height, dst.width, dst.height));
+    }
+    if (src.empty()) return;
+
+    const int sw = src.width;
+    const int sh = src.height;
+    const int dw = dst.width;
+    const Filter::WeightedSumFn weighted_sum = Filter::weighted_sum_kernel();
+    const Border border{BorderMode::Reflect, 0.0f};
+
+    parallel_for(0, dst.height, 16, [&](int y_begin, int y_end) {
+        ArenaScope scope;
+        detail::RowRing ring(scope, 3, static_cast<size_t>(dw));
+        const std::span<float> pad = scope.array<float>(static_cast<size_t>(sw + 2));
+
+        auto prepare = [&](int row, float *buf) {
+            detail::load_padded_row(src, row, 1, border, pad.data());
+            for (int x = 0; x < dw; ++x) {
+                const float *p = pad.data() + x / 2;
+                buf[x] = (x & 1) == 0
+                             ? detail::up_even[0] * p[0] + detail::up_even[1] * p[1] + detail::up_even[2] * p[2]
+                             : detail::up_odd[0] * p[1] + detail::up_odd[1] * p[2];
+            }
+        };
+
+        std::array<const float *, 3> vrows{};
+        for (int y = y_begin; y < y_end; ++y) {
+            const int i = y / 2;
+            if ((y & 1) == 0) {
+                for (int k = 0; k < 3; ++k) {
+                    vrows[static_cast<size_t>(k)] = ring.get(border_index(i - 1 + k, sh, border.mode), prepare);
+                }
+                weighted_sum(vrows.data(), detail::up_even.data(), 3, dst.row(y), static_cast<size_t>(dw));
+            } else {
+                vrows[0] = ring.get(border_index(i, sh, border.mode), prepare);
+                vrows[1] = ring.get(border_index(i + 1, sh, border.mode), prepare);
+                weighted_sum(vrows.data(), detail::up_odd.data(), 2, dst.row(y), static_cast<size_t>(dw));
+            }
+        }
+    });
+}
+
+// Gaussian pyramid whose levels are computed on first use and cached until the
+// base image changes. Level 0 is the base itself. Safe to query from several
+// threads; returned references stay valid until the next set_base().
+//
+// Levels are built with the mutex released: pyr_down's parallel_for lets the
+// waiting thread run other queued tasks, and one of them may query this same
+// pyramid. Two threads may then build the same level; the first result is
+// kept. set_base() and invalidate() wait until no build is in flight.
+class Pyramid {
+public:
+    // max_levels == 0 keeps halving until the shorter side drops below min_size.
+    explicit Pyramid(int max_levels = 0, int min_size = 8)
+        : m_max_levels(max_levels), m_min_size(std::max(1, min_size)) {}
+
+    // Replaces the base image. With a version, calling again with the same
+    // version and size is a no-op so consumers can call this every frame.
+    // Returns true if the cache was invalidated.
+    auto set_base(ImageView<const float, 1> base, uint64_t version) -> bool {
+        std::unique_lock lock(m_mutex);
+        if (is_current_locked(base.width, base.height, version)) return false;
+        reset(lock, clone<float, 1>(base));
+        m_version = version;
+        m_has_version = true;
+        return true;
+    }
+
+    auto set_base(ImageView<const float, 1> base) -> void {
+        std::unique_lock lock(m_mutex);
+        reset(lock, clone<float, 1>(base));
+        m_has_version = false;
+    }
+
+    auto set_base(ImageView<const uint8_t, 1> base, uint64_t version) -> bool {
+        {
+            std::lock_guard lock(m_mutex);
+            if (is_current_locked(base.width, base.height, version)) return false;
+        }
+        ImageGrayF level0(base.width, base.height);
+        normalize<1>(base, level0.view());
+        std::unique_lock lock(m_mutex);
+        reset(lock, std::move(level0));
+        m_version = version;
+        m_has_version = true;
+        return true;
+    }
+
+    // RGBA input is reduced to BT.601 luma in [0, 1].
+    auto set_base(ImageView<const uint8_t, 4> base, uint64_t version) -> bool {
+        {
+            std::lock_guard lock(m_mutex);
+            if (is_current_locked(base.width, base.height, version)) return false;
+        }
+        const ImageGray8 gray = rgba_to_gray(base);
+        ImageGrayF level0(base.width, base.height);
+        normalize<1>(gray.view(), level0.view());
+        std::unique_lock lock(m_mutex);
+        reset(lock, std::move(level0));
+        m_version = version;
+        m_has_version = true;
+        return true;
+    }
+
+    [[nodiscard]] auto level_count() const -> int {
+        std::lock_guard lock(m_mutex);
+        return static_cast<int>(m_gauss.size());
+    }
+
+    [[nodiscard]] auto level(int i) -> const ImageGrayF & {
+        std::unique_lock lock(m_mutex);
+        return gauss(lock, i);
+    }
+
+    // L_i = G_i - up(G_{i + 1}); the coarsest Laplacian level is G_n itself.
+    [[nodiscard]] auto laplacian(int i) -> const ImageGrayF & {
+        std::unique_lock lock(m_mutex);
+        check_level(i);
+        const auto idx = static_cast<size_t>(i);
+        if (m_lap_valid[idx]) return m_lap[idx];
+
+        const ImageGrayF &g = gauss(lock, i);
+        ImageGrayF out(g.width(), g.height());
+        if (i + 1 == static_cast<int>(m_gauss.size())) {
+            copy<float, 1>(g.view(), out.view());
+        } else {
+            const ImageGrayF &coarser = gauss(lock, i + 1);
+            const Unlocked build(*this, lock);
+            pyr_up(coarser.view(), out.view());
+            for (int y = 0; y < g.height(); ++y) {
+                const float *a = g.row(y);
+                float *o = out.row(y);
+                for (int x = 0; x < g.width(); ++x) o[x] = a[x] - o[x];
+            }
+        }
+        if (!m_lap_valid[idx]) {
+            m_lap[idx] = std::move(out);
+            m_lap_valid[idx] = true;
+        }
+        return m_lap[idx];
+    }
+
+    [[nodiscard]] auto version() const -> uint64_t {
+        std::lock_guard lock(m_mutex);
+        return m_version;
+    }
+
+    auto invalidate() -> void {
+        std::unique_lock lock(m_mutex);
+        m_idle.wait(lock, [&] { return m_building == 0; });
+        m_gauss.clear();
+        m_gauss_valid.clear();
+        m_lap.clear();
+        m_lap_valid.clear();
+        m_has_version = false;
+    }
+
+    // Collapses Laplacian levels (finest first) back into the base image.
+    [[nodiscard]] static auto reconstruct(const std::vector<const ImageGrayF *> &laplacians) -> ImageGrayF {
+        if (laplacians.empty()) return {};
+        ImageGrayF current = clone<float, 1>(laplacians.back()->view());
+        for (size_t i = laplacians.size() - 1; i-- > 0;) {
+            const ImageGrayF &lap = *laplacians[i];
+            ImageGrayF up(lap.width(), lap.height());
+            pyr_up(current.view(), up.view());
+            for (int y = 0; y < lap.height(); ++y) {
+                const float *l = lap.row(y);
+                float *u = up.row(y);
+                for (int x = 0; x < lap.width(); ++x) u[x] += l[x];
+            }
+            current = std::move(up);
+        }
+        return current;
+    }
+
+private:
+    [[nodiscard]] auto is_current_locked(int width, int height, uint64_t version) const -> bool {
+        return m_has_version && version == m_version && !m_gauss.empty() &&
+               m_gauss[0].width() == width && m_gauss[0].height() == height;
+    }
+
+    // Marks a build in flight and releases the mutex for its lifetime.
+    class Unlocked {
+    public:
+        Unlocked(Pyramid &pyramid, std::unique_lock<std::mutex> &lock)
+            : m_pyramid(pyramid), m_lock(lock) {
+            ++m_pyramid.m_building;
+            m_lock.unlock();
+        }
+        ~Unlocked() {
+            m_lock.lock();
+            if (--m_pyramid.m_building == 0) m_pyramid.m_idle.notify_all();
+        }
+        Unlocked(const Unlocked &) = delete;
+        auto operator=(const Unlocked &) -> Unlocked & = delete;
+
+    private:
+        Pyramid &m_pyramid;
+        std::unique_lock<std::mutex> &m_lock;
+    };
+
+    auto reset(std::unique_lock<std::mutex> &lock, ImageGrayF base) -> void {
+        m_idle.wait(lock, [&] { return m_building == 0; });
+        int levels = 1;
+        int w = base.width(), h = base.height();
+        while ((m_max_levels == 0 || levels < m_max_levels) &&
+               std::min(pyr_down_size(w), pyr_down_size(h)) >= m_min_size && std::min(w, h) > 1) {
+            w = pyr_down_size(w);
+            h = pyr_down_size(h);
+            ++levels;
+        }
+        const auto n = static_cast<size_t>(levels);
+        m_gauss.clear();
+        m_gauss.resize(n);
+        m_gauss[0] = std::move(base);
+        m_gauss_valid.assign(n, false);
+        m_gauss_valid[0] = true;
+        m_lap.clear();
+        m_lap.resize(n);
+        m_lap_valid.assign(n, false);
+    }
+
+    auto check_level(int i) const -> void {
+        if (i < 0 || i >= static_cast<int>(m_gauss.size())) {
+            PANIC(std::format("Pyramid level {} out of range ({} levels)", i, m_gauss.size()));
+        }
+    }
+
+    // G_i, building the missing levels up to it. lock is held on entry and on
+    // return but released while pyr_down runs.
+    auto gauss(std::unique_lock<std::mutex> &lock, int i) -> const ImageGrayF & {
+        check_level(i);
+        const auto idx = static_cast<size_t>(i);
+        while (!m_gauss_valid[idx]) {
+            size_t j = 1;
+            while (m_gauss_valid[j]) ++j;
+            const ImageGrayF &finer = m_gauss[j - 1];
+            ImageGrayF next(pyr_down_size(finer.width()), pyr_down_size(finer.height()));
+            {
+                const Unlocked build(*this, lock);
+                pyr_down(finer.view(), next.view());
+            }
+            if (!m_gauss_valid[j]) {
+                m_gauss[j] = std::move(next);
+                m_gauss_valid[j] = true;
+            }
+        }
+        return m_gauss[idx];
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idle;
+    int m_building = 0;
+    std::vector<ImageGrayF> m_gauss;
+    std::vector<bool> m_gauss_valid;
+    std::vector<ImageGrayF> m_lap;
+    std::vector<bool> m_lap_valid;
+    uint64_t m_version = 0;
+    bool m_has_version = false;
+    int m_max_levels = 0;
+    int m_min_size = 8;
+};
+} // namespace CV
@@ -0,0 +1,88 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace CV {
+// Blocking FIFO with a fixed capacity. push() waits while the queue is full,
+// which throttles producers to the pace of the consumers (back-pressure).
+// After close() pushes fail and pops drain what is left, then return nullopt.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1) {}
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    auto operator=(const BoundedQueue &) -> BoundedQueue & = delete;
+
+    // Returns false (and drops the item) once the queue is closed.
+    auto push(T item) -> bool {
+        std::unique_lock lock(m_mutex);
+        m_not_full.wait(lock, [&] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed) return false;
+        m_items.push_back(std::move(item));
+        lock.unlock();
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    // For producers that must not wait, like a live source: returns false when
+    // the queue is full or closed, in which case item is left untouched.
+    auto try_push(T &&item) -> bool {
+        std::unique_lock lock(m_mutex);
+        if (m_closed || m_items.size() >= m_capacity) return false;
+        m_items.push_back(std::move(item));
+        lock.unlock();
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    [[nodiscard]] auto pop() -> std::optional<T> {
+        std::unique_lock lock(m_mutex);
+        m_not_empty.wait(lock, [&] { return m_closed || !m_items.empty(); });
+        return take(lock);
+    }
+
+    [[nodiscard]] auto try_pop() -> std::optional<T> {
+        std::unique_lock lock(m_mutex);
+        return take(lock);
+    }
+
+    auto close() -> void {
+        {
+            std::lock_guard lock(m_mutex);
+            m_closed = true;
+        }
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+    [[nodiscard]] auto size() const -> size_t {
+        std::lock_guard lock(m_mutex);
+        return m_items.size();
+    }
+    [[nodiscard]] auto capacity() const -> size_t { return m_capacity; }
+
+private:
+    auto take(std::unique_lock<std::mutex> &lock) -> std::optional<T> {
+        if (m_items.empty()) return std::nullopt;
+        std::optional<T> item(std::move(m_items.front()));
+        m_items.pop_front();
+        lock.unlock();
+        m_not_full.notify_one();
+        return item;
+    }
+
+    size_t m_capacity;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+    std::deque<T> m_items;
+    bool m_closed = false;
+};
+} // namespace CV
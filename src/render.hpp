@@ -4,16 +4,270 @@
 #include "backends/imgui_impl_opengl3.h"
 #include "backends/imgui_impl_sdl.h"
 #include "imgui.h"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <functional>
 #include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "canny.hpp"
+#include "components.hpp"
+#include "constants.hpp"
+#include "features.hpp"
 #include "global.hpp"
+#include "histogram.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "profile.hpp"
+#include "texture.hpp"
 #include "utils.hpp"
 
 namespace Render {
-auto show_image_texture(GL::ImageTexture tex) -> void {
+// Full-resolution texture scaled down to fit Constants::max_display_size.
+inline auto show_image_view(const GL::StreamingTexture &tex) -> void {
+    if (tex.empty()) return;
+    const float longest = static_cast<float>(std::max(tex.width(), tex.height()));
+    const float scale = std::min(1.0f, static_cast<float>(Constants::max_display_size) / longest);
     ImGui::Image(
-        reinterpret_cast<void *>(static_cast<intptr_t>(tex.id)),
-        ImVec2(tex.width, tex.height));
+        reinterpret_cast<void *>(static_cast<intptr_t>(tex.id())),
+        ImVec2(static_cast<float>(tex.width()) * scale, static_cast<float>(tex.height()) * scale));
+}
+
+inline auto draw_histogram(const char *label, const CV::Histogram256 &hist) -> void {
+    std::array<float, 256> values{};
+    std::transform(hist.begin(), hist.end(), values.begin(), [](uint32_t v) { return static_cast<float>(v); });
+    const float peak = *std::max_element(values.begin(), values.end());
+    ImGui::PlotHistogram(label, values.data(), static_cast<int>(values.size()), 0, nullptr, 0.0f, peak, ImVec2(256.0f, 60.0f));
+}
+
+// Streams the buffer picked in the GUI into the image view. Edges and labels
+// are recomputed from the cached gray image; the texture only receives the
+// tiles that changed, so dragging a threshold re-sends a fraction of the frame.
+inline auto refresh_image_view() -> void {
+    CV_PROFILE_SCOPE("refresh_view");
+    VisionState &vision = global.vision;
+    GL::StreamingTexture &view = global.renderer.image_view;
+    if (!vision.source_image) return;
+    if (vision.display == DisplayBuffer::Source) {
+        view.update(vision.source_image->view());
+        return;
+    }
+    const auto gray = vision.cache.gray(Constants::fp_images[static_cast<size_t>(vision.image_index)]);
+    if (!gray) return;
+    if (vision.display == DisplayBuffer::Gray) {
+        view.update(gray->view());
+        return;
+    }
+    if (vision.edges.width() != gray->width() || vision.edges.height() != gray->height()) {
+        vision.edges = CV::ImageGray8(gray->width(), gray->height());
+    }
+    CV::canny(gray->view(), vision.edges.view(), vision.canny);
+    if (vision.display == DisplayBuffer::Edges) {
+        view.update(std::as_const(vision.edges).view());
+        return;
+    }
+    vision.components = CV::label_components(vision.edges.view());
+    view.update(std::as_const(vision.components.labels).view());
+}
+
+// Makes Constants::fp_images[index] the source image. Decoding and the gray
+// conversion go through the cache, so switching back is cheap.
+inline auto select_image(int index) -> bool {
+    CV_PROFILE_SCOPE("select_image");
+    const char *path = Constants::fp_images[static_cast<size_t>(index)];
+    auto image = global.vision.cache.image(path);
+    const auto gray = global.vision.cache.gray(path);
+    if (!image || !gray) {
+        LOG_ERR("Cannot show {}", path);
+        return false;
+    }
+    global.vision.image_index = index;
+    global.vision.source_image = std::move(image);
+    global.vision.channel_histogram = CV::histogram<4>(global.vision.source_image->view());
+    global.vision.luma_histogram = CV::histogram(gray->view());
+    global.vision.keypoints = CV::detect_corners(gray->view());
+    refresh_image_view();
+    return true;
+}
+
+// Uploads the newest processed stream frame, if one arrived since last time.
+inline auto update_stream() -> void {
+    VisionState &vision = global.vision;
+    if (!vision.stream) return;
+    std::optional<CV::StreamFrame> item = vision.stream->poll();
+    if (!item) return;
+    const CV::Frame &frame = item->frame;
+    if (frame.is_gray) {
+        global.renderer.image_view.update(frame.gray.view());
+    } else {
+        global.renderer.image_view.update(frame.rgba.view());
+    }
+    vision.stream_shown = item->times;
+}
+
+// Called after the swap, so the present latency covers the whole frame.
+inline auto stream_presented() -> void {
+    VisionState &vision = global.vision;
+    if (!vision.stream || !vision.stream_shown) return;
+    vision.stream->presented(*vision.stream_shown);
+    vision.stream_shown.reset();
+}
+
+inline auto draw_stream() -> void {
+    CV::VideoStream &stream = *global.vision.stream;
+    std::array<char, 256> &spec = global.vision.stream_pipeline;
+    ImGui::Text("%s at %.1f fps%s", stream.path().c_str(), static_cast<double>(stream.fps()), stream.finished() ? " (ended)" : "");
+    ImGui::InputText("Pipeline", spec.data(), spec.size());
+    ImGui::SameLine();
+    if (ImGui::Button("Apply")) {
+        if (auto stages = CV::parse_pipeline(spec.data())) stream.set_pipeline(std::move(*stages));
+    }
+
+    const CV::StreamStats s = stream.stats();
+    ImGui::Text("End-to-end: %.1f frames/s", static_cast<double>(s.fps));
+    ImGui::Text("Frames: %llu captured, %llu presented", static_cast<unsigned long long>(s.captured), static_cast<unsigned long long>(s.presented));
+    ImGui::Text("Dropped: %llu at source, %llu late, %llu superseded", static_cast<unsigned long long>(s.dropped_source),
+        static_cast<unsigned long long>(s.dropped_late), static_cast<unsigned long long>(s.dropped_present));
+    constexpr ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+    if (ImGui::BeginTable("stream_latency", 4, flags)) {
+        for (const char *column : {"Stage (ms)", "Mean", "p95", "Max"}) ImGui::TableSetupColumn(column);
+        ImGui::TableHeadersRow();
+        const std::array<std::pair<const char *, const CV::StageLatency *>, 5> rows = {{
+            {"Decode", &s.decode}, {"Queue", &s.queue}, {"Process", &s.process}, {"Present", &s.present}, {"Total", &s.total}}};
+        for (const auto &[name, latency] : rows) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(name);
+            int column = 1;
+            for (const float value : {latency->mean_ms, latency->p95_ms, latency->max_ms}) {
+                ImGui::TableSetColumnIndex(column++);
+                ImGui::Text("%.2f", static_cast<double>(value));
+            }
+        }
+        ImGui::EndTable();
+    }
+}
+
+// One lane per thread that recorded in the frame, nested scopes stacked below
+// their parents. Scopes that began in the previous frame are clipped.
+inline auto draw_profile_timeline(const CV::Profile::FrameRecord &frame, const std::vector<CV::Profile::ThreadInfo> &threads) -> void {
+    using CV::Profile::EventKind;
+    constexpr float row_height = 16.0f;
+    constexpr float label_width = 80.0f;
+
+    std::unordered_map<int, int> rows; // thread -> deepest nesting + 1
+    for (const CV::Profile::RecordedEvent &r : frame.events) {
+        if (r.event.kind != EventKind::Scope) continue;
+        int &n = rows[r.thread];
+        n = std::max(n, r.event.depth + 1);
+    }
+    int total_rows = 0;
+    for (const auto &[thread, n] : rows) total_rows += n;
+    if (total_rows == 0) {
+        ImGui::TextUnformatted("No scopes recorded in this frame");
+        return;
+    }
+
+    ImDrawList *draw = ImGui::GetWindowDrawList();
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    const float width = std::max(label_width + 100.0f, ImGui::GetContentRegionAvail().x);
+    const float track_width = width - label_width;
+    ImGui::InvisibleButton("timeline", ImVec2(width, static_cast<float>(total_rows) * row_height));
+    const bool hovered = ImGui::IsItemHovered();
+    const double span = static_cast<double>(std::max<int64_t>(1, frame.end_ns - frame.begin_ns));
+    const auto to_x = [&](int64_t t) {
+        const double f = std::clamp(static_cast<double>(t - frame.begin_ns) / span, 0.0, 1.0);
+        return origin.x + label_width + static_cast<float>(f) * track_width;
+    };
+
+    float lane_y = origin.y;
+    for (const CV::Profile::ThreadInfo &thread : threads) {
+        const auto it = rows.find(thread.id);
+        if (it == rows.end()) continue;
+        draw->AddText(ImVec2(origin.x, lane_y), IM_COL32(200, 200, 200, 255), thread.name.c_str());
+        for (const CV::Profile::RecordedEvent &r : frame.events) {
+            const CV::Profile::Event &e = r.event;
+            if (r.thread != thread.id || e.kind != EventKind::Scope) continue;
+            const ImVec2 p0(to_x(e.start_ns), lane_y + static_cast<float>(e.depth) * row_height);
+            const ImVec2 p1(std::max(to_x(e.end_ns), p0.x + 1.0f), p0.y + row_height - 1.0f);
+            const float hue = static_cast<float>(std::hash<std::string_view>{}(e.name) % 360) / 360.0f;
+            draw->AddRectFilled(p0, p1, ImColor::HSV(hue, 0.55f, 0.75f));
+            if (p1.x - p0.x > 24.0f) {
+                draw->PushClipRect(p0, p1, true);
+                draw->AddText(ImVec2(p0.x + 2.0f, p0.y), IM_COL32(15, 15, 21, 255), e.name);
+                draw->PopClipRect();
+            }
+            if (hovered && ImGui::IsMouseHoveringRect(p0, p1)) {
+                ImGui::SetTooltip("%s (%s)\n%.3f ms", e.name, thread.name.c_str(), static_cast<double>(e.end_ns - e.start_ns) / 1.0e6);
+            }
+        }
+        lane_y += static_cast<float>(it->second) * row_height;
+    }
+}
+
+inline auto draw_profiler() -> void {
+    CV::Profile::Profiler &profiler = CV::Profile::Profiler::instance();
+    bool recording = CV::Profile::enabled();
+    if (ImGui::Checkbox("Record", &recording)) CV::Profile::set_enabled(recording);
+    ImGui::SameLine();
+    bool paused = profiler.paused();
+    if (ImGui::Checkbox("Pause", &paused)) profiler.set_paused(paused);
+    ImGui::SameLine();
+    if (ImGui::Button("Export Chrome Trace")) (void)profiler.write_chrome_trace(Constants::fp_profile_trace);
+    if (const uint64_t dropped = profiler.dropped()) ImGui::Text("Dropped events: %llu", static_cast<unsigned long long>(dropped));
+
+    const std::vector<float> times = profiler.frame_times_ms();
+    if (times.empty()) return;
+    ImGui::PlotLines("Frame (ms)", times.data(), static_cast<int>(times.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 50.0f));
+    int &back = global.profiler_view.frames_back;
+    back = std::clamp(back, 0, static_cast<int>(times.size()) - 1);
+    ImGui::SliderInt("Frames back", &back, 0, static_cast<int>(times.size()) - 1);
+    if (const auto frame = profiler.frame(times.size() - 1 - static_cast<size_t>(back))) {
+        ImGui::Text("Frame %llu: %.3f ms", static_cast<unsigned long long>(frame->index), frame->duration_ms());
+        draw_profile_timeline(*frame, profiler.threads());
+    }
+
+    // Per-frame totals summed over threads, so parallel scopes show CPU time.
+    constexpr ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+    if (ImGui::BeginTable("scopes", 7, flags)) {
+        for (const char *column : {"Scope", "Calls", "Mean", "p50", "p95", "p99", "Max"}) ImGui::TableSetupColumn(column);
+        ImGui::TableHeadersRow();
+        for (const CV::Profile::ScopeStats &s : profiler.scope_stats()) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%.*s", static_cast<int>(s.name.size()), s.name.data());
+            int column = 1;
+            for (const double value : {s.calls_per_frame, s.mean_ms, s.p50_ms, s.p95_ms, s.p99_ms, s.max_ms}) {
+                ImGui::TableSetColumnIndex(column++);
+                ImGui::Text("%.3f", value);
+            }
+        }
+        ImGui::EndTable();
+    }
+}
+
+// Image and pipeline buffer selection for the static image.
+inline auto gui_image_controls() -> void {
+    int index = global.vision.image_index;
+    if (ImGui::Combo("Image", &index, Constants::fp_images.data(), static_cast<int>(Constants::fp_images.size())) &&
+        index != global.vision.image_index) {
+        select_image(index);
+    }
+    constexpr std::array<const char *, 4> buffers = {"Source", "Gray", "Edges", "Labels"};
+    int display = static_cast<int>(global.vision.display);
+    bool view_changed = ImGui::Combo("Buffer", &display, buffers.data(), static_cast<int>(buffers.size()));
+    global.vision.display = static_cast<DisplayBuffer>(display);
+    if (global.vision.display == DisplayBuffer::Edges || global.vision.display == DisplayBuffer::Labels) {
+        view_changed |= ImGui::SliderFloat("Canny Low", &global.vision.canny.low_threshold, 0.0f, 255.0f);
+        view_changed |= ImGui::SliderFloat("Canny High", &global.vision.canny.high_threshold, 0.0f, 255.0f);
+    }
+    if (view_changed) refresh_image_view();
 }
 
 inline auto gui_debug() -> void {
@@ -30,15 +284,98 @@ inline auto gui_debug() -> void {
     ImGui::Text("Mouse Position: (%.3f, %.3f)",
         global.input.mouse_pos.x,
         global.input.mouse_pos.y);
+    if (ImGui::CollapsingHeader("Memory")) {
+        const CV::PoolStats pool = CV::BufferPool::instance().stats();
+        // Other threads' arenas are in use while a stream runs; report ours only.
+        CV::ArenaStats arena;
+        if (global.vision.stream) {
+            const CV::FrameArena &own = CV::frame_arena();
+            arena = {own.used(), own.peak(), own.capacity()};
+        } else {
+            arena = CV::frame_arena_stats();
+        }
+        constexpr double mib = 1 << 20;
+        ImGui::Text("Pool in use: %.1f MiB (peak %.1f MiB)", static_cast<double>(pool.bytes_in_use) / mib, static_cast<double>(pool.peak_in_use) / mib);
+        ImGui::Text("Pool cached: %.1f MiB", static_cast<double>(pool.bytes_cached) / mib);
+        ImGui::Text("Pool allocated: %.1f MiB", static_cast<double>(pool.bytes_allocated) / mib);
+        ImGui::Text("Pool reuse: %.1f%% of %llu", 100.0 * pool.reuse_rate(), static_cast<unsigned long long>(pool.requests));
+        ImGui::Text("%s: %.1f MiB reserved, peak %.1f MiB", global.vision.stream ? "Main arena" : "Arenas",
+            static_cast<double>(arena.capacity) / mib, static_cast<double>(arena.peak) / mib);
+    }
+    if (global.vision.stream && ImGui::CollapsingHeader("Stream", ImGuiTreeNodeFlags_DefaultOpen)) draw_stream();
+    if (ImGui::CollapsingHeader("Profiler")) draw_profiler();
     ImGui::End();
 
     ImGui::Begin("Computer Vision");
-    ImGui::Text("Loaded Image:");
-    show_image_texture(global.renderer.image_texture);
+    // In streaming mode the stream's pipeline decides what is shown.
+    if (!global.vision.stream) gui_image_controls();
+    show_image_view(global.renderer.image_view);
+    if (!global.vision.stream && ImGui::CollapsingHeader("Histogram")) {
+        draw_histogram("Red", global.vision.channel_histogram[0]);
+        draw_histogram("Green", global.vision.channel_histogram[1]);
+        draw_histogram("Blue", global.vision.channel_histogram[2]);
+        draw_histogram("Luma", global.vision.luma_histogram);
+    }
+    if (!global.vision.stream && ImGui::CollapsingHeader("Overlay")) {
+        ImGui::Checkbox("Show Keypoints", &global.vision.show_keypoints);
+        ImGui::Text("Keypoints: %zu", global.vision.keypoints.size());
+        ImGui::Text("Instances: %zu in %d draw calls", global.renderer.overlay.instance_count(), global.renderer.overlay.draw_calls());
+    }
+    if (ImGui::CollapsingHeader("Texture Upload")) {
+        const GL::UploadStats &upload = global.renderer.image_view.stats();
+        ImGui::Text("Last: %zu rects, %.1f KiB", upload.rects, static_cast<double>(upload.bytes) / 1024.0);
+        ImGui::Text("Uploads: %llu (%llu full, %llu unchanged)", static_cast<unsigned long long>(upload.uploads),
+            static_cast<unsigned long long>(upload.full_uploads), static_cast<unsigned long long>(upload.skipped));
+        ImGui::Text("Orphaned Buffers: %llu", static_cast<unsigned long long>(upload.orphaned));
+    }
+    if (ImGui::CollapsingHeader("Image Cache")) {
+        const CV::CacheStats stats = global.vision.cache.stats();
+        ImGui::Text("Entries: %zu", stats.entries);
+        ImGui::Text("Memory: %.1f / %.1f MiB", static_cast<double>(stats.bytes) / (1 << 20), static_cast<double>(stats.budget) / (1 << 20));
+        ImGui::Text("Hits / Misses: %llu / %llu", static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses));
+        ImGui::Text("Shared Waits: %llu", static_cast<unsigned long long>(stats.shared_waits));
+        ImGui::Text("Evictions: %llu", static_cast<unsigned long long>(stats.evictions));
+    }
     ImGui::End();
     ImGui::Render();
 }
 
+// Keypoints of the source image, fitted into the window behind the GUI: every
+// corner as a circle shaded by score, the strongest ones also marked.
+inline auto draw_overlay() -> void {
+    constexpr size_t marked = 64;
+    GL::OverlayRenderer &overlay = global.renderer.overlay;
+    overlay.clear();
+    const auto &image = global.vision.source_image;
+    if (!global.vision.show_keypoints || !image || global.vision.stream) return;
+    CV_PROFILE_SCOPE("overlay");
+
+    const ImVec2 display = ImGui::GetIO().DisplaySize;
+    const float w = static_cast<float>(image->width());
+    const float h = static_cast<float>(image->height());
+    const float s = std::min(display.x / w, display.y / h);
+    const float ox = 0.5f * (display.x - w * s);
+    const float oy = 0.5f * (display.y - h * s);
+    const glm::mat4 projection = glm::ortho(-ox / s, (display.x - ox) / s, (display.y - oy) / s, -oy / s);
+
+    const CV::Keypoints &kp = global.vision.keypoints;
+    const float max_score = kp.score.empty() ? 1.0f : std::max(1e-6f, *std::max_element(kp.score.begin(), kp.score.end()));
+    const float radius = 2.5f / s; // screen pixels
+    overlay.rect({0.0f, 0.0f}, {w, h}, {1.0f, 1.0f, 1.0f, 0.05f});
+    overlay.reserve(GL::OverlayShape::Circle, kp.size());
+    for (size_t i = 0; i < kp.size(); ++i) {
+        const float t = kp.score[i] / max_score;
+        overlay.circle({kp.x[i], kp.y[i]}, radius, {1.0f, 1.0f - 0.8f * t, 0.2f, 0.85f});
+    }
+    std::vector<size_t> order(kp.size());
+    std::iota(order.begin(), order.end(), size_t{0});
+    const size_t n = std::min(marked, order.size());
+    std::partial_sort(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(n), order.end(),
+        [&](size_t a, size_t b) { return kp.score[a] > kp.score[b]; });
+    for (size_t i = 0; i < n; ++i) overlay.marker({kp.x[order[i]], kp.y[order[i]]}, 4.0f * radius, {0.2f, 1.0f, 0.4f, 0.9f});
+    overlay.draw(projection);
+}
+
 inline auto frame() -> void {
     glViewport(0, 0,
         (int)global.renderer.imgui_io.DisplaySize.x,
@@ -0,0 +1,117 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CV_SIMD_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define CV_SIMD_X86 0
+#endif
+
+// Per-function ISA selection, so kernels for every level live in the same
+// translation unit without raising the baseline -march of the whole build.
+#if CV_SIMD_X86
+#define CV_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define CV_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define CV_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl")))
+#define CV_TARGET_AVX512_VPOPCNT __attribute__((target("avx512f,avx512bw,avx512vl,avx512vpopcntdq")))
+#define CV_TARGET_POPCNT __attribute__((target("popcnt")))
+#endif
+
+namespace CV::Simd {
+enum class Level : int {
+    Scalar = 0,
+    SSE41 = 1,
+    AVX2 = 2,
+    AVX512 = 3
+};
+inline constexpr int level_count = 4;
+
+struct Features {
+    bool sse41 = false;
+    bool avx2 = false;
+    bool avx512 = false; // F + BW + VL
+    bool avx512_vpopcntdq = false;
+};
+
+[[nodiscard]] inline auto to_string(Level level) -> std::string_view {
+    switch (level) {
+    case Level::Scalar: return "scalar";
+    case Level::SSE41: return "sse4.1";
+    case Level::AVX2: return "avx2";
+    case Level::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+[[nodiscard]] inline auto detect_features() -> Features {
+    Features f;
+#if CV_SIMD_X86
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return f;
+    f.sse41 = (ecx & bit_SSE4_1) != 0;
+
+    // AVX state must also be enabled by the OS (XCR0), not only by the CPU.
+    const bool osxsave = (ecx & bit_OSXSAVE) != 0;
+    const bool cpu_avx = (ecx & bit_AVX) != 0;
+    const bool cpu_fma = (ecx & bit_FMA) != 0;
+    uint64_t xcr0 = 0;
+    if (osxsave) {
+        uint32_t lo = 0, hi = 0;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = (static_cast<uint64_t>(hi) << 32) | lo;
+    }
+    const bool os_avx = (xcr0 & 0x6) == 0x6;
+    const bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return f;
+    f.avx2 = cpu_avx && cpu_fma && os_avx && (ebx & bit_AVX2) != 0;
+    f.avx512 = f.avx2 && os_avx512 &&
+               (ebx & bit_AVX512F) != 0 &&
+               (ebx & bit_AVX512BW) != 0 &&
+               (ebx & bit_AVX512VL) != 0;
+    f.avx512_vpopcntdq = f.avx512 && (ecx & bit_AVX512VPOPCNTDQ) != 0;
+#endif
+    return f;
+}
+
+[[nodiscard]] inline auto features() -> const Features & {
+    static const Features f = detect_features();
+    return f;
+}
+
+[[nodiscard]] inline auto detected_level() -> Level {
+    const Features &f = features();
+    if (f.avx512) return Level::AVX512;
+    if (f.avx2) return Level::AVX2;
+    if (f.sse41) return Level::SSE41;
+    return Level::Scalar;
+}
+
+namespace detail {
+inline auto level_storage() -> std::atomic<Level> & {
+    static std::atomic<Level> level{detected_level()};
+    return level;
+}
+} // namespace detail
+
+// Level used by all dispatched kernels. Defaults to the best level the CPU and
+// OS support; tests and benchmarks may lower it to compare against scalar code.
+[[nodiscard]] inline auto active_level() -> Level {
+    return detail::level_storage().load(std::memory_order_relaxed);
+}
+
+// Requests a dispatch level, clamped to what the machine actually supports.
+// Returns the level that is now active.
+inline auto set_level(Level requested) -> Level {
+    const Level best = detected_level();
+    const Level level = static_cast<int>(requested) > static_cast<int>(best) ? best : requested;
+    detail::level_storage().store(level, std::memory_order_relaxed);
+    return level;
+}
+} // namespace CV::Simd
@@ -0,0 +1,503 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "image.hpp"
+#include "loader.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "pipeline.hpp"
+#include "profile.hpp"
+#include "queue.hpp"
+
+// Video streaming: a paced source feeding decode -> process -> present.
+//
+// A source is a directory of numbered frames, decoded ahead by an ImageLoader,
+// or a raw 4:2:0 file: Y4M, or headerless NV12 of a given size. The source
+// thread releases at most one frame per frame period, like a camera, and never
+// waits for the consumers; when the decoded queue is full the frame is
+// dropped. It does wait for its own input, so when the loader's decoding (or
+// the disk) falls behind, frames arrive late rather than being dropped. The
+// process thread runs a pipeline.hpp stage list on each frame, skipping frames
+// that are already older than the latency budget for newer ones. The
+// presenting thread (the GUI loop) polls for the newest processed frame and
+// skips the rest. Frames carry their timestamps, so the per-stage latencies
+// are those of the frames that were actually shown.
+namespace CV {
+using StreamClock = std::chrono::steady_clock;
+
+struct StreamParams {
+    int width = 0;  // NV12 only, which has no header
+    int height = 0; // NV12 only
+    float fps = 0.0f; // 0 = the Y4M frame rate, 30 for other sources
+    size_t queue_capacity = 2; // frames between two stages
+    std::chrono::milliseconds max_latency{100}; // older frames are skipped for newer ones before processing
+    bool loop = true;
+};
+
+struct FrameTimes {
+    StreamClock::time_point captured; // released by the source
+    StreamClock::time_point decoded;
+    StreamClock::time_point process_start;
+    StreamClock::time_point processed;
+};
+
+struct StreamFrame {
+    uint64_t index = 0;
+    Frame frame;
+    FrameTimes times;
+};
+
+struct StageLatency {
+    float mean_ms = 0.0f;
+    float p95_ms = 0.0f;
+    float max_ms = 0.0f;
+};
+
+struct StreamStats {
+    float fps = 0.0f; // presented frames per second
+    StageLatency decode;
+    StageLatency queue; // decoded, waiting for the process thread
+    StageLatency process;
+    StageLatency present; // processed, waiting to be shown
+    StageLatency total;
+    uint64_t captured = 0;
+    uint64_t presented = 0;
+    uint64_t dropped_source = 0;  // decoded queue full
+    uint64_t dropped_late = 0;    // over max_latency with a newer frame waiting
+    uint64_t dropped_present = 0; // superseded by a newer processed frame
+};
+
+namespace detail {
+// BT.601 limited range in the usual 8-bit fixed point form. chroma_step is 1
+// for planar chroma (Y4M) and 2 for interleaved UV (NV12).
+inline auto yuv420_row_to_rgba(const uint8_t *y, const uint8_t *u, const uint8_t *v, size_t chroma_step, uint8_t *dst, int width) -> void {
+    const auto clamp8 = [](int value) { return static_cast<uint8_t>(std::clamp(value >> 8, 0, 255)); };
+    for (int x = 0; x < width; ++x) {
+        const size_t c = static_cast<size_t>(x / 2) * chroma_step;
+        const int luma = 298 * (y[x] - 16) + 128;
+        const int cb = u[c] - 128;
+        const int cr = v[c] - 128;
+        uint8_t *p = dst + static_cast<size_t>(x) * 4;
+        p[0] = clamp8(luma + 409 * cr);
+        p[1] = clamp8(luma - 100 * cb - 208 * cr);
+        p[2] = clamp8(luma + 516 * cb);
+        p[3] = 255;
+    }
+}
+
+// Frame numbers decide the order of a frame directory: the last run of digits
+// in the file stem, so frame_9 comes before frame_10 without zero padding.
+[[nodiscard]] inline auto frame_number(const std::filesystem::path &path) -> uint64_t {
+    const std::string stem = path.stem().string();
+    const size_t end = stem.find_last_of("0123456789");
+    if (end == std::string::npos) return 0;
+    size_t begin = end;
+    while (begin > 0 && std::isdigit(static_cast<unsigned char>(stem[begin - 1]))) --begin;
+    uint64_t number = 0;
+    std::from_chars(stem.data() + begin, stem.data() + end + 1, number);
+    return number;
+}
+
+[[nodiscard]] inline auto frame_paths(const std::filesystem::path &dir) -> std::vector<std::string> {
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        const bool image = ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga" || ext == ".pgm" || ext == ".ppm";
+        if (entry.is_regular_file() && image) files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) {
+        const uint64_t na = frame_number(a);
+        const uint64_t nb = frame_number(b);
+        return na != nb ? na < nb : a < b;
+    });
+    std::vector<std::string> out;
+    out.reserve(files.size());
+    for (const auto &file : files) out.push_back(file.string());
+    return out;
+}
+} // namespace detail
+
+// Sequential reader for raw 8-bit 4:2:0 video, Y4M (C420* and Cmono) or NV12.
+class RawVideoReader {
+public:
+    [[nodiscard]] auto open(const std::string &path, int width, int height) -> bool {
+        m_file.open(path, std::ios::binary);
+        if (!m_file) {
+            LOG_ERR("Cannot open video {}", path);
+            return false;
+        }
+        m_y4m = std::filesystem::path(path).extension() == ".y4m";
+        if (m_y4m) {
+            if (!parse_header()) return false;
+        } else {
+            m_width = width;
+            m_height = height;
+            m_chroma_step = 2;
+        }
+        if (m_width <= 0 || m_height <= 0 || m_width % 2 != 0 || m_height % 2 != 0) {
+            LOG_ERR("Video {}: {}x{} is not a valid 4:2:0 frame size", path, m_width, m_height);
+            return false;
+        }
+        const size_t luma = static_cast<size_t>(m_width) * static_cast<size_t>(m_height);
+        m_bytes.resize(m_mono ? luma : luma + luma / 2);
+        if (m_mono) m_neutral.assign(static_cast<size_t>(m_width / 2), 128);
+        m_data_start = m_file.tellg();
+        return true;
+    }
+
+    // Reads the next frame, only its luma plane as gray when gray_only is set.
+    // Returns false at the end of the file.
+    [[nodiscard]] auto read(Frame &out, bool gray_only) -> bool {
+        if (m_y4m) {
+            std::string line;
+            if (!std::getline(m_file, line)) return false;
+            if (!line.starts_with("FRAME")) {
+                LOG_ERR("Y4M: expected FRAME, got '{}'", line.substr(0, 16));
+                return false;
+            }
+        }
+        if (!m_file.read(reinterpret_cast<char *>(m_bytes.data()), static_cast<std::streamsize>(m_bytes.size()))) return false;
+
+        const auto w = static_cast<size_t>(m_width);
+        const uint8_t *luma = m_bytes.data();
+        if (gray_only) {
+            out.gray = pooled_image<uint8_t, 1>(m_width, m_height);
+            for (int y = 0; y < m_height; ++y) std::memcpy(out.gray.row(y), luma + static_cast<size_t>(y) * w, w);
+            out.rgba = {};
+            out.is_gray = true;
+            return true;
+        }
+
+        // Mono has no chroma planes; every row reads the same neutral one.
+        const uint8_t *chroma = m_mono ? m_neutral.data() : luma + w * static_cast<size_t>(m_height);
+        const size_t chroma_stride = m_mono ? 0 : (m_chroma_step == 2 ? w : w / 2);
+        const uint8_t *u = chroma;
+        const uint8_t *v = m_mono ? chroma : (m_chroma_step == 2 ? chroma + 1 : chroma + chroma_stride * static_cast<size_t>(m_height / 2));
+        out.rgba = pooled_image<uint8_t, 4>(m_width, m_height);
+        out.gray = {};
+        out.is_gray = false;
+        parallel_for(0, m_height, 16, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                const size_t c = static_cast<size_t>(y / 2) * chroma_stride;
+                detail::yuv420_row_to_rgba(luma + static_cast<size_t>(y) * w, u + c, v + c, m_chroma_step, out.rgba.row(y), m_width);
+            }
+        });
+        return true;
+    }
+
+    auto rewind() -> void {
+        m_file.clear();
+        m_file.seekg(m_data_start);
+    }
+
+    [[nodiscard]] auto width() const -> int { return m_width; }
+    [[nodiscard]] auto height() const -> int { return m_height; }
+    [[nodiscard]] auto fps() const -> float { return m_fps; } // 0 when the file does not say
+
+private:
+    // "YUV4MPEG2 W640 H480 F30000:1001 Ip A1:1 C420jpeg", tags in any order.
+    [[nodiscard]] auto parse_header() -> bool {
+        std::string line;
+        if (!std::getline(m_file, line) || !line.starts_with("YUV4MPEG2")) {
+            LOG_ERR("Y4M: missing YUV4MPEG2 signature");
+            return false;
+        }
+        std::string_view rest = line;
+        while (!rest.empty()) {
+            const size_t space = rest.find(' ');
+            const std::string_view tag = rest.substr(0, space);
+            rest = space == std::string_view::npos ? std::string_view{} : rest.substr(space + 1);
+            if (tag.size() < 2) continue;
+            const std::string_view value = tag.substr(1);
+            const auto number = [](std::string_view text) {
+                int n = 0;
+                std::from_chars(text.data(), text.data() + text.size(), n);
+                return n;
+            };
+            switch (tag[0]) {
+            case 'W': m_width = number(value); break;
+            case 'H': m_height = number(value); break;
+            case 'F': {
+                const size_t colon = value.find(':');
+                const int den = colon == std::string_view::npos ? 1 : number(value.substr(colon + 1));
+                if (den > 0) m_fps = static_cast<float>(number(value.substr(0, colon))) / static_cast<float>(den);
+                break;
+            }
+            case 'C':
+                // 8-bit only: C420p10 and the like carry 16-bit samples.
+                m_mono = value == "mono";
+                if (!m_mono && value != "420" && value != "420jpeg" && value != "420paldv" && value != "420mpeg2") {
+                    LOG_ERR("Y4M: colour space C{} is not supported, only 8-bit 4:2:0 and mono", value);
+                    return false;
+                }
+                break;
+            default: break;
+            }
+        }
+        return true;
+    }
+
+    std::ifstream m_file;
+    std::streampos m_data_start{};
+    std::vector<uint8_t> m_bytes; // one frame
+    std::vector<uint8_t> m_neutral; // chroma row for mono input
+    int m_width = 0;
+    int m_height = 0;
+    float m_fps = 0.0f;
+    size_t m_chroma_step = 1;
+    bool m_y4m = false;
+    bool m_mono = false;
+};
+
+class VideoStream {
+public:
+    static constexpr size_t history_length = 240; // presented frames the stats cover
+
+    // A directory is read as numbered frames, *.y4m as Y4M and anything else
+    // as NV12 of params.width x params.height. ok() tells whether it opened.
+    explicit VideoStream(std::string path, std::vector<PipelineStage> stages = {}, StreamParams params = {})
+        : m_path(std::move(path)), m_params(params), m_decoded(params.queue_capacity), m_processed(params.queue_capacity) {
+        set_pipeline(std::move(stages));
+        std::error_code ec;
+        if (std::filesystem::is_directory(m_path, ec)) {
+            m_frame_paths = detail::frame_paths(m_path);
+            if (m_frame_paths.empty()) LOG_ERR("No frames in {}", m_path);
+            m_fps = params.fps > 0.0f ? params.fps : 30.0f;
+        } else if (m_reader.open(m_path, params.width, params.height)) {
+            m_raw = true;
+            m_fps = params.fps > 0.0f ? params.fps : (m_reader.fps() > 0.0f ? m_reader.fps() : 30.0f);
+        }
+        if (!m_raw && m_frame_paths.empty()) {
+            m_decoded.close();
+            m_processed.close();
+            m_source_done.store(true);
+            return;
+        }
+        m_ok = true;
+        LOG_INFO("Streaming {} at {:.1f} fps", m_path, m_fps);
+        m_threads.emplace_back([this](std::stop_token stop) { source_main(stop); });
+        m_threads.emplace_back([this] { process_main(); });
+    }
+
+    ~VideoStream() {
+        // Unblocks the process thread; the source thread stops through its
+        // stop token when the jthreads are destroyed.
+        m_decoded.close();
+        m_processed.close();
+    }
+
+    VideoStream(const VideoStream &) = delete;
+    auto operator=(const VideoStream &) -> VideoStream & = delete;
+
+    // Takes effect from the next frame the process thread picks up.
+    auto set_pipeline(std::vector<PipelineStage> stages) -> void {
+        m_gray_source.store(!stages.empty() && stages.front().op == StageOp::Gray);
+        auto shared = std::make_shared<const std::vector<PipelineStage>>(std::move(stages));
+        std::lock_guard lock(m_stages_mutex);
+        m_stages = std::move(shared);
+    }
+
+    // Newest processed frame, if any arrived since the last poll; older ones
+    // are dropped. Call from the presenting thread only, as presented().
+    [[nodiscard]] auto poll() -> std::optional<StreamFrame> {
+        std::optional<StreamFrame> newest;
+        while (auto item = m_processed.try_pop()) {
+            if (newest) m_dropped_present.fetch_add(1);
+            newest = std::move(item);
+        }
+        return newest;
+    }
+
+    // Records that a polled frame reached the screen now.
+    auto presented(const FrameTimes &times) -> void {
+        Presented p;
+        p.times = times;
+        p.presented = StreamClock::now();
+        m_history.push_back(p);
+        if (m_history.size() > history_length) m_history.pop_front();
+        ++m_presented;
+    }
+
+    [[nodiscard]] auto stats() const -> StreamStats {
+        StreamStats s;
+        s.captured = m_captured.load();
+        s.presented = m_presented;
+        s.dropped_source = m_dropped_source.load();
+        s.dropped_late = m_dropped_late.load();
+        s.dropped_present = m_dropped_present.load();
+        if (m_history.empty()) return s;
+        const auto summarize = [&](auto from, auto to) {
+            std::vector<float> ms;
+            ms.reserve(m_history.size());
+            for (const Presented &p : m_history) ms.push_back(std::chrono::duration<float, std::milli>(to(p) - from(p)).count());
+            std::sort(ms.begin(), ms.end());
+            StageLatency l;
+            for (const float v : ms) l.mean_ms += v;
+            l.mean_ms /= static_cast<float>(ms.size());
+            l.p95_ms = ms[std::min(ms.size() - 1, ms.size() * 95 / 100)];
+            l.max_ms = ms.back();
+            return l;
+        };
+        s.decode = summarize([](const Presented &p) { return p.times.captured; }, [](const Presented &p) { return p.times.decoded; });
+        s.queue = summarize([](const Presented &p) { return p.times.decoded; }, [](const Presented &p) { return p.times.process_start; });
+        s.process = summarize([](const Presented &p) { return p.times.process_start; }, [](const Presented &p) { return p.times.processed; });
+        s.present = summarize([](const Presented &p) { return p.times.processed; }, [](const Presented &p) { return p.presented; });
+        s.total = summarize([](const Presented &p) { return p.times.captured; }, [](const Presented &p) { return p.presented; });
+        if (m_history.size() > 1) {
+            const float seconds = std::chrono::duration<float>(m_history.back().presented - m_history.front().presented).count();
+            s.fps = seconds > 0.0f ? static_cast<float>(m_history.size() - 1) / seconds : 0.0f;
+        }
+        return s;
+    }
+
+    [[nodiscard]] auto ok() const -> bool { return m_ok; }
+    // The source ran out (no looping) and every frame went through.
+    [[nodiscard]] auto finished() const -> bool { return m_source_done.load() && m_decoded.size() == 0 && m_processed.size() == 0; }
+    [[nodiscard]] auto path() const -> const std::string & { return m_path; }
+    [[nodiscard]] auto fps() const -> float { return m_fps; }
+
+private:
+    struct Presented {
+        FrameTimes times;
+        StreamClock::time_point presented;
+    };
+
+    auto source_main(std::stop_token stop) -> void {
+        Profile::set_thread_name("stream source");
+        const auto period = std::chrono::duration_cast<StreamClock::duration>(std::chrono::duration<double>(1.0 / static_cast<double>(m_fps)));
+        std::mutex sleep_mutex;
+        std::condition_variable_any sleep_cv;
+        std::unique_ptr<ImageLoader> loader;
+        std::mutex loader_mutex;
+        const std::stop_callback cancel(stop, [&] {
+            std::lock_guard lock(loader_mutex);
+            if (loader) loader->cancel();
+        });
+        const auto restart = [&]() -> bool {
+            if (m_raw) {
+                m_reader.rewind();
+                return true;
+            }
+            LoaderParams lp;
+            lp.queue_capacity = m_params.queue_capacity;
+            std::lock_guard lock(loader_mutex);
+            if (stop.stop_requested()) return false;
+            loader = std::make_unique<ImageLoader>(m_frame_paths, lp);
+            return true;
+        };
+        bool started = restart();
+
+        uint64_t index = 0;
+        auto due = StreamClock::now();
+        while (started && !stop.stop_requested()) {
+            {
+                std::unique_lock lock(sleep_mutex);
+                (void)sleep_cv.wait_until(lock, stop, due, [] { return false; });
+            }
+            if (stop.stop_requested()) break;
+            // A source that fell behind carries on from now instead of bursting.
+            due = std::max(due + period, StreamClock::now());
+
+            StreamFrame item;
+            item.times.captured = StreamClock::now();
+            bool more = true;
+            {
+                CV_PROFILE_SCOPE("stream_decode");
+                if (m_raw) {
+                    more = m_reader.read(item.frame, m_gray_source.load());
+                } else if (std::optional<DecodedImage> decoded = loader->next()) {
+                    item.frame.rgba = std::move(decoded->image); // empty if decoding failed, skipped below
+                } else {
+                    more = false;
+                }
+            }
+            if (!more) {
+                if (!m_params.loop || stop.stop_requested() || !restart()) break;
+                due = StreamClock::now();
+                continue;
+            }
+            if (item.frame.empty()) continue;
+            item.index = index++;
+            item.times.decoded = StreamClock::now();
+            m_captured.fetch_add(1);
+            if (!m_decoded.try_push(std::move(item))) m_dropped_source.fetch_add(1);
+        }
+        m_source_done.store(true);
+        m_decoded.close();
+    }
+
+    auto process_main() -> void {
+        Profile::set_thread_name("stream process");
+        while (std::optional<StreamFrame> item = m_decoded.pop()) {
+            // A late frame is only dropped for a newer one; dropping the last
+            // would starve the display when processing alone is over budget.
+            while (StreamClock::now() - item->times.captured > m_params.max_latency) {
+                std::optional<StreamFrame> newer = m_decoded.try_pop();
+                if (!newer) break;
+                m_dropped_late.fetch_add(1);
+                item = std::move(newer);
+            }
+            item->times.process_start = StreamClock::now();
+            std::shared_ptr<const std::vector<PipelineStage>> stages;
+            {
+                std::lock_guard lock(m_stages_mutex);
+                stages = m_stages;
+            }
+            {
+                CV_PROFILE_SCOPE("stream_process");
+                run_pipeline(item->frame, *stages);
+            }
+            frame_arena().reset();
+            item->times.processed = StreamClock::now();
+            if (!m_processed.try_push(std::move(*item))) m_dropped_present.fetch_add(1);
+        }
+        m_processed.close();
+    }
+
+    std::string m_path;
+    StreamParams m_params;
+    float m_fps = 30.0f;
+    bool m_ok = false;
+    bool m_raw = false;
+    RawVideoReader m_reader; // raw sources, used by the source thread only
+    std::vector<std::string> m_frame_paths;
+
+    std::mutex m_stages_mutex;
+    std::shared_ptr<const std::vector<PipelineStage>> m_stages;
+    std::atomic<bool> m_gray_source{false}; // the pipeline starts with gray, so raw sources skip chroma
+
+    BoundedQueue<StreamFrame> m_decoded;
+    BoundedQueue<StreamFrame> m_processed;
+    std::atomic<bool> m_source_done{false};
+    std::atomic<uint64_t> m_captured{0};
+    std::atomic<uint64_t> m_dropped_source{0};
+    std::atomic<uint64_t> m_dropped_late{0};
+    std::atomic<uint64_t> m_dropped_present{0};
+    std::deque<Presented> m_history; // presenting thread only
+    uint64_t m_presented = 0;
+    std::vector<std::jthread> m_threads; // last, so threads are joined before the state goes away
+};
+} // namespace CV
@@ -0,0 +1,335 @@
+/* danielsinkin97@gmail.com */
+
+// Kernel tests: every SIMD level must reproduce the scalar reference bit for
+// bit.
+//
+//   cv_test
+//
+// Each case runs once per Simd level the machine supports, on odd widths and
+// rows whose stride is not a multiple of row_alignment and whose start is not
+// aligned either. Outputs are compared with memcmp against the scalar level,
+// including the padding between rows, so stray writes are caught too. The
+// optical flow case also checks that a known shift is recovered. Exit code 1
+// on any failure; registered with ctest.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+// Standard library
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Project headers
+#include "convert.hpp"
+#include "flow.hpp"
+#include "image.hpp"
+#include "log.hpp"
+#include "simd.hpp"
+#include "types.hpp"
+
+namespace {
+using Bytes = std::vector<uint8_t>;
+
+constexpr int test_widths[] = {1, 3, 15, 17, 31, 33, 63, 65, 127, 129, 257, 1001};
+constexpr int test_height = 3;
+
+// xorshift32: the inputs only need to be the same on every run.
+struct Random {
+    uint32_t state = 0x9e3779b9u;
+    auto next() -> uint32_t {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    auto byte() -> uint8_t { return static_cast<uint8_t>(next() >> 24); }
+};
+
+// Pixels in a plain vector, one element past an aligned start and with a few
+// elements of padding per row, so kernels see unaligned rows and strides.
+template <typename T, int C>
+struct StridedImage {
+    static constexpr size_t padding = 5;
+
+    StridedImage(int w, int h, T fill)
+        : width(w), height(h), stride(static_cast<size_t>(w) * C + padding),
+          storage(stride * static_cast<size_t>(height) + 1, fill) {}
+
+    [[nodiscard]] auto view() -> CV::ImageView<T, C> { return {storage.data() + 1, width, height, stride}; }
+    [[nodiscard]] auto view() const -> CV::ImageView<const T, C> { return {storage.data() + 1, width, height, stride}; }
+    [[nodiscard]] auto bytes() const -> Bytes {
+        Bytes out(storage.size() * sizeof(T));
+        std::memcpy(out.data(), storage.data(), out.size());
+        return out;
+    }
+
+    int width;
+    int height;
+    size_t stride;
+    std::vector<T> storage;
+};
+
+template <typename T, int C>
+auto append_planes(Bytes &out, const CV::PlanarImage<T, C> &img) -> void {
+    for (int c = 0; c < C; ++c) {
+        const CV::ImageView<const T, 1> plane = img.plane(c);
+        for (int y = 0; y < plane.height; ++y) {
+            const auto *row = reinterpret_cast<const uint8_t *>(plane.row(y));
+            out.insert(out.end(), row, row + static_cast<size_t>(plane.width) * sizeof(T));
+        }
+    }
+}
+
+template <int C>
+[[nodiscard]] auto random_u8(int width, int height, Random &rng) -> StridedImage<uint8_t, C> {
+    StridedImage<uint8_t, C> img(width, height, 0xcd);
+    for (int y = 0; y < height; ++y) {
+        uint8_t *row = img.view().row(y);
+        for (size_t i = 0; i < static_cast<size_t>(width) * C; ++i) row[i] = rng.byte();
+    }
+    return img;
+}
+
+// Mostly [-0.25, 1.25], with exact rounding ties, NaN and infinities mixed in.
+template <int C>
+[[nodiscard]] auto random_f32(int width, int height, Random &rng) -> StridedImage<float, C> {
+    StridedImage<float, C> img(width, height, -7.0f);
+    for (int y = 0; y < height; ++y) {
+        float *row = img.view().row(y);
+        for (size_t i = 0; i < static_cast<size_t>(width) * C; ++i) {
+            const uint32_t r = rng.next();
+            switch (r % 8) {
+            case 0: row[i] = (static_cast<float>(r >> 24) + 0.5f) / 255.0f; break;
+            case 1: row[i] = std::numeric_limits<float>::quiet_NaN(); break;
+            case 2: row[i] = (r & 256) != 0 ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity(); break;
+            default: row[i] = static_cast<float>(r >> 8) / static_cast<float>(1 << 24) * 1.5f - 0.25f; break;
+            }
+        }
+    }
+    return img;
+}
+
+// Runs `run` at the scalar level and at every higher level the machine
+// supports, and compares what it returns. Returns the number of mismatches.
+auto compare_levels(std::string_view name, const std::function<Bytes()> &run) -> int {
+    CV::Simd::set_level(CV::Simd::Level::Scalar);
+    const Bytes reference = run();
+    int failures = 0;
+    for (int l = 1; l < CV::Simd::level_count; ++l) {
+        const auto requested = static_cast<CV::Simd::Level>(l);
+        if (CV::Simd::set_level(requested) != requested) break;
+        const Bytes out = run();
+        if (out.size() != reference.size() || std::memcmp(out.data(), reference.data(), out.size()) != 0) {
+            size_t first = 0;
+            while (first < std::min(out.size(), reference.size()) && out[first] == reference[first]) ++first;
+            LOG_ERR("{}: {} differs from scalar at byte {}", name, CV::Simd::to_string(requested), first);
+            ++failures;
+        }
+    }
+    CV::Simd::set_level(CV::Simd::detected_level());
+    return failures;
+}
+
+[[nodiscard]] auto test_convert() -> int {
+    int failures = 0;
+    Random rng;
+    for (const int w : test_widths) {
+        const int h = test_height;
+        const auto rgba = random_u8<4>(w, h, rng);
+        for (const CV::GrayWeights weights : {CV::GrayWeights::BT601, CV::GrayWeights::BT709}) {
+            failures += compare_levels(std::format("rgba_to_gray/{}/w{}", weights == CV::GrayWeights::BT601 ? "bt601" : "bt709", w), [&] {
+                StridedImage<uint8_t, 1> out(w, h, 0xcd);
+                CV::rgba_to_gray(rgba.view(), out.view(), weights);
+                return out.bytes();
+            });
+        }
+        failures += compare_levels(std::format("rgba_to_planar/w{}", w), [&] {
+            CV::PlanarImage<float, 4> out(w, h);
+            CV::rgba_to_planar(rgba.view(), out);
+            Bytes bytes;
+            append_planes(bytes, out);
+            return bytes;
+        });
+        failures += compare_levels(std::format("deinterleave/w{}", w), [&] {
+            CV::PlanarImage<uint8_t, 4> out(w, h);
+            CV::deinterleave(rgba.view(), out);
+            Bytes bytes;
+            append_planes(bytes, out);
+            return bytes;
+        });
+
+        CV::PlanarImage<uint8_t, 4> planes(w, h);
+        for (int c = 0; c < 4; ++c) {
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) planes.plane(c).row(y)[x] = rng.byte();
+            }
+        }
+        failures += compare_levels(std::format("interleave/w{}", w), [&] {
+            StridedImage<uint8_t, 4> out(w, h, 0xcd);
+            CV::interleave(planes, out.view());
+            return out.bytes();
+        });
+
+        const auto gray = random_u8<1>(w, h, rng);
+        failures += compare_levels(std::format("normalize/c1/w{}", w), [&] {
+            StridedImage<float, 1> out(w, h, -7.0f);
+            CV::normalize<1>(gray.view(), out.view());
+            return out.bytes();
+        });
+        failures += compare_levels(std::format("normalize/c4/w{}", w), [&] {
+            StridedImage<float, 4> out(w, h, -7.0f);
+            CV::normalize<4>(rgba.view(), out.view());
+            return out.bytes();
+        });
+
+        const auto grayf = random_f32<1>(w, h, rng);
+        const auto rgbaf = random_f32<4>(w, h, rng);
+        failures += compare_levels(std::format("denormalize/c1/w{}", w), [&] {
+            StridedImage<uint8_t, 1> out(w, h, 0xcd);
+            CV::denormalize<1>(grayf.view(), out.view());
+            return out.bytes();
+        });
+        failures += compare_levels(std::format("denormalize/c4/w{}", w), [&] {
+            StridedImage<uint8_t, 4> out(w, h, 0xcd);
+            CV::denormalize<4>(rgbaf.view(), out.view());
+            return out.bytes();
+        });
+    }
+    return failures;
+}
+
+template <typename T>
+auto append(Bytes &out, const std::vector<T> &values) -> void {
+    const auto *p = reinterpret_cast<const uint8_t *>(values.data());
+    out.insert(out.end(), p, p + values.size() * sizeof(T));
+}
+
+template <typename T, int C>
+auto append_rows(Bytes &out, CV::ImageView<const T, C> img) -> void {
+    for (int y = 0; y < img.height; ++y) {
+        const auto *row = reinterpret_cast<const uint8_t *>(img.row(y));
+        out.insert(out.end(), row, row + img.row_elements() * sizeof(T));
+    }
+}
+
+// Box-filtered noise: gradients in every direction at every scale the
+// default pyramid reaches.
+[[nodiscard]] auto textured_gray(int width, int height, Random &rng) -> CV::ImageGray8 {
+    CV::ImageGray8 noise(width, height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) noise.row(y)[x] = rng.byte();
+    }
+    constexpr int r = 2;
+    CV::ImageGray8 out(width, height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int sum = 0;
+            for (int dy = -r; dy <= r; ++dy) {
+                const uint8_t *row = noise.row(std::clamp(y + dy, 0, height - 1));
+                for (int dx = -r; dx <= r; ++dx) sum += row[std::clamp(x + dx, 0, width - 1)];
+            }
+            out.row(y)[x] = static_cast<uint8_t>(sum / ((2 * r + 1) * (2 * r + 1)));
+        }
+    }
+    return out;
+}
+
+[[nodiscard]] auto test_flow() -> int {
+    constexpr int w = 333;
+    constexpr int h = 245;
+    constexpr float shift_x = 3.0f;
+    constexpr float shift_y = 2.0f;
+    Random rng;
+    const CV::ImageGray8 from = textured_gray(w, h, rng);
+    CV::ImageGray8 to(w, h);
+    for (int y = 0; y < h; ++y) {
+        const uint8_t *src = from.row(std::max(y - 2, 0));
+        for (int x = 0; x < w; ++x) to.row(y)[x] = src[std::max(x - 3, 0)];
+    }
+    std::vector<Position> points;
+    for (int y = 24; y < h - 24; y += 13) {
+        for (int x = 24; x < w - 24; x += 11) points.push_back({static_cast<float>(x) + 0.25f, static_cast<float>(y) + 0.5f});
+    }
+    const CV::FlowParams params;
+    const auto result_bytes = [](const CV::FlowResult &r) {
+        Bytes bytes;
+        append(bytes, r.points);
+        append(bytes, r.status);
+        append(bytes, r.fb_error);
+        return bytes;
+    };
+
+    int failures = compare_levels("flow_pyramid", [&] {
+        CV::FlowPyramid pyramid;
+        pyramid.build(from.view(), params.levels, params.window);
+        Bytes bytes;
+        for (int i = 0; i < pyramid.level_count(); ++i) {
+            const CV::FlowLevel &level = pyramid.level(i);
+            append_rows(bytes, level.image.view());
+            append_rows(bytes, level.dx.view());
+            append_rows(bytes, level.dy.view());
+        }
+        return bytes;
+    });
+    failures += compare_levels("track_points", [&] { return result_bytes(CV::track_points(from.view(), to.view(), points, params)); });
+
+    // A whole-pixel shift has an exact answer at every level.
+    for (int l = 0; l <= static_cast<int>(CV::Simd::detected_level()); ++l) {
+        const auto level = CV::Simd::set_level(static_cast<CV::Simd::Level>(l));
+        const CV::FlowResult r = CV::track_points(from.view(), to.view(), points, params);
+        if (r.tracked() < points.size() * 9 / 10) {
+            LOG_ERR("track_points/shift: {} tracked only {} of {} points", CV::Simd::to_string(level), r.tracked(), points.size());
+            ++failures;
+        }
+        for (size_t i = 0; i < r.size(); ++i) {
+            if (r.status[i] != CV::FlowStatus::Tracked) continue;
+            const float ex = r.points[i].x - points[i].x - shift_x;
+            const float ey = r.points[i].y - points[i].y - shift_y;
+            if (std::abs(ex) > 0.05f || std::abs(ey) > 0.05f) {
+                LOG_ERR("track_points/shift: {} point {} off by ({}, {})", CV::Simd::to_string(level), i, ex, ey);
+                ++failures;
+                break;
+            }
+        }
+    }
+    CV::Simd::set_level(CV::Simd::detected_level());
+    return failures;
+}
+
+struct TestCase {
+    std::string_view name;
+    int (*run)();
+};
+
+constexpr TestCase test_table[] = {
+    {"convert", test_convert},
+    {"flow", test_flow},
+};
+} // namespace
+
+auto main() -> int {
+    std::string levels;
+    for (int l = 0; l <= static_cast<int>(CV::Simd::detected_level()); ++l) {
+        levels += std::format("{}{}", l == 0 ? "" : ", ", CV::Simd::to_string(static_cast<CV::Simd::Level>(l)));
+    }
+    std::cout << std::format("SIMD levels under test: {}\n", levels);
+
+    int failed = 0;
+    for (const TestCase &t : test_table) {
+        const int failures = t.run();
+        Log::flush(); // mismatches precede the verdict
+        std::cout << std::format("{:<12} {}\n", t.name, failures == 0 ? "ok" : std::format("FAILED ({} mismatches)", failures));
+        if (failures != 0) ++failed;
+    }
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,420 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <glad/glad.h>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "gl.hpp"
+#include "image.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
+
+// Streaming texture for showing frames that change every GUI frame.
+//
+// Uploads go through a ring of pixel unpack buffers: the dirty rectangles are
+// packed into the next buffer and glTexSubImage2D reads from it, so the call
+// returns as soon as the copy is queued instead of waiting for the transfer.
+// A fence per buffer tells whether the GPU still reads it; a busy buffer is
+// orphaned (glBufferData with nullptr) rather than waited on.
+//
+// update(frame) finds the dirty rectangles itself from a hash per 64x64 tile,
+// update(frame, rects) trusts the caller. Buffers are uploaded in their own
+// format: gray8 and normalised float gray as one-channel textures swizzled to
+// gray, labels as an integer texture that a palette pass draws into an RGBA8
+// texture on the GPU. Nothing is converted to RGBA on the CPU.
+//
+// Everything is GL 3.3 core, like overlay.hpp.
+namespace GL {
+enum class TextureFormat {
+    RGBA8,
+    Gray8,
+    GrayF, // normalised to [0, 1]
+    Label  // 0 is background, drawn black
+};
+
+template <typename T, int C>
+[[nodiscard]] consteval auto texture_format() -> TextureFormat {
+    if constexpr (std::is_same_v<T, uint8_t> && C == 4) {
+        return TextureFormat::RGBA8;
+    } else if constexpr (std::is_same_v<T, uint8_t> && C == 1) {
+        return TextureFormat::Gray8;
+    } else if constexpr (std::is_same_v<T, float> && C == 1) {
+        return TextureFormat::GrayF;
+    } else if constexpr (std::is_same_v<T, uint32_t> && C == 1) {
+        return TextureFormat::Label;
+    } else {
+        static_assert(sizeof(T) == 0, "StreamingTexture supports rgba8, gray8, gray float and uint32 labels");
+    }
+}
+
+struct UploadStats {
+    size_t rects = 0; // in the last upload
+    size_t bytes = 0; // in the last upload
+    uint64_t uploads = 0;
+    uint64_t full_uploads = 0;
+    uint64_t skipped = 0;  // updates with nothing dirty
+    uint64_t orphaned = 0; // buffers still in use by the GPU when their turn came
+};
+
+namespace detail {
+struct FormatInfo {
+    GLint internal_format;
+    GLenum format;
+    GLenum type;
+};
+
+[[nodiscard]] inline auto format_info(TextureFormat format) -> FormatInfo {
+    switch (format) {
+    case TextureFormat::RGBA8: return {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE};
+    case TextureFormat::Gray8: return {GL_R8, GL_RED, GL_UNSIGNED_BYTE};
+    case TextureFormat::GrayF: return {GL_R32F, GL_RED, GL_FLOAT};
+    case TextureFormat::Label: return {GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT};
+    }
+    PANIC("Unknown texture format");
+}
+
+// Four independent multiply-rotate lanes so the loop is bound by memory
+// bandwidth rather than by the latency of one multiply chain.
+template <typename T, int C>
+[[nodiscard]] inline auto hash_block(CV::ImageView<const T, C> view, int x, int y, int w, int h) -> uint64_t {
+    constexpr uint64_t k = 0x9E3779B97F4A7C15ull;
+    const size_t bytes = static_cast<size_t>(w) * C * sizeof(T);
+    std::array<uint64_t, 4> lanes = {k, k + 1, k + 2, k + 3};
+    for (int r = 0; r < h; ++r) {
+        const auto *p = reinterpret_cast<const unsigned char *>(view.row(y + r) + static_cast<size_t>(x) * C);
+        size_t i = 0;
+        for (; i + 32 <= bytes; i += 32) {
+            for (size_t l = 0; l < 4; ++l) {
+                uint64_t word;
+                std::memcpy(&word, p + i + 8 * l, sizeof(word));
+                lanes[l] = std::rotl((lanes[l] ^ word) * k, 31);
+            }
+        }
+        uint64_t tail = bytes - i;
+        for (; i < bytes; ++i) tail = (tail << 8) ^ p[i] ^ (tail >> 56);
+        lanes[0] = std::rotl((lanes[0] ^ tail) * k, 31);
+    }
+    uint64_t out = lanes[0];
+    for (size_t l = 1; l < 4; ++l) out = std::rotl((out ^ lanes[l]) * k, 27);
+    return out ^ (out >> 32);
+}
+} // namespace detail
+
+class StreamingTexture {
+public:
+    static constexpr int buffer_count = 3;
+    static constexpr int tile_size = 64;
+
+    // The palette shader is only used for label buffers; the other formats
+    // display the uploaded texture directly.
+    auto init(const char *palette_vertex_path, const char *palette_fragment_path) -> void {
+        m_palette_shader.load(palette_vertex_path, palette_fragment_path);
+        m_palette_shader.bind();
+        ShaderProgram::set_uniform(m_palette_shader.get_uniform("u_Labels"), 0);
+        ShaderProgram::set_uniform(m_palette_shader.get_uniform("u_Palette"), 1);
+        ShaderProgram::unbind();
+        glGenVertexArrays(1, &m_empty_vao);
+        glGenFramebuffers(1, &m_fbo);
+        for (Slot &slot : m_slots) glGenBuffers(1, &slot.pbo);
+        create_palette();
+        LOG_INFO("Streaming texture ready: {} pixel buffers", buffer_count);
+    }
+
+    auto destroy() -> void {
+        for (Slot &slot : m_slots) {
+            if (slot.fence) glDeleteSync(slot.fence);
+            glDeleteBuffers(1, &slot.pbo);
+            slot = Slot{};
+        }
+        glDeleteTextures(1, &m_source);
+        glDeleteTextures(1, &m_display);
+        glDeleteTextures(1, &m_palette);
+        glDeleteFramebuffers(1, &m_fbo);
+        glDeleteVertexArrays(1, &m_empty_vao);
+        glDeleteProgram(m_palette_shader.m_id);
+        *this = StreamingTexture{};
+    }
+
+    // Uploads the tiles of frame that differ from the previous update.
+    template <typename T, int C>
+    auto update(CV::ImageView<const T, C> frame) -> void {
+        if (frame.empty()) return;
+        CV_PROFILE_SCOPE("texture_upload");
+        const bool reallocated = allocate(frame.width, frame.height, texture_format<T, C>());
+        const int tiles_x = (frame.width + tile_size - 1) / tile_size;
+        const int tiles_y = (frame.height + tile_size - 1) / tile_size;
+        std::vector<uint64_t> hashes(static_cast<size_t>(tiles_x) * static_cast<size_t>(tiles_y));
+        CV::parallel_for(0, tiles_y, 1, [&](int ty0, int ty1) {
+            for (int ty = ty0; ty < ty1; ++ty) {
+                const int y = ty * tile_size;
+                const int h = std::min(tile_size, frame.height - y);
+                for (int tx = 0; tx < tiles_x; ++tx) {
+                    const int x = tx * tile_size;
+                    const int w = std::min(tile_size, frame.width - x);
+                    hashes[static_cast<size_t>(ty * tiles_x + tx)] = detail::hash_block(frame, x, y, w, h);
+                }
+            }
+        });
+
+        std::vector<CV::PixelRect> dirty;
+        if (reallocated || m_hashes.size() != hashes.size()) {
+            dirty.push_back({0, 0, frame.width, frame.height});
+        } else {
+            // Runs of dirty tiles within a tile row become one rectangle.
+            size_t dirty_tiles = 0;
+            for (int ty = 0; ty < tiles_y; ++ty) {
+                int run = -1;
+                for (int tx = 0; tx <= tiles_x; ++tx) {
+                    const size_t i = static_cast<size_t>(ty * tiles_x + tx);
+                    const bool changed = tx < tiles_x && hashes[i] != m_hashes[i];
+                    dirty_tiles += changed ? 1 : 0;
+                    if (changed && run < 0) run = tx;
+                    if (!changed && run >= 0) {
+                        dirty.push_back(CV::clip({run * tile_size, ty * tile_size, (tx - run) * tile_size, tile_size}, frame.width, frame.height));
+                        run = -1;
+                    }
+                }
+            }
+            // Past half the frame one large copy beats many small ones.
+            if (2 * dirty_tiles > hashes.size()) dirty.assign(1, {0, 0, frame.width, frame.height});
+        }
+        m_hashes = std::move(hashes);
+        upload(frame, dirty);
+    }
+
+    // Uploads exactly the given rectangles, e.g. the tiles a stage rewrote.
+    template <typename T, int C>
+    auto update(CV::ImageView<const T, C> frame, std::span<const CV::PixelRect> rects) -> void {
+        if (frame.empty()) return;
+        CV_PROFILE_SCOPE("texture_upload");
+        std::vector<CV::PixelRect> dirty;
+        if (allocate(frame.width, frame.height, texture_format<T, C>())) {
+            dirty.push_back({0, 0, frame.width, frame.height});
+        } else {
+            for (const CV::PixelRect &r : rects) {
+                const CV::PixelRect c = CV::clip(r, frame.width, frame.height);
+                if (c.width > 0 && c.height > 0) dirty.push_back(c);
+            }
+        }
+        // The tile hashes no longer describe the texture.
+        m_hashes.clear();
+        upload(frame, dirty);
+    }
+
+    // The next update uploads the whole frame.
+    auto invalidate() -> void { m_hashes.clear(); }
+
+    // Texture to sample for display: the palette target for labels, the
+    // uploaded texture otherwise.
+    [[nodiscard]] auto id() const -> TextureID { return m_format == TextureFormat::Label ? m_display : m_source; }
+    [[nodiscard]] auto width() const -> int { return m_width; }
+    [[nodiscard]] auto height() const -> int { return m_height; }
+    [[nodiscard]] auto format() const -> TextureFormat { return m_format; }
+    [[nodiscard]] auto empty() const -> bool { return m_source == GL_ZERO; }
+    [[nodiscard]] auto stats() const -> const UploadStats & { return m_stats; }
+
+private:
+    struct Slot {
+        GLuint pbo = GL_ZERO;
+        size_t capacity = 0;
+        GLsync fence = nullptr;
+    };
+
+    static auto create_texture(GLint internal_format, GLenum format, GLenum type, int width, int height, bool filtered) -> TextureID {
+        TextureID id = GL_ZERO;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtered ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filtered ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return id;
+    }
+
+    // Golden-ratio hue steps keep neighbouring label ids apart.
+    auto create_palette() -> void {
+        std::array<uint8_t, 256 * 4> colors{};
+        for (size_t i = 0; i < 256; ++i) {
+            const float h = std::fmod(static_cast<float>(i) * 0.618034f, 1.0f) * 6.0f;
+            const float v = i % 2 == 0 ? 0.95f : 0.75f;
+            const float s = 0.65f;
+            const float f = h - std::floor(h);
+            const std::array<float, 4> levels = {v, v * (1.0f - s), v * (1.0f - s * f), v * (1.0f - s * (1.0f - f))};
+            // (r, g, b) per hue sextant, as indices into levels.
+            constexpr std::array<std::array<int, 3>, 6> sextants = {{{0, 3, 1}, {2, 0, 1}, {1, 0, 3}, {1, 2, 0}, {3, 1, 0}, {0, 1, 2}}};
+            const auto &sextant = sextants[static_cast<size_t>(h) % 6];
+            for (size_t c = 0; c < 3; ++c) colors[4 * i + c] = static_cast<uint8_t>(255.0f * levels[static_cast<size_t>(sextant[c])]);
+            colors[4 * i + 3] = 255;
+        }
+        m_palette = create_texture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 256, 1, false);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE, colors.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Recreates the textures when the frame geometry or format changes.
+    // Returns whether it did, in which case the whole frame is dirty.
+    auto allocate(int width, int height, TextureFormat format) -> bool {
+        if (m_source != GL_ZERO && width == m_width && height == m_height && format == m_format) return false;
+        glDeleteTextures(1, &m_source);
+        glDeleteTextures(1, &m_display);
+        m_display = GL_ZERO;
+        m_width = width;
+        m_height = height;
+        m_format = format;
+        m_hashes.clear();
+
+        const detail::FormatInfo info = detail::format_info(format);
+        m_source = create_texture(info.internal_format, info.format, info.type, width, height, format != TextureFormat::Label);
+        if (format == TextureFormat::Gray8 || format == TextureFormat::GrayF) {
+            const std::array<GLint, 4> swizzle = {GL_RED, GL_RED, GL_RED, GL_ONE};
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle.data());
+        }
+        if (format == TextureFormat::Label) {
+            m_display = create_texture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height, true);
+            glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_display, 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) PANIC("StreamingTexture: palette target is incomplete");
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        LOG_INFO("Streaming texture: {}x{}, format {}", width, height, static_cast<int>(format));
+        return true;
+    }
+
+    // Next buffer of the ring, bound and large enough for bytes.
+    auto acquire(size_t bytes) -> Slot & {
+        Slot &slot = m_slots[m_next];
+        m_next = (m_next + 1) % buffer_count;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        bool busy = false;
+        if (slot.fence) {
+            const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+            busy = status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED;
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        if (busy || bytes > slot.capacity) {
+            m_stats.orphaned += busy ? 1 : 0;
+            slot.capacity = std::max(slot.capacity, bytes);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(slot.capacity), nullptr, GL_STREAM_DRAW);
+        }
+        return slot;
+    }
+
+    template <typename T, int C>
+    auto upload(CV::ImageView<const T, C> frame, std::span<const CV::PixelRect> rects) -> void {
+        constexpr size_t pixel_bytes = sizeof(T) * C;
+        size_t total = 0;
+        for (const CV::PixelRect &r : rects) total += static_cast<size_t>(r.width) * static_cast<size_t>(r.height) * pixel_bytes;
+        m_stats.rects = rects.size();
+        m_stats.bytes = total;
+        if (total == 0) {
+            ++m_stats.skipped;
+            return;
+        }
+
+        Slot &slot = acquire(total);
+        auto *mapped = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(total),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        if (!mapped) PANIC("StreamingTexture: cannot map pixel buffer");
+        size_t offset = 0;
+        for (const CV::PixelRect &r : rects) {
+            const size_t row_bytes = static_cast<size_t>(r.width) * pixel_bytes;
+            unsigned char *base = mapped + offset;
+            const int grain = static_cast<int>(std::max<size_t>(1, (size_t{1} << 18) / row_bytes));
+            CV::parallel_for(0, r.height, grain, [&](int y0, int y1) {
+                for (int y = y0; y < y1; ++y) {
+                    std::memcpy(base + static_cast<size_t>(y) * row_bytes, frame.row(r.y + y) + static_cast<size_t>(r.x) * C, row_bytes);
+                }
+            });
+            offset += row_bytes * static_cast<size_t>(r.height);
+        }
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+            // The buffer contents were lost (e.g. a mode switch); retry in full.
+            LOG_WARN("StreamingTexture: pixel buffer lost, re-uploading next update");
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            m_hashes.clear();
+            return;
+        }
+
+        const detail::FormatInfo info = detail::format_info(m_format);
+        glBindTexture(GL_TEXTURE_2D, m_source);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        offset = 0;
+        for (const CV::PixelRect &r : rects) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, info.format, info.type, reinterpret_cast<const void *>(offset));
+            offset += static_cast<size_t>(r.width) * static_cast<size_t>(r.height) * pixel_bytes;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        if (m_format == TextureFormat::Label) {
+            draw_palette(rects);
+            glBindTexture(GL_TEXTURE_2D, m_display);
+        }
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        ++m_stats.uploads;
+        const bool full = rects.size() == 1 && rects[0].width == m_width && rects[0].height == m_height;
+        m_stats.full_uploads += full ? 1 : 0;
+    }
+
+    // Maps the dirty part of the label texture through the palette into the
+    // display texture. Texture row y is framebuffer row y, so the rectangles
+    // double as scissor boxes.
+    auto draw_palette(std::span<const CV::PixelRect> rects) -> void {
+        std::array<GLint, 4> viewport{};
+        glGetIntegerv(GL_VIEWPORT, viewport.data());
+        const GLboolean blend = glIsEnabled(GL_BLEND);
+        const GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glViewport(0, 0, m_width, m_height);
+        glDisable(GL_BLEND);
+        glEnable(GL_SCISSOR_TEST);
+        m_palette_shader.bind();
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_palette);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_source);
+        glBindVertexArray(m_empty_vao);
+        for (const CV::PixelRect &r : rects) {
+            glScissor(r.x, r.y, r.width, r.height);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glBindVertexArray(0);
+        ShaderProgram::unbind();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (blend) glEnable(GL_BLEND);
+        if (!scissor) glDisable(GL_SCISSOR_TEST);
+    }
+
+    ShaderProgram m_palette_shader;
+    VAO m_empty_vao = GL_ZERO; // the palette pass builds its triangle from gl_VertexID
+    GLuint m_fbo = GL_ZERO;
+    TextureID m_palette = GL_ZERO;
+    TextureID m_source = GL_ZERO;  // uploaded pixels in their own format
+    TextureID m_display = GL_ZERO; // RGBA8 palette target, labels only
+    int m_width = 0;
+    int m_height = 0;
+    TextureFormat m_format = TextureFormat::RGBA8;
+    std::array<Slot, buffer_count> m_slots{};
+    size_t m_next = 0;
+    std::vector<uint64_t> m_hashes; // per tile, of the last uploaded frame
+    UploadStats m_stats;
+};
+} // namespace GL
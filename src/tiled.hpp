@@ -0,0 +1,407 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stb_image.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CV_HAS_MMAP 1
+#else
+#define CV_HAS_MMAP 0
+#endif
+
+#include "image.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
+
+// Native memory-mappable image format (.cvti).
+//
+// A 64-byte header is followed, at a page boundary, by fixed-size tiles in
+// row-major tile order. Inside a tile, rows start every tile_stride bytes (a
+// multiple of row_alignment) and every tile starts on a page, so a mapped tile
+// is directly a valid ImageView and reading an ROI faults in only the pages of
+// the rows it covers. Edge tiles are stored full size with zero padding.
+//
+// With a single tile the payload is a plain row-aligned raster, which map_image
+// adopts as an Image without decoding or copying.
+//
+// Header (little-endian): "CVTI", u16 version, u8 channels, u8 element type,
+// u32 width, height, tile width, tile height, u64 tile stride, tile bytes and
+// data offset; the rest is zero.
+namespace CV {
+// tile_width / tile_height <= 0 select the full image extent.
+struct TiledLayout {
+    int tile_width = 256;
+    int tile_height = 256;
+};
+
+namespace Tiled {
+static_assert(std::endian::native == std::endian::little, "the .cvti header is read in place");
+
+inline constexpr std::array<char, 4> magic = {'C', 'V', 'T', 'I'};
+inline constexpr uint16_t version = 1;
+inline constexpr size_t header_bytes = 64;
+inline constexpr size_t page_bytes = 4096;
+
+enum class ElementType : uint8_t {
+    U8 = 0,
+    U16 = 1,
+    F32 = 2
+};
+
+template <typename T>
+[[nodiscard]] constexpr auto element_type() -> ElementType {
+    if constexpr (std::is_same_v<T, uint8_t>) return ElementType::U8;
+    else if constexpr (std::is_same_v<T, uint16_t>) return ElementType::U16;
+    else if constexpr (std::is_same_v<T, float>) return ElementType::F32;
+    else static_assert(sizeof(T) == 0, ".cvti supports uint8_t, uint16_t and float");
+}
+
+struct Header {
+    uint8_t channels = 0;
+    ElementType type = ElementType::U8;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t tile_width = 0;
+    uint32_t tile_height = 0;
+    uint64_t tile_stride = 0; // bytes between rows of a tile
+    uint64_t tile_bytes = 0;  // bytes between tiles, a multiple of page_bytes
+    uint64_t data_offset = 0; // first tile, a multiple of page_bytes
+
+    [[nodiscard]] auto tiles_x() const -> uint32_t { return (width + tile_width - 1) / tile_width; }
+    [[nodiscard]] auto tiles_y() const -> uint32_t { return (height + tile_height - 1) / tile_height; }
+    [[nodiscard]] auto file_bytes() const -> uint64_t { return data_offset + tile_bytes * tiles_x() * tiles_y(); }
+    [[nodiscard]] auto tile_offset(uint32_t tx, uint32_t ty) const -> uint64_t {
+        return data_offset + tile_bytes * (static_cast<uint64_t>(ty) * tiles_x() + tx);
+    }
+};
+
+// a * b + c, or nullopt if any step overflows 64 bits.
+[[nodiscard]] inline auto checked_mul_add(uint64_t a, uint64_t b, uint64_t c = 0) -> std::optional<uint64_t> {
+    uint64_t out = 0;
+    if (__builtin_mul_overflow(a, b, &out) || __builtin_add_overflow(out, c, &out)) return std::nullopt;
+    return out;
+}
+
+[[nodiscard]] inline auto round_up(uint64_t v, uint64_t multiple) -> uint64_t {
+    return (v + multiple - 1) / multiple * multiple;
+}
+
+template <typename T, int C>
+[[nodiscard]] inline auto make_header(int width, int height, TiledLayout layout) -> Header {
+    Header h;
+    h.channels = static_cast<uint8_t>(C);
+    h.type = element_type<T>();
+    h.width = static_cast<uint32_t>(width);
+    h.height = static_cast<uint32_t>(height);
+    h.tile_width = static_cast<uint32_t>(layout.tile_width > 0 ? std::min(layout.tile_width, width) : width);
+    h.tile_height = static_cast<uint32_t>(layout.tile_height > 0 ? std::min(layout.tile_height, height) : height);
+    h.tile_stride = round_up(static_cast<uint64_t>(h.tile_width) * C * sizeof(T), row_alignment);
+    h.tile_bytes = round_up(h.tile_stride * h.tile_height, page_bytes);
+    h.data_offset = page_bytes;
+    return h;
+}
+
+[[nodiscard]] inline auto encode(const Header &h) -> std::array<uint8_t, header_bytes> {
+    std::array<uint8_t, header_bytes> out{};
+    uint8_t *p = out.data();
+    auto put = [&p](const auto &v) {
+        std::memcpy(p, &v, sizeof(v));
+        p += sizeof(v);
+    };
+    put(magic);
+    put(version);
+    put(h.channels);
+    put(h.type);
+    put(h.width);
+    put(h.height);
+    put(h.tile_width);
+    put(h.tile_height);
+    put(h.tile_stride);
+    put(h.tile_bytes);
+    put(h.data_offset);
+    return out;
+}
+
+// Validates everything a reader relies on, including the file size.
+[[nodiscard]] inline auto decode(const uint8_t *data, uint64_t size) -> std::optional<Header> {
+    if (size < header_bytes) return std::nullopt;
+    const uint8_t *p = data;
+    auto get = [&p](auto &v) {
+        std::memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+    };
+    std::array<char, 4> m{};
+    uint16_t ver = 0;
+    Header h;
+    get(m);
+    get(ver);
+    get(h.channels);
+    get(h.type);
+    get(h.width);
+    get(h.height);
+    get(h.tile_width);
+    get(h.tile_height);
+    get(h.tile_stride);
+    get(h.tile_bytes);
+    get(h.data_offset);
+    if (m != magic || ver != version) return std::nullopt;
+    if (h.channels < 1 || h.channels > 4 || h.type > ElementType::F32) return std::nullopt;
+    if (h.width == 0 || h.height == 0 || h.tile_width == 0 || h.tile_height == 0) return std::nullopt;
+    // Sizes are handed out as int.
+    if (h.width > INT_MAX || h.height > INT_MAX) return std::nullopt;
+    if (h.tile_width > h.width || h.tile_height > h.height) return std::nullopt;
+    const uint64_t elem = h.type == ElementType::U8 ? 1 : h.type == ElementType::U16 ? 2 : 4;
+    if (h.tile_stride < static_cast<uint64_t>(h.tile_width) * h.channels * elem || h.tile_stride % row_alignment != 0) return std::nullopt;
+    const std::optional<uint64_t> tile_min = checked_mul_add(h.tile_stride, h.tile_height);
+    if (!tile_min || h.tile_bytes < *tile_min || h.tile_bytes % page_bytes != 0) return std::nullopt;
+    // Every product a reader forms is bounded by the file size once this fits.
+    const std::optional<uint64_t> tiles = checked_mul_add(h.tiles_x(), h.tiles_y());
+    const std::optional<uint64_t> file = tiles ? checked_mul_add(h.tile_bytes, *tiles, h.data_offset) : std::nullopt;
+    if (h.data_offset < header_bytes || h.data_offset % page_bytes != 0 || !file || *file > size) return std::nullopt;
+    return h;
+}
+
+// Releases a mapping; ctx is the mapping base when ptr points inside it.
+inline auto unmap_bytes([[maybe_unused]] void *ptr, [[maybe_unused]] size_t bytes, [[maybe_unused]] void *ctx) -> void {
+#if CV_HAS_MMAP
+    munmap(ctx ? ctx : ptr, bytes);
+#endif
+}
+
+using Mapping = std::unique_ptr<uint8_t, BufferDeleter>;
+
+// Maps a whole file. Private mappings are copy-on-write, so callers may write
+// through them without touching the file.
+[[nodiscard]] inline auto map_file(const std::string &path, bool writable_private) -> Mapping {
+#if CV_HAS_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return {};
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return {};
+    }
+    const auto length = static_cast<size_t>(st.st_size);
+    const int prot = writable_private ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *base = mmap(nullptr, length, prot, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) return {};
+    return Mapping(static_cast<uint8_t *>(base), BufferDeleter{unmap_bytes, length, nullptr});
+#else
+    (void)path;
+    (void)writable_private;
+    LOG_ERR("Memory-mapped images are not supported on this platform");
+    return {};
+#endif
+}
+
+template <typename T, int C>
+[[nodiscard]] inline auto matches(const Header &h) -> bool {
+    return h.channels == C && h.type == element_type<T>();
+}
+} // namespace Tiled
+
+// Read-only view of a mapped .cvti file. Tiles are exposed as zero-copy views;
+// read() assembles an arbitrary ROI from the tiles it intersects.
+template <typename T, int C>
+class TiledImage {
+public:
+    TiledImage() = default;
+
+    // Returns an empty image and logs the reason on failure.
+    [[nodiscard]] static auto open(const std::string &path) -> TiledImage {
+        TiledImage img;
+        Tiled::Mapping map = Tiled::map_file(path, false);
+        if (!map) {
+            LOG_ERR("Failed to map {}", path);
+            return img;
+        }
+        const auto header = Tiled::decode(map.get(), map.get_deleter().bytes);
+        if (!header) {
+            LOG_ERR("{} is not a valid .cvti file", path);
+            return img;
+        }
+        if (!Tiled::matches<T, C>(*header)) {
+            LOG_ERR("{} holds {} channel(s) of element type {}, not the requested format", path, header->channels,
+                static_cast<int>(header->type));
+            return img;
+        }
+        img.m_map = std::move(map);
+        img.m_header = *header;
+        return img;
+    }
+
+    [[nodiscard]] auto empty() const -> bool { return !m_map; }
+    [[nodiscard]] auto width() const -> int { return static_cast<int>(m_header.width); }
+    [[nodiscard]] auto height() const -> int { return static_cast<int>(m_header.height); }
+    [[nodiscard]] auto tile_width() const -> int { return static_cast<int>(m_header.tile_width); }
+    [[nodiscard]] auto tile_height() const -> int { return static_cast<int>(m_header.tile_height); }
+    [[nodiscard]] auto tiles_x() const -> int { return static_cast<int>(m_header.tiles_x()); }
+    [[nodiscard]] auto tiles_y() const -> int { return static_cast<int>(m_header.tiles_y()); }
+    [[nodiscard]] auto header() const -> const Tiled::Header & { return m_header; }
+
+    // Tile (tx, ty), clipped to the image.
+    [[nodiscard]] auto tile(int tx, int ty) const -> ImageView<const T, C> {
+        if (tx < 0 || ty < 0 || tx >= tiles_x() || ty >= tiles_y()) {
+            PANIC(std::format("tile ({}, {}) outside of {}x{} tile grid", tx, ty, tiles_x(), tiles_y()));
+        }
+        const int x0 = tx * tile_width();
+        const int y0 = ty * tile_height();
+        const auto *data = reinterpret_cast<const T *>(m_map.get() + m_header.tile_offset(static_cast<uint32_t>(tx), static_cast<uint32_t>(ty)));
+        return {data, std::min(tile_width(), width() - x0), std::min(tile_height(), height() - y0),
+            m_header.tile_stride / sizeof(T)};
+    }
+
+    // Single-tile files are one row-aligned raster.
+    [[nodiscard]] auto is_contiguous() const -> bool { return tiles_x() == 1 && tiles_y() == 1; }
+    [[nodiscard]] auto view() const -> ImageView<const T, C> {
+        if (!is_contiguous()) PANIC("TiledImage::view: file has more than one tile, use tile() or read()");
+        return tile(0, 0);
+    }
+
+    // Copies `roi` into dst (same size). Only the tiles, and inside them only
+    // the rows, that intersect the ROI are touched.
+    auto read(PixelRect roi, ImageView<T, C> dst) const -> void {
+        if (roi.x < 0 || roi.y < 0 || roi.width < 0 || roi.height < 0 || roi.x + roi.width > width() || roi.y + roi.height > height()) {
+            PANIC(std::format("ROI ({}, {}, {}x{}) outside of {}x{} image", roi.x, roi.y, roi.width, roi.height, width(), height()));
+        }
+        if (dst.width != roi.width || dst.height != roi.height) PANIC("TiledImage::read: size mismatch");
+        if (roi.width == 0 || roi.height == 0) return;
+        const int tx0 = roi.x / tile_width();
+        const int ty0 = roi.y / tile_height();
+        const int tx1 = (roi.x + roi.width - 1) / tile_width();
+        const int ty1 = (roi.y + roi.height - 1) / tile_height();
+        const int nx = tx1 - tx0 + 1;
+        parallel_for(0, nx * (ty1 - ty0 + 1), 1, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                const int tx = tx0 + i % nx;
+                const int ty = ty0 + i / nx;
+                const ImageView<const T, C> t = tile(tx, ty);
+                const PixelRect part = clip(PixelRect{roi.x - tx * tile_width(), roi.y - ty * tile_height(), roi.width, roi.height},
+                    t.width, t.height);
+                const ImageView<const T, C> src = t.roi(part.x, part.y, part.width, part.height);
+                copy<T, C>(src, dst.roi(tx * tile_width() + part.x - roi.x, ty * tile_height() + part.y - roi.y, part.width, part.height));
+            }
+        });
+    }
+
+    [[nodiscard]] auto read(PixelRect roi) const -> Image<T, C> {
+        Image<T, C> out(roi.width, roi.height);
+        if (!out.empty()) read(roi, out.view());
+        return out;
+    }
+
+private:
+    Tiled::Mapping m_map;
+    Tiled::Header m_header;
+};
+
+// Writes src as .cvti; returns false and logs on failure.
+template <typename T, int C>
+[[nodiscard]] inline auto write_tiled(ImageView<const T, C> src, const std::string &path, TiledLayout layout = {}) -> bool {
+    if (src.empty()) {
+        LOG_ERR("write_tiled: empty image for {}", path);
+        return false;
+    }
+    const Tiled::Header h = Tiled::make_header<T, C>(src.width, src.height, layout);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        LOG_ERR("Cannot open {} for writing", path);
+        return false;
+    }
+    std::vector<uint8_t> page(h.data_offset, 0);
+    const auto encoded = Tiled::encode(h);
+    std::copy(encoded.begin(), encoded.end(), page.begin());
+    file.write(reinterpret_cast<const char *>(page.data()), static_cast<std::streamsize>(page.size()));
+
+    std::vector<uint8_t> tile(h.tile_bytes);
+    for (uint32_t ty = 0; ty < h.tiles_y(); ++ty) {
+        for (uint32_t tx = 0; tx < h.tiles_x(); ++tx) {
+            std::fill(tile.begin(), tile.end(), uint8_t{0});
+            const int x0 = static_cast<int>(tx * h.tile_width);
+            const int y0 = static_cast<int>(ty * h.tile_height);
+            const int w = std::min(static_cast<int>(h.tile_width), src.width - x0);
+            const int rows = std::min(static_cast<int>(h.tile_height), src.height - y0);
+            for (int y = 0; y < rows; ++y) {
+                std::memcpy(tile.data() + static_cast<size_t>(y) * h.tile_stride, src.row(y0 + y) + static_cast<size_t>(x0) * C,
+                    static_cast<size_t>(w) * C * sizeof(T));
+            }
+            file.write(reinterpret_cast<const char *>(tile.data()), static_cast<std::streamsize>(tile.size()));
+        }
+    }
+    if (!file) {
+        LOG_ERR("Failed writing {}", path);
+        return false;
+    }
+    return true;
+}
+
+// Maps a single-tile .cvti file and adopts it as an Image without copying.
+// The mapping is private, so writes to the image never reach the file.
+template <typename T, int C>
+[[nodiscard]] inline auto map_image(const std::string &path) -> Image<T, C> {
+    Tiled::Mapping map = Tiled::map_file(path, true);
+    if (!map) {
+        LOG_ERR("Failed to map {}", path);
+        return {};
+    }
+    const size_t length = map.get_deleter().bytes;
+    const auto header = Tiled::decode(map.get(), length);
+    if (!header || !Tiled::matches<T, C>(*header) || header->tiles_x() != 1 || header->tiles_y() != 1) {
+        LOG_ERR("{} is not a single-tile .cvti file of the requested format", path);
+        return {};
+    }
+    uint8_t *base = map.release();
+    return Image<T, C>::adopt(reinterpret_cast<T *>(base + header->data_offset), static_cast<int>(header->width),
+        static_cast<int>(header->height), header->tile_stride / sizeof(T),
+        BufferDeleter{Tiled::unmap_bytes, length, base});
+}
+
+// Reads a .cvti header without mapping the pixels.
+[[nodiscard]] inline auto read_tiled_header(const std::string &path) -> std::optional<Tiled::Header> {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return std::nullopt;
+    const auto size = static_cast<uint64_t>(file.tellg());
+    std::array<uint8_t, Tiled::header_bytes> bytes{};
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(bytes.data()), bytes.size())) return std::nullopt;
+    return Tiled::decode(bytes.data(), size);
+}
+
+// Converts anything stb_image decodes to .cvti, keeping the file's channel
+// count and 8 / 16 bit depth.
+[[nodiscard]] inline auto convert_to_tiled(const std::string &input, const std::string &output, TiledLayout layout = {}) -> bool {
+    int w = 0, h = 0, channels = 0;
+    if (!stbi_info(input.c_str(), &w, &h, &channels)) {
+        LOG_ERR("Cannot read {}: {}", input, stbi_failure_reason());
+        return false;
+    }
+    auto convert = [&]<typename T, int C>() {
+        const Image<T, C> img = load_image<T, C>(input.c_str());
+        return !img.empty() && write_tiled<T, C>(img.view(), output, layout);
+    };
+    const bool wide = stbi_is_16_bit(input.c_str()) != 0;
+    switch (channels) {
+    case 1: return wide ? convert.template operator()<uint16_t, 1>() : convert.template operator()<uint8_t, 1>();
+    case 2: return wide ? convert.template operator()<uint16_t, 2>() : convert.template operator()<uint8_t, 2>();
+    case 3: return wide ? convert.template operator()<uint16_t, 3>() : convert.template operator()<uint8_t, 3>();
+    default: return wide ? convert.template operator()<uint16_t, 4>() : convert.template operator()<uint8_t, 4>();
+    }
+}
+} // namespace CV